@@ -4,7 +4,7 @@ layout(location = 1) in vec2 iStart;
 layout(location = 2) in vec2 iDir;
 layout(location = 3) in float iLength;
 layout(location = 4) in float iWidth;
-layout(location = 5) in vec3 iColor;
+layout(location = 5) in vec4 iColor;
 layout(location = 6) in float iDepth;
 
 out vec4 vColor;
@@ -23,5 +23,5 @@ void main() {
     ndc.y = -ndc.y;
 
     gl_Position = vec4(ndc, iDepth, 1.0);
-    vColor = vec4(iColor, 1.0);
+    vColor = iColor;
 }
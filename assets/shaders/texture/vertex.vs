@@ -3,6 +3,7 @@ layout(location = 0) in vec2 aPos;
 layout(location = 1) in vec4 iPosSize;
 layout(location = 2) in vec4 iUV;
 layout(location = 3) in float iDepth;
+layout(location = 4) in float iAnimation;
 
 out vec2 TexCoord;
 out vec4 vColor;
@@ -10,14 +11,26 @@ out vec4 vColor;
 uniform vec2 uScreen;
 uniform vec2 uPan;
 uniform vec4 uColor;
+uniform float uDepthOffset;
+// One row per animation: (frame count, interval in ms) followed by each frame's UV rectangle
+uniform sampler2D uAnimations;
+uniform float uTime;
 
 void main() {
     vec2 pixelPos = aPos * iPosSize.zw + iPosSize.xy - uPan;
     vec2 ndc = (pixelPos / uScreen) * 2.0 - 1.0;
     ndc.y = -ndc.y;
-    gl_Position = vec4(ndc, iDepth, 1.0);
+    gl_Position = vec4(ndc, iDepth + uDepthOffset, 1.0);
 
-    vec2 uv = mix(iUV.xy, iUV.zw, aPos);
+    vec4 uvRect = iUV;
+    if (iAnimation >= 0.0) {
+        int animation = int(iAnimation);
+        vec4 info = texelFetch(uAnimations, ivec2(0, animation), 0);
+        int frame = int(mod(floor(uTime / info.y), info.x));
+        uvRect = texelFetch(uAnimations, ivec2(frame + 1, animation), 0);
+    }
+
+    vec2 uv = mix(uvRect.xy, uvRect.zw, aPos);
     TexCoord = uv;
     vColor = uColor;
 }
@@ -0,0 +1,39 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 WorldPos;
+
+uniform sampler2D uAtlas;
+uniform usampler2D uTileIds;
+uniform sampler2D uTileUVs;
+uniform usampler2D uTileAtlases;
+uniform isampler2D uTileAnimations;
+uniform sampler2D uAnimations;
+uniform float uTime;
+uniform vec2 uTileSize;
+uniform int uLutWidth;
+uniform uint uAtlasIndex;
+uniform float uAlphaClip;
+
+void main() {
+    vec2 tile_pos = WorldPos / uTileSize;
+    ivec2 cell = ivec2(floor(tile_pos));
+    uint id = texelFetch(uTileIds, cell, 0).r;
+    if (id == 0u) discard;
+
+    // Every atlas gets its own pass, skip tiles that live in another one
+    ivec2 lut_cell = ivec2(int(id) % uLutWidth, int(id) / uLutWidth);
+    if (texelFetch(uTileAtlases, lut_cell, 0).r != uAtlasIndex) discard;
+
+    vec4 uv_rect = texelFetch(uTileUVs, lut_cell, 0);
+    int animation = texelFetch(uTileAnimations, lut_cell, 0).r;
+    if (animation >= 0) {
+        // Same table as the instanced path, frames all live in the base tile's atlas
+        vec4 info = texelFetch(uAnimations, ivec2(0, animation), 0);
+        int frame = int(mod(floor(uTime / info.y), info.x));
+        uv_rect = texelFetch(uAnimations, ivec2(frame + 1, animation), 0);
+    }
+    vec4 texel = texture(uAtlas, mix(uv_rect.xy, uv_rect.zw, fract(tile_pos)));
+    if (texel.a <= uAlphaClip) discard;
+    FragColor = texel;
+}
@@ -0,0 +1,17 @@
+#version 330 core
+layout(location = 0) in vec2 aPos;
+
+out vec2 WorldPos;
+
+uniform vec2 uScreen;
+uniform vec2 uPan;
+uniform vec2 uMapSize;
+uniform float uDepth;
+
+void main() {
+    // One quad over the whole layer, the fragment shader works out which tile it's in
+    WorldPos = aPos * uMapSize;
+    vec2 ndc = ((WorldPos - uPan) / uScreen) * 2.0 - 1.0;
+    ndc.y = -ndc.y;
+    gl_Position = vec4(ndc, uDepth, 1.0);
+}
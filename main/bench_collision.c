@@ -0,0 +1,173 @@
+#include "bench_common.h"
+#include "game/collision.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_SEED 0xc011de5ULL
+#define DEFAULT_TICKS 600
+#define ARENA_TILES 256
+#define TILE_SIZE 16
+// Share of the arena's cells that are walls, on top of the border
+#define WALL_DENSITY 0.08
+#define TICK_DT (1.0f / 60.0f)
+#define TICK_MS (1000.0 / 60.0)
+#define BODY_SPEED 60.0f
+
+typedef struct bench_options {
+    uint64_t seed;
+    int ticks;
+    size_t bodies;
+    FILE *output;
+} bench_options;
+
+// A square room of the game's tile size with walls scattered through it, big enough that
+// thousands of bodies spread out like they would over a level
+static int *create_arena(void) {
+    int *cells = (int *) calloc(ARENA_TILES * ARENA_TILES, sizeof(int));
+    if (cells == NULL) return NULL;
+    for (int y = 0; y < ARENA_TILES; y++) {
+        for (int x = 0; x < ARENA_TILES; x++) {
+            int border = x == 0 || y == 0 || x == ARENA_TILES - 1 || y == ARENA_TILES - 1;
+            cells[x + y * ARENA_TILES] = border || bench_rng_float(1.0f) < WALL_DENSITY;
+        }
+    }
+    return cells;
+}
+
+// Bodies without owners, hitboxes the size of the game's own, dropped on floor cells
+static int spawn_bodies(const collision_tiles *tiles, entity_storage storage, size_t count, float *velocity_x, float *velocity_y) {
+    static const entity_hitbox HITBOXES[] = { { 14, 22, 0, 0 }, { 26, 28, 0, 0 } };
+    float size = (float) (ARENA_TILES * TILE_SIZE);
+
+    for (size_t i = 0; i < count; i++) {
+        size_t row = entity_storage_add(storage, NULL);
+        if (row == ENTITY_STORAGE_INVALID_ROW) {
+            fprintf(stderr, "Failed to allocate %zu bodies\n", count);
+            return 1;
+        }
+        float x = 0.0f, y = 0.0f;
+        for (int attempt = 0; attempt < 64; attempt++) {
+            x = bench_rng_float(size);
+            y = bench_rng_float(size);
+            if (tiles->cells[(int) (x / TILE_SIZE) + (int) (y / TILE_SIZE) * ARENA_TILES] == 0) break;
+        }
+        entity_columns *c = entity_storage_get_columns(storage);
+        c->position_x[row] = x;
+        c->position_y[row] = y;
+        c->hitbox[row] = HITBOXES[bench_rng_next() % 2];
+        velocity_x[row] = bench_rng_float(2.0f * BODY_SPEED) - BODY_SPEED;
+        velocity_y[row] = bench_rng_float(2.0f * BODY_SPEED) - BODY_SPEED;
+    }
+    return 0;
+}
+
+static int run_population(const bench_options *options, size_t count) {
+    fprintf(stderr, "Benchmarking %zu bodies\n", count);
+    entity_storage storage = entity_storage_create(count);
+    collision_world world = collision_world_create();
+    float *velocity_x = (float *) malloc(count * sizeof(float));
+    float *velocity_y = (float *) malloc(count * sizeof(float));
+    bench_rng_seed(options->seed ^ (uint64_t) count);
+    collision_tiles tiles = {
+        .cells = create_arena(),
+        .width = ARENA_TILES,
+        .height = ARENA_TILES,
+        .tile_width = TILE_SIZE,
+        .tile_height = TILE_SIZE
+    };
+    int result = 1;
+    if (storage == NULL || world == NULL || velocity_x == NULL || velocity_y == NULL || tiles.cells == NULL) {
+        fprintf(stderr, "Failed to allocate %zu bodies\n", count);
+        goto cleanup;
+    }
+    if (spawn_bodies(&tiles, storage, count, velocity_x, velocity_y) != 0) goto cleanup;
+
+    entity_columns *c = entity_storage_get_columns(storage);
+    double total_ms = 0.0, max_ms = 0.0;
+    size_t pairs = 0, entity_contacts = 0, tile_contacts = 0, dropped = 0, skipped = 0;
+    for (int tick = 0; tick < options->ticks; tick++) {
+        memcpy(c->velocity_x, velocity_x, count * sizeof(float));
+        memcpy(c->velocity_y, velocity_y, count * sizeof(float));
+        collision_world_step(world, storage, &tiles, TICK_DT);
+
+        collision_statistics stats = collision_world_get_stats(world);
+        total_ms += stats.last_step_ms;
+        pairs += stats.pairs_tested;
+        entity_contacts += stats.entity_contacts;
+        tile_contacts += stats.tile_contacts;
+        dropped += stats.dropped_contacts;
+        skipped += stats.skipped_bodies;
+
+        // Bounce off walls so everyone keeps moving, outside the measurement
+        size_t contact_count = 0;
+        const collision_contact *contacts = collision_world_get_contacts(world, &contact_count);
+        for (size_t i = 0; i < contact_count; i++) {
+            if (contacts[i].type != COLLISION_CONTACT_TILE) continue;
+            if (contacts[i].normal_x != 0.0f) velocity_x[contacts[i].row_a] = -velocity_x[contacts[i].row_a];
+            if (contacts[i].normal_y != 0.0f) velocity_y[contacts[i].row_a] = -velocity_y[contacts[i].row_a];
+        }
+    }
+    max_ms = collision_world_get_stats(world).max_step_ms;
+
+    double ticks = (double) options->ticks;
+    fprintf(
+        options->output,
+        "%zu,%d,%.3f,%.3f,%.0f,%.1f,%.1f,%.1f,%.1f,%.3f\n",
+        count,
+        options->ticks,
+        total_ms / ticks,
+        max_ms,
+        (double) pairs / ticks,
+        (double) entity_contacts / ticks,
+        (double) tile_contacts / ticks,
+        (double) dropped / ticks,
+        (double) skipped / ticks,
+        total_ms / ticks / TICK_MS
+    );
+    fflush(options->output);
+    result = 0;
+
+cleanup:
+    free((int *) tiles.cells);
+    free(velocity_x);
+    free(velocity_y);
+    collision_world_destroy(world);
+    entity_storage_destroy(storage);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    bench_options options = {
+        .seed = DEFAULT_SEED,
+        .ticks = DEFAULT_TICKS,
+        .bodies = 0,
+        .output = stdout
+    };
+    const bench_option option_table[] = {
+        { "--seed", "N", BENCH_OPTION_U64, &options.seed },
+        { "--ticks", "N", BENCH_OPTION_INT, &options.ticks },
+        { "--bodies", "N", BENCH_OPTION_SIZE, &options.bodies },
+        { "--output", "FILE", BENCH_OPTION_OUTPUT, &options.output },
+    };
+    if (bench_parse_options(argc, argv, option_table, sizeof(option_table) / sizeof(option_table[0])) != 0) {
+        return 1;
+    }
+    if (options.ticks <= 0) options.ticks = DEFAULT_TICKS;
+
+    fprintf(options.output, "bodies,ticks,ms_per_tick,max_ms,pairs_per_tick,entity_contacts_per_tick,tile_contacts_per_tick,dropped_per_tick,skipped_per_tick,tick_share\n");
+    const size_t populations[] = { 1000, 4000, 16000 };
+    int result = 0;
+    if (options.bodies > 0) {
+        result = run_population(&options, options.bodies);
+    }
+    else {
+        for (size_t i = 0; i < sizeof(populations) / sizeof(populations[0]); i++) {
+            result |= run_population(&options, populations[i]);
+        }
+    }
+
+    bench_close_output(options.output);
+    return result;
+}
@@ -0,0 +1,104 @@
+#include "bench_common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Any seed but 0 works for xorshift
+#define BENCH_FALLBACK_SEED 0x9e3779b97f4a7c15ULL
+
+// xorshift64*, so results don't depend on the platform's rand()
+static uint64_t rng_state = BENCH_FALLBACK_SEED;
+
+void bench_rng_seed(uint64_t seed) {
+    rng_state = seed != 0 ? seed : BENCH_FALLBACK_SEED;
+}
+
+uint64_t bench_rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+float bench_rng_float(float max) {
+    return (float) ((double) (bench_rng_next() >> 11) / (double) (1ULL << 53)) * max;
+}
+
+int bench_rng_range(int n) {
+    return n > 0 ? (int) (bench_rng_next() % (uint64_t) n) : 0;
+}
+
+double bench_now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+double bench_now_ms(void) {
+    return bench_now_seconds() * 1e3;
+}
+
+void bench_print_usage(const char *program, const bench_option *options, size_t option_count) {
+    fprintf(stderr, "Usage: %s", program);
+    for (size_t i = 0; i < option_count; i++) {
+        if (options[i].name == NULL) fprintf(stderr, " %s", options[i].value_name);
+        else fprintf(stderr, " [%s %s]", options[i].name, options[i].value_name);
+    }
+    fprintf(stderr, "\n");
+}
+
+static const bench_option *find_option(const char *name, const bench_option *options, size_t option_count) {
+    for (size_t i = 0; i < option_count; i++) {
+        if (name == NULL ? options[i].name == NULL : options[i].name != NULL && strcmp(options[i].name, name) == 0) {
+            return &options[i];
+        }
+    }
+    return NULL;
+}
+
+static int set_option(const bench_option *option, const char *value) {
+    switch (option->kind) {
+        case BENCH_OPTION_INT: *(int *) option->value = atoi(value); break;
+        case BENCH_OPTION_SIZE: *(size_t *) option->value = (size_t) strtoull(value, NULL, 0); break;
+        case BENCH_OPTION_U64: *(uint64_t *) option->value = strtoull(value, NULL, 0); break;
+        case BENCH_OPTION_DOUBLE: *(double *) option->value = atof(value); break;
+        case BENCH_OPTION_STRING: *(const char **) option->value = value; break;
+        case BENCH_OPTION_OUTPUT: {
+            FILE *output = fopen(value, "w");
+            if (output == NULL) {
+                fprintf(stderr, "Failed to open '%s' for writing\n", value);
+                return 1;
+            }
+            bench_close_output(*(FILE **) option->value);
+            *(FILE **) option->value = output;
+            break;
+        }
+    }
+    return 0;
+}
+
+int bench_parse_options(int argc, char **argv, const bench_option *options, size_t option_count) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            bench_print_usage(argv[0], options, option_count);
+            return 1;
+        }
+        int bare = strncmp(argv[i], "--", 2) != 0;
+        const bench_option *option = find_option(bare ? NULL : argv[i], options, option_count);
+        const char *value = bare ? argv[i] : i + 1 < argc ? argv[++i] : NULL;
+        if (option == NULL || value == NULL) {
+            bench_print_usage(argv[0], options, option_count);
+            return 1;
+        }
+        if (set_option(option, value) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void bench_close_output(FILE *output) {
+    if (output != NULL && output != stdout) {
+        fclose(output);
+    }
+}
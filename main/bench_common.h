@@ -0,0 +1,43 @@
+#ifndef _H_BENCH_COMMON_H_
+#define _H_BENCH_COMMON_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Shared by the benchmarks and tayira_sim, so their runs only depend on the seed and the options given
+
+typedef enum bench_option_kind {
+    BENCH_OPTION_INT,
+    BENCH_OPTION_SIZE,
+    BENCH_OPTION_U64,
+    BENCH_OPTION_DOUBLE,
+    BENCH_OPTION_STRING,
+    // Opens the file for writing into a FILE *
+    BENCH_OPTION_OUTPUT
+} bench_option_kind;
+
+typedef struct bench_option {
+    // "--ticks", or NULL for the one bare argument a program takes
+    const char *name;
+    // Shown in the usage line, e.g. "N" or "FILE"
+    const char *value_name;
+    bench_option_kind kind;
+    void *value;
+} bench_option;
+
+void bench_rng_seed(uint64_t seed);
+uint64_t bench_rng_next(void);
+// In [0, max)
+float bench_rng_float(float max);
+int bench_rng_range(int n);
+// Wall clock, safe to compare between threads
+double bench_now_seconds(void);
+double bench_now_ms(void);
+void bench_print_usage(const char *program, const bench_option *options, size_t option_count);
+// Fills in the options given on the command line, leaving the rest as they were. Prints the usage
+// and returns 1 on --help or anything it doesn't know
+int bench_parse_options(int argc, char **argv, const bench_option *options, size_t option_count);
+void bench_close_output(FILE *output);
+
+#endif
@@ -0,0 +1,205 @@
+#include "bench_common.h"
+#include "game/entity_storage.h"
+#include "data_structures/linked_list.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_SEED 0xe7717e5ULL
+#define DEFAULT_TICKS 200
+#define WORLD_SIZE 8192.0f
+#define VIEW_WIDTH 1280.0f
+#define VIEW_HEIGHT 720.0f
+#define TICK_DT (1.0f / 60.0f)
+
+typedef struct bench_options {
+    uint64_t seed;
+    int ticks;
+    FILE *output;
+} bench_options;
+
+// How entities were laid out before the storage: one heap object each, hot fields mixed with
+// cold ones, reached through a linked list
+typedef struct legacy_entity {
+    char *name;
+    char *entity_id;
+    void *animations, *state_map;
+    unsigned char base_attributes[8];
+    int hitbox[4];
+    int moving, visible, has_immediate_goal, sees_player;
+    float position_x, position_y;
+    float velocity_x, velocity_y;
+    int facing;
+    void *path, *path_request;
+    int goal[2], immediate_goal[2];
+    unsigned char current_attributes[8];
+    void *grid;
+    int grid_handle;
+    void *sight;
+} legacy_entity;
+
+struct legacy_args_s {
+    float dt;
+    float min_x, min_y, max_x, max_y;
+    size_t visible;
+};
+
+static iteration_result integrate_legacy(void *value, void *_args) {
+    legacy_entity *e = (legacy_entity *) value;
+    struct legacy_args_s *args = (struct legacy_args_s *) _args;
+    e->position_x += e->velocity_x * args->dt;
+    e->position_y += e->velocity_y * args->dt;
+    return ITERATION_CONTINUE;
+}
+
+static iteration_result cull_legacy(void *value, void *_args) {
+    legacy_entity *e = (legacy_entity *) value;
+    struct legacy_args_s *args = (struct legacy_args_s *) _args;
+    args->visible += e->position_x >= args->min_x && e->position_x <= args->max_x && e->position_y >= args->min_y && e->position_y <= args->max_y;
+    return ITERATION_CONTINUE;
+}
+
+static size_t cull_columns(const entity_columns *c, float min_x, float min_y, float max_x, float max_y) {
+    size_t visible = 0;
+    for (size_t row = 0; row < c->count; row++) {
+        visible += c->position_x[row] >= min_x && c->position_x[row] <= max_x && c->position_y[row] >= min_y && c->position_y[row] <= max_y;
+    }
+    return visible;
+}
+
+static void report(const bench_options *options, size_t entities, const char *layout, const char *operation, double elapsed, size_t visible, double baseline_elapsed) {
+    double processed = (double) entities * (double) options->ticks;
+    fprintf(
+        options->output,
+        "%zu,%s,%s,%d,%.0f,%.2f,%.1f,%.1f\n",
+        entities,
+        layout,
+        operation,
+        options->ticks,
+        elapsed > 0.0 ? processed / elapsed : 0.0,
+        processed > 0.0 ? elapsed * 1e9 / processed : 0.0,
+        options->ticks > 0 ? (double) visible / (double) options->ticks : 0.0,
+        baseline_elapsed > 0.0 && elapsed > 0.0 ? baseline_elapsed / elapsed : 0.0
+    );
+    fflush(options->output);
+}
+
+static int run_population(const bench_options *options, size_t count) {
+    fprintf(stderr, "Benchmarking %zu entities\n", count);
+    linked_list legacy = linked_list_create_owned(free);
+    entity_storage storage = entity_storage_create(count);
+    if (legacy == NULL || storage == NULL) {
+        fprintf(stderr, "Failed to allocate %zu entities\n", count);
+        if (legacy != NULL) linked_list_destroy(legacy);
+        entity_storage_destroy(storage);
+        return 1;
+    }
+
+    bench_rng_seed(options->seed ^ (uint64_t) count);
+    int result = 0;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        float x = bench_rng_float(WORLD_SIZE), y = bench_rng_float(WORLD_SIZE);
+        float velocity_x = bench_rng_float(80.0f) - 40.0f, velocity_y = bench_rng_float(80.0f) - 40.0f;
+
+        legacy_entity *e = (legacy_entity *) calloc(1, sizeof(legacy_entity));
+        // Something else allocated in between, like the game's own loading does
+        void *interleaved = malloc(64 + bench_rng_next() % 192);
+        if (e == NULL || linked_list_pushfront(legacy, e) != 0) {
+            free(e);
+            result = 1;
+        }
+        free(interleaved);
+        if (result != 0) break;
+        e->position_x = x;
+        e->position_y = y;
+        e->velocity_x = velocity_x;
+        e->velocity_y = velocity_y;
+
+        size_t row = entity_storage_add(storage, NULL);
+        if (row == ENTITY_STORAGE_INVALID_ROW) {
+            result = 1;
+            break;
+        }
+        entity_columns *c = entity_storage_get_columns(storage);
+        c->position_x[row] = x;
+        c->position_y[row] = y;
+        c->velocity_x[row] = velocity_x;
+        c->velocity_y[row] = velocity_y;
+    }
+    if (result != 0) {
+        fprintf(stderr, "Failed to allocate %zu entities\n", count);
+    }
+    else {
+        // The view sits in the middle of the world
+        float min_x = (WORLD_SIZE - VIEW_WIDTH) / 2.0f, min_y = (WORLD_SIZE - VIEW_HEIGHT) / 2.0f;
+        struct legacy_args_s legacy_args = {
+            .dt = TICK_DT,
+            .min_x = min_x,
+            .min_y = min_y,
+            .max_x = min_x + VIEW_WIDTH,
+            .max_y = min_y + VIEW_HEIGHT,
+            .visible = 0
+        };
+
+        double start = bench_now_seconds();
+        for (int tick = 0; tick < options->ticks; tick++) {
+            linked_list_foreach_args(legacy, integrate_legacy, &legacy_args);
+        }
+        double legacy_update = bench_now_seconds() - start;
+        report(options, count, "linked_list", "update", legacy_update, 0, 0.0);
+
+        start = bench_now_seconds();
+        for (int tick = 0; tick < options->ticks; tick++) {
+            entity_storage_integrate(storage, TICK_DT);
+        }
+        report(options, count, "columns", "update", bench_now_seconds() - start, 0, legacy_update);
+
+        start = bench_now_seconds();
+        for (int tick = 0; tick < options->ticks; tick++) {
+            linked_list_foreach_args(legacy, cull_legacy, &legacy_args);
+        }
+        double legacy_cull = bench_now_seconds() - start;
+        report(options, count, "linked_list", "cull", legacy_cull, legacy_args.visible, 0.0);
+
+        size_t visible = 0;
+        entity_columns *c = entity_storage_get_columns(storage);
+        start = bench_now_seconds();
+        for (int tick = 0; tick < options->ticks; tick++) {
+            visible += cull_columns(c, legacy_args.min_x, legacy_args.min_y, legacy_args.max_x, legacy_args.max_y);
+        }
+        report(options, count, "columns", "cull", bench_now_seconds() - start, visible, legacy_cull);
+    }
+
+    // The list owns the legacy entities
+    linked_list_destroy(legacy);
+    entity_storage_destroy(storage);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    bench_options options = {
+        .seed = DEFAULT_SEED,
+        .ticks = DEFAULT_TICKS,
+        .output = stdout
+    };
+    const bench_option option_table[] = {
+        { "--seed", "N", BENCH_OPTION_U64, &options.seed },
+        { "--ticks", "N", BENCH_OPTION_INT, &options.ticks },
+        { "--output", "FILE", BENCH_OPTION_OUTPUT, &options.output },
+    };
+    if (bench_parse_options(argc, argv, option_table, sizeof(option_table) / sizeof(option_table[0])) != 0) {
+        return 1;
+    }
+    if (options.ticks <= 0) options.ticks = DEFAULT_TICKS;
+
+    fprintf(options.output, "entities,layout,operation,ticks,entities_per_sec,ns_per_entity,avg_visible,speedup\n");
+    const size_t populations[] = { 1000, 10000, 100000 };
+    int result = 0;
+    for (size_t i = 0; i < sizeof(populations) / sizeof(populations[0]); i++) {
+        result |= run_population(&options, populations[i]);
+    }
+
+    bench_close_output(options.output);
+    return result;
+}
@@ -0,0 +1,193 @@
+#include "bench_common.h"
+#include "game/asset_manager.h"
+#include "game/entity_manager.h"
+#include "game/level_manager.h"
+#include "game/map.h"
+#include "watchdog/watchdog.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_SEED 0x90b11e5ULL
+#define DEFAULT_TICKS 300
+#define DEFAULT_ENTITIES 20000
+#define BENCH_LEVEL "dungeon"
+#define BENCH_ENTITY "simple-goblin"
+#define TICK_DT (1.0 / 60.0)
+
+typedef struct bench_options {
+    uint64_t seed;
+    int ticks;
+    size_t entities;
+    int max_threads;
+    FILE *output;
+} bench_options;
+
+typedef struct bench_result {
+    double update_seconds;
+    uint64_t checksum;
+} bench_result;
+
+// FNV-1a over everything the update writes, equal checksums mean bit-identical rows
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t checksum_entities(const entity *entities, size_t count) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < count; i++) {
+        entity_position position = entity_get_position(entities[i]);
+        direction facing = entity_get_facing(entities[i]);
+        entity_state state = entity_get_state(entities[i]);
+        hash = hash_bytes(hash, &position, sizeof(position));
+        hash = hash_bytes(hash, &facing, sizeof(facing));
+        hash = hash_bytes(hash, &state, sizeof(state));
+    }
+    return hash;
+}
+
+// The level owns the rows, so they are updated by its own scheduler and collision world like in the game
+static int spawn_entities(const bench_options *options, entity_manager_ctx entity_mgr, level l, entity *out_entities) {
+    map m = level_get_map(l);
+    int width = 0, height = 0;
+    map_get_pixel_dimensions(m, &width, &height);
+    entity_archetype archetype = entity_manager_get_archetype(entity_mgr, BENCH_ENTITY);
+    entity_position *positions = (entity_position *) malloc(options->entities * sizeof(entity_position));
+    if (archetype == NULL || positions == NULL || width <= 0 || height <= 0) {
+        fprintf(stderr, "Failed to set up %zu '%s' on level '%s'\n", options->entities, BENCH_ENTITY, BENCH_LEVEL);
+        free(positions);
+        return 1;
+    }
+
+    bench_rng_seed(options->seed);
+    for (size_t i = 0; i < options->entities; i++) {
+        // Anywhere that doesn't block sight is floor, give up on the map after a while
+        for (int attempt = 0; attempt < 64; attempt++) {
+            positions[i].x = (float) (bench_rng_next() % (uint64_t) width);
+            positions[i].y = (float) (bench_rng_next() % (uint64_t) height);
+            integer_position cell = map_get_cell_at(m, positions[i].x, positions[i].y);
+            if (!map_blocks_sight(m, cell.x, cell.y)) break;
+        }
+    }
+    size_t spawned = level_spawn_batch(l, archetype, options->entities, positions, out_entities);
+    free(positions);
+    if (spawned != options->entities) {
+        fprintf(stderr, "Spawned %zu of %zu entities\n", spawned, options->entities);
+        return 1;
+    }
+    return 0;
+}
+
+static int run_threads(const bench_options *options, int threads, bench_result *result) {
+    asset_manager_ctx asset_mgr = asset_manager_init();
+    entity_manager_ctx entity_mgr = asset_mgr != NULL ? entity_manager_init(asset_mgr) : NULL;
+    level_manager_ctx level_mgr = entity_mgr != NULL ? level_manager_init(asset_mgr, entity_mgr) : NULL;
+    entity *entities = (entity *) calloc(options->entities, sizeof(entity));
+    level l = NULL;
+    int return_value = 1;
+
+    if (level_mgr == NULL || entities == NULL) {
+        fprintf(stderr, "Failed to set up the game\n");
+        goto cleanup;
+    }
+    asset_manager_set_headless(asset_mgr, 1);
+    if (entity_manager_set_worker_count(entity_mgr, threads) != 0) goto cleanup;
+    l = level_manager_load_level(level_mgr, BENCH_LEVEL);
+    if (l == NULL) {
+        fprintf(stderr, "Failed to load level '%s', run from the repository root\n", BENCH_LEVEL);
+        goto cleanup;
+    }
+    if (spawn_entities(options, entity_mgr, l, entities) != 0) goto cleanup;
+
+    result->update_seconds = 0.0;
+    for (int tick = 0; tick < options->ticks; tick++) {
+        level_update(l, TICK_DT);
+        // Only the entity phase, streaming, sight and pathfinding aren't what the threads speed up
+        result->update_seconds += level_get_update_stats(l).entities_ms / 1000.0;
+    }
+    result->checksum = checksum_entities(entities, options->entities);
+    return_value = 0;
+
+cleanup:
+    // The level's entities go with the level manager
+    level_manager_cleanup(level_mgr);
+    entity_manager_cleanup(entity_mgr);
+    asset_manager_cleanup(asset_mgr);
+    free(entities);
+    return return_value;
+}
+
+int main(int argc, char **argv) {
+    bench_options options = {
+        .seed = DEFAULT_SEED,
+        .ticks = DEFAULT_TICKS,
+        .entities = DEFAULT_ENTITIES,
+        .max_threads = 0,
+        .output = stdout
+    };
+    const bench_option option_table[] = {
+        { "--seed", "N", BENCH_OPTION_U64, &options.seed },
+        { "--ticks", "N", BENCH_OPTION_INT, &options.ticks },
+        { "--entities", "N", BENCH_OPTION_SIZE, &options.entities },
+        { "--max-threads", "N", BENCH_OPTION_INT, &options.max_threads },
+        { "--output", "FILE", BENCH_OPTION_OUTPUT, &options.output },
+    };
+    if (bench_parse_options(argc, argv, option_table, sizeof(option_table) / sizeof(option_table[0])) != 0) {
+        return 1;
+    }
+    if (options.ticks <= 0) options.ticks = DEFAULT_TICKS;
+    if (options.entities == 0) options.entities = DEFAULT_ENTITIES;
+    int cores = worker_pool_get_core_count();
+    if (options.max_threads <= 0) options.max_threads = cores;
+    if (options.max_threads > cores) {
+        fprintf(stderr, "Only %d cores online, runs on more threads than that share them\n", cores);
+    }
+    watchdog_init();
+
+    // Doubling up to the core count, then the core count itself
+    int thread_counts[32];
+    size_t thread_count_size = 0;
+    for (int threads = 1; threads < options.max_threads && thread_count_size < 31; threads *= 2) {
+        thread_counts[thread_count_size++] = threads;
+    }
+    thread_counts[thread_count_size++] = options.max_threads;
+
+    bench_result results[32];
+    int result = 0;
+    for (size_t i = 0; i < thread_count_size && result == 0; i++) {
+        fprintf(stderr, "Benchmarking %zu entities on %d threads\n", options.entities, thread_counts[i]);
+        result = run_threads(&options, thread_counts[i], &results[i]);
+    }
+    if (result != 0) {
+        return 1;
+    }
+
+    fprintf(options.output, "entities,threads,cores,ticks,ms_per_tick,entities_per_sec,speedup,efficiency,checksum,matches_single_thread\n");
+    for (size_t i = 0; i < thread_count_size; i++) {
+        double seconds = results[i].update_seconds;
+        double speedup = seconds > 0.0 ? results[0].update_seconds / seconds : 0.0;
+        fprintf(
+            options.output,
+            "%zu,%d,%d,%d,%.3f,%.0f,%.2f,%.2f,%016llx,%s\n",
+            options.entities,
+            thread_counts[i],
+            cores,
+            options.ticks,
+            seconds * 1e3 / (double) options.ticks,
+            seconds > 0.0 ? (double) options.entities * (double) options.ticks / seconds : 0.0,
+            speedup,
+            speedup / (double) thread_counts[i],
+            (unsigned long long) results[i].checksum,
+            results[i].checksum == results[0].checksum ? "yes" : "no"
+        );
+        if (results[i].checksum != results[0].checksum) result = 1;
+    }
+
+    bench_close_output(options.output);
+    return result;
+}
@@ -0,0 +1,143 @@
+#include "bench_common.h"
+#include "game/ai/fov.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_SEED 0xf0f0a11ULL
+#define DEFAULT_FRAMES 20
+#define GRID_SIZE 512
+// Share of cells blocking sight, a little denser than the dungeon maps
+#define WALL_CHANCE 0.18f
+
+typedef struct bench_options {
+    uint64_t seed;
+    int frames;
+    FILE *output;
+} bench_options;
+
+static void report(const bench_options *options, int radius, size_t viewers, const char *operation, size_t updates, double elapsed, double visible, size_t memory) {
+    fprintf(
+        options->output,
+        "%d,%zu,%s,%zu,%.0f,%.3f,%.1f,%zu\n",
+        radius,
+        viewers,
+        operation,
+        updates,
+        elapsed > 0.0 ? (double) updates / elapsed : 0.0,
+        updates > 0 ? elapsed * 1e6 / (double) updates : 0.0,
+        updates > 0 ? visible / (double) updates : 0.0,
+        memory
+    );
+    fflush(options->output);
+}
+
+static integer_position random_floor(const int *grid) {
+    integer_position p;
+    do {
+        p.x = (int) bench_rng_float(GRID_SIZE);
+        p.y = (int) bench_rng_float(GRID_SIZE);
+    } while (grid[p.x + p.y * GRID_SIZE] != 0);
+    return p;
+}
+
+static int run_case(const bench_options *options, const int *grid, int radius, size_t count) {
+    fov_viewer *viewers = (fov_viewer *) calloc(count, sizeof(fov_viewer));
+    integer_position *origins = (integer_position *) malloc(count * sizeof(integer_position));
+    if (viewers == NULL || origins == NULL) {
+        fprintf(stderr, "Failed to allocate %zu viewers\n", count);
+        free(viewers);
+        free(origins);
+        return 1;
+    }
+    int result = 0;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        viewers[i] = fov_viewer_create(radius);
+        origins[i] = random_floor(grid);
+        if (viewers[i] == NULL) result = 1;
+    }
+
+    if (result == 0) {
+        // Everyone steps to another cell every frame, the worst case
+        size_t updates = 0;
+        double visible = 0.0;
+        unsigned int version = 0;
+        double start = bench_now_seconds();
+        for (int frame = 0; frame < options->frames; frame++) {
+            // As if a door opened somewhere every frame, standing still recomputes too
+            version++;
+            for (size_t i = 0; i < count; i++) {
+                integer_position step = origins[i];
+                step.x += (frame & 1) ? 1 : -1;
+                if (step.x < 0 || step.x >= GRID_SIZE || grid[step.x + step.y * GRID_SIZE] != 0) step = origins[i];
+                else origins[i] = step;
+                updates += (size_t) fov_viewer_update(viewers[i], grid, GRID_SIZE, GRID_SIZE, version, origins[i]);
+                visible += (double) fov_viewer_get_visible_count(viewers[i]);
+            }
+        }
+        size_t memory = 0;
+        for (size_t i = 0; i < count; i++) memory += fov_viewer_get_memory_usage(viewers[i]);
+        report(options, radius, count, "recompute", updates, bench_now_seconds() - start, visible, memory);
+
+        // Nothing moved and the map didn't change, what idle entities pay every frame
+        updates = 0;
+        visible = 0.0;
+        start = bench_now_seconds();
+        for (int frame = 0; frame < options->frames; frame++) {
+            for (size_t i = 0; i < count; i++) {
+                fov_viewer_update(viewers[i], grid, GRID_SIZE, GRID_SIZE, version, origins[i]);
+                visible += (double) fov_viewer_get_visible_count(viewers[i]);
+                updates++;
+            }
+        }
+        report(options, radius, count, "cached", updates, bench_now_seconds() - start, visible, memory);
+    }
+
+    for (size_t i = 0; i < count; i++) fov_viewer_destroy(viewers[i]);
+    free(viewers);
+    free(origins);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    bench_options options = {
+        .seed = DEFAULT_SEED,
+        .frames = DEFAULT_FRAMES,
+        .output = stdout
+    };
+    const bench_option option_table[] = {
+        { "--seed", "N", BENCH_OPTION_U64, &options.seed },
+        { "--frames", "N", BENCH_OPTION_INT, &options.frames },
+        { "--output", "FILE", BENCH_OPTION_OUTPUT, &options.output },
+    };
+    if (bench_parse_options(argc, argv, option_table, sizeof(option_table) / sizeof(option_table[0])) != 0) {
+        return 1;
+    }
+    if (options.frames <= 0) options.frames = DEFAULT_FRAMES;
+
+    int *grid = (int *) malloc(GRID_SIZE * GRID_SIZE * sizeof(int));
+    if (grid == NULL) {
+        fprintf(stderr, "Failed to allocate the grid\n");
+        return 1;
+    }
+    bench_rng_seed(options.seed);
+    for (int i = 0; i < GRID_SIZE * GRID_SIZE; i++) {
+        grid[i] = bench_rng_float(1.0f) < WALL_CHANCE;
+    }
+
+    fprintf(options.output, "radius,viewers,operation,updates,updates_per_sec,us_per_update,avg_visible,memory_bytes\n");
+    const int radii[] = { 8, 16, 32, 64 };
+    const size_t populations[] = { 100, 1000 };
+    int result = 0;
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+        for (size_t p = 0; p < sizeof(populations) / sizeof(populations[0]); p++) {
+            fprintf(stderr, "Benchmarking %zu viewers with radius %d\n", populations[p], radii[r]);
+            result |= run_case(&options, grid, radii[r], populations[p]);
+        }
+    }
+
+    free(grid);
+    bench_close_output(options.output);
+    return result;
+}
@@ -0,0 +1,541 @@
+#include "bench_common.h"
+#include "game/ai/pathfinding.h"
+#include "cjson/cJSON.h"
+#include "utils/utils.h"
+#include "logger/logger.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_SEED 0x7a1a5eedULL
+#define DEFAULT_QUERIES 200
+#define DEFAULT_MAX_SIZE 4096
+#define DEFAULT_TIME_LIMIT 5.0
+#define DEFAULT_MAP_PATH "assets/maps/dungeon/dungeon.map-config.json"
+
+typedef struct bench_grid {
+    char name[64];
+    int width, height;
+    int *occupancy;
+    // Connected component of every free cell, -1 for walls
+    int *components;
+    int component_count, largest_component;
+    // Free cells grouped by component, component i spans [component_offsets[i], component_offsets[i + 1])
+    int *component_cells;
+    size_t *component_offsets;
+} bench_grid;
+
+typedef struct bench_query {
+    integer_position start, goal;
+} bench_query;
+
+typedef enum query_set {
+    QUERY_SET_RANDOM,
+    QUERY_SET_UNREACHABLE,
+    QUERY_SET_LONG_DIAGONAL
+} query_set;
+
+static const char *QUERY_SET_NAMES[] = {
+    [QUERY_SET_RANDOM] = "random",
+    [QUERY_SET_UNREACHABLE] = "unreachable",
+    [QUERY_SET_LONG_DIAGONAL] = "long_diagonal"
+};
+
+typedef struct bench_options {
+    uint64_t seed;
+    int queries;
+    int max_size;
+    double time_limit;
+    const char *map_path;
+    FILE *output;
+} bench_options;
+
+typedef struct planner {
+    const char *name;
+    pathfinding_options options;
+} planner;
+
+static const planner PLANNERS[] = {
+    {
+        .name = "astar_4_manhattan",
+        .options = { .heuristic = PATHFINDING_HEURISTIC_MANHATTAN, .connectivity = 4, .corner_rule = PATHFINDING_CORNERS_NEVER, .epsilon = 1.0 }
+    },
+    {
+        .name = "wastar_4_manhattan_e1.5",
+        .options = { .heuristic = PATHFINDING_HEURISTIC_MANHATTAN, .connectivity = 4, .corner_rule = PATHFINDING_CORNERS_NEVER, .epsilon = 1.5 }
+    },
+    {
+        .name = "astar_8_octile",
+        .options = { .heuristic = PATHFINDING_HEURISTIC_OCTILE, .connectivity = 8, .corner_rule = PATHFINDING_CORNERS_NEVER, .epsilon = 1.0 }
+    },
+    {
+        .name = "wastar_8_octile_e1.5",
+        .options = { .heuristic = PATHFINDING_HEURISTIC_OCTILE, .connectivity = 8, .corner_rule = PATHFINDING_CORNERS_NEVER, .epsilon = 1.5 }
+    },
+    {
+        .name = "wastar_8_octile_e3",
+        .options = { .heuristic = PATHFINDING_HEURISTIC_OCTILE, .connectivity = 8, .corner_rule = PATHFINDING_CORNERS_NEVER, .epsilon = 3.0 }
+    }
+};
+
+static int grid_allocate(bench_grid *grid, const char *name, int width, int height, int fill) {
+    snprintf(grid->name, sizeof(grid->name), "%s", name);
+    grid->width = width;
+    grid->height = height;
+    grid->components = NULL;
+    grid->component_cells = NULL;
+    grid->component_offsets = NULL;
+    grid->component_count = 0;
+    grid->largest_component = 0;
+    grid->occupancy = (int *) malloc((size_t) width * (size_t) height * sizeof(int));
+    if (grid->occupancy == NULL) {
+        log_error("Failed to allocate {d}x{d} grid", width, height);
+        return 1;
+    }
+    for (size_t i = 0; i < (size_t) width * (size_t) height; i++) {
+        grid->occupancy[i] = fill;
+    }
+    return 0;
+}
+
+static void grid_free(bench_grid *grid) {
+    free(grid->occupancy);
+    free(grid->components);
+    free(grid->component_cells);
+    free(grid->component_offsets);
+    grid->occupancy = NULL;
+    grid->components = NULL;
+    grid->component_cells = NULL;
+    grid->component_offsets = NULL;
+}
+
+static void grid_set(bench_grid *grid, int x, int y, int value) {
+    if (x < 0 || y < 0 || x >= grid->width || y >= grid->height) return;
+    grid->occupancy[x + y * grid->width] = value;
+}
+
+static int grid_is_free(const bench_grid *grid, int x, int y) {
+    return x >= 0 && y >= 0 && x < grid->width && y < grid->height && grid->occupancy[x + y * grid->width] == 0;
+}
+
+static void grid_fill_rect(bench_grid *grid, int x0, int y0, int w, int h, int value) {
+    for (int y = y0; y < y0 + h; y++) {
+        for (int x = x0; x < x0 + w; x++) {
+            grid_set(grid, x, y, value);
+        }
+    }
+}
+
+// Walls off a small open room so every synthetic map has pairs that can't reach each other.
+// The vault is surrounded by a free moat, so corridors it cuts through stay connected
+static void grid_add_vault(bench_grid *grid) {
+    int size = grid->width / 16 > 5 ? grid->width / 16 : 5;
+    int x0 = (grid->width - size) / 2, y0 = (grid->height - size) / 2;
+    grid_fill_rect(grid, x0 - 1, y0 - 1, size + 2, size + 2, 0);
+    grid_fill_rect(grid, x0, y0, size, size, 1);
+    grid_fill_rect(grid, x0 + 1, y0 + 1, size - 2, size - 2, 0);
+}
+
+static int generate_open_field(bench_grid *grid, int size) {
+    char name[64];
+    snprintf(name, sizeof(name), "open_%d", size);
+    if (grid_allocate(grid, name, size, size, 0) != 0) return 1;
+
+    // Scattered boulders covering roughly 10% of the field
+    for (size_t i = 0; i < (size_t) size * (size_t) size; i++) {
+        grid->occupancy[i] = bench_rng_range(100) < 10;
+    }
+    grid_add_vault(grid);
+    return 0;
+}
+
+static int generate_maze(bench_grid *grid, int size) {
+    char name[64];
+    snprintf(name, sizeof(name), "maze_%d", size);
+    if (grid_allocate(grid, name, size, size, 1) != 0) return 1;
+
+    // Iterative recursive backtracker over the odd cells
+    int cells_x = (size - 1) / 2, cells_y = (size - 1) / 2;
+    int *stack = (int *) malloc((size_t) cells_x * (size_t) cells_y * sizeof(int));
+    unsigned char *visited = (unsigned char *) calloc((size_t) cells_x * (size_t) cells_y, sizeof(unsigned char));
+    if (stack == NULL || visited == NULL) {
+        log_error("Failed to allocate maze generation state");
+        free(stack);
+        free(visited);
+        grid_free(grid);
+        return 1;
+    }
+
+    static const int DIRECTIONS[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+    size_t top = 0;
+    stack[top++] = 0;
+    visited[0] = 1;
+    grid_set(grid, 1, 1, 0);
+    while (top > 0) {
+        int cell = stack[top - 1];
+        int cx = cell % cells_x, cy = cell / cells_x;
+
+        int candidates[4], candidate_count = 0;
+        for (int d = 0; d < 4; d++) {
+            int nx = cx + DIRECTIONS[d][0], ny = cy + DIRECTIONS[d][1];
+            if (nx < 0 || ny < 0 || nx >= cells_x || ny >= cells_y) continue;
+            if (visited[nx + ny * cells_x]) continue;
+            candidates[candidate_count++] = d;
+        }
+        if (candidate_count == 0) {
+            top--;
+            continue;
+        }
+
+        int d = candidates[bench_rng_range(candidate_count)];
+        int nx = cx + DIRECTIONS[d][0], ny = cy + DIRECTIONS[d][1];
+        visited[nx + ny * cells_x] = 1;
+        grid_set(grid, 2 * cx + 1 + DIRECTIONS[d][0], 2 * cy + 1 + DIRECTIONS[d][1], 0);
+        grid_set(grid, 2 * nx + 1, 2 * ny + 1, 0);
+        stack[top++] = nx + ny * cells_x;
+    }
+
+    free(stack);
+    free(visited);
+    grid_add_vault(grid);
+    return 0;
+}
+
+static int generate_rooms(bench_grid *grid, int size) {
+    char name[64];
+    snprintf(name, sizeof(name), "rooms_%d", size);
+    if (grid_allocate(grid, name, size, size, 1) != 0) return 1;
+
+    int room_count = (size / 16) * (size / 16) / 4;
+    if (room_count < 4) room_count = 4;
+    int max_room = size / 8 > 6 ? size / 8 : 6;
+    if (max_room > 24) max_room = 24;
+
+    int previous_x = -1, previous_y = -1;
+    for (int i = 0; i < room_count; i++) {
+        int w = 4 + bench_rng_range(max_room - 3), h = 4 + bench_rng_range(max_room - 3);
+        int x = 1 + bench_rng_range(size - w - 2), y = 1 + bench_rng_range(size - h - 2);
+        grid_fill_rect(grid, x, y, w, h, 0);
+
+        // L-shaped corridor from the previous room's centre
+        int cx = x + w / 2, cy = y + h / 2;
+        if (previous_x >= 0) {
+            int step_x = cx > previous_x ? 1 : -1, step_y = cy > previous_y ? 1 : -1;
+            for (int px = previous_x; px != cx; px += step_x) grid_set(grid, px, previous_y, 0);
+            for (int py = previous_y; py != cy; py += step_y) grid_set(grid, cx, py, 0);
+        }
+        previous_x = cx;
+        previous_y = cy;
+    }
+    grid_add_vault(grid);
+    return 0;
+}
+
+static int load_map_grid(bench_grid *grid, const char *path) {
+    cJSON *map_config = utils_read_base_config(path);
+    if (map_config == NULL) return 1;
+
+    int result = 1;
+    cJSON *map_width = cJSON_GetObjectItem(map_config, "width");
+    cJSON *map_height = cJSON_GetObjectItem(map_config, "height");
+    cJSON *map_layers = cJSON_GetObjectItem(map_config, "layers");
+    if (map_width == NULL || !cJSON_IsNumber(map_width) || map_height == NULL || !cJSON_IsNumber(map_height) || map_layers == NULL || !cJSON_IsObject(map_layers)) {
+        log_error("Failed to parse map '{s}': width, height and layers are required", path);
+        goto cleanup;
+    }
+
+    cJSON *collision_map = NULL;
+    cJSON *layer = NULL;
+    cJSON_ArrayForEach(layer, map_layers) {
+        if (cJSON_IsTrue(cJSON_GetObjectItem(layer, "collisions"))) {
+            collision_map = cJSON_GetObjectItem(layer, "map");
+            break;
+        }
+    }
+    if (collision_map == NULL || !cJSON_IsArray(collision_map)) {
+        log_error("Failed to parse map '{s}': no collision layer", path);
+        goto cleanup;
+    }
+
+    if (grid_allocate(grid, "dungeon", (int) cJSON_GetNumberValue(map_width), (int) cJSON_GetNumberValue(map_height), 0) != 0) {
+        goto cleanup;
+    }
+    int y = 0;
+    cJSON *row = NULL;
+    cJSON_ArrayForEach(row, collision_map) {
+        int x = 0;
+        cJSON *cell = NULL;
+        cJSON_ArrayForEach(cell, row) {
+            grid_set(grid, x, y, (int) cJSON_GetNumberValue(cell));
+            x++;
+        }
+        y++;
+    }
+    result = 0;
+
+cleanup:
+    cJSON_Delete(map_config);
+    return result;
+}
+
+static int label_components(bench_grid *grid) {
+    size_t cells = (size_t) grid->width * (size_t) grid->height;
+    grid->components = (int *) malloc(cells * sizeof(int));
+    int *queue = (int *) malloc(cells * sizeof(int));
+    if (grid->components == NULL || queue == NULL) {
+        log_error("Failed to allocate component labels");
+        free(queue);
+        return 1;
+    }
+    for (size_t i = 0; i < cells; i++) {
+        grid->components[i] = -1;
+    }
+
+    static const int DIRECTIONS[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+    grid->component_count = 0;
+    for (size_t i = 0; i < cells; i++) {
+        if (grid->occupancy[i] != 0 || grid->components[i] != -1) continue;
+
+        size_t head = 0, tail = 0;
+        queue[tail++] = (int) i;
+        grid->components[i] = grid->component_count;
+        while (head < tail) {
+            int node = queue[head++];
+            int x = node % grid->width, y = node / grid->width;
+            for (int d = 0; d < 4; d++) {
+                int nx = x + DIRECTIONS[d][0], ny = y + DIRECTIONS[d][1];
+                if (!grid_is_free(grid, nx, ny)) continue;
+                int neighbour = nx + ny * grid->width;
+                if (grid->components[neighbour] != -1) continue;
+                grid->components[neighbour] = grid->component_count;
+                queue[tail++] = neighbour;
+            }
+        }
+        grid->component_count++;
+    }
+    free(queue);
+
+    // Bucket the free cells by component so queries can sample any component directly
+    grid->component_offsets = (size_t *) calloc((size_t) grid->component_count + 1, sizeof(size_t));
+    grid->component_cells = (int *) malloc(cells * sizeof(int));
+    if (grid->component_offsets == NULL || grid->component_cells == NULL) {
+        log_error("Failed to allocate component labels");
+        return 1;
+    }
+    for (size_t i = 0; i < cells; i++) {
+        if (grid->components[i] >= 0) grid->component_offsets[grid->components[i] + 1]++;
+    }
+    for (int c = 0; c < grid->component_count; c++) {
+        grid->component_offsets[c + 1] += grid->component_offsets[c];
+        size_t component_size = grid->component_offsets[c + 1] - grid->component_offsets[c];
+        size_t largest_size = grid->component_offsets[grid->largest_component + 1] - grid->component_offsets[grid->largest_component];
+        if (c == 0 || component_size > largest_size) grid->largest_component = c;
+    }
+    size_t *next = (size_t *) malloc(((size_t) grid->component_count + 1) * sizeof(size_t));
+    if (next == NULL) {
+        log_error("Failed to allocate component labels");
+        return 1;
+    }
+    memcpy(next, grid->component_offsets, ((size_t) grid->component_count + 1) * sizeof(size_t));
+    for (size_t i = 0; i < cells; i++) {
+        if (grid->components[i] >= 0) grid->component_cells[next[grid->components[i]]++] = (int) i;
+    }
+    free(next);
+    return 0;
+}
+
+static int component_at(const bench_grid *grid, integer_position pos) {
+    return grid->components[pos.x + pos.y * grid->width];
+}
+
+static integer_position cell_position(const bench_grid *grid, int cell) {
+    return (integer_position) { .x = cell % grid->width, .y = cell / grid->width };
+}
+
+static integer_position random_cell_in_component(const bench_grid *grid, int component) {
+    size_t begin = grid->component_offsets[component], end = grid->component_offsets[component + 1];
+    return cell_position(grid, grid->component_cells[begin + (size_t) bench_rng_range((int) (end - begin))]);
+}
+
+// Picks a random cell of the given component inside the rectangle, giving up after a while
+static int random_cell_in_rect(const bench_grid *grid, int component, int x0, int y0, int w, int h, integer_position *out) {
+    for (int attempt = 0; attempt < 65536; attempt++) {
+        integer_position pos = { .x = x0 + bench_rng_range(w), .y = y0 + bench_rng_range(h) };
+        if (grid_is_free(grid, pos.x, pos.y) && component_at(grid, pos) == component) {
+            *out = pos;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int make_query(const bench_grid *grid, query_set set, int index, bench_query *query) {
+    if (grid->component_count == 0) return 1;
+
+    switch (set) {
+        case QUERY_SET_RANDOM: {
+            // Any free cell, paired with a cell it can actually reach
+            size_t total_cells = grid->component_offsets[grid->component_count];
+            query->start = cell_position(grid, grid->component_cells[bench_rng_range((int) total_cells)]);
+            query->goal = random_cell_in_component(grid, component_at(grid, query->start));
+            return 0;
+        }
+        case QUERY_SET_UNREACHABLE: {
+            if (grid->component_count < 2) return 1;
+            int start_component = bench_rng_range(grid->component_count);
+            int goal_component = (start_component + 1 + bench_rng_range(grid->component_count - 1)) % grid->component_count;
+            query->start = random_cell_in_component(grid, start_component);
+            query->goal = random_cell_in_component(grid, goal_component);
+            return 0;
+        }
+        case QUERY_SET_LONG_DIAGONAL: {
+            // Alternate between both diagonals, starting near one corner and ending near the opposite one.
+            // Sparse maps may have nothing right at the corners, so the search area grows until it finds a pair
+            int flip = index % 2;
+            for (int divisor = 8; divisor >= 1; divisor /= 2) {
+                int corner_w = grid->width / divisor > 2 ? grid->width / divisor : 2;
+                int corner_h = grid->height / divisor > 2 ? grid->height / divisor : 2;
+                int start_x = flip ? grid->width - corner_w : 0, goal_x = flip ? 0 : grid->width - corner_w;
+                if (random_cell_in_rect(grid, grid->largest_component, start_x, 0, corner_w, corner_h, &query->start) != 0) continue;
+                if (random_cell_in_rect(grid, grid->largest_component, goal_x, grid->height - corner_h, corner_w, corner_h, &query->goal) != 0) continue;
+                return 0;
+            }
+            return 1;
+        }
+    }
+    return 1;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    if (count == 0) return 0.0;
+    int index = (int) (p * (double) (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void run_query_set(const bench_options *options, const planner *planner, const bench_grid *grid, query_set set) {
+    double *latencies = (double *) malloc((size_t) options->queries * sizeof(double));
+    if (latencies == NULL) {
+        log_error("Failed to allocate latency samples");
+        return;
+    }
+
+    int completed = 0, found = 0;
+    size_t total_expanded = 0, total_path_length = 0, peak_memory = 0;
+    double total_time = 0.0;
+    for (int i = 0; i < options->queries && total_time < options->time_limit; i++) {
+        bench_query query;
+        if (make_query(grid, set, i, &query) != 0) break;
+
+        double start_time = bench_now_seconds();
+        pathfinding_search search = pathfinding_begin(grid->occupancy, grid->width, grid->height, query.start, query.goal, &planner->options);
+        if (search == NULL) {
+            log_error("Failed to start search on '{s}'", grid->name);
+            break;
+        }
+        pathfinding_step(search, SIZE_MAX);
+        linked_list path = pathfinding_result(search);
+        double elapsed = bench_now_seconds() - start_time;
+
+        if (path != NULL) {
+            found++;
+            total_path_length += linked_list_size(path);
+            linked_list_destroy(path);
+        }
+        total_expanded += pathfinding_get_expanded_nodes(search);
+        size_t memory = pathfinding_get_memory_usage(search);
+        if (memory > peak_memory) peak_memory = memory;
+        pathfinding_destroy(search);
+
+        latencies[completed++] = elapsed;
+        total_time += elapsed;
+    }
+
+    qsort(latencies, (size_t) completed, sizeof(double), compare_doubles);
+    fprintf(
+        options->output,
+        "%s,%s,%d,%d,%s,%d,%d,%.2f,%.1f,%.1f,%zu,%.2f,%.2f\n",
+        planner->name,
+        grid->name,
+        grid->width,
+        grid->height,
+        QUERY_SET_NAMES[set],
+        completed,
+        found,
+        total_time > 0.0 ? (double) completed / total_time : 0.0,
+        completed > 0 ? (double) total_expanded / (double) completed : 0.0,
+        found > 0 ? (double) total_path_length / (double) found : 0.0,
+        peak_memory,
+        percentile(latencies, completed, 0.50) * 1e6,
+        percentile(latencies, completed, 0.99) * 1e6
+    );
+    fflush(options->output);
+    free(latencies);
+}
+
+static void run_grid(const bench_options *options, bench_grid *grid) {
+    if (label_components(grid) != 0) return;
+    // Progress goes to stderr so stdout stays plain CSV
+    fprintf(stderr, "Benchmarking '%s' (%d components)\n", grid->name, grid->component_count);
+
+    for (size_t p = 0; p < sizeof(PLANNERS) / sizeof(PLANNERS[0]); p++) {
+        for (int set = QUERY_SET_RANDOM; set <= QUERY_SET_LONG_DIAGONAL; set++) {
+            // Same queries for every planner
+            bench_rng_seed(options->seed + (uint64_t) set);
+            run_query_set(options, &PLANNERS[p], grid, (query_set) set);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_options options = {
+        .seed = DEFAULT_SEED,
+        .queries = DEFAULT_QUERIES,
+        .max_size = DEFAULT_MAX_SIZE,
+        .time_limit = DEFAULT_TIME_LIMIT,
+        .map_path = DEFAULT_MAP_PATH,
+        .output = stdout
+    };
+    const bench_option option_table[] = {
+        { "--seed", "N", BENCH_OPTION_U64, &options.seed },
+        { "--queries", "N", BENCH_OPTION_INT, &options.queries },
+        { "--max-size", "N", BENCH_OPTION_INT, &options.max_size },
+        { "--time-limit", "SECONDS", BENCH_OPTION_DOUBLE, &options.time_limit },
+        { "--map", "PATH", BENCH_OPTION_STRING, &options.map_path },
+        { "--output", "FILE", BENCH_OPTION_OUTPUT, &options.output },
+    };
+    if (bench_parse_options(argc, argv, option_table, sizeof(option_table) / sizeof(option_table[0])) != 0) {
+        return 1;
+    }
+    if (options.queries <= 0) options.queries = DEFAULT_QUERIES;
+
+    fprintf(options.output, "planner,map,width,height,query_set,queries,found,queries_per_sec,avg_nodes_expanded,avg_path_length,peak_search_bytes,p50_us,p99_us\n");
+
+    bench_grid grid;
+    if (load_map_grid(&grid, options.map_path) == 0) {
+        run_grid(&options, &grid);
+        grid_free(&grid);
+    }
+    else {
+        fprintf(stderr, "Skipping real map, run from the build's bin directory or pass --map\n");
+    }
+
+    int (*generators[])(bench_grid *, int) = { generate_open_field, generate_maze, generate_rooms };
+    for (int size = 64; size <= options.max_size; size *= 4) {
+        for (size_t g = 0; g < sizeof(generators) / sizeof(generators[0]); g++) {
+            bench_rng_seed(options.seed ^ ((uint64_t) size << 32) ^ (uint64_t) g);
+            if (generators[g](&grid, size) != 0) continue;
+            run_grid(&options, &grid);
+            grid_free(&grid);
+        }
+    }
+
+    bench_close_output(options.output);
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include "bench_common.h"
+#include "game/asset_manager.h"
+#include "game/entity_manager.h"
+#include "game/level_manager.h"
+#include "game/map.h"
+#include "game/snapshot.h"
+#include "watchdog/watchdog.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_SEED 0x5a95e7ULL
+#define DEFAULT_TICKS 120
+#define BENCH_LEVEL "dungeon"
+#define BENCH_ENTITY "simple-goblin"
+#define TICK_DT (1.0 / 60.0)
+
+typedef struct bench_options {
+    uint64_t seed;
+    int ticks;
+    size_t entities;
+    FILE *output;
+} bench_options;
+
+typedef struct bench_result {
+    size_t snapshot_bytes;
+    double write_ms, read_ms, respawn_ms;
+    double delta_bytes, delta_encode_ms, delta_apply_ms;
+    int roundtrip_matches;
+} bench_result;
+
+static int spawn_entities(const bench_options *options, entity_manager_ctx entity_mgr, level l) {
+    map m = level_get_map(l);
+    int width = 0, height = 0;
+    map_get_pixel_dimensions(m, &width, &height);
+    entity_archetype archetype = entity_manager_get_archetype(entity_mgr, BENCH_ENTITY);
+    entity_position *positions = (entity_position *) malloc(options->entities * sizeof(entity_position));
+    if (archetype == NULL || positions == NULL || width <= 0 || height <= 0) {
+        fprintf(stderr, "Failed to set up %zu '%s'\n", options->entities, BENCH_ENTITY);
+        free(positions);
+        return 1;
+    }
+
+    bench_rng_seed(options->seed);
+    for (size_t i = 0; i < options->entities; i++) {
+        // Anywhere that doesn't block sight is floor, give up on the map after a while
+        for (int attempt = 0; attempt < 64; attempt++) {
+            positions[i].x = (float) (bench_rng_next() % (uint64_t) width);
+            positions[i].y = (float) (bench_rng_next() % (uint64_t) height);
+            integer_position cell = map_get_cell_at(m, positions[i].x, positions[i].y);
+            if (!map_blocks_sight(m, cell.x, cell.y)) break;
+        }
+    }
+    size_t spawned = level_spawn_batch(l, archetype, options->entities, positions, NULL);
+    free(positions);
+    return spawned != options->entities;
+}
+
+static int same_bytes(snapshot a, snapshot b) {
+    size_t a_size = 0, b_size = 0;
+    const unsigned char *a_data = snapshot_get_data(a, &a_size), *b_data = snapshot_get_data(b, &b_size);
+    return a_size == b_size && memcmp(a_data, b_data, a_size) == 0;
+}
+
+static int run_snapshots(const bench_options *options, level l, bench_result *result) {
+    snapshot base = snapshot_create(), current = snapshot_create(), delta = snapshot_create(), rebuilt = snapshot_create();
+    int return_value = 1;
+    if (base == NULL || current == NULL || delta == NULL || rebuilt == NULL) {
+        fprintf(stderr, "Failed to allocate snapshots\n");
+        goto cleanup;
+    }
+
+    // Let everyone wander off before the first snapshot, so paths and goals are filled in
+    for (int tick = 0; tick < 60; tick++) level_update(l, TICK_DT);
+    double start = bench_now_ms();
+    if (level_write_snapshot(l, base) != 0) goto cleanup;
+    result->write_ms = bench_now_ms() - start;
+    snapshot_get_data(base, &result->snapshot_bytes);
+
+    // Every tick against the one before it, like a rollback buffer would
+    result->delta_bytes = result->delta_encode_ms = result->delta_apply_ms = 0.0;
+    result->roundtrip_matches = 1;
+    for (int tick = 0; tick < options->ticks; tick++) {
+        level_update(l, TICK_DT);
+        start = bench_now_ms();
+        if (level_write_snapshot(l, current) != 0) goto cleanup;
+        result->write_ms += bench_now_ms() - start;
+
+        start = bench_now_ms();
+        if (snapshot_encode_delta(base, current, delta) != 0) goto cleanup;
+        result->delta_encode_ms += bench_now_ms() - start;
+        start = bench_now_ms();
+        if (snapshot_apply_delta(base, delta, rebuilt) != 0) goto cleanup;
+        result->delta_apply_ms += bench_now_ms() - start;
+
+        size_t delta_size = 0;
+        snapshot_get_data(delta, &delta_size);
+        result->delta_bytes += (double) delta_size;
+        result->roundtrip_matches &= same_bytes(current, rebuilt);
+
+        snapshot swap = base;
+        base = current;
+        current = swap;
+    }
+    double ticks = (double) options->ticks;
+    result->write_ms /= ticks + 1.0;
+    result->delta_bytes /= ticks;
+    result->delta_encode_ms /= ticks;
+    result->delta_apply_ms /= ticks;
+
+    // Back to the last one with the same entities, then again after the level lost one of them
+    start = bench_now_ms();
+    if (level_read_snapshot(l, base) != 0) goto cleanup;
+    result->read_ms = bench_now_ms() - start;
+    if (level_write_snapshot(l, current) != 0) goto cleanup;
+    result->roundtrip_matches &= same_bytes(base, current);
+
+    level_update(l, TICK_DT);
+    entity player = level_get_player_entity(l), nearest[2] = { NULL, NULL };
+    entity_position player_position = entity_get_position(player);
+    level_find_nearest_entities(l, player_position.x, player_position.y, 2, 1e9f, nearest);
+    level_despawn(l, nearest[0] != player ? nearest[0] : nearest[1]);
+    start = bench_now_ms();
+    if (level_read_snapshot(l, base) != 0) goto cleanup;
+    result->respawn_ms = bench_now_ms() - start;
+    if (level_write_snapshot(l, current) != 0) goto cleanup;
+    result->roundtrip_matches &= same_bytes(base, current);
+    return_value = 0;
+
+cleanup:
+    snapshot_destroy(base);
+    snapshot_destroy(current);
+    snapshot_destroy(delta);
+    snapshot_destroy(rebuilt);
+    return return_value;
+}
+
+static int run_population(const bench_options *options, bench_result *result) {
+    asset_manager_ctx asset_mgr = asset_manager_init();
+    entity_manager_ctx entity_mgr = asset_mgr != NULL ? entity_manager_init(asset_mgr) : NULL;
+    level_manager_ctx level_mgr = entity_mgr != NULL ? level_manager_init(asset_mgr, entity_mgr) : NULL;
+    int return_value = 1;
+
+    if (level_mgr == NULL) {
+        fprintf(stderr, "Failed to set up the game\n");
+        goto cleanup;
+    }
+    asset_manager_set_headless(asset_mgr, 1);
+    level l = level_manager_load_level(level_mgr, BENCH_LEVEL);
+    if (l == NULL) {
+        fprintf(stderr, "Failed to load level '%s', run from the repository root\n", BENCH_LEVEL);
+        goto cleanup;
+    }
+    if (spawn_entities(options, entity_mgr, l) != 0) goto cleanup;
+    return_value = run_snapshots(options, l, result);
+
+cleanup:
+    level_manager_cleanup(level_mgr);
+    entity_manager_cleanup(entity_mgr);
+    asset_manager_cleanup(asset_mgr);
+    return return_value;
+}
+
+int main(int argc, char **argv) {
+    bench_options options = {
+        .seed = DEFAULT_SEED,
+        .ticks = DEFAULT_TICKS,
+        .entities = 0,
+        .output = stdout
+    };
+    const bench_option option_table[] = {
+        { "--seed", "N", BENCH_OPTION_U64, &options.seed },
+        { "--ticks", "N", BENCH_OPTION_INT, &options.ticks },
+        { "--entities", "N", BENCH_OPTION_SIZE, &options.entities },
+        { "--output", "FILE", BENCH_OPTION_OUTPUT, &options.output },
+    };
+    if (bench_parse_options(argc, argv, option_table, sizeof(option_table) / sizeof(option_table[0])) != 0) {
+        return 1;
+    }
+    if (options.ticks <= 0) options.ticks = DEFAULT_TICKS;
+    watchdog_init();
+
+    fprintf(options.output, "entities,snapshot_bytes,write_ms,read_ms,respawn_ms,delta_bytes,delta_encode_ms,delta_apply_ms,roundtrip_matches\n");
+    const size_t populations[] = { 1000, 10000 };
+    size_t population_count = sizeof(populations) / sizeof(populations[0]);
+    int result = 0;
+    for (size_t i = 0; i < population_count && result == 0; i++) {
+        bench_options run = options;
+        run.entities = options.entities > 0 ? options.entities : populations[i];
+        fprintf(stderr, "Benchmarking snapshots of %zu entities\n", run.entities);
+        bench_result r = { 0 };
+        result = run_population(&run, &r);
+        if (result != 0) break;
+        fprintf(
+            options.output,
+            "%zu,%zu,%.3f,%.3f,%.3f,%.0f,%.3f,%.3f,%s\n",
+            run.entities,
+            r.snapshot_bytes,
+            r.write_ms,
+            r.read_ms,
+            r.respawn_ms,
+            r.delta_bytes,
+            r.delta_encode_ms,
+            r.delta_apply_ms,
+            r.roundtrip_matches ? "yes" : "no"
+        );
+        fflush(options.output);
+        if (!r.roundtrip_matches) result = 1;
+        if (options.entities > 0) break;
+    }
+
+    bench_close_output(options.output);
+    return result;
+}
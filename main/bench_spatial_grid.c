@@ -0,0 +1,212 @@
+#include "bench_common.h"
+#include "data_structures/spatial_grid.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_SEED 0x5ba71a1ULL
+#define DEFAULT_QUERIES 20000
+#define DEFAULT_TICKS 20
+#define CELL_SIZE 64.0f
+#define BUCKETS 65536
+// Entities per 64x64 pixel area, about one per 4x4 tiles like a busy level
+#define DENSITY 1.0f
+#define QUERY_RADIUS 128.0f
+#define NEAREST_K 8
+
+typedef struct bench_options {
+    uint64_t seed;
+    int queries;
+    int ticks;
+    FILE *output;
+} bench_options;
+
+typedef struct bench_entity {
+    float x, y;
+    spatial_grid_handle handle;
+} bench_entity;
+
+typedef struct query_point {
+    float x, y;
+} query_point;
+
+static iteration_result count_match(void *value, float x, float y, void *args) {
+    (void) value;
+    (void) x;
+    (void) y;
+    (*(size_t *) args)++;
+    return ITERATION_CONTINUE;
+}
+
+// What every caller had to do before the grid existed
+static size_t linear_radius(const bench_entity *entities, size_t count, float x, float y, float radius) {
+    size_t matched = 0;
+    for (size_t i = 0; i < count; i++) {
+        float dx = entities[i].x - x, dy = entities[i].y - y;
+        matched += dx * dx + dy * dy <= radius * radius;
+    }
+    return matched;
+}
+
+static size_t linear_nearest(const bench_entity *entities, size_t count, float x, float y, size_t k, float *distances) {
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        float dx = entities[i].x - x, dy = entities[i].y - y;
+        float d = dx * dx + dy * dy;
+        if (found == k && d >= distances[k - 1]) continue;
+        size_t j = found < k ? found++ : found - 1;
+        while (j > 0 && distances[j - 1] > d) {
+            distances[j] = distances[j - 1];
+            j--;
+        }
+        distances[j] = d;
+    }
+    return found;
+}
+
+static void report(const bench_options *options, size_t entities, const char *operation, size_t operations, double elapsed, double results, double baseline_elapsed) {
+    fprintf(
+        options->output,
+        "%zu,%s,%zu,%.0f,%.2f,%.1f\n",
+        entities,
+        operation,
+        operations,
+        elapsed > 0.0 ? (double) operations / elapsed : 0.0,
+        operations > 0 ? results / (double) operations : 0.0,
+        baseline_elapsed > 0.0 && elapsed > 0.0 ? baseline_elapsed / elapsed : 0.0
+    );
+    fflush(options->output);
+}
+
+static int run_population(const bench_options *options, size_t count) {
+    float world_size = CELL_SIZE;
+    while (world_size * world_size * DENSITY < (float) count * CELL_SIZE * CELL_SIZE) world_size += CELL_SIZE;
+    fprintf(stderr, "Benchmarking %zu entities in a %.0fx%.0f world\n", count, world_size, world_size);
+
+    bench_entity *entities = (bench_entity *) malloc(count * sizeof(bench_entity));
+    query_point *points = (query_point *) malloc((size_t) options->queries * sizeof(query_point));
+    void **nearest = (void **) malloc(NEAREST_K * sizeof(void *));
+    float *distances = (float *) malloc(NEAREST_K * sizeof(float));
+    spatial_grid grid = spatial_grid_create(CELL_SIZE, BUCKETS);
+    if (entities == NULL || points == NULL || nearest == NULL || distances == NULL || grid == NULL) {
+        fprintf(stderr, "Failed to allocate %zu entities\n", count);
+        free(entities);
+        free(points);
+        free(nearest);
+        free(distances);
+        spatial_grid_destroy(grid);
+        return 1;
+    }
+
+    bench_rng_seed(options->seed ^ (uint64_t) count);
+    for (size_t i = 0; i < count; i++) {
+        entities[i].x = bench_rng_float(world_size);
+        entities[i].y = bench_rng_float(world_size);
+    }
+    for (int i = 0; i < options->queries; i++) {
+        points[i].x = bench_rng_float(world_size);
+        points[i].y = bench_rng_float(world_size);
+    }
+
+    double start = bench_now_seconds();
+    for (size_t i = 0; i < count; i++) {
+        entities[i].handle = spatial_grid_insert(grid, &entities[i], entities[i].x, entities[i].y);
+    }
+    report(options, count, "insert", count, bench_now_seconds() - start, (double) count, 0.0);
+
+    // Everyone wanders a couple of pixels per tick, most of them stay in their cell
+    start = bench_now_seconds();
+    for (int tick = 0; tick < options->ticks; tick++) {
+        for (size_t i = 0; i < count; i++) {
+            entities[i].x += bench_rng_float(4.0f) - 2.0f;
+            entities[i].y += bench_rng_float(4.0f) - 2.0f;
+            spatial_grid_move(grid, entities[i].handle, entities[i].x, entities[i].y);
+        }
+    }
+    report(options, count, "move", count * (size_t) options->ticks, bench_now_seconds() - start, (double) count * options->ticks, 0.0);
+
+    size_t linear_queries = (size_t) options->queries / (count >= 100000 ? 100 : 10);
+    if (linear_queries == 0) linear_queries = 1;
+    size_t matched = 0;
+    start = bench_now_seconds();
+    for (size_t i = 0; i < linear_queries; i++) {
+        matched += linear_radius(entities, count, points[i].x, points[i].y, QUERY_RADIUS);
+    }
+    double linear_elapsed = (bench_now_seconds() - start) / (double) linear_queries;
+    report(options, count, "radius_linear", linear_queries, linear_elapsed * (double) linear_queries, (double) matched, 0.0);
+
+    matched = 0;
+    start = bench_now_seconds();
+    for (int i = 0; i < options->queries; i++) {
+        spatial_grid_query_radius(grid, points[i].x, points[i].y, QUERY_RADIUS, count_match, &matched);
+    }
+    double elapsed = bench_now_seconds() - start;
+    report(options, count, "radius", (size_t) options->queries, elapsed, (double) matched, linear_elapsed * options->queries);
+
+    matched = 0;
+    start = bench_now_seconds();
+    for (int i = 0; i < options->queries; i++) {
+        spatial_grid_query_rect(grid, points[i].x, points[i].y, 2.0f * QUERY_RADIUS, QUERY_RADIUS, count_match, &matched);
+    }
+    report(options, count, "rect", (size_t) options->queries, bench_now_seconds() - start, (double) matched, 0.0);
+
+    size_t found = 0;
+    start = bench_now_seconds();
+    for (size_t i = 0; i < linear_queries; i++) {
+        found += linear_nearest(entities, count, points[i].x, points[i].y, NEAREST_K, distances);
+    }
+    linear_elapsed = (bench_now_seconds() - start) / (double) linear_queries;
+    report(options, count, "nearest_linear", linear_queries, linear_elapsed * (double) linear_queries, (double) found, 0.0);
+
+    found = 0;
+    start = bench_now_seconds();
+    for (int i = 0; i < options->queries; i++) {
+        found += spatial_grid_query_nearest(grid, points[i].x, points[i].y, NEAREST_K, 1e30f, nearest, distances);
+    }
+    elapsed = bench_now_seconds() - start;
+    report(options, count, "nearest", (size_t) options->queries, elapsed, (double) found, linear_elapsed * options->queries);
+
+    start = bench_now_seconds();
+    for (size_t i = 0; i < count; i++) {
+        spatial_grid_remove(grid, entities[i].handle);
+    }
+    report(options, count, "remove", count, bench_now_seconds() - start, (double) count, 0.0);
+
+    free(entities);
+    free(points);
+    free(nearest);
+    free(distances);
+    spatial_grid_destroy(grid);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    bench_options options = {
+        .seed = DEFAULT_SEED,
+        .queries = DEFAULT_QUERIES,
+        .ticks = DEFAULT_TICKS,
+        .output = stdout
+    };
+    const bench_option option_table[] = {
+        { "--seed", "N", BENCH_OPTION_U64, &options.seed },
+        { "--queries", "N", BENCH_OPTION_INT, &options.queries },
+        { "--ticks", "N", BENCH_OPTION_INT, &options.ticks },
+        { "--output", "FILE", BENCH_OPTION_OUTPUT, &options.output },
+    };
+    if (bench_parse_options(argc, argv, option_table, sizeof(option_table) / sizeof(option_table[0])) != 0) {
+        return 1;
+    }
+    if (options.queries <= 0) options.queries = DEFAULT_QUERIES;
+    if (options.ticks <= 0) options.ticks = DEFAULT_TICKS;
+
+    fprintf(options.output, "entities,operation,operations,ops_per_sec,avg_results,speedup_vs_linear\n");
+    const size_t populations[] = { 10000, 100000 };
+    int result = 0;
+    for (size_t i = 0; i < sizeof(populations) / sizeof(populations[0]); i++) {
+        result |= run_population(&options, populations[i]);
+    }
+
+    bench_close_output(options.output);
+    return result;
+}
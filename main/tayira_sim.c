@@ -0,0 +1,272 @@
+#include "bench_common.h"
+#include "game/config.h"
+#include "game/game.h"
+#include "game/entity_manager.h"
+#include "game/level_manager.h"
+#include "game/map.h"
+#include "cjson/cJSON.h"
+#include "utils/utils.h"
+#include "watchdog/watchdog.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__unix__)
+#include <sys/resource.h>
+#endif
+
+#define DEFAULT_SEED 0x51a71a5ULL
+#define DEFAULT_TICKS 600
+#define DEFAULT_DT (1.0 / 60.0)
+
+// What to simulate, read from a scenario file
+typedef struct sim_scenario {
+    char *level_id;
+    char *entity_id;
+    size_t entities;
+    uint64_t seed;
+    int ticks;
+    double dt;
+    int has_player_position;
+    entity_position player_position;
+} sim_scenario;
+
+typedef struct sim_options {
+    const char *scenario_path;
+    // Override the scenario's when set
+    uint64_t seed;
+    int ticks;
+    FILE *output;
+} sim_options;
+
+// Sums over every tick, in ms
+typedef struct sim_totals {
+    double tick_ms, max_tick_ms;
+    double entities_ms, think_ms, collision_ms;
+    double streaming_ms, fov_ms, pathfinding_ms;
+    size_t thinking;
+} sim_totals;
+
+static char *copy_string_field(cJSON *json, const char *key) {
+    cJSON *field = cJSON_GetObjectItemCaseSensitive(json, key);
+    return cJSON_IsString(field) ? utils_copy_string(field->valuestring) : NULL;
+}
+
+static double number_field(cJSON *json, const char *key, double fallback) {
+    cJSON *field = cJSON_GetObjectItemCaseSensitive(json, key);
+    return cJSON_IsNumber(field) ? field->valuedouble : fallback;
+}
+
+// { "level": "dungeon", "entity": "simple-goblin", "entities": 2000, "seed": 1234, "ticks": 600, "dt": 0.0167, "player": [208, 144] },
+// only level and entity are required
+static int load_scenario(const char *path, sim_scenario *scenario) {
+    cJSON *json = utils_read_base_config(path);
+    if (json == NULL) {
+        return 1;
+    }
+
+    scenario->level_id = copy_string_field(json, "level");
+    scenario->entity_id = copy_string_field(json, "entity");
+    scenario->entities = (size_t) number_field(json, "entities", 0.0);
+    scenario->seed = (uint64_t) number_field(json, "seed", (double) DEFAULT_SEED);
+    scenario->ticks = (int) number_field(json, "ticks", DEFAULT_TICKS);
+    scenario->dt = number_field(json, "dt", DEFAULT_DT);
+
+    cJSON *player = cJSON_GetObjectItemCaseSensitive(json, "player");
+    if (cJSON_IsArray(player) && cJSON_GetArraySize(player) == 2) {
+        scenario->has_player_position = 1;
+        scenario->player_position.x = (float) cJSON_GetNumberValue(cJSON_GetArrayItem(player, 0));
+        scenario->player_position.y = (float) cJSON_GetNumberValue(cJSON_GetArrayItem(player, 1));
+    }
+    cJSON_Delete(json);
+
+    if (scenario->level_id == NULL || scenario->entity_id == NULL) {
+        fprintf(stderr, "Scenario '%s' needs a \"level\" and an \"entity\"\n", path);
+        return 1;
+    }
+    if (scenario->ticks <= 0 || scenario->dt <= 0.0) {
+        fprintf(stderr, "Scenario '%s' needs positive \"ticks\" and \"dt\"\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+static void free_scenario(sim_scenario *scenario) {
+    free(scenario->level_id);
+    free(scenario->entity_id);
+}
+
+// Drops the entities on random cells nothing collides with, in one batch
+static int spawn_entities(const sim_scenario *scenario, game_ctx game) {
+    if (scenario->entities == 0) return 0;
+    level l = game_get_level(game);
+    int width = 0, height = 0, tile_width = 0, tile_height = 0;
+    const int *cells = map_get_collision_grid(level_get_map(l), &width, &height);
+    map_get_tile_dimensions(level_get_map(l), &tile_width, &tile_height);
+    if (cells == NULL || width <= 0 || height <= 0) {
+        fprintf(stderr, "Level '%s' has no collision layer to spawn on\n", scenario->level_id);
+        return 1;
+    }
+
+    entity_archetype archetype = entity_manager_get_archetype(game_get_entity_manager(game), scenario->entity_id);
+    entity_position *positions = (entity_position *) malloc(scenario->entities * sizeof(entity_position));
+    if (archetype == NULL || positions == NULL) {
+        fprintf(stderr, "Failed to spawn %zu '%s'\n", scenario->entities, scenario->entity_id);
+        free(positions);
+        return 1;
+    }
+
+    bench_rng_seed(scenario->seed);
+    for (size_t i = 0; i < scenario->entities; i++) {
+        // Give up on finding floor after a while, the collision step walks them out of walls
+        int x = 0, y = 0;
+        for (int attempt = 0; attempt < 64; attempt++) {
+            x = (int) (bench_rng_next() % (uint64_t) width);
+            y = (int) (bench_rng_next() % (uint64_t) height);
+            if (cells[x + y * width] == 0) break;
+        }
+        // Positions are bottom left corners
+        positions[i].x = (float) (x * tile_width);
+        positions[i].y = (float) ((y + 1) * tile_height) - 1.0f;
+    }
+    size_t spawned = level_spawn_batch(l, archetype, scenario->entities, positions, NULL);
+    free(positions);
+    if (spawned != scenario->entities) {
+        fprintf(stderr, "Only spawned %zu of %zu '%s'\n", spawned, scenario->entities, scenario->entity_id);
+        return 1;
+    }
+    return 0;
+}
+
+static void add_tick(sim_totals *totals, level l, double tick_ms) {
+    level_update_statistics update = level_get_update_stats(l);
+    ai_scheduler_statistics ai = ai_scheduler_get_stats(level_get_ai_scheduler(l));
+    collision_statistics collisions = collision_world_get_stats(level_get_collisions(l));
+
+    totals->tick_ms += tick_ms;
+    if (tick_ms > totals->max_tick_ms) totals->max_tick_ms = tick_ms;
+    totals->entities_ms += update.entities_ms;
+    for (int bucket = 0; bucket < AI_LOD_BUCKET_COUNT; bucket++) {
+        totals->think_ms += ai.bucket_ms[bucket];
+    }
+    totals->collision_ms += collisions.last_step_ms;
+    totals->streaming_ms += update.streaming_ms;
+    totals->fov_ms += update.fov_ms;
+    totals->pathfinding_ms += update.pathfinding_ms;
+    totals->thinking += ai.updated_last_tick;
+}
+
+static size_t peak_resident_kb(void) {
+#if defined(__unix__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) return (size_t) usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+static void report(const sim_options *options, const sim_scenario *scenario, game_ctx game, const sim_totals *totals, double seconds) {
+    level l = game_get_level(game);
+    double ticks = (double) scenario->ticks;
+    size_t level_bytes = level_get_memory_usage(l);
+    size_t map_bytes = map_get_memory_usage(level_get_map(l));
+    ai_scheduler_statistics ai = ai_scheduler_get_stats(level_get_ai_scheduler(l));
+    // Waits are only ranked so far, past that the schedule stops being fair
+    if (ai.max_wait >= AI_MAX_RANKED_WAIT - 1) {
+        fprintf(stderr, "Entities waited %u ticks to think, the budget can't keep up with them\n", (unsigned int) ai.max_wait);
+    }
+
+    fprintf(options->output, "scenario,level,entities,ticks,seconds,ticks_per_sec,ms_per_tick,max_tick_ms,entities_ms,think_ms,collision_ms,streaming_ms,fov_ms,pathfinding_ms,player_ms,thinking_per_tick,max_think_wait,level_bytes,map_bytes,peak_rss_kb\n");
+    fprintf(
+        options->output,
+        "%s,%s,%zu,%d,%.3f,%.1f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f,%u,%zu,%zu,%zu\n",
+        options->scenario_path,
+        scenario->level_id,
+        scenario->entities,
+        scenario->ticks,
+        seconds,
+        seconds > 0.0 ? ticks / seconds : 0.0,
+        totals->tick_ms / ticks,
+        totals->max_tick_ms,
+        totals->entities_ms / ticks,
+        totals->think_ms / ticks,
+        totals->collision_ms / ticks,
+        totals->streaming_ms / ticks,
+        totals->fov_ms / ticks,
+        totals->pathfinding_ms / ticks,
+        // game_step's own work on top of level_update, moving the player
+        (totals->tick_ms - totals->entities_ms - totals->streaming_ms - totals->fov_ms - totals->pathfinding_ms) / ticks,
+        (double) totals->thinking / ticks,
+        (unsigned int) ai.max_wait,
+        level_bytes - map_bytes,
+        map_bytes,
+        peak_resident_kb()
+    );
+    fflush(options->output);
+}
+
+static int run_scenario(const sim_options *options, sim_scenario *scenario) {
+    if (options->seed != 0) scenario->seed = options->seed;
+    if (options->ticks > 0) scenario->ticks = options->ticks;
+    // The rules roll dice with rand()
+    srand((unsigned int) scenario->seed);
+
+    game_ctx game = game_context_init_headless(scenario->level_id);
+    if (game == NULL) {
+        fprintf(stderr, "Failed to load level '%s', run from the repository root\n", scenario->level_id);
+        return 1;
+    }
+    int result = 1;
+    if (scenario->has_player_position) {
+        entity_set_position(level_get_player_entity(game_get_level(game)), scenario->player_position.x, scenario->player_position.y);
+    }
+    if (spawn_entities(scenario, game) != 0) goto cleanup;
+
+    fprintf(stderr, "Simulating %zu '%s' in '%s' for %d ticks\n", scenario->entities, scenario->entity_id, scenario->level_id, scenario->ticks);
+    sim_totals totals = { 0 };
+    double start = utils_get_time();
+    for (int tick = 0; tick < scenario->ticks; tick++) {
+        double tick_start = utils_get_time();
+        game_step(game, scenario->dt, (double) tick * scenario->dt);
+        add_tick(&totals, game_get_level(game), (utils_get_time() - tick_start) * 1000.0);
+    }
+    report(options, scenario, game, &totals, utils_get_time() - start);
+    result = 0;
+
+cleanup:
+    game_context_cleanup(game);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    sim_options options = {
+        .scenario_path = NULL,
+        .seed = 0,
+        .ticks = 0,
+        .output = stdout
+    };
+    const bench_option option_table[] = {
+        { NULL, "SCENARIO", BENCH_OPTION_STRING, &options.scenario_path },
+        { "--seed", "N", BENCH_OPTION_U64, &options.seed },
+        { "--ticks", "N", BENCH_OPTION_INT, &options.ticks },
+        { "--output", "FILE", BENCH_OPTION_OUTPUT, &options.output },
+    };
+    size_t option_count = sizeof(option_table) / sizeof(option_table[0]);
+    if (bench_parse_options(argc, argv, option_table, option_count) != 0) {
+        return 1;
+    }
+    if (options.scenario_path == NULL) {
+        bench_print_usage(argv[0], option_table, option_count);
+        return 1;
+    }
+    watchdog_init();
+
+    sim_scenario scenario = { 0 };
+    int result = load_scenario(options.scenario_path, &scenario);
+    if (result == 0) {
+        result = run_scenario(&options, &scenario);
+    }
+    free_scenario(&scenario);
+
+    bench_close_output(options.output);
+    watchdog_cleanup();
+    return result;
+}
@@ -0,0 +1,149 @@
+#!/usr/bin/python3
+import argparse
+import json
+import os
+import struct
+
+# Keep in sync with src/game/map_format.h
+MAGIC = b"TMAP"
+VERSION = 2
+HEADER_FORMAT = "<4sHHiiiiiIIIII"
+ASSET_FORMAT = "<Iii"
+LAYER_FORMAT = "<IiBBHII"
+ANIMATION_FORMAT = "<iiii"
+
+FLAG_COLLISIONS = 1 << 0
+FLAG_VISION = 1 << 1
+FLAG_ENTITIES = 1 << 2
+FLAG_TRANSPARENT = 1 << 3
+FLAG_TERRAIN = 1 << 4
+
+ENCODING_RAW = 0
+ENCODING_RLE = 1
+
+
+def flatten(layer_map, width, height):
+    cells = [0] * (width * height)
+    for y, row in enumerate(layer_map[:height]):
+        for x, value in enumerate(row[:width]):
+            if value < 0 or value > 0xFFFF:
+                raise ValueError(f"tile id {value} does not fit in 16 bits")
+            cells[x + y * width] = value
+    return cells
+
+def encode_raw(cells):
+    return struct.pack(f"<{len(cells)}H", *cells)
+
+def encode_rle(cells):
+    runs = bytearray()
+    i = 0
+    while i < len(cells):
+        value = cells[i]
+        count = 1
+        while i + count < len(cells) and cells[i + count] == value and count < 0xFFFF:
+            count += 1
+        runs += struct.pack("<HH", count, value)
+        i += count
+    return bytes(runs)
+
+def encode_layer(cells, compression):
+    raw = encode_raw(cells)
+    if compression == "none":
+        return ENCODING_RAW, raw
+    rle = encode_rle(cells)
+    if compression == "rle" or len(rle) < len(raw):
+        return ENCODING_RLE, rle
+    return ENCODING_RAW, raw
+
+def layer_flags(layer_info):
+    flags = 0
+    if layer_info["collisions"]:
+        flags |= FLAG_COLLISIONS
+    if layer_info["vision"]:
+        flags |= FLAG_VISION
+    if layer_info["entities"]:
+        flags |= FLAG_ENTITIES
+    if layer_info["transparent"]:
+        flags |= FLAG_TRANSPARENT
+    if layer_info.get("terrain", False):
+        flags |= FLAG_TERRAIN
+    return flags
+
+def main(args):
+    with open(args.config, "r") as f:
+        config = json.load(f)
+
+    if config.get("streaming", False):
+        print("Streamed maps keep their layers in chunk files and can't be compiled")
+        return 1
+
+    if args.output is None:
+        args.output = args.config.replace(".map-config.json", "") + ".map.bin"
+
+    width, height = config["width"], config["height"]
+
+    strings = bytearray()
+    string_offsets = {}
+    def add_string(string):
+        if string not in string_offsets:
+            string_offsets[string] = len(strings)
+            strings.extend(string.encode("utf-8") + b"\0")
+        return string_offsets[string]
+
+    assets = [(add_string(name), info["min_id"], info["max_id"]) for name, info in config["assets"].items()]
+    animations = [
+        (animation["base_id"], animation["frames"], animation.get("stride", 1), animation["interval"])
+        for animation in config.get("animated_tiles", [])
+    ]
+
+    layers = []
+    for name, layer_info in config["layers"].items():
+        cells = flatten(layer_info["map"], width, height)
+        encoding, data = encode_layer(cells, args.compression)
+        layers.append((add_string(name), layer_info["layer"], layer_flags(layer_info), encoding, data))
+        print(f"{name}: {len(data)} bytes ({'rle' if encoding == ENCODING_RLE else 'raw'})")
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    tables_size = (
+        len(assets) * struct.calcsize(ASSET_FORMAT)
+        + len(layers) * struct.calcsize(LAYER_FORMAT)
+        + len(animations) * struct.calcsize(ANIMATION_FORMAT)
+    )
+    strings_offset = header_size + tables_size
+    data_offset = strings_offset + len(strings)
+    # Keep the tile arrays 2-byte aligned for whoever maps the file
+    data_offset += data_offset % 2
+
+    header = struct.pack(
+        HEADER_FORMAT, MAGIC, VERSION, 0,
+        width, height, config["tilewidth"], config["tileheight"], config.get("player_layer", -1),
+        len(assets), len(layers), strings_offset, len(strings), len(animations)
+    )
+    tables = b"".join(struct.pack(ASSET_FORMAT, *asset) for asset in assets)
+    blobs = bytearray()
+    for name_offset, layer, flags, encoding, data in layers:
+        tables += struct.pack(LAYER_FORMAT, name_offset, layer, flags, encoding, 0, data_offset + len(blobs), len(data))
+        blobs += data
+        blobs += b"\0" * (len(blobs) % 2)
+    tables += b"".join(struct.pack(ANIMATION_FORMAT, *animation) for animation in animations)
+
+    contents = header + tables + bytes(strings)
+    contents += b"\0" * (data_offset - len(contents))
+    contents += bytes(blobs)
+    with open(args.output, "wb") as f:
+        f.write(contents)
+
+    source_size = os.path.getsize(args.config)
+    print(f"Wrote {args.output}: {len(contents)} bytes ({source_size / len(contents):.1f}x smaller than the config)")
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compile map configs into the binary format loaded by the game")
+
+    parser.add_argument("config", help="the .map-config.json file to compile")
+    parser.add_argument("--output", "-o", help="path of the compiled map, defaults to next to the config")
+    parser.add_argument("--compression", "-c", choices=["auto", "none", "rle"], default="auto", help="how to encode layer data, auto picks whatever is smaller per layer")
+
+    args = parser.parse_args()
+    raise SystemExit(main(args))
@@ -28,6 +28,55 @@ def get_custom_property(obj, property_name):
 def tileset_has_tile(tileset, tile_id):
     return tile_id >= tileset["firstgid"] and tile_id < tileset["firstgid"] + tileset["tilecount"]
 
+def get_terrain_cost(tilesets, tile_id):
+    # The n-th tile (0-based) of whatever tileset is painted on a terrain layer costs n+1
+    if tile_id == 0:
+        return 0
+    for tileset in tilesets:
+        if tileset_has_tile(tileset, tile_id):
+            return tile_id - tileset["firstgid"] + 1
+    return 0
+
+def get_tile_animations(tilesets):
+    # The game only plays animations whose frames start at the animated tile and are evenly spaced
+    animations = []
+    for tileset in tilesets:
+        for tile in tileset.get("tiles", []):
+            frames = tile.get("animation")
+            if not frames:
+                continue
+            base_id = tileset["firstgid"] + tile["id"]
+            frame_ids = [frame["tileid"] for frame in frames]
+            stride = frame_ids[1] - frame_ids[0] if len(frame_ids) > 1 else 1
+            durations = {frame["duration"] for frame in frames}
+            if frame_ids[0] != tile["id"] or stride <= 0 or len(durations) != 1 \
+                    or any(frame_ids[i] != frame_ids[0] + i * stride for i in range(len(frame_ids))):
+                print(f"Skipping animation of tile {base_id}: frames must be evenly spaced and equally long")
+                continue
+            animations.append({
+                "base_id": base_id,
+                "frames": len(frame_ids),
+                "stride": stride,
+                "interval": durations.pop()
+            })
+    return animations
+
+def write_chunks(chunks_directory, layers, width, height, chunk_size):
+    # One file per chunk holding the chunk-local rows of every layer that has something in it
+    os.makedirs(chunks_directory, exist_ok=True)
+    for chunk_row in range((height + chunk_size - 1) // chunk_size):
+        for chunk_col in range((width + chunk_size - 1) // chunk_size):
+            chunk_layers = {}
+            for name, layer_info in layers.items():
+                rows = [
+                    row[chunk_col * chunk_size:(chunk_col + 1) * chunk_size]
+                    for row in layer_info["map"][chunk_row * chunk_size:(chunk_row + 1) * chunk_size]
+                ]
+                if any(any(row) for row in rows):
+                    chunk_layers[name] = rows
+            with open(os.path.join(chunks_directory, f"{chunk_col}_{chunk_row}.json"), "w") as f:
+                json.dump({"layers": chunk_layers}, f)
+
 def main(args):
     if args.name == None:
         args.name = os.path.basename(args.map).replace(" ", "_").lower()
@@ -46,9 +95,12 @@ def main(args):
         transparent = get_custom_property(layer, "transparent") is True
         is_collisions = get_custom_property(layer, "collisions") is True
         is_vision = get_custom_property(layer, "vision") is True
+        is_terrain = get_custom_property(layer, "terrain") is True
         is_binary = is_vision or is_collisions
         layer_map = get_layer_map(layer, is_binary)
-        if not is_binary:
+        if is_terrain:
+            layer_map = [[get_terrain_cost(map_contents["tilesets"], t) for t in row] for row in layer_map]
+        elif not is_binary:
             for row in layer_map:
                 used_ids.update(row)
         
@@ -60,6 +112,8 @@ def main(args):
             "entities": get_custom_property(layer, "objects") is True,
             "transparent": transparent
         }
+        if is_terrain:
+            layer_info["terrain"] = True
         layers[layer["name"]] = layer_info
 
     for tileset in map_contents["tilesets"]:
@@ -82,6 +136,17 @@ def main(args):
     }
     if player_layer is not None:
         map_info["player_layer"] = player_layer
+    animated_tiles = get_tile_animations(map_contents["tilesets"])
+    if animated_tiles:
+        map_info["animated_tiles"] = animated_tiles
+
+    if args.streaming:
+        chunks_directory = os.path.join("..", relative_path, args.name + ".chunks")
+        write_chunks(chunks_directory, layers, map_contents["width"], map_contents["height"], args.chunk_size)
+        for layer_info in layers.values():
+            del layer_info["map"]
+        map_info["streaming"] = True
+        map_info["chunk_size"] = args.chunk_size
     
     with open(os.path.join("..", relative_path, args.name + ".map-config.json"), "w") as f:
         json.dump(map_info, f)
@@ -96,6 +161,8 @@ if __name__ == "__main__":
     parser.add_argument("output_directory", help="path to a directory to place the converted files")
     parser.add_argument("--config", "-c", help="path to the base asset configuration file")
     parser.add_argument("--name", "-n", help="name of the map")
+    parser.add_argument("--streaming", "-s", action="store_true", help="split the layers into chunk files loaded on demand")
+    parser.add_argument("--chunk-size", type=int, default=32, help="tiles per chunk side, must match MAP_CHUNK_SIZE")
     
     args = parser.parse_args()    
     raise SystemExit(main(args))
@@ -11,7 +11,7 @@ struct linked_list_s {
     size_t size, element_size;
     free_function free_element;
     copy_function copy_element;
-    struct linked_list_element_s *head;
+    struct linked_list_element_s *head, *tail;
 };
 
 struct f_cb_s {
@@ -35,6 +35,7 @@ linked_list linked_list_create(size_t element_size, free_function free_element,
     ll->free_element = free_element == NULL ? default_free_impl : free_element;
     ll->copy_element = copy_element == NULL ? default_copy_impl : copy_element;
     ll->head = NULL;
+    ll->tail = NULL;
     ll->size = 0;
     return ll;
 }
@@ -63,6 +64,7 @@ int linked_list_pushfront(linked_list ll, const void *element) {
 
     if (ll->head == NULL) {
         ll->head = new_element;
+        ll->tail = new_element;
         new_element->next = NULL;
     }
     else {
@@ -73,6 +75,26 @@ int linked_list_pushfront(linked_list ll, const void *element) {
     return 0;
 }
 
+int linked_list_pushback(linked_list ll, const void *element) {
+    struct linked_list_element_s *new_element = (struct linked_list_element_s *) malloc(sizeof(struct linked_list_element_s));
+    if (new_element == NULL) {
+        return 1;
+    }
+
+    new_element->value = ll->copy_element(element, ll->element_size);
+    new_element->next = NULL;
+
+    if (ll->tail == NULL) {
+        ll->head = new_element;
+    }
+    else {
+        ll->tail->next = new_element;
+    }
+    ll->tail = new_element;
+    ll->size++;
+    return 0;
+}
+
 void *linked_list_popfront(linked_list ll) {
     if (ll->head == NULL) {
         return NULL;
@@ -81,10 +103,32 @@ void *linked_list_popfront(linked_list ll) {
     void *result = ll->head->value;
     struct linked_list_element_s *prev_head = ll->head;
     ll->head = ll->head->next;
+    if (ll->head == NULL) {
+        ll->tail = NULL;
+    }
     free(prev_head);
     return result;
 }
 
+void linked_list_rotate(linked_list ll, size_t count) {
+    if (ll->size == 0) {
+        return;
+    }
+    count %= ll->size;
+    if (count == 0) {
+        return;
+    }
+
+    struct linked_list_element_s *new_tail = ll->head;
+    for (size_t i = 1; i < count; i++) {
+        new_tail = new_tail->next;
+    }
+    ll->tail->next = ll->head;
+    ll->head = new_tail->next;
+    ll->tail = new_tail;
+    new_tail->next = NULL;
+}
+
 void linked_list_remove_if(linked_list ll, predicate_function f, void *args) {
     if (ll->head == NULL) {
         return;
@@ -100,7 +144,11 @@ void linked_list_remove_if(linked_list ll, predicate_function f, void *args) {
                 prev->next = cur->next;
             }
             struct linked_list_element_s *tmp = cur->next;
+            if (tmp == NULL) {
+                ll->tail = prev;
+            }
             free(cur);
+            ll->size--;
             cur = tmp;
         }
         else {
@@ -16,7 +16,10 @@ linked_list linked_list_create_borrowed();
 linked_list linked_list_create_trivial(size_t element_size, copy_function copy_element);
 
 int linked_list_pushfront(linked_list, const void *element);
+int linked_list_pushback(linked_list, const void *element);
 void *linked_list_popfront(linked_list);
+// Moves the first count elements to the back, keeping their order
+void linked_list_rotate(linked_list, size_t count);
 void linked_list_remove_if(linked_list, predicate_function, void *args);
 size_t linked_list_foreach(linked_list, iteration_result (*callback) (void* value));
 size_t linked_list_foreach_args(linked_list, iteration_result (*callback) (void* value, void* args), void* args);
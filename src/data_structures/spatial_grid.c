@@ -0,0 +1,297 @@
+#include "spatial_grid.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct spatial_grid_item {
+    void *value;
+    float x, y;
+    int cell_x, cell_y;
+    // Neighbours in the bucket's list, next is also the free list link once removed
+    int previous, next;
+    int live;
+} spatial_grid_item;
+
+struct spatial_grid_s {
+    float cell_size;
+    size_t bucket_mask;
+    // Head of each bucket's item list, -1 when empty
+    int *buckets;
+    spatial_grid_item *items;
+    size_t item_capacity, item_count, live_count;
+    int free_list;
+};
+
+typedef struct spatial_query {
+    int circle;
+    float min_x, min_y, max_x, max_y;
+    float centre_x, centre_y, radius_squared;
+} spatial_query;
+
+static int cell_coordinate(spatial_grid g, float v) {
+    // floorf without pulling in libm
+    float scaled = v / g->cell_size;
+    int cell = (int) scaled;
+    return (float) cell > scaled ? cell - 1 : cell;
+}
+
+static size_t bucket_of(spatial_grid g, int cell_x, int cell_y) {
+    uint32_t hash = (uint32_t) cell_x * 73856093u ^ (uint32_t) cell_y * 19349663u;
+    return (size_t) hash & g->bucket_mask;
+}
+
+static void link_item(spatial_grid g, int handle) {
+    spatial_grid_item *item = &g->items[handle];
+    size_t bucket = bucket_of(g, item->cell_x, item->cell_y);
+    item->previous = -1;
+    item->next = g->buckets[bucket];
+    if (item->next >= 0) g->items[item->next].previous = handle;
+    g->buckets[bucket] = handle;
+}
+
+static void unlink_item(spatial_grid g, int handle) {
+    spatial_grid_item *item = &g->items[handle];
+    if (item->previous >= 0) g->items[item->previous].next = item->next;
+    else g->buckets[bucket_of(g, item->cell_x, item->cell_y)] = item->next;
+    if (item->next >= 0) g->items[item->next].previous = item->previous;
+}
+
+spatial_grid spatial_grid_create(float cell_size, size_t bucket_count) {
+    spatial_grid g = (spatial_grid) calloc(1, sizeof(struct spatial_grid_s));
+    if (g == NULL) {
+        return NULL;
+    }
+    size_t buckets = 16;
+    while (buckets < bucket_count) buckets <<= 1;
+    g->cell_size = cell_size > 0.0f ? cell_size : 1.0f;
+    g->bucket_mask = buckets - 1;
+    g->free_list = -1;
+    g->buckets = (int *) malloc(buckets * sizeof(int));
+    if (g->buckets == NULL) {
+        spatial_grid_destroy(g);
+        return NULL;
+    }
+    for (size_t i = 0; i < buckets; i++) {
+        g->buckets[i] = -1;
+    }
+    return g;
+}
+
+spatial_grid_handle spatial_grid_insert(spatial_grid g, void *value, float x, float y) {
+    int handle = g->free_list;
+    if (handle >= 0) {
+        g->free_list = g->items[handle].next;
+    }
+    else {
+        if (g->item_count == g->item_capacity) {
+            size_t new_capacity = g->item_capacity ? g->item_capacity * 2 : 64;
+            if (new_capacity > INT32_MAX) return SPATIAL_GRID_INVALID_HANDLE;
+            spatial_grid_item *items = (spatial_grid_item *) realloc(g->items, new_capacity * sizeof(spatial_grid_item));
+            if (items == NULL) return SPATIAL_GRID_INVALID_HANDLE;
+            g->items = items;
+            g->item_capacity = new_capacity;
+        }
+        handle = (int) g->item_count++;
+    }
+
+    spatial_grid_item *item = &g->items[handle];
+    item->value = value;
+    item->x = x;
+    item->y = y;
+    item->cell_x = cell_coordinate(g, x);
+    item->cell_y = cell_coordinate(g, y);
+    item->live = 1;
+    link_item(g, handle);
+    g->live_count++;
+    return handle;
+}
+
+void spatial_grid_move(spatial_grid g, spatial_grid_handle handle, float x, float y) {
+    if (handle < 0 || (size_t) handle >= g->item_count || !g->items[handle].live) return;
+    spatial_grid_item *item = &g->items[handle];
+    item->x = x;
+    item->y = y;
+    int cell_x = cell_coordinate(g, x), cell_y = cell_coordinate(g, y);
+    if (cell_x == item->cell_x && cell_y == item->cell_y) return;
+
+    unlink_item(g, handle);
+    item->cell_x = cell_x;
+    item->cell_y = cell_y;
+    link_item(g, handle);
+}
+
+void spatial_grid_remove(spatial_grid g, spatial_grid_handle handle) {
+    if (handle < 0 || (size_t) handle >= g->item_count || !g->items[handle].live) return;
+    unlink_item(g, handle);
+    g->items[handle].live = 0;
+    g->items[handle].value = NULL;
+    g->items[handle].next = g->free_list;
+    g->free_list = handle;
+    g->live_count--;
+}
+
+size_t spatial_grid_size(const spatial_grid g) {
+    return g->live_count;
+}
+
+static int query_matches(const spatial_query *query, const spatial_grid_item *item) {
+    if (query->circle) {
+        float dx = item->x - query->centre_x, dy = item->y - query->centre_y;
+        return dx * dx + dy * dy <= query->radius_squared;
+    }
+    return item->x >= query->min_x && item->x <= query->max_x && item->y >= query->min_y && item->y <= query->max_y;
+}
+
+static size_t run_query(spatial_grid g, const spatial_query *query, spatial_grid_callback callback, void *args) {
+    size_t matched = 0;
+    int first_x = cell_coordinate(g, query->min_x), last_x = cell_coordinate(g, query->max_x);
+    int first_y = cell_coordinate(g, query->min_y), last_y = cell_coordinate(g, query->max_y);
+    uint64_t cell_count = (uint64_t) ((int64_t) last_x - first_x + 1) * (uint64_t) ((int64_t) last_y - first_y + 1);
+
+    if (cell_count > g->bucket_mask + 1) {
+        // Covers more cells than there are buckets, every bucket would be walked more than once
+        for (size_t i = 0; i < g->item_count; i++) {
+            if (!g->items[i].live || !query_matches(query, &g->items[i])) continue;
+            matched++;
+            if (callback(g->items[i].value, g->items[i].x, g->items[i].y, args) == ITERATION_BREAK) return matched;
+        }
+        return matched;
+    }
+
+    for (int cell_y = first_y; cell_y <= last_y; cell_y++) {
+        for (int cell_x = first_x; cell_x <= last_x; cell_x++) {
+            for (int i = g->buckets[bucket_of(g, cell_x, cell_y)]; i >= 0; i = g->items[i].next) {
+                const spatial_grid_item *item = &g->items[i];
+                // Buckets are shared with whatever other cells hash to them
+                if (item->cell_x != cell_x || item->cell_y != cell_y || !query_matches(query, item)) continue;
+                matched++;
+                if (callback(item->value, item->x, item->y, args) == ITERATION_BREAK) return matched;
+            }
+        }
+    }
+    return matched;
+}
+
+size_t spatial_grid_query_rect(spatial_grid g, float x, float y, float width, float height, spatial_grid_callback callback, void *args) {
+    if (width < 0.0f || height < 0.0f) return 0;
+    spatial_query query = {
+        .circle = 0,
+        .min_x = x,
+        .min_y = y,
+        .max_x = x + width,
+        .max_y = y + height
+    };
+    return run_query(g, &query, callback, args);
+}
+
+size_t spatial_grid_query_radius(spatial_grid g, float x, float y, float radius, spatial_grid_callback callback, void *args) {
+    if (radius < 0.0f) return 0;
+    spatial_query query = {
+        .circle = 1,
+        .min_x = x - radius,
+        .min_y = y - radius,
+        .max_x = x + radius,
+        .max_y = y + radius,
+        .centre_x = x,
+        .centre_y = y,
+        .radius_squared = radius * radius
+    };
+    return run_query(g, &query, callback, args);
+}
+
+typedef struct nearest_set {
+    void **values;
+    float *distances_squared;
+    size_t k, count;
+    float max_distance_squared;
+} nearest_set;
+
+static void offer_nearest(nearest_set *set, const spatial_grid_item *item, float x, float y) {
+    float dx = item->x - x, dy = item->y - y;
+    float distance_squared = dx * dx + dy * dy;
+    if (distance_squared > set->max_distance_squared) return;
+    if (set->count == set->k && distance_squared >= set->distances_squared[set->count - 1]) return;
+
+    // k is small, so a sorted insertion beats keeping a heap
+    size_t i = set->count < set->k ? set->count++ : set->count - 1;
+    while (i > 0 && set->distances_squared[i - 1] > distance_squared) {
+        set->values[i] = set->values[i - 1];
+        set->distances_squared[i] = set->distances_squared[i - 1];
+        i--;
+    }
+    set->values[i] = item->value;
+    set->distances_squared[i] = distance_squared;
+}
+
+static void offer_cell(spatial_grid g, nearest_set *set, int cell_x, int cell_y, float x, float y) {
+    for (int i = g->buckets[bucket_of(g, cell_x, cell_y)]; i >= 0; i = g->items[i].next) {
+        const spatial_grid_item *item = &g->items[i];
+        if (item->cell_x == cell_x && item->cell_y == cell_y) offer_nearest(set, item, x, y);
+    }
+}
+
+size_t spatial_grid_query_nearest(spatial_grid g, float x, float y, size_t k, float max_distance, void **out_values, float *out_distances_squared) {
+    if (k == 0 || g->live_count == 0 || max_distance < 0.0f) return 0;
+
+    float *distances_squared = out_distances_squared;
+    if (distances_squared == NULL) {
+        distances_squared = (float *) malloc(k * sizeof(float));
+        if (distances_squared == NULL) return 0;
+    }
+    nearest_set set = {
+        .values = out_values,
+        .distances_squared = distances_squared,
+        .k = k,
+        .count = 0,
+        .max_distance_squared = max_distance * max_distance
+    };
+
+    int centre_x = cell_coordinate(g, x), centre_y = cell_coordinate(g, y);
+    // Rings of cells around the point, until no unvisited cell can hold anything closer
+    for (int ring = 0; ; ring++) {
+        uint64_t visited_cells = (uint64_t) (2 * ring + 1) * (uint64_t) (2 * ring + 1);
+        if (k >= g->live_count || visited_cells > g->bucket_mask + 1) {
+            // Sparse or tiny grids, scanning everything is cheaper than more rings
+            set.count = 0;
+            for (size_t i = 0; i < g->item_count; i++) {
+                if (g->items[i].live) offer_nearest(&set, &g->items[i], x, y);
+            }
+            break;
+        }
+
+        if (ring == 0) {
+            offer_cell(g, &set, centre_x, centre_y, x, y);
+        }
+        else {
+            for (int cell_x = centre_x - ring; cell_x <= centre_x + ring; cell_x++) {
+                offer_cell(g, &set, cell_x, centre_y - ring, x, y);
+                offer_cell(g, &set, cell_x, centre_y + ring, x, y);
+            }
+            for (int cell_y = centre_y - ring + 1; cell_y <= centre_y + ring - 1; cell_y++) {
+                offer_cell(g, &set, centre_x - ring, cell_y, x, y);
+                offer_cell(g, &set, centre_x + ring, cell_y, x, y);
+            }
+        }
+
+        // Distance from the point to the edge of the visited square
+        float left = x - (float) (centre_x - ring) * g->cell_size;
+        float right = (float) (centre_x + ring + 1) * g->cell_size - x;
+        float top = y - (float) (centre_y - ring) * g->cell_size;
+        float bottom = (float) (centre_y + ring + 1) * g->cell_size - y;
+        float reach = left < right ? left : right;
+        if (top < reach) reach = top;
+        if (bottom < reach) reach = bottom;
+        float reach_squared = reach * reach;
+        if (reach_squared > set.max_distance_squared) break;
+        if (set.count == k && reach_squared >= distances_squared[k - 1]) break;
+    }
+
+    if (distances_squared != out_distances_squared) free(distances_squared);
+    return set.count;
+}
+
+void spatial_grid_destroy(spatial_grid g) {
+    if (g == NULL) return;
+    free(g->buckets);
+    free(g->items);
+    free(g);
+}
@@ -0,0 +1,135 @@
+#ifndef _H_SPATIAL_GRID_H_
+#define _H_SPATIAL_GRID_H_
+
+#include "data_structures.h"
+#include <stddef.h>
+
+/**
+ * This type represents an opaque pointer to a spatial grid, a hash of
+ * uniform square cells used to find the values stored near a point.
+ */
+typedef struct spatial_grid_s *spatial_grid;
+
+/**
+ * This type identifies a value stored in a spatial grid. Handles of removed
+ * values are reused by later insertions.
+ */
+typedef int spatial_grid_handle;
+
+#define SPATIAL_GRID_INVALID_HANDLE (-1)
+
+/**
+ * Called once for every value matching a query. Returning `ITERATION_BREAK`
+ * stops the query early. The grid must not be modified from inside it.
+ */
+typedef iteration_result (*spatial_grid_callback)(void *value, float x, float y, void *args);
+
+/**
+ * This function creates a new spatial grid. The returned object must be
+ * destroyed using `spatial_grid_destroy(...)`.
+ *
+ * @param cell_size the side of each cell, ideally close to the usual query
+ * radius
+ * @param bucket_count how many cells can be told apart before they start
+ * sharing a bucket, rounded up to a power of two
+ *
+ * @return the spatial grid or NULL if this operation failed.
+ */
+spatial_grid spatial_grid_create(float cell_size, size_t bucket_count);
+
+/**
+ * This function stores a value at a point.
+ *
+ * @param g the spatial grid
+ * @param value the value to store; it is not owned by the grid
+ * @param x the x coordinate of the value
+ * @param y the y coordinate of the value
+ *
+ * @return a handle to the stored value, or `SPATIAL_GRID_INVALID_HANDLE`
+ * if this operation failed
+ */
+spatial_grid_handle spatial_grid_insert(spatial_grid g, void *value, float x, float y);
+
+/**
+ * This function moves a stored value. It only touches the bucket lists
+ * when the value crosses into another cell.
+ *
+ * @param g the spatial grid
+ * @param handle the handle returned by `spatial_grid_insert(...)`
+ * @param x the new x coordinate
+ * @param y the new y coordinate
+ */
+void spatial_grid_move(spatial_grid g, spatial_grid_handle handle, float x, float y);
+
+/**
+ * This function removes a stored value from the grid.
+ *
+ * @param g the spatial grid
+ * @param handle the handle returned by `spatial_grid_insert(...)`
+ */
+void spatial_grid_remove(spatial_grid g, spatial_grid_handle handle);
+
+/**
+ * This function returns the number of values currently in the grid.
+ *
+ * @param g the spatial grid
+ *
+ * @return the number of values in the grid
+ */
+size_t spatial_grid_size(const spatial_grid g);
+
+/**
+ * This function finds every value inside an axis-aligned rectangle,
+ * edges included.
+ *
+ * @param g the spatial grid
+ * @param x the left edge of the rectangle
+ * @param y the top edge of the rectangle
+ * @param width the width of the rectangle
+ * @param height the height of the rectangle
+ * @param callback called for each value found, in no particular order
+ * @param args passed on to the callback
+ *
+ * @return the number of values the callback was called with
+ */
+size_t spatial_grid_query_rect(spatial_grid g, float x, float y, float width, float height, spatial_grid_callback callback, void *args);
+
+/**
+ * This function finds every value within a distance of a point.
+ *
+ * @param g the spatial grid
+ * @param x the x coordinate of the centre
+ * @param y the y coordinate of the centre
+ * @param radius the largest distance from the centre
+ * @param callback called for each value found, in no particular order
+ * @param args passed on to the callback
+ *
+ * @return the number of values the callback was called with
+ */
+size_t spatial_grid_query_radius(spatial_grid g, float x, float y, float radius, spatial_grid_callback callback, void *args);
+
+/**
+ * This function finds the values closest to a point.
+ *
+ * @param g the spatial grid
+ * @param x the x coordinate of the point
+ * @param y the y coordinate of the point
+ * @param k the maximum number of values to find
+ * @param max_distance values further away than this are ignored
+ * @param out_values filled with up to `k` values, nearest first
+ * @param out_distances_squared optional, filled with the squared distance
+ * of each value found
+ *
+ * @return the number of values found
+ */
+size_t spatial_grid_query_nearest(spatial_grid g, float x, float y, size_t k, float max_distance, void **out_values, float *out_distances_squared);
+
+/**
+ * This function frees the resources taken up by a spatial grid. The values
+ * it stores are left alone.
+ *
+ * @param g the spatial grid
+ */
+void spatial_grid_destroy(spatial_grid g);
+
+#endif
@@ -0,0 +1,216 @@
+#include "fov.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One row of a quadrant being scanned. Slopes are kept as exact fractions with positive
+// denominators, floating point rounding would break symmetry on the tie cases
+typedef struct fov_row {
+    int depth;
+    int start_num, start_den;
+    int end_num, end_den;
+} fov_row;
+
+struct fov_viewer_s {
+    int radius;
+    // Bitset of the (2 * radius + 1)^2 window centred on the origin
+    int side;
+    uint64_t *visible;
+    size_t word_count, visible_count;
+
+    integer_position origin;
+    unsigned int grid_version;
+    int computed;
+
+    // Rows still to scan, reused between computations
+    fov_row *rows;
+    size_t row_count, row_capacity;
+};
+
+typedef struct fov_grid {
+    const int *blocking;
+    int width, height;
+} fov_grid;
+
+fov_viewer fov_viewer_create(int radius) {
+    fov_viewer viewer = (fov_viewer) calloc(1, sizeof(struct fov_viewer_s));
+    if (viewer == NULL) {
+        return NULL;
+    }
+    viewer->radius = radius > 0 ? radius : 0;
+    viewer->side = 2 * viewer->radius + 1;
+    viewer->word_count = ((size_t) viewer->side * (size_t) viewer->side + 63) / 64;
+    viewer->visible = (uint64_t *) calloc(viewer->word_count, sizeof(uint64_t));
+    if (viewer->visible == NULL) {
+        fov_viewer_destroy(viewer);
+        return NULL;
+    }
+    return viewer;
+}
+
+static int floor_div(int a, int b) {
+    // b is always positive here
+    int q = a / b;
+    return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+static int round_ties_up(int depth, int num, int den) {
+    return floor_div(2 * depth * num + den, 2 * den);
+}
+
+static int round_ties_down(int depth, int num, int den) {
+    return -floor_div(den - 2 * depth * num, 2 * den);
+}
+
+static integer_position quadrant_cell(int quadrant, integer_position origin, int depth, int col) {
+    switch (quadrant) {
+        case 0: return (integer_position) { .x = origin.x + col, .y = origin.y - depth };
+        case 1: return (integer_position) { .x = origin.x + depth, .y = origin.y + col };
+        case 2: return (integer_position) { .x = origin.x + col, .y = origin.y + depth };
+        default: return (integer_position) { .x = origin.x - depth, .y = origin.y + col };
+    }
+}
+
+static int in_grid(const fov_grid *grid, integer_position cell) {
+    return cell.x >= 0 && cell.y >= 0 && cell.x < grid->width && cell.y < grid->height;
+}
+
+static int blocks_sight(const fov_grid *grid, integer_position cell) {
+    if (!in_grid(grid, cell)) return 1;
+    return grid->blocking != NULL && grid->blocking[cell.x + cell.y * grid->width] != 0;
+}
+
+static void reveal(fov_viewer viewer, const fov_grid *grid, integer_position cell) {
+    if (!in_grid(grid, cell)) return;
+    int dx = cell.x - viewer->origin.x, dy = cell.y - viewer->origin.y;
+    // r^2 + r gives rounder circles than r^2 on small radii
+    if (dx * dx + dy * dy > viewer->radius * viewer->radius + viewer->radius) return;
+
+    size_t bit = (size_t) (dx + viewer->radius) + (size_t) (dy + viewer->radius) * (size_t) viewer->side;
+    uint64_t mask = UINT64_C(1) << (bit % 64);
+    // Cells on the quadrant borders are reached twice
+    if (viewer->visible[bit / 64] & mask) return;
+    viewer->visible[bit / 64] |= mask;
+    viewer->visible_count++;
+}
+
+static int push_row(fov_viewer viewer, fov_row row) {
+    if (viewer->row_count == viewer->row_capacity) {
+        size_t new_capacity = viewer->row_capacity ? viewer->row_capacity * 2 : 64;
+        fov_row *rows = (fov_row *) realloc(viewer->rows, new_capacity * sizeof(fov_row));
+        if (rows == NULL) return 1;
+        viewer->rows = rows;
+        viewer->row_capacity = new_capacity;
+    }
+    viewer->rows[viewer->row_count++] = row;
+    return 0;
+}
+
+static int scan_quadrant(fov_viewer viewer, const fov_grid *grid, int quadrant) {
+    viewer->row_count = 0;
+    if (push_row(viewer, (fov_row) { .depth = 1, .start_num = -1, .start_den = 1, .end_num = 1, .end_den = 1 }) != 0) return 1;
+
+    while (viewer->row_count > 0) {
+        fov_row row = viewer->rows[--viewer->row_count];
+        if (row.depth > viewer->radius) continue;
+
+        int min_col = round_ties_up(row.depth, row.start_num, row.start_den);
+        int max_col = round_ties_down(row.depth, row.end_num, row.end_den);
+        // -1 before the first cell, then whether the previous cell blocked sight
+        int previous_blocks = -1;
+        for (int col = min_col; col <= max_col; col++) {
+            integer_position cell = quadrant_cell(quadrant, viewer->origin, row.depth, col);
+            int blocks = blocks_sight(grid, cell);
+            // Floors are only seen when their centre is inside the visible wedge, which is what makes it symmetric
+            int symmetric = col * row.start_den >= row.depth * row.start_num && col * row.end_den <= row.depth * row.end_num;
+            if (blocks || symmetric) {
+                reveal(viewer, grid, cell);
+            }
+
+            if (previous_blocks == 1 && !blocks) {
+                row.start_num = 2 * col - 1;
+                row.start_den = 2 * row.depth;
+            }
+            if (previous_blocks == 0 && blocks) {
+                fov_row next = {
+                    .depth = row.depth + 1,
+                    .start_num = row.start_num,
+                    .start_den = row.start_den,
+                    .end_num = 2 * col - 1,
+                    .end_den = 2 * row.depth
+                };
+                if (push_row(viewer, next) != 0) return 1;
+            }
+            previous_blocks = blocks;
+        }
+        if (previous_blocks == 0) {
+            fov_row next = row;
+            next.depth++;
+            if (push_row(viewer, next) != 0) return 1;
+        }
+    }
+    return 0;
+}
+
+int fov_viewer_update(fov_viewer viewer, const int *blocking_grid, int width, int height, unsigned int grid_version, integer_position origin) {
+    if (viewer->computed && viewer->grid_version == grid_version && viewer->origin.x == origin.x && viewer->origin.y == origin.y) {
+        return 0;
+    }
+
+    viewer->origin = origin;
+    viewer->grid_version = grid_version;
+    viewer->computed = 1;
+    viewer->visible_count = 0;
+    memset(viewer->visible, 0, viewer->word_count * sizeof(uint64_t));
+
+    fov_grid grid = {
+        .blocking = blocking_grid,
+        .width = width,
+        .height = height
+    };
+    reveal(viewer, &grid, origin);
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        if (scan_quadrant(viewer, &grid, quadrant) != 0) {
+            // Out of memory, keep what was revealed so far but try again next time
+            viewer->computed = 0;
+            break;
+        }
+    }
+    return 1;
+}
+
+void fov_viewer_invalidate(fov_viewer viewer) {
+    viewer->computed = 0;
+    memset(viewer->visible, 0, viewer->word_count * sizeof(uint64_t));
+    viewer->visible_count = 0;
+}
+
+int fov_viewer_can_see(fov_viewer viewer, int x, int y) {
+    int dx = x - viewer->origin.x + viewer->radius, dy = y - viewer->origin.y + viewer->radius;
+    if (dx < 0 || dy < 0 || dx >= viewer->side || dy >= viewer->side) return 0;
+    size_t bit = (size_t) dx + (size_t) dy * (size_t) viewer->side;
+    return (viewer->visible[bit / 64] >> (bit % 64)) & 1;
+}
+
+integer_position fov_viewer_get_origin(fov_viewer viewer) {
+    return viewer->origin;
+}
+
+int fov_viewer_get_radius(fov_viewer viewer) {
+    return viewer->radius;
+}
+
+size_t fov_viewer_get_visible_count(fov_viewer viewer) {
+    return viewer->visible_count;
+}
+
+size_t fov_viewer_get_memory_usage(fov_viewer viewer) {
+    return sizeof(struct fov_viewer_s) + viewer->word_count * sizeof(uint64_t) + viewer->row_capacity * sizeof(fov_row);
+}
+
+void fov_viewer_destroy(fov_viewer viewer) {
+    if (viewer == NULL) return;
+    free(viewer->visible);
+    free(viewer->rows);
+    free(viewer);
+}
@@ -0,0 +1,24 @@
+#ifndef _H_FOV_H_
+#define _H_FOV_H_
+
+#include "pathfinding.h"
+#include <stddef.h>
+
+// What one viewer can see, from symmetric shadowcasting over a grid of sight blockers.
+// If A sees B then B sees A, so the same result serves rendering and AI perception
+typedef struct fov_viewer_s *fov_viewer;
+
+fov_viewer fov_viewer_create(int radius);
+// Only recomputes when the origin moved or grid_version differs from the last computation,
+// returns 1 if it did. Any non-zero cell of blocking_grid blocks sight, out of bounds cells too
+int fov_viewer_update(fov_viewer, const int *blocking_grid, int width, int height, unsigned int grid_version, integer_position origin);
+// Sees nothing until the next fov_viewer_update
+void fov_viewer_invalidate(fov_viewer);
+int fov_viewer_can_see(fov_viewer, int x, int y);
+integer_position fov_viewer_get_origin(fov_viewer);
+int fov_viewer_get_radius(fov_viewer);
+size_t fov_viewer_get_visible_count(fov_viewer);
+size_t fov_viewer_get_memory_usage(fov_viewer);
+void fov_viewer_destroy(fov_viewer);
+
+#endif
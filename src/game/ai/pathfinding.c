@@ -1,80 +1,134 @@
-// TODO: This file is a mess.
-
 #include "pathfinding.h"
-#include "data_structures/hashtable.h"
 #include "data_structures/heap.h"
-#include "utils/utils.h"
 #include "logger/logger.h"
+#include <stdint.h>
 #include <stdlib.h>
 
-#define POS_VALUE(x, y) (&(integer_position){ .x=x, .y=y })
-#define INT_VALUE(x) (&(int){ x })
-#define ASSERT_OR_EXIT(expr) do { if (!(expr)) { return_value = NULL; goto cleanup; } } while (0)
-#define SUCCESS_OR_EXIT(expr) do { if ((expr) != 0) { return_value = NULL; goto cleanup; } } while (0)
+#define NO_NODE (-1)
+// Integer step costs, diagonals approximate 10 * sqrt(2)
+#define ORTHOGONAL_COST 10
+#define DIAGONAL_COST 14
+
+typedef enum node_state {
+    NODE_UNSEEN,
+    NODE_OPEN,
+    NODE_CLOSED
+} node_state;
+
+struct pathfinding_search_s {
+    const int *occupancy_grid;
+    pathfinding_options options;
+    int width, height;
+    int start, goal;
+
+    // Closest node to the goal expanded so far, used for partial results
+    int best_node, best_heuristic;
+
+    int *g_score;
+    int *came_from;
+    unsigned char *node_state;
+    heap open_set;
+
+    size_t expanded_nodes, peak_open_nodes;
+    pathfinding_status status;
+};
+
+// The first four are the orthogonal neighbours, the rest are only used with 8-connectivity
+static const integer_position NEIGHBOUR_OFFSETS[] = {
+    { .x =  0, .y = -1 },
+    { .x =  1, .y =  0 },
+    { .x =  0, .y =  1 },
+    { .x = -1, .y =  0 },
+    { .x =  1, .y = -1 },
+    { .x =  1, .y =  1 },
+    { .x = -1, .y =  1 },
+    { .x = -1, .y = -1 }
+};
+
+pathfinding_options pathfinding_default_options() {
+    return (pathfinding_options) {
+        .heuristic = PATHFINDING_HEURISTIC_MANHATTAN,
+        .connectivity = 4,
+        .corner_rule = PATHFINDING_CORNERS_NEVER,
+        .epsilon = 1.0,
+        .terrain_costs = NULL
+    };
+}
 
-static int compare_positions(const void* _value1, const void* _value2) {
-    integer_position *value1 = (integer_position*) _value1, *value2 = (integer_position*) _value2;
-    return (value1->x == value2->x && value1->y == value2->y) ? 0 : 1;
+static int heuristic(const pathfinding_search search, int node) {
+    int x_diff = abs(search->goal % search->width - node % search->width);
+    int y_diff = abs(search->goal / search->width - node / search->width);
+    if (search->options.heuristic == PATHFINDING_HEURISTIC_OCTILE) {
+        int diagonal = x_diff < y_diff ? x_diff : y_diff;
+        return ORTHOGONAL_COST * (x_diff + y_diff) + (DIAGONAL_COST - 2 * ORTHOGONAL_COST) * diagonal;
+    }
+    return ORTHOGONAL_COST * (x_diff + y_diff);
 }
 
-static uint64_t hash_position(const void *_key) {
-    integer_position *key = (integer_position*) _key;
-    return hashtable_hash_int(&(int){key->x}) ^ hashtable_hash_int(&(int){key->y});
+static int terrain_cost(const pathfinding_search search, int node) {
+    if (search->options.terrain_costs == NULL) return 1;
+    int cost = search->options.terrain_costs[node];
+    // Never go below 1, or the heuristic would stop being admissible
+    return cost > 1 ? cost : 1;
 }
 
-static int heuristic(integer_position *goal, integer_position *pos) {
-    int x_diff = goal->x - pos->x;
-    int y_diff = goal->y - pos->y;
-    return x_diff * x_diff + y_diff * y_diff;
+static int in_bounds(const pathfinding_search search, integer_position pos) {
+    return pos.x >= 0 && pos.y >= 0 && pos.x < search->width && pos.y < search->height;
 }
 
-static integer_position *new_position(int x, int y) {
-    integer_position *pos = (integer_position*) malloc(sizeof(integer_position));
-    if (pos == NULL) {
-        return NULL;
+static int is_occupied(const pathfinding_search search, int node) {
+    return search->occupancy_grid != NULL && search->occupancy_grid[node] != 0;
+}
+
+static int can_move_diagonally(const pathfinding_search search, integer_position from, integer_position offset) {
+    int horizontal_free = !is_occupied(search, (from.x + offset.x) + from.y * search->width);
+    int vertical_free = !is_occupied(search, from.x + (from.y + offset.y) * search->width);
+    switch (search->options.corner_rule) {
+        case PATHFINDING_CORNERS_NEVER:
+            return horizontal_free && vertical_free;
+        case PATHFINDING_CORNERS_ONE_FREE:
+            return horizontal_free || vertical_free;
+        case PATHFINDING_CORNERS_ALWAYS:
+            return 1;
     }
-    pos->x = x;
-    pos->y = y;
-    return pos;
+    return 0;
+}
+
+static int push_open(pathfinding_search search, int node, int g) {
+    // Our heap pops the *highest* priority first, so we negate f = g + epsilon * h
+    int f = g + (int) (search->options.epsilon * (double) heuristic(search, node));
+    if (heap_insert(search->open_set, (void *) (intptr_t) node, -f) != 0) {
+        return 1;
+    }
+    search->g_score[node] = g;
+    search->node_state[node] = NODE_OPEN;
+    if (heap_size(search->open_set) > search->peak_open_nodes) {
+        search->peak_open_nodes = heap_size(search->open_set);
+    }
+    return 0;
 }
 
 static void free_integer_position(void *position) {
     free(position);
 }
 
-linked_list reconstruct_path(hashtable came_from, integer_position *current) {
-    // TODO: We will probably only need to return the next position, not a 
-    // TODO: full path.
-
+static linked_list reconstruct_path(const pathfinding_search search, int node) {
     // This linked list should own its elements
     linked_list total_path = linked_list_create_owned(free_integer_position);
     if (total_path == NULL) {
         return NULL;
     }
 
-    integer_position *pos = new_position(current->x, current->y);
-    if (pos == NULL) {
-        linked_list_destroy(total_path);
-        return NULL;
-    }
-
-    if (linked_list_pushfront(total_path, pos) != 0) {
-        linked_list_destroy(total_path);
-        return NULL;
-    }
-
-    integer_position *from = current;
-    while (1) {
-        from = hashtable_get(came_from, from);
-        if (from == NULL) break;
-
-        integer_position *from_copy = new_position(from->x, from->y);
-        if (from_copy == NULL) {
+    for (int current = node; current != NO_NODE; current = search->came_from[current]) {
+        integer_position *pos = (integer_position *) malloc(sizeof(integer_position));
+        if (pos == NULL) {
             linked_list_destroy(total_path);
             return NULL;
         }
-        if (linked_list_pushfront(total_path, from_copy) != 0) {
-            free(from_copy);
+        pos->x = current % search->width;
+        pos->y = current / search->width;
+        if (linked_list_pushfront(total_path, pos) != 0) {
+            free(pos);
             linked_list_destroy(total_path);
             return NULL;
         }
@@ -83,111 +137,152 @@ linked_list reconstruct_path(hashtable came_from, integer_position *current) {
     return total_path;
 }
 
-static int find_element(void *element, void *args) {
-    return compare_positions(element, args) == 0;
-}
+pathfinding_search pathfinding_begin(const int *occupancy_grid, int width, int height, integer_position start, integer_position goal, const pathfinding_options *options) {
+    if (width <= 0 || height <= 0) return NULL;
 
-static void destroy_heap(heap h) {
-    if (h == NULL) return;
-    while (1) {
-        void *element = NULL;
-        heap_pop(h, &element, NULL);
-        if (element == NULL) break;
-        free(element);
+    pathfinding_search search = (pathfinding_search) calloc(1, sizeof(struct pathfinding_search_s));
+    if (search == NULL) {
+        return NULL;
     }
-    heap_destroy(h);
-}
-
-linked_list pathfinding_find_path(int* occupancy_grid, int width, int height, integer_position start, integer_position goal) {
-    //! FIXME: Although our hashtable implementation works with both heap-allocated values and by copying objects
-    //! on the stack, the heap doesn't (yet).
-
-    linked_list return_value = NULL;
-
-    heap open_set = NULL;
-    hashtable came_from = NULL, g_score = NULL, f_score = NULL;
-    integer_position *pos = NULL;
-    open_set = heap_create(width * height / 2 + 1);
-    came_from = hashtable_create_trivial_key_trivial_value(sizeof(integer_position), compare_positions, hash_position, sizeof(integer_position));
-    g_score = hashtable_create_trivial_key_trivial_value(sizeof(integer_position), compare_positions, hash_position, sizeof(int));
-    f_score = hashtable_create_trivial_key_trivial_value(sizeof(integer_position), compare_positions, hash_position, sizeof(int));
-    
-    ASSERT_OR_EXIT(open_set != NULL && came_from != NULL && g_score != NULL && f_score != NULL);
-
-    int h_start = heuristic(&goal, &start);
-    pos = new_position(start.x, start.y);
-    ASSERT_OR_EXIT(pos != NULL);
-    SUCCESS_OR_EXIT(heap_insert(open_set, pos, h_start));
-    pos = NULL;
-
-    SUCCESS_OR_EXIT(hashtable_set(g_score, &start, INT_VALUE(0)));
-    SUCCESS_OR_EXIT(hashtable_set(f_score, &start, &h_start));
-
-    while (!heap_is_empty(open_set)) {
-        integer_position *current_ptr = NULL; 
-        integer_position neighbour, current;
-
-        if (heap_pop(open_set, (void **) &current_ptr, NULL) == 1) break;
-        current.x = current_ptr->x;
-        current.y = current_ptr->y;
-        free(current_ptr);
-
-        if (compare_positions(&current, &goal) == 0) {
-            return_value = reconstruct_path(came_from, &current);
-            goto cleanup;
+    search->occupancy_grid = occupancy_grid;
+    search->options = options != NULL ? *options : pathfinding_default_options();
+    if (search->options.epsilon < 1.0) search->options.epsilon = 1.0;
+    search->width = width;
+    search->height = height;
+    search->best_node = NO_NODE;
+    search->status = PATHFINDING_IN_PROGRESS;
+
+    size_t cells = (size_t) width * (size_t) height;
+    search->g_score = (int *) malloc(cells * sizeof(int));
+    search->came_from = (int *) malloc(cells * sizeof(int));
+    search->node_state = (unsigned char *) calloc(cells, sizeof(unsigned char));
+    search->open_set = heap_create(256);
+    if (search->g_score == NULL || search->came_from == NULL || search->node_state == NULL || search->open_set == NULL) {
+        pathfinding_destroy(search);
+        return NULL;
+    }
+
+    if (!in_bounds(search, start) || !in_bounds(search, goal)) {
+        search->status = PATHFINDING_FAILED;
+        return search;
+    }
+    search->start = start.x + start.y * width;
+    search->goal = goal.x + goal.y * width;
+
+    if (is_occupied(search, search->goal)) {
+        // No point in exploring the whole map for a goal we can never stand on
+        search->status = PATHFINDING_FAILED;
+        return search;
+    }
+
+    search->came_from[search->start] = NO_NODE;
+    if (push_open(search, search->start, 0) != 0) {
+        pathfinding_destroy(search);
+        return NULL;
+    }
+    return search;
+}
+
+pathfinding_status pathfinding_step(pathfinding_search search, size_t budget_nodes) {
+    size_t expanded = 0;
+    while (search->status == PATHFINDING_IN_PROGRESS && expanded < budget_nodes) {
+        void *value = NULL;
+        if (heap_pop(search->open_set, &value, NULL) != 0) {
+            search->status = PATHFINDING_FAILED;
+            break;
         }
+        int current = (int) (intptr_t) value;
 
-        int tentative_g_score = 0;
-        void *tmp = NULL;
+        // Stale heap entry for a node that was already expanded with a better score
+        if (search->node_state[current] != NODE_OPEN) continue;
+        search->node_state[current] = NODE_CLOSED;
+        search->expanded_nodes++;
+        expanded++;
 
-        for (int i = 0; i < 9; i++) {            
-            int x_offset = (i % 3) - 1;
-            int y_offset = (i / 3) - 1;
+        int current_heuristic = heuristic(search, current);
+        if (search->best_node == NO_NODE || current_heuristic < search->best_heuristic) {
+            search->best_node = current;
+            search->best_heuristic = current_heuristic;
+        }
 
-            if (abs(x_offset + y_offset) != 1) continue;
+        if (current == search->goal) {
+            search->status = PATHFINDING_FOUND;
+            break;
+        }
 
-            neighbour = (integer_position) { .x = current.x + x_offset, .y = current.y + y_offset };
-            
-            if (neighbour.x >= width || neighbour.x < 0 || neighbour.y >= height || neighbour.y < 0) {
-                // Out of bounds
-                continue;
-            }
+        integer_position current_pos = { .x = current % search->width, .y = current / search->width };
+        size_t neighbour_count = search->options.connectivity == 8 ? 8 : 4;
+        for (size_t i = 0; i < neighbour_count; i++) {
+            integer_position neighbour_pos = {
+                .x = current_pos.x + NEIGHBOUR_OFFSETS[i].x,
+                .y = current_pos.y + NEIGHBOUR_OFFSETS[i].y
+            };
+            if (!in_bounds(search, neighbour_pos)) continue;
 
-            if (occupancy_grid[neighbour.x + neighbour.y * width] == 1) {
-                // This cell is occupied
-                continue;
-            }
+            int neighbour = neighbour_pos.x + neighbour_pos.y * search->width;
+            if (is_occupied(search, neighbour)) continue;
 
-            tmp = hashtable_get(g_score, &current);
-            if (tmp == NULL) {
-                log_error("Pathfinding error: missing g_score");
+            int diagonal = NEIGHBOUR_OFFSETS[i].x != 0 && NEIGHBOUR_OFFSETS[i].y != 0;
+            if (diagonal && !can_move_diagonally(search, current_pos, NEIGHBOUR_OFFSETS[i])) continue;
+
+            int step_cost = (diagonal ? DIAGONAL_COST : ORTHOGONAL_COST) * terrain_cost(search, neighbour);
+            int tentative_g_score = search->g_score[current] + step_cost;
+            if (search->node_state[neighbour] != NODE_UNSEEN && tentative_g_score >= search->g_score[neighbour]) continue;
+
+            // This path is better, so record it
+            search->came_from[neighbour] = current;
+            if (push_open(search, neighbour, tentative_g_score) != 0) {
+                log_error("Pathfinding error: failed to grow open set");
+                search->status = PATHFINDING_FAILED;
                 break;
             }
-            tentative_g_score = *(int*) tmp + 1;  // TODO: instead of 1, it should be d(current, neighbour)
-            
-            tmp = hashtable_get(g_score, &neighbour);
-            if (tmp == NULL || tentative_g_score < *(int*) tmp) {
-                // This path is better, so record it
-                SUCCESS_OR_EXIT(hashtable_set(came_from, &neighbour, &current));
-                SUCCESS_OR_EXIT(hashtable_set(g_score, &neighbour, &tentative_g_score));
-                
-                int neighbour_heuristic = heuristic(&goal, &neighbour);
-                SUCCESS_OR_EXIT(hashtable_set(f_score, &neighbour, INT_VALUE(tentative_g_score + neighbour_heuristic)));
-                if (!heap_any(open_set, find_element, &neighbour)) {
-                    integer_position *pos = new_position(neighbour.x, neighbour.y);
-                    ASSERT_OR_EXIT(pos != NULL);
-                    SUCCESS_OR_EXIT(heap_insert(open_set, pos, neighbour_heuristic));
-                    pos = NULL;
-                }            
-            }
         }
     }
+    return search->status;
+}
+
+pathfinding_status pathfinding_get_status(pathfinding_search search) {
+    return search->status;
+}
+
+linked_list pathfinding_result(pathfinding_search search) {
+    if (search->status != PATHFINDING_FOUND) return NULL;
+    return reconstruct_path(search, search->goal);
+}
+
+linked_list pathfinding_partial_result(pathfinding_search search) {
+    if (search->best_node == NO_NODE) return NULL;
+    return reconstruct_path(search, search->best_node);
+}
 
-cleanup:
-    free(pos);
-    destroy_heap(open_set);
-    hashtable_destroy(came_from);
-    hashtable_destroy(g_score);
-    hashtable_destroy(f_score);
-    return return_value;
+size_t pathfinding_get_expanded_nodes(pathfinding_search search) {
+    return search->expanded_nodes;
+}
+
+size_t pathfinding_get_memory_usage(pathfinding_search search) {
+    size_t cells = (size_t) search->width * (size_t) search->height;
+    size_t per_cell = sizeof(*search->g_score) + sizeof(*search->came_from) + sizeof(*search->node_state);
+    // Each open set entry holds a value pointer and its priority
+    size_t per_open_node = sizeof(void *) + sizeof(int);
+    return sizeof(struct pathfinding_search_s) + cells * per_cell + search->peak_open_nodes * per_open_node;
+}
+
+void pathfinding_destroy(pathfinding_search search) {
+    if (search == NULL) return;
+    heap_destroy(search->open_set);
+    free(search->g_score);
+    free(search->came_from);
+    free(search->node_state);
+    free(search);
+}
+
+linked_list pathfinding_find_path(const int *occupancy_grid, int width, int height, integer_position start, integer_position goal, const pathfinding_options *options) {
+    pathfinding_search search = pathfinding_begin(occupancy_grid, width, height, start, goal, options);
+    if (search == NULL) {
+        return NULL;
+    }
+    pathfinding_step(search, SIZE_MAX);
+    linked_list result = pathfinding_result(search);
+    pathfinding_destroy(search);
+    return result;
 }
@@ -2,11 +2,51 @@
 #define _H_PATHFINDING_H_
 
 #include "data_structures/linked_list.h"
+#include <stddef.h>
 
 typedef struct integer_position {
     int x, y;
 } integer_position;
 
-linked_list pathfinding_find_path(int* occupancy_grid, int width, int height, integer_position start, integer_position goal);
+typedef struct pathfinding_search_s *pathfinding_search;
+
+typedef enum pathfinding_heuristic {
+    PATHFINDING_HEURISTIC_MANHATTAN,  // Only admissible with 4-connectivity
+    PATHFINDING_HEURISTIC_OCTILE
+} pathfinding_heuristic;
+
+typedef enum pathfinding_corner_rule {
+    PATHFINDING_CORNERS_NEVER,     // Diagonal moves need both adjacent orthogonal cells free
+    PATHFINDING_CORNERS_ONE_FREE,  // Diagonal moves need at least one adjacent orthogonal cell free
+    PATHFINDING_CORNERS_ALWAYS
+} pathfinding_corner_rule;
+
+typedef struct pathfinding_options {
+    pathfinding_heuristic heuristic;
+    int connectivity;  // 4 or 8
+    pathfinding_corner_rule corner_rule;
+    // Weighted A*: paths are at most epsilon times longer than optimal, 1.0 is plain A*
+    double epsilon;
+    // Optional per-cell cost multipliers, anything below 1 counts as 1
+    const int *terrain_costs;
+} pathfinding_options;
+
+typedef enum pathfinding_status {
+    PATHFINDING_IN_PROGRESS,
+    PATHFINDING_FOUND,
+    PATHFINDING_FAILED
+} pathfinding_status;
+
+pathfinding_options pathfinding_default_options();
+pathfinding_search pathfinding_begin(const int *occupancy_grid, int width, int height, integer_position start, integer_position goal, const pathfinding_options *options);
+pathfinding_status pathfinding_step(pathfinding_search, size_t budget_nodes);
+pathfinding_status pathfinding_get_status(pathfinding_search);
+linked_list pathfinding_result(pathfinding_search);
+linked_list pathfinding_partial_result(pathfinding_search);
+size_t pathfinding_get_expanded_nodes(pathfinding_search);
+size_t pathfinding_get_memory_usage(pathfinding_search);
+void pathfinding_destroy(pathfinding_search);
+
+linked_list pathfinding_find_path(const int *occupancy_grid, int width, int height, integer_position start, integer_position goal, const pathfinding_options *options);
 
 #endif
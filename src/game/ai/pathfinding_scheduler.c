@@ -0,0 +1,223 @@
+#include "pathfinding_scheduler.h"
+#include "data_structures/linked_list.h"
+#include <stdlib.h>
+
+struct pathfinding_request_s {
+    pathfinding_search search;
+    pathfinding_status status;
+    linked_list path;
+    size_t submitted_at;
+};
+
+struct pathfinding_scheduler_s {
+    size_t budget_per_tick;
+    size_t tick;
+
+    // Every request that hasn't been released yet, and the subset still searching in the order they get
+    // the budget. Requests a tick ran go to the back, so the next tick picks up where it stopped
+    linked_list requests;
+    linked_list pending;
+
+    // Instrumentation
+    size_t expanded_last_tick;
+    size_t busy_ticks;
+    double total_utilization;
+    size_t completed_requests;
+    size_t total_latency_ticks, last_latency_ticks, max_latency_ticks;
+};
+
+pathfinding_scheduler pathfinding_scheduler_create(size_t budget_per_tick) {
+    pathfinding_scheduler sched = (pathfinding_scheduler) calloc(1, sizeof(struct pathfinding_scheduler_s));
+    if (sched == NULL) {
+        return NULL;
+    }
+    sched->budget_per_tick = budget_per_tick > 0 ? budget_per_tick : 1;
+    sched->requests = linked_list_create_borrowed();
+    if (sched->requests == NULL) {
+        pathfinding_scheduler_destroy(sched);
+        return NULL;
+    }
+    sched->pending = linked_list_create_borrowed();
+    if (sched->pending == NULL) {
+        pathfinding_scheduler_destroy(sched);
+        return NULL;
+    }
+    return sched;
+}
+
+pathfinding_request pathfinding_scheduler_submit(pathfinding_scheduler sched, pathfinding_search search) {
+    if (search == NULL) return NULL;
+
+    pathfinding_request request = (pathfinding_request) calloc(1, sizeof(struct pathfinding_request_s));
+    if (request == NULL) {
+        pathfinding_destroy(search);
+        return NULL;
+    }
+    request->search = search;
+    request->status = pathfinding_get_status(search);
+    request->submitted_at = sched->tick;
+
+    if (linked_list_pushfront(sched->requests, request) != 0) {
+        pathfinding_destroy(search);
+        free(request);
+        return NULL;
+    }
+    if (request->status == PATHFINDING_IN_PROGRESS && linked_list_pushback(sched->pending, request) != 0) {
+        pathfinding_scheduler_release(sched, request);
+        return NULL;
+    }
+    return request;
+}
+
+static void complete_request(pathfinding_scheduler sched, pathfinding_request request) {
+    request->status = pathfinding_get_status(request->search);
+    if (request->status == PATHFINDING_FOUND) {
+        request->path = pathfinding_result(request->search);
+        if (request->path == NULL) {
+            request->status = PATHFINDING_FAILED;
+        }
+    }
+    // The search state can be rather large, so let it go as soon as we're done
+    pathfinding_destroy(request->search);
+    request->search = NULL;
+
+    size_t latency = sched->tick - request->submitted_at;
+    sched->completed_requests++;
+    sched->last_latency_ticks = latency;
+    sched->total_latency_ticks += latency;
+    if (latency > sched->max_latency_ticks) {
+        sched->max_latency_ticks = latency;
+    }
+}
+
+struct run_request_args_s {
+    pathfinding_scheduler sched;
+    size_t remaining_budget;
+    size_t remaining_requests;
+    size_t visited;
+};
+
+static iteration_result run_request(void *value, void *_args) {
+    struct run_request_args_s *args = (struct run_request_args_s *) _args;
+    pathfinding_request request = (pathfinding_request) value;
+
+    if (args->remaining_budget == 0) return ITERATION_BREAK;
+
+    // Split whatever is left evenly among the requests we haven't visited yet,
+    // so budget a finished search didn't use goes to the ones after it
+    size_t share = args->remaining_budget / args->remaining_requests;
+    if (share == 0) share = 1;
+    args->remaining_requests--;
+    args->visited++;
+
+    size_t expanded_before = pathfinding_get_expanded_nodes(request->search);
+    pathfinding_status status = pathfinding_step(request->search, share);
+    size_t used = pathfinding_get_expanded_nodes(request->search) - expanded_before;
+    args->remaining_budget -= used < args->remaining_budget ? used : args->remaining_budget;
+
+    if (status != PATHFINDING_IN_PROGRESS) {
+        complete_request(args->sched, request);
+    }
+    return ITERATION_CONTINUE;
+}
+
+static int is_not_pending(void *value, void *) {
+    pathfinding_request request = (pathfinding_request) value;
+    return request->status != PATHFINDING_IN_PROGRESS;
+}
+
+void pathfinding_scheduler_run(pathfinding_scheduler sched) {
+    sched->tick++;
+    sched->expanded_last_tick = 0;
+
+    size_t pending = linked_list_size(sched->pending);
+    if (pending == 0) return;
+
+    struct run_request_args_s run_request_args = {
+        .sched = sched,
+        .remaining_budget = sched->budget_per_tick,
+        .remaining_requests = pending,
+        .visited = 0
+    };
+    linked_list_foreach_args(sched->pending, run_request, &run_request_args);
+    linked_list_rotate(sched->pending, run_request_args.visited);
+    linked_list_remove_if(sched->pending, is_not_pending, NULL);
+
+    sched->expanded_last_tick = sched->budget_per_tick - run_request_args.remaining_budget;
+    sched->total_utilization += (double) sched->expanded_last_tick / (double) sched->budget_per_tick;
+    sched->busy_ticks++;
+}
+
+static int is_same_request(void *value, void *args) {
+    return value == args;
+}
+
+static void destroy_request(pathfinding_request request) {
+    pathfinding_destroy(request->search);
+    linked_list_destroy(request->path);
+    free(request);
+}
+
+void pathfinding_scheduler_release(pathfinding_scheduler sched, pathfinding_request request) {
+    if (request == NULL) return;
+    linked_list_remove_if(sched->pending, is_same_request, request);
+    linked_list_remove_if(sched->requests, is_same_request, request);
+    destroy_request(request);
+}
+
+static iteration_result cancel_request(void *value, void *) {
+    pathfinding_request request = (pathfinding_request) value;
+    pathfinding_destroy(request->search);
+    request->search = NULL;
+    request->status = PATHFINDING_FAILED;
+    return ITERATION_CONTINUE;
+}
+
+void pathfinding_scheduler_cancel_all(pathfinding_scheduler sched) {
+    // Requests stay valid until released, they just won't make any progress
+    linked_list_foreach_args(sched->pending, cancel_request, NULL);
+    linked_list_remove_if(sched->pending, is_not_pending, NULL);
+}
+
+pathfinding_scheduler_statistics pathfinding_scheduler_get_stats(pathfinding_scheduler sched) {
+    return (pathfinding_scheduler_statistics) {
+        .budget_per_tick = sched->budget_per_tick,
+        .expanded_last_tick = sched->expanded_last_tick,
+        .pending_requests = linked_list_size(sched->pending),
+        .completed_requests = sched->completed_requests,
+        .last_latency_ticks = sched->last_latency_ticks,
+        .max_latency_ticks = sched->max_latency_ticks,
+        .average_latency_ticks = sched->completed_requests > 0 ? (double) sched->total_latency_ticks / (double) sched->completed_requests : 0.0,
+        .average_utilization = sched->busy_ticks > 0 ? sched->total_utilization / (double) sched->busy_ticks : 0.0
+    };
+}
+
+static iteration_result destroy_request_element(void *value) {
+    destroy_request((pathfinding_request) value);
+    return ITERATION_CONTINUE;
+}
+
+void pathfinding_scheduler_destroy(pathfinding_scheduler sched) {
+    if (sched == NULL) return;
+    if (sched->requests != NULL) {
+        linked_list_foreach(sched->requests, destroy_request_element);
+        linked_list_destroy(sched->requests);
+    }
+    linked_list_destroy(sched->pending);
+    free(sched);
+}
+
+pathfinding_status pathfinding_request_get_status(pathfinding_request request) {
+    return request->status;
+}
+
+linked_list pathfinding_request_take_path(pathfinding_request request) {
+    linked_list path = request->path;
+    request->path = NULL;
+    return path;
+}
+
+linked_list pathfinding_request_get_partial_path(pathfinding_request request) {
+    if (request->search == NULL) return NULL;
+    return pathfinding_partial_result(request->search);
+}
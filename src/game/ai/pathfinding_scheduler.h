@@ -0,0 +1,33 @@
+#ifndef _H_PATHFINDING_SCHEDULER_H_
+#define _H_PATHFINDING_SCHEDULER_H_
+
+#include "pathfinding.h"
+#include <stddef.h>
+
+typedef struct pathfinding_scheduler_s *pathfinding_scheduler;
+typedef struct pathfinding_request_s *pathfinding_request;
+
+typedef struct pathfinding_scheduler_statistics {
+    size_t budget_per_tick;
+    size_t expanded_last_tick;
+    size_t pending_requests;
+    size_t completed_requests;
+    size_t last_latency_ticks;
+    size_t max_latency_ticks;
+    double average_latency_ticks;
+    double average_utilization;
+} pathfinding_scheduler_statistics;
+
+pathfinding_scheduler pathfinding_scheduler_create(size_t budget_per_tick);
+pathfinding_request pathfinding_scheduler_submit(pathfinding_scheduler, pathfinding_search);
+void pathfinding_scheduler_run(pathfinding_scheduler);
+void pathfinding_scheduler_release(pathfinding_scheduler, pathfinding_request);
+void pathfinding_scheduler_cancel_all(pathfinding_scheduler);
+pathfinding_scheduler_statistics pathfinding_scheduler_get_stats(pathfinding_scheduler);
+void pathfinding_scheduler_destroy(pathfinding_scheduler);
+
+pathfinding_status pathfinding_request_get_status(pathfinding_request);
+linked_list pathfinding_request_take_path(pathfinding_request);
+linked_list pathfinding_request_get_partial_path(pathfinding_request);
+
+#endif
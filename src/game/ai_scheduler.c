@@ -0,0 +1,188 @@
+#include "ai_scheduler.h"
+#include "config.h"
+#include "logger/logger.h"
+#include <stdlib.h>
+
+struct ai_scheduler_s {
+    size_t budget;
+    uint32_t tick;
+    size_t *rows[AI_LOD_BUCKET_COUNT];
+    size_t counts[AI_LOD_BUCKET_COUNT];
+    size_t capacity;
+
+    // Due rows by how many ticks they waited, to find where the budget cuts
+    size_t *waits;
+
+    ai_scheduler_statistics stats;
+    size_t planned_ticks, total_updated;
+};
+
+static const uint32_t BUCKET_INTERVALS[AI_LOD_BUCKET_COUNT] = { 1, AI_LOD_MID_INTERVAL, AI_LOD_FAR_INTERVAL };
+
+ai_scheduler ai_scheduler_create(size_t budget_per_tick) {
+    ai_scheduler s = (ai_scheduler) calloc(1, sizeof(struct ai_scheduler_s));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->waits = (size_t *) calloc(AI_MAX_RANKED_WAIT, sizeof(size_t));
+    if (s->waits == NULL) {
+        ai_scheduler_destroy(s);
+        return NULL;
+    }
+    s->budget = budget_per_tick;
+    s->stats.budget_per_tick = budget_per_tick;
+    return s;
+}
+
+static int reserve(ai_scheduler s, size_t count) {
+    if (count <= s->capacity) return 0;
+    size_t capacity = s->capacity ? s->capacity : 64;
+    while (capacity < count) capacity *= 2;
+    for (int bucket = 0; bucket < AI_LOD_BUCKET_COUNT; bucket++) {
+        size_t *rows = (size_t *) realloc(s->rows[bucket], capacity * sizeof(size_t));
+        if (rows == NULL) return 1;
+        s->rows[bucket] = rows;
+    }
+    s->capacity = capacity;
+    return 0;
+}
+
+static ai_lod_bucket bucket_of(const entity_columns *c, size_t row, const entity_position *focus) {
+    if (focus == NULL) return AI_LOD_NEAR;
+    float dx = c->position_x[row] - focus->x, dy = c->position_y[row] - focus->y;
+    float distance_squared = dx * dx + dy * dy;
+    if (distance_squared <= AI_LOD_NEAR_RADIUS * AI_LOD_NEAR_RADIUS) return AI_LOD_NEAR;
+    if (distance_squared <= AI_LOD_MID_RADIUS * AI_LOD_MID_RADIUS) return AI_LOD_MID;
+    return AI_LOD_FAR;
+}
+
+static int is_due(uint32_t think_tick, uint32_t tick) {
+    // Wraps around with the tick counter
+    return think_tick == 0 || (int32_t) (tick - think_tick) >= 0;
+}
+
+// Ticks a due row has waited past its due tick
+static uint32_t wait_of(uint32_t think_tick, uint32_t tick) {
+    return think_tick == 0 ? 0 : tick - think_tick;
+}
+
+static uint32_t ranked_wait(uint32_t wait) {
+    return wait < AI_MAX_RANKED_WAIT ? wait : AI_MAX_RANKED_WAIT - 1;
+}
+
+// Keeps the rows of each bucket that fit in the budget: every one that waited longer than the cut,
+// then those that waited exactly as long, nearest bucket first. The others get their wait started
+static void cut_to_budget(ai_scheduler s, entity_columns *c, size_t budget) {
+    uint32_t cut = AI_MAX_RANKED_WAIT - 1;
+    size_t longer = 0;
+    while (cut > 0 && longer + s->waits[cut] < budget) {
+        longer += s->waits[cut--];
+    }
+    size_t at_cut = budget - longer;
+
+    for (int bucket = 0; bucket < AI_LOD_BUCKET_COUNT; bucket++) {
+        size_t kept = 0;
+        for (size_t i = 0; i < s->counts[bucket]; i++) {
+            size_t row = s->rows[bucket][i];
+            uint32_t wait = ranked_wait(wait_of(c->think_tick[row], s->tick));
+            if (wait > cut || (wait == cut && at_cut > 0)) {
+                if (wait == cut) at_cut--;
+                s->rows[bucket][kept++] = row;
+                continue;
+            }
+            // Rows yet to think for the first time are due from now on, so they rank by their wait too
+            if (c->think_tick[row] == 0) c->think_tick[row] = s->tick;
+        }
+        s->stats.deferred_last_tick += s->counts[bucket] - kept;
+        s->counts[bucket] = kept;
+    }
+}
+
+int ai_scheduler_plan(ai_scheduler s, entity_storage storage, const entity_position *focus, entity skip) {
+    entity_columns *c = entity_storage_get_columns(storage);
+    if (++s->tick == 0) s->tick = 1;
+    for (int bucket = 0; bucket < AI_LOD_BUCKET_COUNT; bucket++) {
+        s->counts[bucket] = 0;
+        s->stats.bucket_entities[bucket] = 0;
+        s->stats.bucket_updated[bucket] = 0;
+        s->stats.bucket_ms[bucket] = 0.0;
+    }
+    s->stats.updated_last_tick = 0;
+    s->stats.deferred_last_tick = 0;
+    s->stats.max_wait_last_tick = 0;
+    for (uint32_t wait = 0; wait < AI_MAX_RANKED_WAIT; wait++) {
+        s->waits[wait] = 0;
+    }
+    if (reserve(s, c->count) != 0) {
+        log_error("Failed to allocate the AI schedule for {zu} entities", c->count);
+        return 1;
+    }
+
+    size_t due = 0;
+    for (size_t row = 0; row < c->count; row++) {
+        if (c->owners[row] == skip) continue;
+        ai_lod_bucket bucket = bucket_of(c, row, focus);
+        s->stats.bucket_entities[bucket]++;
+        if (is_due(c->think_tick[row], s->tick)) {
+            s->rows[bucket][s->counts[bucket]++] = row;
+            s->waits[ranked_wait(wait_of(c->think_tick[row], s->tick))]++;
+            due++;
+        }
+    }
+    // Taking the same rows first every tick would leave the rest waiting for good
+    if (s->budget > 0 && due > s->budget) {
+        cut_to_budget(s, c, s->budget);
+    }
+
+    for (int bucket = 0; bucket < AI_LOD_BUCKET_COUNT; bucket++) {
+        size_t taken = s->counts[bucket];
+        uint32_t interval = BUCKET_INTERVALS[bucket];
+        for (size_t i = 0; i < taken; i++) {
+            size_t row = s->rows[bucket][i];
+            uint32_t wait = wait_of(c->think_tick[row], s->tick);
+            if (wait > s->stats.max_wait_last_tick) s->stats.max_wait_last_tick = wait;
+            // A first think lands on a random tick of the interval, so a batch spawned together spreads out
+            uint32_t offset = c->think_tick[row] == 0 ? 1 + c->random[row] % interval : interval;
+            c->think_tick[row] = s->tick + offset;
+            if (c->think_tick[row] == 0) c->think_tick[row] = 1;
+        }
+        s->stats.bucket_updated[bucket] = taken;
+        s->stats.updated_last_tick += taken;
+    }
+
+    if (s->stats.max_wait_last_tick > s->stats.max_wait) s->stats.max_wait = s->stats.max_wait_last_tick;
+    s->planned_ticks++;
+    s->total_updated += s->stats.updated_last_tick;
+    s->stats.average_updated = (double) s->total_updated / (double) s->planned_ticks;
+    return 0;
+}
+
+const size_t *ai_scheduler_get_rows(ai_scheduler s, ai_lod_bucket bucket, size_t *out_count) {
+    *out_count = s->counts[bucket];
+    return s->rows[bucket];
+}
+
+void ai_scheduler_record_bucket_time(ai_scheduler s, ai_lod_bucket bucket, double ms) {
+    s->stats.bucket_ms[bucket] += ms;
+}
+
+uint32_t ai_scheduler_get_tick(ai_scheduler s) {
+    return s->tick;
+}
+
+void ai_scheduler_set_tick(ai_scheduler s, uint32_t tick) {
+    s->tick = tick;
+}
+
+ai_scheduler_statistics ai_scheduler_get_stats(ai_scheduler s) {
+    return s->stats;
+}
+
+void ai_scheduler_destroy(ai_scheduler s) {
+    if (s == NULL) return;
+    for (int bucket = 0; bucket < AI_LOD_BUCKET_COUNT; bucket++) {
+        free(s->rows[bucket]);
+    }
+    free(s->waits);
+    free(s);
+}
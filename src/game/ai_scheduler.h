@@ -0,0 +1,51 @@
+#ifndef _H_AI_SCHEDULER_H_
+#define _H_AI_SCHEDULER_H_
+
+#include "entity_defs.h"
+#include "entity_storage.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Decides which entities think each tick. Those near the player think every tick, further ones
+// at lower rates spread over several ticks, and never more than the budget in a single tick
+typedef struct ai_scheduler_s *ai_scheduler;
+
+typedef enum ai_lod_bucket {
+    AI_LOD_NEAR,
+    AI_LOD_MID,
+    AI_LOD_FAR,
+    AI_LOD_BUCKET_COUNT
+} ai_lod_bucket;
+
+typedef struct ai_scheduler_statistics {
+    size_t budget_per_tick;
+    size_t updated_last_tick;
+    // Due last tick but past the budget, they wait for a later one
+    size_t deferred_last_tick;
+    // Most ticks a row waited past its due tick before thinking, last tick and since created
+    uint32_t max_wait_last_tick;
+    uint32_t max_wait;
+    double average_updated;
+    // Entities in each bucket, how many of them thought and how long that took, last tick
+    size_t bucket_entities[AI_LOD_BUCKET_COUNT];
+    size_t bucket_updated[AI_LOD_BUCKET_COUNT];
+    double bucket_ms[AI_LOD_BUCKET_COUNT];
+} ai_scheduler_statistics;
+
+// A budget of 0 lets every due entity think
+ai_scheduler ai_scheduler_create(size_t budget_per_tick);
+// Starts a tick: buckets the storage's rows by distance to focus, all near without one, and takes the
+// due ones that waited longest first, nearest bucket first among equals, until the budget runs out.
+// Taken rows are scheduled for their next think.
+// Meant for one storage, the schedule lives in its rows
+int ai_scheduler_plan(ai_scheduler, entity_storage, const entity_position *focus, entity skip);
+// Rows of the bucket that think this tick, valid until the next plan
+const size_t *ai_scheduler_get_rows(ai_scheduler, ai_lod_bucket, size_t *out_count);
+void ai_scheduler_record_bucket_time(ai_scheduler, ai_lod_bucket, double ms);
+// What the rows' think_tick count in, snapshots keep it along with them
+uint32_t ai_scheduler_get_tick(ai_scheduler);
+void ai_scheduler_set_tick(ai_scheduler, uint32_t tick);
+ai_scheduler_statistics ai_scheduler_get_stats(ai_scheduler);
+void ai_scheduler_destroy(ai_scheduler);
+
+#endif
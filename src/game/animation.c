@@ -315,17 +315,59 @@ iteration_result render_animation_part(void *element, void *_args) {
     return ITERATION_CONTINUE;
 }
 
+static size_t current_step(animation anim, double time) {
+    size_t ms = (size_t) (time * 1000);
+    if (anim->start == 0) {
+        anim->start = ms;
+    }
+    return (ms / anim->interval) % anim->steps;
+}
+
+struct first_part_texture_args_s {
+    animation anim;
+    size_t step;
+    unsigned int texture_id;
+};
+
+static iteration_result first_part_texture(void *element, void *_args) {
+    struct first_part_texture_args_s *args = (struct first_part_texture_args_s *) _args;
+    struct animation_info_s *a_info = (struct animation_info_s *) element;
+
+    snprintf(
+        args->anim->texture_id_buffer,
+        args->anim->texture_id_buffer_size,
+        "%s/%s-%lu",
+        args->anim->base_asset_id,
+        a_info->prefix,
+        args->step
+    );
+    texture anim_texture = asset_manager_get_texture(args->anim->asset_mgr, args->anim->texture_id_buffer);
+    if (anim_texture != NULL) {
+        args->texture_id = texture_get_id(anim_texture);
+    }
+    // Parts of one frame come from the same sheet, the first one stands for all of them
+    return ITERATION_BREAK;
+}
+
+unsigned int animation_get_texture_id(animation anim, double time) {
+    if (anim->anim_config == NULL) return 0;
+
+    struct first_part_texture_args_s first_part_texture_args = {
+        .anim = anim,
+        .step = current_step(anim, time),
+        .texture_id = 0
+    };
+    linked_list_foreach_args(anim->anim_config, first_part_texture, &first_part_texture_args);
+    return first_part_texture_args.texture_id;
+}
+
 int animation_render(animation anim, renderer_ctx ctx, int x, int y, double time, render_anchor anchor) {
     if (anim->anim_config == NULL) {
         log_throttle_error(5000, "Can't render animation '{s}/{s}' before it is loaded", anim->base_asset_id, anim->variant);
         return 1;
     }
 
-    size_t ms = (size_t) (time * 1000);
-    if (anim->start == 0) {
-        anim->start = ms;
-    }
-    size_t step = (ms / anim->interval) % anim->steps;
+    size_t step = current_step(anim, time);
 
     int anchor_x = 0, anchor_y = 0;
     if (anchor & RENDER_ANCHOR_BOTTOM) {
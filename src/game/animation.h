@@ -9,6 +9,8 @@ typedef struct animation_s *animation;
 animation animation_create(asset_manager_ctx, const char *asset_id, const char *variant);
 animation animation_copy(animation);
 int animation_render(animation, renderer_ctx, int x, int y, double time, render_anchor);
+// GPU texture the current frame is drawn from, 0 if it isn't loaded
+unsigned int animation_get_texture_id(animation, double time);
 int animation_render_bounds(animation, renderer_ctx, int x, int y, render_anchor);
 int animation_load(animation);
 int animation_unload(animation);
@@ -41,9 +41,13 @@ struct asset_manager_ctx_s {
     linked_list changed_files_queue;
     mtx_t changed_files_queue_mtx;
     int changed_files_queue_mtx_init;
+    // No GL context, assets are only given ids
+    int headless;
 };
 
 static void track_for_hot_reload(asset_manager_ctx ctx, const char *filename, const char *key, record_type type) {
+    // Assets loaded again after being unloaded are still being watched
+    if (hashtable_get(ctx->file_record, filename) != NULL) return;
     file_record_info *fr_info = (file_record_info *) malloc(sizeof(file_record_info));
     if (fr_info == NULL) return;
     fr_info->key = utils_copy_string(key);
@@ -428,13 +432,17 @@ asset asset_manager_asset_preload(asset_manager_ctx ctx, const char* asset_id) {
     return _asset_manager_asset_preload(ctx, asset_id, 1);
 }
 
+static int upload_asset(asset_manager_ctx ctx, asset a) {
+    return ctx->headless ? asset_to_gpu_headless(a) : asset_to_gpu(a);
+}
+
 static asset _asset_manager_asset_gpu_preload(asset_manager_ctx ctx, const char* asset_id, int increment_refcount) {
     asset result = _asset_manager_asset_preload(ctx, asset_id, increment_refcount);
     if (result == NULL) {
         return NULL;
     }
     if (!asset_is_gpu_loaded(result)) {
-        if (asset_to_gpu(result) != 0) {
+        if (upload_asset(ctx, result) != 0) {
             log_error("Failed to load asset '{s}' to the GPU", asset_id);
             return NULL;
         }
@@ -443,6 +451,10 @@ static asset _asset_manager_asset_gpu_preload(asset_manager_ctx ctx, const char*
     return result;
 }
 
+void asset_manager_set_headless(asset_manager_ctx ctx, int headless) {
+    ctx->headless = headless;
+}
+
 asset asset_manager_asset_gpu_preload(asset_manager_ctx ctx, const char* asset_id) {
     return _asset_manager_asset_gpu_preload(ctx, asset_id, 1);
 }
@@ -530,6 +542,8 @@ int asset_manager_asset_unload(asset_manager_ctx ctx, const char* asset_id) {
         return 0;
     }
     log_debug("Unloading asset '{s}'", asset_id);
+    // Child textures unload their parent asset when they go, so it must already be gone by then
+    hashtable_pop(ctx->loaded_assets, asset_id);
     if (asset_is_gpu_loaded(result->asset)) {
         // Since this asset has been loaded into the GPU, it might have
         // textures instantiated from it which must be deleted as well.
@@ -540,6 +554,7 @@ int asset_manager_asset_unload(asset_manager_ctx ctx, const char* asset_id) {
         // iterating through the list.
         linked_list textures_to_remove = linked_list_create_borrowed();
         if (textures_to_remove == NULL) {
+            hashtable_set(ctx->loaded_assets, asset_id, result);
             return 1;
         }
 
@@ -563,7 +578,6 @@ int asset_manager_asset_unload(asset_manager_ctx ctx, const char* asset_id) {
         result->ref_count -= linked_list_size(textures_to_remove);
         linked_list_destroy(textures_to_remove);
     }
-    hashtable_pop(ctx->loaded_assets, asset_id);
     asset_unload(result->asset);
     free(result);
     log_debug("Unloaded asset '{s}'", asset_id);
@@ -711,7 +725,7 @@ static void reload_asset(asset_manager_ctx ctx, const char *asset_id, const char
     else {
         // If the asset *is* GPU loaded, our work is much harder; we have to update all child
         // textures
-        if (asset_to_gpu(new_asset) != 0) {
+        if (upload_asset(ctx, new_asset) != 0) {
             log_warning("Failed to load asset '{s}' to the GPU", asset_id);
             asset_unload(new_asset);
             return;
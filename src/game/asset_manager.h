@@ -20,6 +20,8 @@ typedef struct texture_info {
 } texture_info;
 
 asset_manager_ctx asset_manager_init();
+// For running without a window: assets loaded from then on are never uploaded to the GPU
+void asset_manager_set_headless(asset_manager_ctx, int headless);
 int asset_manager_asset_and_textures_preload(asset_manager_ctx, const char* asset_id);
 asset asset_manager_asset_gpu_preload(asset_manager_ctx, const char* asset_id);
 asset asset_manager_asset_preload(asset_manager_ctx, const char* asset_id);
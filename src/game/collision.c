@@ -0,0 +1,340 @@
+#include "collision.h"
+#include "config.h"
+#include "logger/logger.h"
+#include "utils/utils.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// A row's place on the x axis, kept sorted between steps
+typedef struct collision_proxy {
+    float min_x;
+    uint32_t row;
+} collision_proxy;
+
+struct collision_world_s {
+    collision_box *boxes;
+    collision_proxy *proxies;
+    size_t capacity, proxy_count;
+    collision_contact *contacts;
+    size_t contact_count;
+    collision_statistics stats;
+};
+
+collision_world collision_world_create() {
+    collision_world w = (collision_world) calloc(1, sizeof(struct collision_world_s));
+    if (w == NULL) {
+        return NULL;
+    }
+    w->contacts = (collision_contact *) malloc(COLLISION_MAX_CONTACTS * sizeof(collision_contact));
+    if (w->contacts == NULL) {
+        collision_world_destroy(w);
+        return NULL;
+    }
+    return w;
+}
+
+static int reserve(collision_world w, size_t count) {
+    if (count <= w->capacity) return 0;
+    size_t capacity = w->capacity ? w->capacity : 64;
+    while (capacity < count) capacity *= 2;
+
+    collision_box *boxes = (collision_box *) realloc(w->boxes, capacity * sizeof(collision_box));
+    if (boxes == NULL) return 1;
+    w->boxes = boxes;
+    collision_proxy *proxies = (collision_proxy *) realloc(w->proxies, capacity * sizeof(collision_proxy));
+    if (proxies == NULL) return 1;
+    w->proxies = proxies;
+    w->capacity = capacity;
+    return 0;
+}
+
+collision_box collision_box_of(entity_position position, entity_hitbox hitbox) {
+    return (collision_box) {
+        .min_x = position.x,
+        .min_y = position.y - (float) hitbox.height,
+        .max_x = position.x + (float) hitbox.width,
+        .max_y = position.y
+    };
+}
+
+// Where a row stands on the map: the single point entity_manager maps to a cell when it plans and walks
+// paths. Sprite sized hitboxes are wider than the corridors those paths go through, so rows walking one
+// are kept out of walls by this instead
+static collision_box footprint_of(entity_position position) {
+    return (collision_box) {
+        .min_x = position.x,
+        .min_y = position.y,
+        .max_x = nextafterf(position.x, INFINITY),
+        .max_y = nextafterf(position.y, INFINITY)
+    };
+}
+
+static int box_is_empty(const collision_box *box) {
+    return box->max_x <= box->min_x || box->max_y <= box->min_y;
+}
+
+collision_tiles collision_tiles_of_map(map m) {
+    collision_tiles tiles = { 0 };
+    tiles.cells = map_get_collision_grid(m, &tiles.width, &tiles.height);
+    map_get_tile_dimensions(m, &tiles.tile_width, &tiles.tile_height);
+    return tiles;
+}
+
+static int tile_blocks(const collision_tiles *tiles, int x, int y) {
+    if (tiles->cells == NULL) return 0;
+    if (x < 0 || y < 0 || x >= tiles->width || y >= tiles->height) return 1;
+    return tiles->cells[x + y * tiles->width] != 0;
+}
+
+static int span_blocked(const collision_tiles *tiles, int fixed, int first, int last, int vertical, integer_position *out_tile) {
+    for (int i = first; i <= last; i++) {
+        int x = vertical ? i : fixed, y = vertical ? fixed : i;
+        if (tile_blocks(tiles, x, y)) {
+            if (out_tile != NULL) *out_tile = (integer_position) { .x = x, .y = y };
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Walks the cells the leading edge crosses, one line of cells at a time, so nothing tunnels through thin walls
+static float sweep_axis(const collision_tiles *tiles, const collision_box *box, float d, int vertical, int *out_hit, integer_position *out_tile) {
+    *out_hit = 0;
+    if (d == 0.0f) return 0.0f;
+
+    float tile_width = (float) tiles->tile_width, tile_height = (float) tiles->tile_height;
+    float size = vertical ? tile_height : tile_width, side = vertical ? tile_width : tile_height;
+    float min = vertical ? box->min_y : box->min_x, max = vertical ? box->max_y : box->max_x;
+    float side_min = vertical ? box->min_x : box->min_y, side_max = vertical ? box->max_x : box->max_y;
+    int first_side = (int) floorf(side_min / side), last_side = (int) ceilf(side_max / side) - 1;
+
+    if (d > 0.0f) {
+        int last_line = (int) ceilf((max + d) / size) - 1;
+        for (int line = (int) ceilf(max / size); line <= last_line; line++) {
+            if (span_blocked(tiles, line, first_side, last_side, vertical, out_tile)) {
+                *out_hit = 1;
+                return (float) line * size - max;
+            }
+        }
+    }
+    else {
+        int last_line = (int) floorf((min + d) / size);
+        for (int line = (int) floorf(min / size) - 1; line >= last_line; line--) {
+            if (span_blocked(tiles, line, first_side, last_side, vertical, out_tile)) {
+                *out_hit = 1;
+                return (float) (line + 1) * size - min;
+            }
+        }
+    }
+    return d;
+}
+
+static void offset_box(collision_box *box, float dx, float dy) {
+    box->min_x += dx;
+    box->max_x += dx;
+    box->min_y += dy;
+    box->max_y += dy;
+}
+
+static int tiles_are_usable(const collision_tiles *tiles) {
+    return tiles != NULL && tiles->cells != NULL && tiles->tile_width > 0 && tiles->tile_height > 0;
+}
+
+int collision_sweep_box(const collision_tiles *tiles, collision_box box, float dx, float dy, float *out_dx, float *out_dy, integer_position *out_tile) {
+    if (!tiles_are_usable(tiles) || box_is_empty(&box)) {
+        *out_dx = dx;
+        *out_dy = dy;
+        return 0;
+    }
+
+    int hit_x = 0, hit_y = 0;
+    *out_dx = sweep_axis(tiles, &box, dx, 0, &hit_x, out_tile);
+    offset_box(&box, *out_dx, 0.0f);
+    *out_dy = sweep_axis(tiles, &box, dy, 1, &hit_y, hit_x ? NULL : out_tile);
+    return hit_x || hit_y;
+}
+
+static void add_contact(collision_world w, const collision_contact *contact) {
+    if (contact->type == COLLISION_CONTACT_TILE) w->stats.tile_contacts++;
+    else w->stats.entity_contacts++;
+    if (w->contact_count == COLLISION_MAX_CONTACTS) {
+        w->stats.dropped_contacts++;
+        return;
+    }
+    w->contacts[w->contact_count++] = *contact;
+}
+
+static void add_tile_contact(collision_world w, const entity_columns *c, size_t row, integer_position tile, float normal_x, float normal_y) {
+    collision_contact contact = {
+        .type = COLLISION_CONTACT_TILE,
+        .row_a = row,
+        .row_b = ENTITY_STORAGE_INVALID_ROW,
+        .a = c->owners[row],
+        .b = NULL,
+        .tile = tile,
+        .normal_x = normal_x,
+        .normal_y = normal_y
+    };
+    add_contact(w, &contact);
+}
+
+static void move_rows(collision_world w, entity_columns *c, const collision_tiles *tiles, float dt) {
+    int usable = tiles_are_usable(tiles);
+
+    for (size_t row = 0; row < c->count; row++) {
+        float dx = c->velocity_x[row] * dt, dy = c->velocity_y[row] * dt;
+        if (dx == 0.0f && dy == 0.0f) continue;
+
+        // Rows only think every few ticks far from the player and keep walking in between, so
+        // even path steps can overshoot into a wall
+        entity_position position = { c->position_x[row], c->position_y[row] };
+        collision_box box = (c->flags[row] & ENTITY_FLAG_HAS_IMMEDIATE_GOAL)
+            ? footprint_of(position) : collision_box_of(position, c->hitbox[row]);
+        if (box_is_empty(&box) || !usable) {
+            c->position_x[row] += dx;
+            c->position_y[row] += dy;
+            continue;
+        }
+
+        w->stats.swept_bodies++;
+        int hit_x = 0, hit_y = 0;
+        integer_position tile_x = { 0 }, tile_y = { 0 };
+        float moved_x = sweep_axis(tiles, &box, dx, 0, &hit_x, &tile_x);
+        offset_box(&box, moved_x, 0.0f);
+        float moved_y = sweep_axis(tiles, &box, dy, 1, &hit_y, &tile_y);
+        c->position_x[row] += moved_x;
+        c->position_y[row] += moved_y;
+
+        // Whatever stopped the row also stops its velocity, for anything reading it this tick
+        if (hit_x) {
+            c->velocity_x[row] = 0.0f;
+            add_tile_contact(w, c, row, tile_x, dx > 0.0f ? -1.0f : 1.0f, 0.0f);
+        }
+        if (hit_y) {
+            c->velocity_y[row] = 0.0f;
+            add_tile_contact(w, c, row, tile_y, 0.0f, dy > 0.0f ? -1.0f : 1.0f);
+        }
+    }
+}
+
+static int compare_proxies(const void *a, const void *b) {
+    float min_a = ((const collision_proxy *) a)->min_x, min_b = ((const collision_proxy *) b)->min_x;
+    return (min_a > min_b) - (min_a < min_b);
+}
+
+static void sort_proxies(collision_world w, size_t count) {
+    // Rows came or went, their indices can't be trusted anymore
+    if (w->proxy_count != count) {
+        for (size_t i = 0; i < count; i++) {
+            w->proxies[i].row = (uint32_t) i;
+        }
+        w->proxy_count = count;
+    }
+    for (size_t i = 0; i < count; i++) {
+        w->proxies[i].min_x = w->boxes[w->proxies[i].row].min_x;
+    }
+
+    // Bodies barely move between ticks, so last tick's order is almost sorted and insertion sort is
+    // close to linear. Past a few shifts per body it's cheaper to start over
+    size_t shifts = 0, max_shifts = COLLISION_MAX_SORT_SHIFTS_PER_BODY * count;
+    for (size_t i = 1; i < count; i++) {
+        collision_proxy proxy = w->proxies[i];
+        size_t j = i;
+        while (j > 0 && w->proxies[j - 1].min_x > proxy.min_x) {
+            w->proxies[j] = w->proxies[j - 1];
+            j--;
+            shifts++;
+        }
+        w->proxies[j] = proxy;
+        if (shifts > max_shifts) {
+            qsort(w->proxies, count, sizeof(collision_proxy), compare_proxies);
+            return;
+        }
+    }
+}
+
+static void find_entity_contacts(collision_world w, const entity_columns *c) {
+    for (size_t row = 0; row < c->count; row++) {
+        entity_position position = { c->position_x[row], c->position_y[row] };
+        w->boxes[row] = collision_box_of(position, c->hitbox[row]);
+    }
+    sort_proxies(w, c->count);
+
+    // Sweep and prune: only bodies starting before this one ends on x can touch it. A crowd piled
+    // on one spot is quadratic, so the pairs tested per tick are capped
+    for (size_t i = 0; i < c->count; i++) {
+        if (w->stats.pairs_tested >= COLLISION_MAX_PAIRS_PER_TICK) {
+            w->stats.skipped_bodies = c->count - i;
+            break;
+        }
+        uint32_t row_a = w->proxies[i].row;
+        const collision_box *a = &w->boxes[row_a];
+        if (box_is_empty(a)) continue;
+        for (size_t j = i + 1; j < c->count && w->proxies[j].min_x < a->max_x; j++) {
+            uint32_t row_b = w->proxies[j].row;
+            const collision_box *b = &w->boxes[row_b];
+            if (box_is_empty(b)) continue;
+            w->stats.pairs_tested++;
+            if (a->min_y >= b->max_y || b->min_y >= a->max_y) continue;
+
+            // Normal along the axis they overlap least on
+            float overlap_x = fminf(a->max_x, b->max_x) - fmaxf(a->min_x, b->min_x);
+            float overlap_y = fminf(a->max_y, b->max_y) - fmaxf(a->min_y, b->min_y);
+            collision_contact contact = {
+                .type = COLLISION_CONTACT_ENTITY,
+                .row_a = row_a,
+                .row_b = row_b,
+                .a = c->owners[row_a],
+                .b = c->owners[row_b],
+                .tile = { 0 },
+                .normal_x = overlap_x <= overlap_y ? (a->min_x + a->max_x < b->min_x + b->max_x ? -1.0f : 1.0f) : 0.0f,
+                .normal_y = overlap_x <= overlap_y ? 0.0f : (a->min_y + a->max_y < b->min_y + b->max_y ? -1.0f : 1.0f)
+            };
+            add_contact(w, &contact);
+        }
+    }
+}
+
+int collision_world_step(collision_world w, entity_storage storage, const collision_tiles *tiles, float dt) {
+    double start = utils_get_time();
+    entity_columns *c = entity_storage_get_columns(storage);
+    w->contact_count = 0;
+    w->stats.bodies = c->count;
+    w->stats.swept_bodies = 0;
+    w->stats.pairs_tested = 0;
+    w->stats.tile_contacts = 0;
+    w->stats.entity_contacts = 0;
+    w->stats.dropped_contacts = 0;
+    w->stats.skipped_bodies = 0;
+
+    if (reserve(w, c->count) != 0) {
+        // Still move everyone, just without any collisions this tick
+        log_error("Failed to allocate memory for {zu} colliding entities", c->count);
+        entity_storage_integrate(storage, dt);
+        return 1;
+    }
+    move_rows(w, c, tiles, dt);
+    find_entity_contacts(w, c);
+
+    w->stats.last_step_ms = (utils_get_time() - start) * 1000.0;
+    if (w->stats.last_step_ms > w->stats.max_step_ms) w->stats.max_step_ms = w->stats.last_step_ms;
+    return 0;
+}
+
+const collision_contact *collision_world_get_contacts(collision_world w, size_t *out_count) {
+    *out_count = w->contact_count;
+    return w->contacts;
+}
+
+collision_statistics collision_world_get_stats(collision_world w) {
+    return w->stats;
+}
+
+void collision_world_destroy(collision_world w) {
+    if (w == NULL) return;
+    free(w->boxes);
+    free(w->proxies);
+    free(w->contacts);
+    free(w);
+}
@@ -0,0 +1,72 @@
+#ifndef _H_COLLISION_H_
+#define _H_COLLISION_H_
+
+#include "entity_defs.h"
+#include "entity_storage.h"
+#include "map.h"
+#include <stddef.h>
+
+// Moves entity rows against the map's collision layer and reports which hitboxes touch what
+typedef struct collision_world_s *collision_world;
+
+// Pixels, max edges exclusive
+typedef struct collision_box {
+    float min_x, min_y, max_x, max_y;
+} collision_box;
+
+// A collision layer, one cell per tile and non zero where it blocks. Outside of it everything blocks
+typedef struct collision_tiles {
+    const int *cells;
+    int width, height;
+    int tile_width, tile_height;
+} collision_tiles;
+
+typedef enum collision_contact_type {
+    COLLISION_CONTACT_TILE,
+    COLLISION_CONTACT_ENTITY
+} collision_contact_type;
+
+typedef struct collision_contact {
+    collision_contact_type type;
+    // Rows as they were during the step. b is only set for entity contacts
+    size_t row_a, row_b;
+    entity a, b;
+    // The blocking cell, for tile contacts
+    integer_position tile;
+    // Unit axis pointing from what was hit towards a
+    float normal_x, normal_y;
+} collision_contact;
+
+typedef struct collision_statistics {
+    size_t bodies;
+    size_t swept_bodies;
+    size_t pairs_tested;
+    size_t tile_contacts;
+    size_t entity_contacts;
+    // Found past COLLISION_MAX_CONTACTS and not reported
+    size_t dropped_contacts;
+    // Bodies the broadphase didn't get to once COLLISION_MAX_PAIRS_PER_TICK ran out
+    size_t skipped_bodies;
+    double last_step_ms;
+    double max_step_ms;
+} collision_statistics;
+
+collision_world collision_world_create();
+// Moves every row along its velocity, stopping short of blocking tiles, then finds overlapping hitboxes.
+// Rows walking a path are stopped by the cell their position falls in rather than by their hitbox.
+// Takes the place of entity_storage_integrate
+int collision_world_step(collision_world, entity_storage, const collision_tiles *, float dt);
+// Contacts found by the last step, valid until the next one
+const collision_contact *collision_world_get_contacts(collision_world, size_t *out_count);
+collision_statistics collision_world_get_stats(collision_world);
+void collision_world_destroy(collision_world);
+
+// Borrows the map's collision layer, valid while the map stays loaded
+collision_tiles collision_tiles_of_map(map);
+// Box of a hitbox whose bottom left corner is at the position
+collision_box collision_box_of(entity_position, entity_hitbox);
+// How far the box gets along (dx, dy) before touching a blocking tile, x first. Cells the box already
+// overlaps don't block, so anything stuck in a wall can walk out. Returns 1 if it was stopped
+int collision_sweep_box(const collision_tiles *, collision_box, float dx, float dy, float *out_dx, float *out_dy, integer_position *out_tile);
+
+#endif
@@ -1,14 +1,79 @@
 #ifndef _H_CONFIG_H_
 #define _H_CONFIG_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 static const char ASSETS_PATH_PREFIX[] = "assets/";
 static const char ANIM_CONFIG_FILE_EXT[] = ".anim-config.json";
 static const char ASSET_CONFIG_FILE_EXT[] = ".asset-config.json";
 static const char FONT_CONFIG_FILE_EXT[] = ".font-config.json";
 static const char MAP_CONFIG_FILE_EXT[] = ".map-config.json";
+static const char MAP_BINARY_FILE_EXT[] = ".map.bin";
+static const char MAP_CHUNKS_DIR_EXT[] = ".chunks";
 static const char LEVEL_CONFIG_FILE_EXT[] = ".level-config.json";
 static const char ENTITY_CONFIG_FILE_EXT[] = ".entity-config.json";
 
+// Maps are split into square chunks of this many tiles per side for culling
+#define MAP_CHUNK_SIZE 32
+
+// Streaming maps keep chunks within the load radius (in chunks) of the player resident, and
+// drop them once they're past the evict radius or the memory budget runs out
+#define MAP_STREAMING_LOAD_RADIUS 1
+#define MAP_STREAMING_EVICT_RADIUS 2
+static const size_t MAP_STREAMING_MEMORY_BUDGET = 16 * 1024 * 1024;
+// Loaded chunks handed over to the map per update, bounds the main thread's share of the work
+static const size_t MAP_STREAMING_INTEGRATIONS_PER_UPDATE = 2;
+// Streaming updates slower than this are counted as hitches
+static const double MAP_STREAMING_HITCH_MS = 2.0;
+
+// Maximum number of A* node expansions shared by all path requests in a single tick
+static const size_t PATHFINDING_NODE_BUDGET_PER_TICK = 2048;
+
+// Levels left by the player stay in memory until this much is used by all of them
+static const size_t LEVEL_RESIDENCY_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+// Entities are indexed in cells of this many pixels per side, hashed into this many buckets
+static const float ENTITY_GRID_CELL_SIZE = 64.0f;
+static const size_t ENTITY_GRID_BUCKETS = 4096;
+
+// Pixels per second, two and a half tiles
+static const float ENTITY_WALK_SPEED = 2.5f * 16.0f;
+
+// Threads sharing the entity update, 0 for one per core. Smaller batches of rows stay on the main thread
+static const int ENTITY_UPDATE_THREADS = 0;
+static const size_t ENTITY_UPDATE_MIN_BATCH = 256;
+
+// Entities are drawn back to front by the y of their feet, in bands this many pixels tall. Within
+// a band they're grouped by texture so neighbouring sprites share a draw call
+static const float ENTITY_DRAW_Y_BAND = 4.0f;
+
+// Entities within the near radius of the player think every tick, those within the mid radius every
+// few ticks and the rest less often still, staggered so they don't all land on the same tick
+static const float AI_LOD_NEAR_RADIUS = 320.0f;
+static const float AI_LOD_MID_RADIUS = 960.0f;
+static const uint32_t AI_LOD_MID_INTERVAL = 4;
+static const uint32_t AI_LOD_FAR_INTERVAL = 8;
+// Entities thinking per tick at most, those waiting longest past their due tick first and nearest
+// bucket first among equals. The rest stay due and wait one more tick
+static const size_t AI_THINK_BUDGET_PER_TICK = 8192;
+// Waits are ranked up to this many ticks, longer ones all count the same
+static const uint32_t AI_MAX_RANKED_WAIT = 64;
+
+// Contacts reported per tick, more are counted but dropped so a pile-up can't stall the tick
+static const size_t COLLISION_MAX_CONTACTS = 4096;
+// Broadphase pairs tested per tick, bodies past it go without entity contacts for the tick
+static const size_t COLLISION_MAX_PAIRS_PER_TICK = 262144;
+// Past this many insertion sort shifts per body the broadphase sorts from scratch
+static const size_t COLLISION_MAX_SORT_SHIFTS_PER_BODY = 8;
+
+// Sight radius in tiles of the player, which drives the fog of war, and of every other entity
+static const int FOV_PLAYER_RADIUS = 10;
+static const int FOV_ENTITY_RADIUS = 6;
+// Darkness of the cells the player has seen before but can't see now, and of those never seen
+static const float FOG_EXPLORED_ALPHA = 0.6f;
+static const float FOG_UNEXPLORED_ALPHA = 1.0f;
+
 typedef enum direction_e {
     DIRECTION_NONE,
     DIRECTION_UP,
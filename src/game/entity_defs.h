@@ -3,6 +3,8 @@
 
 typedef struct entity_manager_ctx_s *entity_manager_ctx;
 typedef struct entity_s *entity;
+// What every instance of an entity shares: name, attributes, hitbox and animations
+typedef struct entity_archetype_s *entity_archetype;
 typedef struct entity_position {
     float x, y;
 } entity_position;
@@ -1,4 +1,8 @@
 #include "entity_manager.h"
+#include "entity_storage.h"
+#include "worker_pool.h"
+#include "collision.h"
+#include "ai_scheduler.h"
 #include "animation.h"
 #include "map.h"
 #include "level_manager.h"
@@ -6,6 +10,7 @@
 #include "utils/utils.h"
 #include "logger/logger.h"
 #include "data_structures/hashtable.h"
+#include "data_structures/spatial_grid.h"
 #include "rules.h"
 #include <stdlib.h>
 #include <stddef.h>
@@ -13,13 +18,19 @@
 
 #define LOAD_FAIL(...) do { log_error(__VA_ARGS__); return_value = 1; goto cleanup; } while (0)
 
-entity entity_create(const char* entity_id);
+entity entity_create(entity_storage, entity_archetype);
 void entity_destroy(entity);
 
 struct entity_manager_ctx_s {
     asset_manager_ctx asset_mgr;
     hashtable entity_config;
-    hashtable entities;
+    // Loaded archetypes by entity id, dropped once their last instance is destroyed
+    hashtable archetypes;
+    // Rows of instances not yet placed in a level
+    entity_storage storage;
+    worker_pool workers;
+    // Seeds every new instance's random state, in spawn order
+    uint32_t spawned;
 };
 
 typedef struct entity_action {
@@ -27,38 +38,54 @@ typedef struct entity_action {
     char *clip;
 } entity_action;
 
-typedef struct entity_state {
-    int moving, visible, has_immediate_goal;
-    entity_position position;
-    direction facing;
-    linked_list path;
-    integer_position goal, immediate_goal;
-
-    game_attributes current_attributes;
-} entity_state;
-
 typedef struct state_map_entry {
     size_t entry_size;
     entity_action *states;
 } state_map_entry;
 
-struct entity_s {
+#define DIRECTION_COUNT (DIRECTION_LEFT + 1)
+
+// Keys of sprites.state_map, in entity_state order
+static const char *ENTITY_STATE_NAMES[ENTITY_STATE_COUNT] = { "idle", "walk", "attack", "hurt", "death" };
+
+// Everything read from an entity's config, shared by all of its instances and never changed after loading
+struct entity_archetype_s {
+    entity_manager_ctx ctx;
+    size_t ref_count;
+
     char *name;
     char *entity_id;
 
     hashtable animations;
+    // Only kept while loading, compiled into clips afterwards
     hashtable state_map;
+    // Animation to play for every state and facing, fallbacks already resolved. Borrowed from animations
+    animation clips[ENTITY_STATE_COUNT][DIRECTION_COUNT];
 
     base_attributes base_attributes;
     entity_hitbox hitbox;
 
-    entity_state state;
+    // Despawned instances waiting to be spawned again, linked through next_pooled.
+    // Each still holds its reference, so waves don't reload the archetype
+    entity pool;
 };
 
-typedef struct ref_counted_entity {
-    entity entity;
-    size_t ref_count;
-} ref_counted_entity;
+struct entity_s {
+    entity_archetype archetype;
+    game_attributes current_attributes;
+
+    // Everything touched every tick lives in a row of the storage
+    entity_storage storage;
+    size_t row;
+
+    // Level's proximity index, if the entity has been placed in one
+    spatial_grid grid;
+    spatial_grid_handle grid_handle;
+
+    // Created on the first update, copies start without one. Kept while pooled
+    fov_viewer sight;
+    entity next_pooled;
+};
 
 static char *get_entity_path(const char *partial_path) {
     char *fullpath = (char*) calloc(
@@ -100,7 +127,7 @@ cleanup:
     return return_value;
 }
 
-static int load_entity_base_attributes(entity e, cJSON *entity_config) {
+static int load_entity_base_attributes(entity_archetype a, cJSON *entity_config) {
     cJSON *base_attributes = cJSON_GetObjectItem(entity_config, "base_attributes");
     if (base_attributes == NULL || !cJSON_IsObject(base_attributes)) {
         log_error("Failed to parse config for entity '{s}': base_attributes must be an object");
@@ -116,28 +143,28 @@ static int load_entity_base_attributes(entity e, cJSON *entity_config) {
     cJSON *armor_class = cJSON_GetObjectItem(base_attributes, "ac");
     cJSON *level = cJSON_GetObjectItem(base_attributes, "level");
 
-    if (strength == NULL || !cJSON_IsNumber(strength)) { log_error("Failed to parse config for entity '{s}': base_attributes.str must be a number", e->entity_id); return 1; }
-    if (dexterity == NULL || !cJSON_IsNumber(dexterity)) { log_error("Failed to parse config for entity '{s}': base_attributes.dex must be a number", e->entity_id); return 1; }
-    if (constitution == NULL || !cJSON_IsNumber(constitution)) { log_error("Failed to parse config for entity '{s}': base_attributes.con must be a number", e->entity_id); return 1; }
-    if (intelligence == NULL || !cJSON_IsNumber(intelligence)) { log_error("Failed to parse config for entity '{s}': base_attributes.int must be a number", e->entity_id); return 1; }
-    if (wisdom == NULL || !cJSON_IsNumber(wisdom)) { log_error("Failed to parse config for entity '{s}': base_attributes.wis must be a number", e->entity_id); return 1; }
-    if (charisma == NULL || !cJSON_IsNumber(charisma)) { log_error("Failed to parse config for entity '{s}': base_attributes.cha must be a number", e->entity_id); return 1; }
-    if (armor_class == NULL || !cJSON_IsNumber(armor_class)) { log_error("Failed to parse config for entity '{s}': base_attributes.ac must be a number", e->entity_id); return 1; }
-    if (level == NULL || !cJSON_IsNumber(level)) { log_error("Failed to parse config for entity '{s}': base_attributes.level must be a number", e->entity_id); return 1; }
-
-    e->base_attributes.strength = (unsigned char) cJSON_GetNumberValue(strength);
-    e->base_attributes.dexterity = (unsigned char) cJSON_GetNumberValue(dexterity);
-    e->base_attributes.constitution = (unsigned char) cJSON_GetNumberValue(constitution);
-    e->base_attributes.intelligence = (unsigned char) cJSON_GetNumberValue(intelligence);
-    e->base_attributes.wisdom = (unsigned char) cJSON_GetNumberValue(wisdom);
-    e->base_attributes.charisma = (unsigned char) cJSON_GetNumberValue(charisma);
-    e->base_attributes.armor_class = (unsigned char) cJSON_GetNumberValue(armor_class);
-    e->base_attributes.level = (unsigned char) cJSON_GetNumberValue(level);
+    if (strength == NULL || !cJSON_IsNumber(strength)) { log_error("Failed to parse config for entity '{s}': base_attributes.str must be a number", a->entity_id); return 1; }
+    if (dexterity == NULL || !cJSON_IsNumber(dexterity)) { log_error("Failed to parse config for entity '{s}': base_attributes.dex must be a number", a->entity_id); return 1; }
+    if (constitution == NULL || !cJSON_IsNumber(constitution)) { log_error("Failed to parse config for entity '{s}': base_attributes.con must be a number", a->entity_id); return 1; }
+    if (intelligence == NULL || !cJSON_IsNumber(intelligence)) { log_error("Failed to parse config for entity '{s}': base_attributes.int must be a number", a->entity_id); return 1; }
+    if (wisdom == NULL || !cJSON_IsNumber(wisdom)) { log_error("Failed to parse config for entity '{s}': base_attributes.wis must be a number", a->entity_id); return 1; }
+    if (charisma == NULL || !cJSON_IsNumber(charisma)) { log_error("Failed to parse config for entity '{s}': base_attributes.cha must be a number", a->entity_id); return 1; }
+    if (armor_class == NULL || !cJSON_IsNumber(armor_class)) { log_error("Failed to parse config for entity '{s}': base_attributes.ac must be a number", a->entity_id); return 1; }
+    if (level == NULL || !cJSON_IsNumber(level)) { log_error("Failed to parse config for entity '{s}': base_attributes.level must be a number", a->entity_id); return 1; }
+
+    a->base_attributes.strength = (unsigned char) cJSON_GetNumberValue(strength);
+    a->base_attributes.dexterity = (unsigned char) cJSON_GetNumberValue(dexterity);
+    a->base_attributes.constitution = (unsigned char) cJSON_GetNumberValue(constitution);
+    a->base_attributes.intelligence = (unsigned char) cJSON_GetNumberValue(intelligence);
+    a->base_attributes.wisdom = (unsigned char) cJSON_GetNumberValue(wisdom);
+    a->base_attributes.charisma = (unsigned char) cJSON_GetNumberValue(charisma);
+    a->base_attributes.armor_class = (unsigned char) cJSON_GetNumberValue(armor_class);
+    a->base_attributes.level = (unsigned char) cJSON_GetNumberValue(level);
 
     return 0;
 }
 
-static entity_action *load_entity_sprite_state_map_action(entity e, cJSON *direction_config, entity_action* action) {
+static entity_action *load_entity_sprite_state_map_action(entity_archetype a, cJSON *direction_config, entity_action* action) {
     direction d = DIRECTION_NONE;
     if (strcmp(direction_config->string, "down") == 0) {
         d = DIRECTION_DOWN;
@@ -155,12 +182,12 @@ static entity_action *load_entity_sprite_state_map_action(entity e, cJSON *direc
         d = DIRECTION_NONE;
     }
     else {
-        log_error("Failed to parse config for entity '{s}': keys of sprites.state_map.* must be one of the following: down, up, left, right, any", e->entity_id);
+        log_error("Failed to parse config for entity '{s}': keys of sprites.state_map.* must be one of the following: down, up, left, right, any", a->entity_id);
         return NULL;
     }
 
     if (!cJSON_IsString(direction_config)) {
-        log_error("Failed to parse config for entity '{s}': sprites.state_map.*.* must be a string", e->entity_id);
+        log_error("Failed to parse config for entity '{s}': sprites.state_map.*.* must be a string", a->entity_id);
         return NULL;
     }
 
@@ -173,16 +200,16 @@ static entity_action *load_entity_sprite_state_map_action(entity e, cJSON *direc
     return action;
 }
 
-static int load_entity_sprite_state_map(entity e, cJSON *sprites) {
+static int load_entity_sprite_state_map(entity_archetype a, cJSON *sprites) {
     int return_value = 0;
     state_map_entry *sm_entry = NULL;
 
     cJSON *state_map = cJSON_GetObjectItem(sprites, "state_map");
-    if (state_map == NULL || !cJSON_IsObject(state_map)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.state_map must be an object", e->entity_id);
+    if (state_map == NULL || !cJSON_IsObject(state_map)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.state_map must be an object", a->entity_id);
 
     cJSON *state_config = NULL;
     cJSON_ArrayForEach(state_config, state_map) {
-        if (!cJSON_IsObject(state_config)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.state_map.* must be an object", e->entity_id);
+        if (!cJSON_IsObject(state_config)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.state_map.* must be an object", a->entity_id);
         cJSON *direction_config = NULL;
 
         sm_entry = (state_map_entry*) calloc(1, sizeof(state_map_entry));
@@ -194,12 +221,12 @@ static int load_entity_sprite_state_map(entity e, cJSON *sprites) {
 
         size_t i = 0;
         cJSON_ArrayForEach(direction_config, state_config) {
-            entity_action *action = load_entity_sprite_state_map_action(e, direction_config, &sm_entry->states[i++]);
+            entity_action *action = load_entity_sprite_state_map_action(a, direction_config, &sm_entry->states[i++]);
             if (action == NULL) { return_value = 1; goto cleanup; }
             sm_entry->entry_size++;
         }
 
-        if (hashtable_set(e->state_map, state_config->string, sm_entry) != 0) LOAD_FAIL("Failed to save entity config");
+        if (hashtable_set(a->state_map, state_config->string, sm_entry) != 0) LOAD_FAIL("Failed to save entity config");
         sm_entry = NULL;
     }
 
@@ -214,45 +241,45 @@ cleanup:
     return return_value;
 }
 
-static int load_entity_sprite_hitbox(entity e, cJSON *sprites) {
+static int load_entity_sprite_hitbox(entity_archetype a, cJSON *sprites) {
     int return_value = 0;
 
     cJSON *hitbox = cJSON_GetObjectItem(sprites, "hitbox");
-    if (hitbox == NULL || !cJSON_IsObject(hitbox)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox must be an object", e->entity_id);
+    if (hitbox == NULL || !cJSON_IsObject(hitbox)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox must be an object", a->entity_id);
 
     cJSON *width = cJSON_GetObjectItem(hitbox, "width");
     cJSON *height = cJSON_GetObjectItem(hitbox, "height");
     cJSON *offset_x = cJSON_GetObjectItem(hitbox, "offset_x");
     cJSON *offset_y = cJSON_GetObjectItem(hitbox, "offset_y");
 
-    if (width == NULL || !cJSON_IsNumber(width)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox.width must be a number", e->entity_id);
-    if (height == NULL || !cJSON_IsNumber(height)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox.height must be a number", e->entity_id);
-    if (offset_x == NULL || !cJSON_IsNumber(offset_x)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox.offset_x must be a number", e->entity_id);
-    if (offset_y == NULL || !cJSON_IsNumber(offset_y)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox.offset_y must be a number", e->entity_id);
+    if (width == NULL || !cJSON_IsNumber(width)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox.width must be a number", a->entity_id);
+    if (height == NULL || !cJSON_IsNumber(height)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox.height must be a number", a->entity_id);
+    if (offset_x == NULL || !cJSON_IsNumber(offset_x)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox.offset_x must be a number", a->entity_id);
+    if (offset_y == NULL || !cJSON_IsNumber(offset_y)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.hitbox.offset_y must be a number", a->entity_id);
 
-    e->hitbox.width = (int) cJSON_GetNumberValue(width);
-    e->hitbox.height = (int) cJSON_GetNumberValue(height);
-    e->hitbox.offset_x = (int) cJSON_GetNumberValue(offset_x);
-    e->hitbox.offset_y = (int) cJSON_GetNumberValue(offset_y);
+    a->hitbox.width = (int) cJSON_GetNumberValue(width);
+    a->hitbox.height = (int) cJSON_GetNumberValue(height);
+    a->hitbox.offset_x = (int) cJSON_GetNumberValue(offset_x);
+    a->hitbox.offset_y = (int) cJSON_GetNumberValue(offset_y);
 
 cleanup:
     return return_value;
 }
 
-static int load_entity_sprite_clips(entity_manager_ctx ctx, entity e, cJSON *sprites) {
+static int load_entity_sprite_clips(entity_manager_ctx ctx, entity_archetype a, cJSON *sprites) {
     int return_value = 0;
     animation anim = NULL;
 
     cJSON *clips = cJSON_GetObjectItem(sprites, "clips");
-    if (clips == NULL || !cJSON_IsObject(clips)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.clips must be an object", e->entity_id);
+    if (clips == NULL || !cJSON_IsObject(clips)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.clips must be an object", a->entity_id);
 
     cJSON *animation_config = NULL;
     cJSON_ArrayForEach(animation_config, clips) {
         cJSON *animation_id = cJSON_GetObjectItem(animation_config, "animation");
-        if (animation_id == NULL || !cJSON_IsString(animation_id)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.clips.*.animation must be a string", e->entity_id);
+        if (animation_id == NULL || !cJSON_IsString(animation_id)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.clips.*.animation must be a string", a->entity_id);
 
         cJSON *variant = cJSON_GetObjectItem(animation_config, "variant");
-        if (variant == NULL || !cJSON_IsString(variant)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.clips.*.variant must be a string", e->entity_id);
+        if (variant == NULL || !cJSON_IsString(variant)) LOAD_FAIL("Failed to parse config for entity '{s}': sprites.clips.*.variant must be a string", a->entity_id);
         
         anim = animation_create(
             ctx->asset_mgr, 
@@ -260,12 +287,12 @@ static int load_entity_sprite_clips(entity_manager_ctx ctx, entity e, cJSON *spr
             cJSON_GetStringValue(variant)
         );
 
-        if (anim == NULL) LOAD_FAIL("Failed to create animation for entity '{s}'", e->entity_id);
+        if (anim == NULL) LOAD_FAIL("Failed to create animation for entity '{s}'", a->entity_id);
 
         // Should we load all animations eagerly like this?
-        if (animation_load(anim) != 0) LOAD_FAIL("Failed to load animation for entity '{s}'", e->entity_id);
+        if (animation_load(anim) != 0) LOAD_FAIL("Failed to load animation for entity '{s}'", a->entity_id);
 
-        if (hashtable_set(e->animations, animation_config->string, anim) != 0) LOAD_FAIL("Failed to save animation for entity '{s}'", e->entity_id);
+        if (hashtable_set(a->animations, animation_config->string, anim) != 0) LOAD_FAIL("Failed to save animation for entity '{s}'", a->entity_id);
         anim = NULL;
     }
 
@@ -274,24 +301,123 @@ cleanup:
     return return_value;
 }
 
-static int load_entity_sprites(entity_manager_ctx ctx, entity e, cJSON *entity_config) {
+static iteration_result destroy_entity_action(const hashtable_entry *entry) {
+    state_map_entry *action = (state_map_entry *) entry->value;
+    for (size_t i = 0; i < action->entry_size; i++) {
+        free(action->states[i].clip);
+    }
+    free(action->states);
+    free(action);
+    return ITERATION_CONTINUE;
+}
+
+static animation resolve_clip(entity_archetype a, entity_state state, direction d) {
+    state_map_entry *entry = hashtable_get(a->state_map, ENTITY_STATE_NAMES[state]);
+    if (entry == NULL) {
+        entry = hashtable_get(a->state_map, "*");
+        if (entry == NULL) {
+            return NULL;
+        }
+    }
+    char *any_fallback_clip = NULL, *result_clip = NULL;
+    for (size_t i = 0; i < entry->entry_size; i++) {
+        entity_action *action = &entry->states[i];
+        if (action->direction == DIRECTION_NONE) {
+            any_fallback_clip = action->clip;
+        }
+        else if (action->direction == d) {
+            result_clip = action->clip;
+            break;
+        }
+    }
+    char *clip = result_clip != NULL ? result_clip : any_fallback_clip;
+    if (clip == NULL) {
+        return NULL;
+    }
+    animation anim = hashtable_get(a->animations, clip);
+    if (anim == NULL) {
+        log_warning("Entity '{s}' maps a state to unknown clip '{s}'", a->entity_id, clip);
+    }
+    return anim;
+}
+
+static void compile_state_map(entity_archetype a) {
+    for (int state = 0; state < ENTITY_STATE_COUNT; state++) {
+        for (int d = 0; d < DIRECTION_COUNT; d++) {
+            a->clips[state][d] = resolve_clip(a, (entity_state) state, (direction) d);
+        }
+    }
+    hashtable_foreach(a->state_map, destroy_entity_action);
+    hashtable_destroy(a->state_map);
+    a->state_map = NULL;
+}
+
+static int load_entity_sprites(entity_manager_ctx ctx, entity_archetype a, cJSON *entity_config) {
     cJSON *sprites = cJSON_GetObjectItem(entity_config, "sprites");
     if (sprites == NULL || !cJSON_IsObject(sprites)) {
-        log_error("Failed to parse config for entity '{s}': sprites must be an object", e->entity_id);
+        log_error("Failed to parse config for entity '{s}': sprites must be an object", a->entity_id);
         return 1;
     }
 
-    if (load_entity_sprite_clips(ctx, e, sprites) != 0) return 1;
-    if (load_entity_sprite_state_map(e, sprites) != 0) return 1;
-    if (load_entity_sprite_hitbox(e, sprites) != 0) return 1;
+    if (load_entity_sprite_clips(ctx, a, sprites) != 0) return 1;
+    if (load_entity_sprite_state_map(a, sprites) != 0) return 1;
+    if (load_entity_sprite_hitbox(a, sprites) != 0) return 1;
+    compile_state_map(a);
     return 0;
 }
 
-static entity load_entity(entity_manager_ctx ctx, const char *entity_id) {
+static iteration_result destroy_entity_animation(const hashtable_entry *entry) {
+    animation anim = (animation) entry->value;
+    animation_destroy(anim);
+    return ITERATION_CONTINUE;
+}
+
+static void destroy_pooled_instance(entity e) {
+    fov_viewer_destroy(e->sight);
+    free(e);
+}
+
+static void archetype_destroy(entity_archetype a) {
+    if (a == NULL) return;
+    while (a->pool != NULL) {
+        entity pooled = a->pool;
+        a->pool = pooled->next_pooled;
+        destroy_pooled_instance(pooled);
+    }
+    if (a->state_map != NULL) {
+        hashtable_foreach(a->state_map, destroy_entity_action);
+        hashtable_destroy(a->state_map);
+    }
+    if (a->animations != NULL) {
+        hashtable_foreach(a->animations, destroy_entity_animation);
+        hashtable_destroy(a->animations);
+    }
+    free(a->entity_id);
+    free(a->name);
+    free(a);
+}
+
+static entity_archetype archetype_create(entity_manager_ctx ctx, const char *entity_id) {
+    entity_archetype a = (entity_archetype) calloc(1, sizeof(struct entity_archetype_s));
+    if (a == NULL) {
+        return NULL;
+    }
+    a->ctx = ctx;
+    a->entity_id = utils_copy_string(entity_id);
+    a->state_map = hashtable_create_copied_string_key_borrowed_pointer_value();
+    a->animations = hashtable_create_copied_string_key_borrowed_pointer_value();
+    if (a->entity_id == NULL || a->state_map == NULL || a->animations == NULL) {
+        archetype_destroy(a);
+        return NULL;
+    }
+    return a;
+}
+
+static entity_archetype load_archetype(entity_manager_ctx ctx, const char *entity_id) {
     int return_value = 0;
     char *fullpath = NULL, *config_contents = NULL;
     cJSON *entity_config = NULL;
-    entity result = NULL;
+    entity_archetype result = NULL;
 
     char *partial_path = hashtable_get(ctx->entity_config, entity_id);
     if (partial_path == NULL) LOAD_FAIL("Unknown entity '{s}'", entity_id);
@@ -306,7 +432,7 @@ static entity load_entity(entity_manager_ctx ctx, const char *entity_id) {
     if (entity_config == NULL) LOAD_FAIL("Failed to parse config for entity '{s}'", entity_id);
     if (!cJSON_IsObject(entity_config)) LOAD_FAIL("Failed to parse config for entity '{s}': config must be an object", entity_id);
 
-    result = entity_create(entity_id);
+    result = archetype_create(ctx, entity_id);
     if (result == NULL) LOAD_FAIL("Failed to allocate memory during parsing of entity config");
 
     cJSON *entity_name = cJSON_GetObjectItem(entity_config, "name");
@@ -321,55 +447,90 @@ cleanup:
     free(fullpath);
     free(config_contents);
     cJSON_Delete(entity_config);
-    if (result != NULL && return_value != 0) entity_destroy(result);
-    return return_value == 0 ? result : NULL;
+    if (result != NULL && return_value != 0) {
+        archetype_destroy(result);
+        result = NULL;
+    }
+    return result;
 }
 
-entity entity_manager_load_entity(entity_manager_ctx ctx, const char *entity_id) {
-    // Check for a cached entity
-    ref_counted_entity *rc_entity = (ref_counted_entity *) hashtable_get(ctx->entities, entity_id);
-    if (rc_entity != NULL) {
-        rc_entity->ref_count++;
-        // We still return a new entity; the cache only caches the config
-        return entity_copy(rc_entity->entity);
+static void archetype_release(entity_archetype a) {
+    if (--a->ref_count > 0) {
+        return;
     }
+    hashtable_pop(a->ctx->archetypes, a->entity_id);
+    log_debug("Unloaded entity '{s}'", a->entity_id);
+    archetype_destroy(a);
+}
 
-    // No entity in the cache, so we must load it
-    ref_counted_entity *rc_new_entity = (ref_counted_entity *) malloc(sizeof(ref_counted_entity));
-    if (rc_new_entity == NULL) {
-        log_error("Failed to allocate memory while loading entity '{s}'", entity_id);
+entity_archetype entity_manager_get_archetype(entity_manager_ctx ctx, const char *entity_id) {
+    // Every instance of an entity shares the archetype loaded the first time it was asked for
+    entity_archetype a = (entity_archetype) hashtable_get(ctx->archetypes, entity_id);
+    if (a != NULL) return a;
+
+    a = load_archetype(ctx, entity_id);
+    if (a == NULL) {
+        log_error("Failed to load entity '{s}'", entity_id);
         return NULL;
     }
-
-    if (hashtable_set(ctx->entities, entity_id, rc_new_entity) != 0) {
+    if (hashtable_set(ctx->archetypes, entity_id, a) != 0) {
         log_error("Failed to store entity '{s}' in cache", entity_id);
-        free(rc_new_entity);
+        archetype_destroy(a);
         return NULL;
     }
+    log_debug("Loaded entity '{s}'", entity_id);
+    return a;
+}
 
-    rc_new_entity->entity = load_entity(ctx, entity_id);
-    if (rc_new_entity->entity == NULL) {
-        log_error("Failed to load entity '{s}'", entity_id);
+entity entity_manager_load_entity(entity_manager_ctx ctx, const char *entity_id) {
+    entity_archetype a = entity_manager_get_archetype(ctx, entity_id);
+    if (a == NULL) {
         return NULL;
     }
-    rc_new_entity->ref_count = 1;
-    log_debug("Loaded entity '{s}'", entity_id);
-    return entity_copy(rc_new_entity->entity);
+
+    entity result = entity_spawn(a, ctx->storage);
+    if (result == NULL) {
+        log_error("Failed to allocate memory while loading entity '{s}'", entity_id);
+        if (a->ref_count == 0) {
+            // Nobody else uses it yet, don't keep it around
+            a->ref_count = 1;
+            archetype_release(a);
+        }
+        return NULL;
+    }
+    return result;
 }
 
-void entity_manager_unload_entity(entity_manager_ctx ctx, const char *entity_id) {
-    ref_counted_entity *rc_entity = (ref_counted_entity *) hashtable_get(ctx->entities, entity_id);
-    if (rc_entity == NULL) {
-        return;
+static iteration_result collect_archetype(const hashtable_entry *entry, void *_args) {
+    linked_list archetypes = (linked_list) _args;
+    linked_list_pushfront(archetypes, entry->value);
+    return ITERATION_CONTINUE;
+}
+
+static void trim_pool(entity_archetype a) {
+    size_t released = 0;
+    while (a->pool != NULL) {
+        entity pooled = a->pool;
+        a->pool = pooled->next_pooled;
+        destroy_pooled_instance(pooled);
+        released++;
     }
-    if (rc_entity->ref_count > 1) {
-        rc_entity->ref_count--;
-        return;
+    if (released == 0) return;
+    // The last reference goes through the usual path, which unloads unused archetypes
+    a->ref_count -= released - 1;
+    archetype_release(a);
+}
+
+void entity_manager_trim_pools(entity_manager_ctx ctx) {
+    // Trimming may unload archetypes, which can't happen while iterating over them
+    linked_list archetypes = linked_list_create_borrowed();
+    if (archetypes == NULL) return;
+    hashtable_foreach_args(ctx->archetypes, collect_archetype, archetypes);
+    entity_archetype a = NULL;
+    while ((a = (entity_archetype) linked_list_popfront(archetypes)) != NULL) {
+        trim_pool(a);
     }
-    hashtable_pop(ctx->entities, entity_id);
-    log_debug("Unloaded entity '{s}'", entity_id);
-    entity_destroy(rc_entity->entity);
-    free(rc_entity);
+    linked_list_destroy(archetypes);
 }
 
 entity_manager_ctx entity_manager_init(asset_manager_ctx asset_mgr) {
@@ -378,8 +539,18 @@ entity_manager_ctx entity_manager_init(asset_manager_ctx asset_mgr) {
         return NULL;
     }
     ctx->asset_mgr = asset_mgr;
-    ctx->entities = hashtable_create_copied_string_key_borrowed_pointer_value();
-    if (ctx->entities == NULL) {
+    ctx->storage = entity_storage_create(0);
+    if (ctx->storage == NULL) {
+        entity_manager_cleanup(ctx);
+        return NULL;
+    }
+    ctx->workers = worker_pool_create(ENTITY_UPDATE_THREADS);
+    if (ctx->workers == NULL) {
+        entity_manager_cleanup(ctx);
+        return NULL;
+    }
+    ctx->archetypes = hashtable_create_copied_string_key_borrowed_pointer_value();
+    if (ctx->archetypes == NULL) {
         entity_manager_cleanup(ctx);
         return NULL;
     }
@@ -395,10 +566,8 @@ entity_manager_ctx entity_manager_init(asset_manager_ctx asset_mgr) {
     return ctx;
 }
 
-iteration_result destroy_entity(const hashtable_entry *entry) {
-    ref_counted_entity *rc_entity = (ref_counted_entity *) entry->value;
-    entity_destroy(rc_entity->entity);
-    free(rc_entity);
+static iteration_result destroy_archetype(const hashtable_entry *entry) {
+    archetype_destroy((entity_archetype) entry->value);
     return ITERATION_CONTINUE;
 }
 
@@ -407,266 +576,830 @@ iteration_result destroy_entity_record(const hashtable_entry *entry) {
     return ITERATION_CONTINUE;
 }
 
+worker_pool entity_manager_get_workers(entity_manager_ctx ctx) {
+    return ctx->workers;
+}
+
+int entity_manager_set_worker_count(entity_manager_ctx ctx, int thread_count) {
+    worker_pool workers = worker_pool_create(thread_count);
+    if (workers == NULL) {
+        log_error("Failed to start {d} entity update threads", thread_count);
+        return 1;
+    }
+    worker_pool_destroy(ctx->workers);
+    ctx->workers = workers;
+    return 0;
+}
+
 void entity_manager_cleanup(entity_manager_ctx ctx) {
     if (ctx == NULL) return;
-    if (ctx->entities != NULL) {
-        hashtable_foreach(ctx->entities, destroy_entity);
-        hashtable_destroy(ctx->entities);
+    // Instances still alive at this point would be left with a dangling archetype
+    if (ctx->archetypes != NULL) {
+        hashtable_foreach(ctx->archetypes, destroy_archetype);
+        hashtable_destroy(ctx->archetypes);
     }
     if (ctx->entity_config != NULL) {
         hashtable_foreach(ctx->entity_config, destroy_entity_record);
         hashtable_destroy(ctx->entity_config);
     }
+    entity_storage_destroy(ctx->storage);
+    worker_pool_destroy(ctx->workers);
     free(ctx);
 }
 
-entity entity_create(const char* entity_id) {
+static void init_row(entity e) {
+    entity_columns *c = entity_storage_get_columns(e->storage);
+    c->hitbox[e->row] = e->archetype->hitbox;
+    // Scrambled so consecutive spawns don't start out correlated
+    uint32_t seed = ++e->archetype->ctx->spawned * 0x9e3779b9u;
+    seed ^= seed >> 16;
+    c->random[e->row] = seed != 0 ? seed : 1;
+}
+
+entity entity_create(entity_storage storage, entity_archetype archetype) {
     entity e = (entity) calloc(1, sizeof(struct entity_s));
     if (e == NULL) {
         return NULL;
     }
 
-    e->state.facing = DIRECTION_DOWN;
-    e->entity_id = utils_copy_string(entity_id);
-    if (e->entity_id == NULL) {
-        entity_destroy(e);
+    e->grid_handle = SPATIAL_GRID_INVALID_HANDLE;
+    e->row = entity_storage_add(storage, e);
+    if (e->row == ENTITY_STORAGE_INVALID_ROW) {
+        free(e);
         return NULL;
     }
+    e->storage = storage;
+    e->archetype = archetype;
+    archetype->ref_count++;
+    init_row(e);
+    return e;
+}
+
+entity entity_spawn(entity_archetype archetype, entity_storage storage) {
+    entity e = archetype->pool;
+    if (e == NULL) {
+        return entity_create(storage, archetype);
+    }
 
-    e->state_map = hashtable_create_copied_string_key_borrowed_pointer_value();
-    if (e->state_map == NULL) {
-        entity_destroy(e);
+    // Pooled instances already hold their reference and keep their sight buffer
+    size_t row = entity_storage_add(storage, e);
+    if (row == ENTITY_STORAGE_INVALID_ROW) {
         return NULL;
     }
+    archetype->pool = e->next_pooled;
+    e->next_pooled = NULL;
+    e->storage = storage;
+    e->row = row;
+    e->current_attributes = (game_attributes) { 0 };
+    // What it saw was on whichever map it was despawned from, whose vision versions say nothing about this one
+    if (e->sight != NULL) fov_viewer_invalidate(e->sight);
+    init_row(e);
+    return e;
+}
 
-    e->animations = hashtable_create_copied_string_key_borrowed_pointer_value();
-    if (e->animations == NULL) {
-        entity_destroy(e);
+entity entity_copy(entity e) {
+    entity new_entity = entity_create(e->storage, e->archetype);
+    if (new_entity == NULL) {
         return NULL;
     }
 
-    return e;
+    // Paths and requests belong to the original
+    entity_columns *c = entity_storage_get_columns(e->storage);
+    c->position_x[new_entity->row] = c->position_x[e->row];
+    c->position_y[new_entity->row] = c->position_y[e->row];
+    c->facing[new_entity->row] = c->facing[e->row];
+    c->flags[new_entity->row] = c->flags[e->row] & ENTITY_FLAG_VISIBLE;
+    new_entity->current_attributes = e->current_attributes;
+    return new_entity;
 }
 
-struct clone_entity_args_s {
-    int *result;
-    entity e;
-};
+// FIXME: there should be a better place for this function
+static integer_position screen_to_map_coords(entity_position screen_pos) {
+    // FIXME: 16.0 is a magic constante for now
+    return (integer_position) {
+        .x = (int) (screen_pos.x / 16.0f),
+        .y = (int) (screen_pos.y / 16.0f)
+    };
+}
 
-static iteration_result clone_entity_state_map(const hashtable_entry *entry, void *_args) {
-    struct clone_entity_args_s *args = (struct clone_entity_args_s *) _args;
-    state_map_entry *sm_entry = (state_map_entry *) entry->value;
-    
-    state_map_entry *new_sm_entry = (state_map_entry *) calloc(1, sizeof(state_map_entry));
-    if (new_sm_entry == NULL) {
-        *args->result = 1;
-        return ITERATION_BREAK;
-    }
-
-    new_sm_entry->states = (entity_action *) calloc(sm_entry->entry_size, sizeof(entity_action));
-    if (new_sm_entry->states == NULL) {
-        *args->result = 1;
-        free(new_sm_entry);
-        return ITERATION_BREAK;
-    }
-
-    for (size_t i = 0; i < sm_entry->entry_size; i++) {
-        new_sm_entry->states[i].direction = sm_entry->states[i].direction;
-        new_sm_entry->states[i].clip = utils_copy_string(sm_entry->states[i].clip);
-        if (new_sm_entry->states[i].clip == NULL) {
-            *args->result = 1;
-            // Free all past allocated strings
-            for (size_t j = 0; j < i; j++) {
-                free(new_sm_entry->states[j].clip);
-            }
-            free(new_sm_entry->states);
-            free(new_sm_entry);
-            return ITERATION_BREAK;
-        }
-        new_sm_entry->entry_size++;
+// Drops every step of `path` up to and including `pos`, returning 1 if `pos` was on the path
+static int skip_path_until(linked_list path, integer_position pos) {
+    integer_position *step = NULL;
+    while ((step = linked_list_popfront(path)) != NULL) {
+        int found = step->x == pos.x && step->y == pos.y;
+        free(step);
+        if (found) return 1;
     }
+    return 0;
+}
 
-    if (hashtable_set(args->e->state_map, entry->key, new_sm_entry) != 0) {
-        *args->result = 1;
-        for (size_t i = 0; i < new_sm_entry->entry_size; i++) {
-            free(new_sm_entry->states[i].clip);
-        }
-        free(new_sm_entry->states);
-        free(new_sm_entry);
-        return ITERATION_BREAK;
-    }
+static entity_columns *columns_of(entity e) {
+    return entity_storage_get_columns(e->storage);
+}
 
-    return ITERATION_CONTINUE;
+static int has_flag(const entity_columns *c, size_t row, entity_flag flag) {
+    return (c->flags[row] & flag) != 0;
 }
 
-static iteration_result clone_entity_animations(const hashtable_entry *entry, void *_args) {
-    struct clone_entity_args_s *args = (struct clone_entity_args_s *) _args;
-    animation anim = (animation) entry->value;
-    animation clone = animation_copy(anim);
-    if (clone == NULL) {
-        *args->result = 1;
-        return ITERATION_BREAK;
-    }
-    if (hashtable_set(args->e->animations, entry->key, clone) != 0) {
-        *args->result = 1;
-        animation_destroy(clone);
-        return ITERATION_BREAK;
-    }
-    return ITERATION_CONTINUE;
+static void set_flag(entity_columns *c, size_t row, entity_flag flag, int enabled) {
+    if (enabled) c->flags[row] |= (unsigned char) flag;
+    else c->flags[row] &= (unsigned char) ~flag;
 }
 
-entity entity_copy(entity e) {
-    entity new_entity = entity_create(e->entity_id);
-    if (new_entity == NULL) {
-        return NULL;
-    }
+static entity_position row_position(const entity_columns *c, size_t row) {
+    return (entity_position) { .x = c->position_x[row], .y = c->position_y[row] };
+}
 
-    new_entity->state = e->state;
-    new_entity->hitbox = e->hitbox;
+static int next_random(entity_columns *c, size_t row) {
+    uint32_t x = c->random[row];
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c->random[row] = x;
+    return (int) (x >> 1);
+}
 
-    int result = 0;
-    struct clone_entity_args_s clone_entity_args = {
-        .e = new_entity,
-        .result = &result
-    };
+static void release_path_request(entity_columns *c, size_t row, level l) {
+    if (c->path[row].request == NULL) return;
+    level_release_path_request(l, c->path[row].request);
+    c->path[row].request = NULL;
+}
 
-    // Copy e->state_map
-    hashtable_foreach_args(e->state_map, clone_entity_state_map, &clone_entity_args);
+static void poll_path_request(entity_columns *c, size_t row, level l) {
+    entity_path_state *path = &c->path[row];
+    integer_position current_pos = screen_to_map_coords(row_position(c, row));
 
-    if (result != 0) {
-        entity_destroy(new_entity);
-        return NULL;
+    if (path->request == NULL) {
+        path->request = level_request_path(l, current_pos, path->goal);
+        if (path->request == NULL) {
+            set_flag(c, row, ENTITY_FLAG_MOVING, 0);
+            return;
+        }
     }
 
-    // Copy e->animations
-    hashtable_foreach_args(e->animations, clone_entity_animations, &clone_entity_args);
-
-    if (result != 0) {
-        entity_destroy(new_entity);
-        return NULL;
+    switch (pathfinding_request_get_status(path->request)) {
+        case PATHFINDING_FOUND:
+            path->path = pathfinding_request_take_path(path->request);
+            release_path_request(c, row, l);
+            // We may have wandered along a partial path in the meantime
+            if (!skip_path_until(path->path, current_pos)) {
+                linked_list_destroy(path->path);
+                path->path = NULL;
+            }
+            break;
+        case PATHFINDING_FAILED:
+            release_path_request(c, row, l);
+            set_flag(c, row, ENTITY_FLAG_MOVING, 0);
+            break;
+        case PATHFINDING_IN_PROGRESS: {
+            // Keep heading towards the most promising node while the search runs
+            linked_list partial_path = pathfinding_request_get_partial_path(path->request);
+            if (partial_path == NULL) break;
+            if (skip_path_until(partial_path, current_pos)) {
+                integer_position *next_step = linked_list_popfront(partial_path);
+                if (next_step != NULL) {
+                    path->immediate_goal = *next_step;
+                    set_flag(c, row, ENTITY_FLAG_HAS_IMMEDIATE_GOAL, 1);
+                    free(next_step);
+                }
+            }
+            linked_list_destroy(partial_path);
+            break;
+        }
     }
+}
 
-    return new_entity;
+static void face_towards(entity_columns *c, size_t row, integer_position from, integer_position to) {
+    int dx = to.x - from.x, dy = to.y - from.y;
+    if (dx == 0 && dy == 0) return;
+    if (abs(dx) >= abs(dy)) c->facing[row] = dx > 0 ? DIRECTION_RIGHT : DIRECTION_LEFT;
+    else c->facing[row] = dy > 0 ? DIRECTION_DOWN : DIRECTION_UP;
 }
 
-// FIXME: there should be a better place for this function
-static integer_position screen_to_map_coords(entity_position screen_pos) {
-    // FIXME: 16.0 is a magic constante for now
-    return (integer_position) {
-        .x = (int) (screen_pos.x / 16.0f),
-        .y = (int) (screen_pos.y / 16.0f)
-    };
+static void update_perception(entity_columns *c, size_t row, level l) {
+    entity e = c->owners[row];
+    entity player = level_get_player_entity(l);
+    set_flag(c, row, ENTITY_FLAG_SEES_PLAYER, 0);
+    // The player's own view is kept by the level
+    if (player == NULL || player == e) return;
+    if (e->sight == NULL) {
+        e->sight = fov_viewer_create(FOV_ENTITY_RADIUS);
+        if (e->sight == NULL) return;
+    }
+    integer_position current_pos = screen_to_map_coords(row_position(c, row));
+    map_update_fov(level_get_map(l), e->sight, current_pos);
+
+    integer_position player_pos = screen_to_map_coords(entity_get_position(player));
+    int sees_player = fov_viewer_can_see(e->sight, player_pos.x, player_pos.y);
+    set_flag(c, row, ENTITY_FLAG_SEES_PLAYER, sees_player);
+    // Idle entities keep an eye on the player while they can see them
+    if (sees_player && !has_flag(c, row, ENTITY_FLAG_MOVING)) {
+        face_towards(c, row, current_pos, player_pos);
+    }
 }
 
-void entity_update(entity e, level l, double dt) {
-    if (e->state.moving || e->state.path != NULL || e->state.has_immediate_goal) {
+static void update_grid_position(entity e) {
+    if (e->grid == NULL) return;
+    entity_columns *c = columns_of(e);
+    spatial_grid_move(e->grid, e->grid_handle, c->position_x[e->row], c->position_y[e->row]);
+}
+
+// Decides where the entity is heading this tick, the move itself happens when the storage is integrated.
+// Only touches its own row and reads the rest of the world, so rows can be thought about in parallel.
+// Anything shared, like the pathfinding scheduler, is left as an intent for commit_row
+static void think_row(entity_columns *c, size_t row, level l) {
+    entity_path_state *path = &c->path[row];
+    c->velocity_x[row] = 0.0f;
+    c->velocity_y[row] = 0.0f;
+    update_perception(c, row, l);
+
+    int moving = has_flag(c, row, ENTITY_FLAG_MOVING);
+    if (moving || path->path != NULL || has_flag(c, row, ENTITY_FLAG_HAS_IMMEDIATE_GOAL)) {
         // Figure our the complete path
-        if (e->state.path == NULL && !e->state.has_immediate_goal && e->state.moving) {
-            integer_position current_pos = screen_to_map_coords(e->state.position);
-            e->state.path = map_find_path(
-                level_get_map(l), 
-                current_pos, 
-                e->state.goal
-            );
-            if (e->state.path == NULL) {
-                e->state.moving = 0;
-                e->state.has_immediate_goal = 0;
-            }
+        if (path->path == NULL && !has_flag(c, row, ENTITY_FLAG_HAS_IMMEDIATE_GOAL) && moving) {
+            set_flag(c, row, ENTITY_FLAG_WANTS_PATH, 1);
         }
         // Get the next step if we have reached the previous one
-        if (e->state.path != NULL && !e->state.has_immediate_goal) {
-            integer_position *tmp = linked_list_popfront(e->state.path);
+        if (path->path != NULL && !has_flag(c, row, ENTITY_FLAG_HAS_IMMEDIATE_GOAL)) {
+            integer_position *tmp = linked_list_popfront(path->path);
             if (tmp != NULL) {
-                e->state.immediate_goal.x = tmp->x;
-                e->state.immediate_goal.y = tmp->y;
-                e->state.has_immediate_goal = 1;
+                path->immediate_goal.x = tmp->x;
+                path->immediate_goal.y = tmp->y;
+                set_flag(c, row, ENTITY_FLAG_HAS_IMMEDIATE_GOAL, 1);
                 free(tmp);
             }
             else {
-                linked_list_destroy(e->state.path);
-                e->state.path = NULL;
+                linked_list_destroy(path->path);
+                path->path = NULL;
             }
         }
         // Walk until the next step
-        if (e->state.has_immediate_goal) {
-            integer_position current_pos = screen_to_map_coords(e->state.position);
-            if (e->state.immediate_goal.x > current_pos.x) {
-                e->state.facing = DIRECTION_RIGHT;
-                e->state.position.x += 2.5f * 16.0f * dt;
+        if (has_flag(c, row, ENTITY_FLAG_HAS_IMMEDIATE_GOAL)) {
+            integer_position current_pos = screen_to_map_coords(row_position(c, row));
+            if (path->immediate_goal.x > current_pos.x) {
+                c->facing[row] = DIRECTION_RIGHT;
+                c->velocity_x[row] = ENTITY_WALK_SPEED;
             }
-            else if (e->state.immediate_goal.x < current_pos.x) {
-                e->state.facing = DIRECTION_LEFT;
-                e->state.position.x -= 2.5f * 16.0f * dt;
+            else if (path->immediate_goal.x < current_pos.x) {
+                c->facing[row] = DIRECTION_LEFT;
+                c->velocity_x[row] = -ENTITY_WALK_SPEED;
             }
-            else if (e->state.immediate_goal.y > current_pos.y) {
-                e->state.facing = DIRECTION_DOWN;
-                e->state.position.y += 2.5f * 16.0f * dt;
+            else if (path->immediate_goal.y > current_pos.y) {
+                c->facing[row] = DIRECTION_DOWN;
+                c->velocity_y[row] = ENTITY_WALK_SPEED;
             }
-            else if (e->state.immediate_goal.y < current_pos.y) {
-                e->state.facing = DIRECTION_UP;
-                e->state.position.y -= 2.5f * 16.0f * dt;
+            else if (path->immediate_goal.y < current_pos.y) {
+                c->facing[row] = DIRECTION_UP;
+                c->velocity_y[row] = -ENTITY_WALK_SPEED;
             }
             else {
-                if (e->state.immediate_goal.x == e->state.goal.x && e->state.immediate_goal.y == e->state.goal.y) {
-                    linked_list_destroy(e->state.path);
-                    e->state.path = NULL;
-                    e->state.moving = 0;
+                if (path->immediate_goal.x == path->goal.x && path->immediate_goal.y == path->goal.y) {
+                    linked_list_destroy(path->path);
+                    path->path = NULL;
+                    set_flag(c, row, ENTITY_FLAG_DROPS_PATH, 1);
+                    set_flag(c, row, ENTITY_FLAG_MOVING, 0);
                 }
-                e->state.has_immediate_goal = 0;
+                set_flag(c, row, ENTITY_FLAG_HAS_IMMEDIATE_GOAL, 0);
             }
         } 
     }
-    else {
-        if (rand() % 4096 > 4000) {
-            integer_position current_pos = screen_to_map_coords(e->state.position);
-            int offset_x = (rand() % 15) - 7, offset_y = (rand() % 15) - 7;
+    else if (!has_flag(c, row, ENTITY_FLAG_SEES_PLAYER)) {
+        if (next_random(c, row) % 4096 > 4000) {
+            integer_position current_pos = screen_to_map_coords(row_position(c, row));
+            int offset_x = (next_random(c, row) % 15) - 7, offset_y = (next_random(c, row) % 15) - 7;
             if (offset_x != 0 || offset_y != 0) {
-                e->state.goal.x = current_pos.x + offset_x;
-                e->state.goal.y = current_pos.y + offset_y;
-                e->state.moving = 1;
+                path->goal.x = current_pos.x + offset_x;
+                path->goal.y = current_pos.y + offset_y;
+                set_flag(c, row, ENTITY_FLAG_MOVING, 1);
             }
         }
     }
 }
 
-static animation entity_get_animation_from_state(entity e) {
-    char *move_state = e->state.moving ? "walk": "idle";
-    state_map_entry *entry = hashtable_get(e->state_map, move_state);
-    if (entry == NULL) {
-        entry = hashtable_get(e->state_map, "*");
-        if (entry == NULL) {
+// Carries out the intents think_row left. Rows are committed one at a time in storage order,
+// so path requests reach the scheduler in the same order however many threads did the thinking
+static void commit_row(entity_columns *c, size_t row, level l) {
+    if (has_flag(c, row, ENTITY_FLAG_DROPS_PATH)) {
+        release_path_request(c, row, l);
+    }
+    if (has_flag(c, row, ENTITY_FLAG_WANTS_PATH)) {
+        poll_path_request(c, row, l);
+    }
+    c->flags[row] &= (unsigned char) ~(ENTITY_FLAG_WANTS_PATH | ENTITY_FLAG_DROPS_PATH);
+}
+
+void entity_update(entity e, level l, double dt) {
+    entity_columns *c = columns_of(e);
+    think_row(c, e->row, l);
+    commit_row(c, e->row, l);
+    c->position_x[e->row] += c->velocity_x[e->row] * (float) dt;
+    c->position_y[e->row] += c->velocity_y[e->row] * (float) dt;
+    update_grid_position(e);
+}
+
+struct think_rows_args_s {
+    entity_columns *columns;
+    level l;
+    const size_t *rows;
+};
+
+static void think_rows(void *_args, size_t begin, size_t end) {
+    struct think_rows_args_s *args = (struct think_rows_args_s *) _args;
+    for (size_t i = begin; i < end; i++) {
+        think_row(args->columns, args->rows[i], args->l);
+    }
+}
+
+void entity_update_storage(entity_storage storage, level l, worker_pool workers, double dt) {
+    struct think_rows_args_s think_rows_args = {
+        .columns = entity_storage_get_columns(storage),
+        .l = l
+    };
+    entity_columns *c = think_rows_args.columns;
+
+    // The player is driven by input, the rest think when the scheduler gets to them
+    ai_scheduler scheduler = level_get_ai_scheduler(l);
+    entity player = level_get_player_entity(l);
+    entity_position focus = player != NULL ? entity_get_position(player) : (entity_position) { 0 };
+    ai_scheduler_plan(scheduler, storage, player != NULL ? &focus : NULL, player);
+    for (int bucket = 0; bucket < AI_LOD_BUCKET_COUNT; bucket++) {
+        size_t count = 0;
+        think_rows_args.rows = ai_scheduler_get_rows(scheduler, (ai_lod_bucket) bucket, &count);
+        if (count == 0) continue;
+        double start = utils_get_time();
+        worker_pool_run(workers, count, ENTITY_UPDATE_MIN_BATCH, think_rows, &think_rows_args);
+        ai_scheduler_record_bucket_time(scheduler, (ai_lod_bucket) bucket, (utils_get_time() - start) * 1000.0);
+    }
+
+    for (size_t row = 0; row < c->count; row++) {
+        if (c->flags[row] & (ENTITY_FLAG_WANTS_PATH | ENTITY_FLAG_DROPS_PATH)) commit_row(c, row, l);
+    }
+
+    collision_tiles tiles = collision_tiles_of_map(level_get_map(l));
+    collision_world_step(level_get_collisions(l), storage, &tiles, (float) dt);
+
+    for (size_t row = 0; row < c->count; row++) {
+        if (c->velocity_x[row] != 0.0f || c->velocity_y[row] != 0.0f) update_grid_position(c->owners[row]);
+    }
+}
+
+// Archetypes in the order the rows first use them, rows store their index
+typedef struct snapshot_archetypes {
+    entity_archetype *items;
+    size_t count, capacity;
+} snapshot_archetypes;
+
+static int find_snapshot_archetype(snapshot_archetypes *table, entity_archetype a, uint16_t *out_index) {
+    for (size_t i = 0; i < table->count; i++) {
+        if (table->items[i] != a) continue;
+        *out_index = (uint16_t) i;
+        return 0;
+    }
+    if (table->count == UINT16_MAX) return 1;
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 8;
+        entity_archetype *items = (entity_archetype *) realloc(table->items, capacity * sizeof(entity_archetype));
+        if (items == NULL) return 1;
+        table->items = items;
+        table->capacity = capacity;
+    }
+    table->items[table->count] = a;
+    *out_index = (uint16_t) table->count++;
+    return 0;
+}
+
+// Rows first through first + count, but first + skip. Skip is count when none is left out
+static int write_column(snapshot s, const void *column, size_t element_size, size_t first, size_t count, size_t skip) {
+    const unsigned char *bytes = (const unsigned char *) column + first * element_size;
+    if (skip >= count) return snapshot_write(s, bytes, count * element_size);
+    if (snapshot_write(s, bytes, skip * element_size) != 0) return 1;
+    return snapshot_write(s, bytes + (skip + 1) * element_size, (count - skip - 1) * element_size);
+}
+
+static void read_column(void *column, const unsigned char *bytes, size_t element_size, size_t first, size_t count, size_t skip) {
+    unsigned char *out = (unsigned char *) column + first * element_size;
+    if (skip >= count) {
+        memcpy(out, bytes, count * element_size);
+        return;
+    }
+    memcpy(out, bytes, skip * element_size);
+    memcpy(out + (skip + 1) * element_size, bytes + skip * element_size, (count - skip - 1) * element_size);
+}
+
+struct write_path_step_args_s {
+    unsigned char *out;
+};
+
+static iteration_result write_path_step(void *value, void *_args) {
+    struct write_path_step_args_s *args = (struct write_path_step_args_s *) _args;
+    integer_position *step = (integer_position *) value;
+    int32_t cell[2] = { step->x, step->y };
+    memcpy(args->out, cell, sizeof(cell));
+    args->out += sizeof(cell);
+    return ITERATION_CONTINUE;
+}
+
+// Relative to the scheduler's tick, so rows thinking every tick look the same from one snapshot to the next.
+// The top bit is flipped so that 0 still means the row never thought
+static uint32_t encode_think_tick(uint32_t think_tick, uint32_t tick) {
+    return think_tick != 0 ? (think_tick - tick) ^ UINT32_C(0x80000000) : 0;
+}
+
+static uint32_t decode_think_tick(uint32_t encoded, uint32_t tick) {
+    return encoded != 0 ? (encoded ^ UINT32_C(0x80000000)) + tick : 0;
+}
+
+static int write_snapshot_rows(snapshot s, const entity_columns *c, size_t first, size_t count, size_t skip, uint32_t tick, snapshot_archetypes *archetypes) {
+    size_t n = skip < count ? count - 1 : count;
+    uint32_t row_count = (uint32_t) n;
+    unsigned char *out = NULL;
+    if (snapshot_write(s, &row_count, sizeof(row_count)) != 0) return 1;
+
+    if ((out = snapshot_extend(s, n * sizeof(uint16_t))) == NULL) return 1;
+    entity_archetype last = NULL;
+    uint16_t index = 0;
+    for (size_t row = first, i = 0; row < first + count; row++) {
+        if (row - first == skip) continue;
+        entity_archetype a = c->owners[row]->archetype;
+        if (a != last && find_snapshot_archetype(archetypes, a, &index) != 0) {
+            log_error("Failed to snapshot entity '{s}': too many archetypes", a->entity_id);
+            return 1;
+        }
+        last = a;
+        memcpy(out + i++ * sizeof(uint16_t), &index, sizeof(index));
+    }
+
+    if (write_column(s, c->position_x, sizeof(float), first, count, skip) != 0
+        || write_column(s, c->position_y, sizeof(float), first, count, skip) != 0
+        || write_column(s, c->velocity_x, sizeof(float), first, count, skip) != 0
+        || write_column(s, c->velocity_y, sizeof(float), first, count, skip) != 0
+        || write_column(s, c->facing, sizeof(unsigned char), first, count, skip) != 0
+        || write_column(s, c->flags, sizeof(unsigned char), first, count, skip) != 0
+        || write_column(s, c->state, sizeof(unsigned char), first, count, skip) != 0) {
+        return 1;
+    }
+
+    // Goals then immediate goals
+    if ((out = snapshot_extend(s, n * 4 * sizeof(int32_t))) == NULL) return 1;
+    for (size_t row = first, i = 0; row < first + count; row++) {
+        if (row - first == skip) continue;
+        int32_t goal[2] = { c->path[row].goal.x, c->path[row].goal.y };
+        int32_t immediate_goal[2] = { c->path[row].immediate_goal.x, c->path[row].immediate_goal.y };
+        memcpy(out + i * sizeof(goal), goal, sizeof(goal));
+        memcpy(out + (n + i) * sizeof(goal), immediate_goal, sizeof(immediate_goal));
+        i++;
+    }
+
+    if (write_column(s, c->random, sizeof(uint32_t), first, count, skip) != 0) return 1;
+    if ((out = snapshot_extend(s, n * sizeof(uint32_t))) == NULL) return 1;
+    for (size_t row = first, i = 0; row < first + count; row++) {
+        if (row - first == skip) continue;
+        uint32_t think_tick = encode_think_tick(c->think_tick[row], tick);
+        memcpy(out + i++ * sizeof(uint32_t), &think_tick, sizeof(think_tick));
+    }
+
+    // Hitpoints then path lengths
+    size_t path_steps = 0;
+    if ((out = snapshot_extend(s, n * 2 * sizeof(int32_t))) == NULL) return 1;
+    for (size_t row = first, i = 0; row < first + count; row++) {
+        if (row - first == skip) continue;
+        int32_t hitpoints = c->owners[row]->current_attributes.hitpoints;
+        uint32_t path_length = c->path[row].path != NULL ? (uint32_t) linked_list_size(c->path[row].path) : 0;
+        memcpy(out + i * sizeof(int32_t), &hitpoints, sizeof(hitpoints));
+        memcpy(out + (n + i) * sizeof(int32_t), &path_length, sizeof(path_length));
+        path_steps += path_length;
+        i++;
+    }
+
+    struct write_path_step_args_s write_path_step_args = { .out = snapshot_extend(s, path_steps * 2 * sizeof(int32_t)) };
+    if (write_path_step_args.out == NULL) return 1;
+    for (size_t row = first; row < first + count; row++) {
+        if (row - first == skip || c->path[row].path == NULL) continue;
+        linked_list_foreach_args(c->path[row].path, write_path_step, &write_path_step_args);
+    }
+    return 0;
+}
+
+int entity_storage_write_snapshot(entity_storage storage, entity player, entity_manager_ctx ctx, uint32_t tick, snapshot s) {
+    entity_columns *c = entity_storage_get_columns(storage);
+    size_t player_row = player != NULL && player->storage == storage ? player->row : c->count;
+    snapshot_archetypes archetypes = { 0 };
+    int return_value = 0;
+
+    if (snapshot_write(s, &ctx->spawned, sizeof(ctx->spawned)) != 0
+        || write_snapshot_rows(s, c, player_row, player_row < c->count ? 1 : 0, 1, tick, &archetypes) != 0
+        || write_snapshot_rows(s, c, 0, c->count, player_row, tick, &archetypes) != 0) {
+        return_value = 1;
+        goto cleanup;
+    }
+
+    uint32_t archetype_count = (uint32_t) archetypes.count;
+    if (snapshot_write(s, &archetype_count, sizeof(archetype_count)) != 0) {
+        return_value = 1;
+        goto cleanup;
+    }
+    for (size_t i = 0; i < archetypes.count; i++) {
+        uint32_t length = (uint32_t) strlen(archetypes.items[i]->entity_id);
+        if (snapshot_write(s, &length, sizeof(length)) != 0 || snapshot_write(s, archetypes.items[i]->entity_id, length) != 0) {
+            return_value = 1;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    free(archetypes.items);
+    return return_value;
+}
+
+// Columns of a block of rows, pointing into the snapshot
+typedef struct snapshot_rows {
+    size_t count;
+    const unsigned char *archetype, *position_x, *position_y, *velocity_x, *velocity_y;
+    const unsigned char *facing, *flags, *state, *goals, *random, *think_tick, *attributes, *path;
+} snapshot_rows;
+
+static int parse_snapshot_rows(snapshot_reader *reader, snapshot_rows *rows) {
+    uint32_t row_count = 0;
+    if (snapshot_read_value(reader, &row_count, sizeof(row_count)) != 0) return 1;
+    size_t n = rows->count = row_count;
+    if ((rows->archetype = snapshot_read(reader, n * sizeof(uint16_t))) == NULL
+        || (rows->position_x = snapshot_read(reader, n * sizeof(float))) == NULL
+        || (rows->position_y = snapshot_read(reader, n * sizeof(float))) == NULL
+        || (rows->velocity_x = snapshot_read(reader, n * sizeof(float))) == NULL
+        || (rows->velocity_y = snapshot_read(reader, n * sizeof(float))) == NULL
+        || (rows->facing = snapshot_read(reader, n)) == NULL
+        || (rows->flags = snapshot_read(reader, n)) == NULL
+        || (rows->state = snapshot_read(reader, n)) == NULL
+        || (rows->goals = snapshot_read(reader, n * 4 * sizeof(int32_t))) == NULL
+        || (rows->random = snapshot_read(reader, n * sizeof(uint32_t))) == NULL
+        || (rows->think_tick = snapshot_read(reader, n * sizeof(uint32_t))) == NULL
+        || (rows->attributes = snapshot_read(reader, n * 2 * sizeof(int32_t))) == NULL) {
+        return 1;
+    }
+    // Both pick the animation clip, anything out of range would index past them
+    for (size_t i = 0; i < n; i++) {
+        if (rows->facing[i] >= DIRECTION_COUNT || rows->state[i] >= ENTITY_STATE_COUNT) return 1;
+    }
+
+    size_t path_steps = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t path_length = 0;
+        memcpy(&path_length, rows->attributes + (n + i) * sizeof(uint32_t), sizeof(path_length));
+        path_steps += path_length;
+    }
+    rows->path = snapshot_read(reader, path_steps * 2 * sizeof(int32_t));
+    return rows->path == NULL;
+}
+
+static uint16_t snapshot_row_archetype(const snapshot_rows *rows, size_t i) {
+    uint16_t index = 0;
+    memcpy(&index, rows->archetype + i * sizeof(uint16_t), sizeof(index));
+    return index;
+}
+
+static linked_list read_snapshot_path(const unsigned char *steps, uint32_t length) {
+    linked_list path = linked_list_create_owned(free);
+    if (path == NULL) return NULL;
+    // Only pushes to the front, so last step first
+    for (uint32_t i = length; i-- > 0;) {
+        integer_position *step = (integer_position *) malloc(sizeof(integer_position));
+        int32_t cell[2] = { 0, 0 };
+        memcpy(cell, steps + i * sizeof(cell), sizeof(cell));
+        if (step == NULL) {
+            linked_list_destroy(path);
+            return NULL;
+        }
+        *step = (integer_position) { .x = cell[0], .y = cell[1] };
+        if (linked_list_pushfront(path, step) != 0) {
+            free(step);
+            linked_list_destroy(path);
             return NULL;
         }
     }
-    char *any_fallback_clip = NULL, *result_clip = NULL;
-    for (size_t i = 0; i < entry->entry_size; i++) {
-        entity_action *action = &entry->states[i];
-        if (action->direction == DIRECTION_NONE) {
-            any_fallback_clip = action->clip;
+    return path;
+}
+
+static void read_snapshot_rows(entity_columns *c, const snapshot_rows *rows, size_t first, size_t count, size_t skip, uint32_t tick) {
+    size_t n = rows->count;
+    read_column(c->position_x, rows->position_x, sizeof(float), first, count, skip);
+    read_column(c->position_y, rows->position_y, sizeof(float), first, count, skip);
+    read_column(c->velocity_x, rows->velocity_x, sizeof(float), first, count, skip);
+    read_column(c->velocity_y, rows->velocity_y, sizeof(float), first, count, skip);
+    read_column(c->facing, rows->facing, sizeof(unsigned char), first, count, skip);
+    read_column(c->flags, rows->flags, sizeof(unsigned char), first, count, skip);
+    read_column(c->state, rows->state, sizeof(unsigned char), first, count, skip);
+    read_column(c->random, rows->random, sizeof(uint32_t), first, count, skip);
+
+    const unsigned char *path_steps = rows->path;
+    for (size_t row = first, i = 0; row < first + count; row++) {
+        if (row - first == skip) continue;
+        int32_t goals[4] = { 0, 0, 0, 0 };
+        int32_t hitpoints = 0;
+        uint32_t think_tick = 0, path_length = 0;
+        memcpy(goals, rows->goals + i * 2 * sizeof(int32_t), 2 * sizeof(int32_t));
+        memcpy(goals + 2, rows->goals + (n + i) * 2 * sizeof(int32_t), 2 * sizeof(int32_t));
+        memcpy(&think_tick, rows->think_tick + i * sizeof(uint32_t), sizeof(think_tick));
+        memcpy(&hitpoints, rows->attributes + i * sizeof(int32_t), sizeof(hitpoints));
+        memcpy(&path_length, rows->attributes + (n + i) * sizeof(uint32_t), sizeof(path_length));
+
+        c->path[row].goal = (integer_position) { .x = goals[0], .y = goals[1] };
+        c->path[row].immediate_goal = (integer_position) { .x = goals[2], .y = goals[3] };
+        c->think_tick[row] = decode_think_tick(think_tick, tick);
+        c->owners[row]->current_attributes.hitpoints = hitpoints;
+        if (path_length > 0) {
+            c->path[row].path = read_snapshot_path(path_steps, path_length);
+            // Walks without one until it asks for a new path
+            if (c->path[row].path == NULL) log_error("Failed to restore the path of entity '{s}'", entity_get_id(c->owners[row]));
+            path_steps += path_length * 2 * sizeof(int32_t);
         }
-        else if (action->direction == e->state.facing) {
-            result_clip = action->clip;
-            break;
+        i++;
+    }
+}
+
+static entity_archetype *read_snapshot_archetypes(snapshot_reader *reader, entity_manager_ctx ctx, size_t *out_count) {
+    uint32_t archetype_count = 0;
+    if (snapshot_read_value(reader, &archetype_count, sizeof(archetype_count)) != 0) return NULL;
+    entity_archetype *archetypes = (entity_archetype *) calloc(archetype_count + 1, sizeof(entity_archetype));
+    if (archetypes == NULL) return NULL;
+
+    for (uint32_t i = 0; i < archetype_count; i++) {
+        uint32_t length = 0;
+        const unsigned char *id = NULL;
+        if (snapshot_read_value(reader, &length, sizeof(length)) != 0 || (id = snapshot_read(reader, length)) == NULL) {
+            free(archetypes);
+            return NULL;
+        }
+        char *entity_id = (char *) calloc(length + 1, sizeof(char));
+        if (entity_id == NULL) {
+            free(archetypes);
+            return NULL;
+        }
+        memcpy(entity_id, id, length);
+        archetypes[i] = entity_manager_get_archetype(ctx, entity_id);
+        free(entity_id);
+        if (archetypes[i] == NULL) {
+            free(archetypes);
+            return NULL;
         }
     }
-    char *clip = result_clip != NULL ? result_clip : any_fallback_clip;
-    if (clip == NULL) {
+    *out_count = archetype_count;
+    return archetypes;
+}
+
+static int check_snapshot_archetypes(const snapshot_rows *rows, size_t archetype_count) {
+    for (size_t i = 0; i < rows->count; i++) {
+        if (snapshot_row_archetype(rows, i) >= archetype_count) return 1;
+    }
+    return 0;
+}
+
+static int rows_match_snapshot(const entity_columns *c, size_t player_row, const snapshot_rows *rows, entity_archetype *archetypes) {
+    size_t live_count = player_row < c->count ? c->count - 1 : c->count;
+    if (live_count != rows->count) return 0;
+    for (size_t i = 0; i < rows->count; i++) {
+        size_t row = i < player_row ? i : i + 1;
+        if (c->owners[row]->archetype != archetypes[snapshot_row_archetype(rows, i)]) return 0;
+    }
+    return 1;
+}
+
+// Spawns the snapshot's rows after everyone else, so that a failure only has to take them back off
+// the end. Then despawns everyone but the player and puts the new rows in the snapshot's order around it
+static int respawn_snapshot_rows(entity_storage storage, entity player, level l, const snapshot_rows *rows, entity_archetype *archetypes) {
+    entity_columns *c = entity_storage_get_columns(storage);
+    entity_position *positions = (entity_position *) malloc((rows->count + 1) * sizeof(entity_position));
+    entity *spawned = (entity *) malloc((rows->count + 1) * sizeof(entity));
+    if (positions == NULL || spawned == NULL) {
+        free(positions);
+        free(spawned);
+        return 1;
+    }
+    for (size_t i = 0; i < rows->count; i++) {
+        memcpy(&positions[i].x, rows->position_x + i * sizeof(float), sizeof(float));
+        memcpy(&positions[i].y, rows->position_y + i * sizeof(float), sizeof(float));
+    }
+
+    // A batch for each run of rows of the same archetype
+    size_t old_count = c->count, start = 0;
+    while (start < rows->count) {
+        uint16_t index = snapshot_row_archetype(rows, start);
+        size_t end = start + 1;
+        while (end < rows->count && snapshot_row_archetype(rows, end) == index) end++;
+        size_t batch = level_spawn_batch(l, archetypes[index], end - start, positions + start, spawned + start);
+        if (batch != end - start) {
+            for (size_t i = start + batch; i-- > 0;) entity_despawn(spawned[i], l);
+            free(positions);
+            free(spawned);
+            return 1;
+        }
+        start = end;
+    }
+
+    // Whatever fills a despawned row comes from above it, so going down only ever meets the old rows
+    for (size_t row = old_count; row-- > 0;) {
+        if (c->owners[row] != player) entity_despawn(c->owners[row], l);
+    }
+    size_t player_row = player != NULL ? player->row : c->count;
+    for (size_t i = 0; i < rows->count; i++) {
+        size_t row = i < player_row ? i : i + 1;
+        entity displaced = c->owners[row];
+        if (displaced == spawned[i]) continue;
+        entity_storage_swap(storage, row, spawned[i]->row);
+        displaced->row = spawned[i]->row;
+        spawned[i]->row = row;
+    }
+    free(positions);
+    free(spawned);
+    return 0;
+}
+
+struct entity_snapshot_s {
+    uint32_t spawned;
+    snapshot_rows player_rows, rows;
+    entity_archetype *archetypes;
+    size_t archetype_count;
+};
+
+entity_snapshot entity_storage_parse_snapshot(entity player, entity_manager_ctx ctx, snapshot_reader *reader) {
+    entity_snapshot snapshot = (entity_snapshot) calloc(1, sizeof(struct entity_snapshot_s));
+    int return_value = 0;
+    if (snapshot == NULL) LOAD_FAIL("Failed to allocate memory while reading entities from snapshot");
+
+    if (snapshot_read_value(reader, &snapshot->spawned, sizeof(snapshot->spawned)) != 0
+        || parse_snapshot_rows(reader, &snapshot->player_rows) != 0
+        || parse_snapshot_rows(reader, &snapshot->rows) != 0
+        || (snapshot->archetypes = read_snapshot_archetypes(reader, ctx, &snapshot->archetype_count)) == NULL) {
+        LOAD_FAIL("Failed to read entities from snapshot: truncated, corrupt or unknown entities");
+    }
+    if (check_snapshot_archetypes(&snapshot->player_rows, snapshot->archetype_count) != 0
+        || check_snapshot_archetypes(&snapshot->rows, snapshot->archetype_count) != 0) {
+        LOAD_FAIL("Failed to read entities from snapshot: rows of unknown entities");
+    }
+    if (snapshot->player_rows.count != (player != NULL ? 1u : 0u)
+        || (player != NULL && player->archetype != snapshot->archetypes[snapshot_row_archetype(&snapshot->player_rows, 0)])) {
+        LOAD_FAIL("Failed to read entities from snapshot: player doesn't match");
+    }
+
+cleanup:
+    if (return_value != 0) {
+        entity_snapshot_destroy(snapshot);
         return NULL;
-    } 
-    return hashtable_get(e->animations, clip);
+    }
+    return snapshot;
+}
+
+int entity_storage_apply_snapshot(entity_storage storage, entity player, level l, entity_manager_ctx ctx, uint32_t tick, entity_snapshot snapshot) {
+    entity_columns *c = entity_storage_get_columns(storage);
+    size_t player_row = player != NULL ? player->row : c->count;
+    if (!rows_match_snapshot(c, player_row, &snapshot->rows, snapshot->archetypes)) {
+        // Spawning draws on the same count the snapshot puts back
+        uint32_t spawned = ctx->spawned;
+        if (respawn_snapshot_rows(storage, player, l, &snapshot->rows, snapshot->archetypes) != 0) {
+            ctx->spawned = spawned;
+            log_error("Failed to respawn {zu} entities from snapshot", snapshot->rows.count);
+            return 1;
+        }
+        player_row = player != NULL ? player->row : c->count;
+    }
+
+    // In-flight searches aren't kept, rows waiting on one ask again
+    for (size_t row = 0; row < c->count; row++) {
+        release_path_request(c, row, l);
+        if (c->path[row].path != NULL) linked_list_destroy(c->path[row].path);
+        c->path[row].path = NULL;
+    }
+    if (player != NULL) read_snapshot_rows(c, &snapshot->player_rows, player_row, 1, 1, tick);
+    read_snapshot_rows(c, &snapshot->rows, 0, c->count, player_row, tick);
+    for (size_t row = 0; row < c->count; row++) {
+        update_grid_position(c->owners[row]);
+    }
+    ctx->spawned = snapshot->spawned;
+    return 0;
+}
+
+void entity_snapshot_destroy(entity_snapshot snapshot) {
+    if (snapshot == NULL) return;
+    free(snapshot->archetypes);
+    free(snapshot);
+}
+
+static entity_state current_state(const entity_columns *c, size_t row) {
+    if (c->state[row] != ENTITY_STATE_IDLE) return (entity_state) c->state[row];
+    return has_flag(c, row, ENTITY_FLAG_MOVING) ? ENTITY_STATE_WALK : ENTITY_STATE_IDLE;
+}
+
+static animation entity_get_animation_from_state(entity e) {
+    entity_columns *c = columns_of(e);
+    return e->archetype->clips[current_state(c, e->row)][c->facing[e->row]];
 }
 
 int entity_render(entity e, renderer_ctx renderer, double t) {
     animation current_anim = entity_get_animation_from_state(e);
     if (current_anim == NULL) return 1;
 
-    int x = e->state.position.x - e->hitbox.offset_x;
-    int y = e->state.position.y + e->hitbox.offset_y;
-
-    // renderer_draw_line(renderer, e->state.position.x,e->state.position.y, e->state.position.x+e->hitbox.width,e->state.position.y, (color_rgb) { .r = 0.75, .g = 0.0, .b = 0.0 }, 1);
-    // renderer_draw_line(renderer, e->state.position.x+e->hitbox.width,e->state.position.y, e->state.position.x+e->hitbox.width,e->state.position.y-e->hitbox.height, (color_rgb) { .r = 0.75, .g = 0.0, .b = 0.0 }, 1);
-    // renderer_draw_line(renderer, e->state.position.x+e->hitbox.width,e->state.position.y-e->hitbox.height, e->state.position.x,e->state.position.y-e->hitbox.height, (color_rgb) { .r = 0.75, .g = 0.0, .b = 0.0 }, 1);
-    // renderer_draw_line(renderer, e->state.position.x,e->state.position.y-e->hitbox.height, e->state.position.x,e->state.position.y, (color_rgb) { .r = 0.75, .g = 0.0, .b = 0.0 }, 1);
+    entity_position position = entity_get_position(e);
+    int x = position.x - e->archetype->hitbox.offset_x;
+    int y = position.y + e->archetype->hitbox.offset_y;
 
     return animation_render(
         current_anim,
@@ -678,77 +1411,158 @@ int entity_render(entity e, renderer_ctx renderer, double t) {
     );
 }
 
+unsigned int entity_get_texture_id(entity e, double t) {
+    animation current_anim = entity_get_animation_from_state(e);
+    return current_anim != NULL ? animation_get_texture_id(current_anim, t) : 0;
+}
+
 void entity_set_position(entity e, float x, float y) {
-    e->state.position.x = x;
-    e->state.position.y = y;
+    entity_columns *c = columns_of(e);
+    c->position_x[e->row] = x;
+    c->position_y[e->row] = y;
+    update_grid_position(e);
+}
+
+int entity_set_spatial_grid(entity e, spatial_grid grid) {
+    if (e->grid == grid) return 0;
+    if (e->grid != NULL) {
+        spatial_grid_remove(e->grid, e->grid_handle);
+        e->grid = NULL;
+        e->grid_handle = SPATIAL_GRID_INVALID_HANDLE;
+    }
+    if (grid == NULL) return 0;
+
+    entity_position position = entity_get_position(e);
+    e->grid_handle = spatial_grid_insert(grid, e, position.x, position.y);
+    if (e->grid_handle == SPATIAL_GRID_INVALID_HANDLE) {
+        return 1;
+    }
+    e->grid = grid;
+    return 0;
+}
+
+static void release_row(entity e) {
+    entity moved = entity_storage_remove(e->storage, e->row);
+    if (moved != NULL) moved->row = e->row;
+    e->storage = NULL;
+    e->row = ENTITY_STORAGE_INVALID_ROW;
+}
+
+int entity_set_storage(entity e, entity_storage storage) {
+    if (e->storage == storage) return 0;
+
+    size_t row = entity_storage_add(storage, e);
+    if (row == ENTITY_STORAGE_INVALID_ROW) {
+        return 1;
+    }
+    entity_columns *from = columns_of(e), *to = entity_storage_get_columns(storage);
+    to->position_x[row] = from->position_x[e->row];
+    to->position_y[row] = from->position_y[e->row];
+    to->velocity_x[row] = from->velocity_x[e->row];
+    to->velocity_y[row] = from->velocity_y[e->row];
+    to->facing[row] = from->facing[e->row];
+    to->flags[row] = from->flags[e->row];
+    to->state[row] = from->state[e->row];
+    to->hitbox[row] = from->hitbox[e->row];
+    to->path[row] = from->path[e->row];
+    to->random[row] = from->random[e->row];
+    to->think_tick[row] = from->think_tick[e->row];
+
+    release_row(e);
+    e->storage = storage;
+    e->row = row;
+    return 0;
 }
 
 entity_position entity_get_position(entity e) {
-    return e->state.position;
+    return row_position(columns_of(e), e->row);
 }
 
 entity_hitbox entity_get_hitbox(entity e) {
-    return e->hitbox;
+    return e->archetype->hitbox;
 }
 
 void entity_set_visibility(entity e, int visible) {
-    e->state.visible = visible;
+    set_flag(columns_of(e), e->row, ENTITY_FLAG_VISIBLE, visible);
 }
 
 int entity_is_visible(entity e) {
-    return e->state.visible;
+    return has_flag(columns_of(e), e->row, ENTITY_FLAG_VISIBLE);
 }
 
 void entity_set_facing(entity e, direction d) {
-    e->state.facing = d;
+    columns_of(e)->facing[e->row] = (unsigned char) d;
 }
 
 direction entity_get_facing(entity e) {
-    return e->state.facing;
+    return (direction) columns_of(e)->facing[e->row];
 }
 
 void entity_set_moving(entity e, int moving) {
-    e->state.moving = moving;
+    set_flag(columns_of(e), e->row, ENTITY_FLAG_MOVING, moving);
+}
+
+int entity_can_see(entity e, int x, int y) {
+    return e->sight != NULL && fov_viewer_can_see(e->sight, x, y);
+}
+
+size_t entity_get_memory_usage(entity e) {
+    size_t bytes = sizeof(struct entity_s) + entity_storage_get_row_size();
+    if (e->sight != NULL) bytes += fov_viewer_get_memory_usage(e->sight);
+    linked_list path = columns_of(e)->path[e->row].path;
+    if (path != NULL) bytes += linked_list_size(path) * sizeof(integer_position);
+    return bytes;
+}
+
+int entity_sees_player(entity e) {
+    return has_flag(columns_of(e), e->row, ENTITY_FLAG_SEES_PLAYER);
+}
+
+void entity_set_state(entity e, entity_state state) {
+    columns_of(e)->state[e->row] = (unsigned char) state;
+}
+
+entity_state entity_get_state(entity e) {
+    return current_state(columns_of(e), e->row);
 }
 
 int entity_is_moving(entity e) {
-    return e->state.moving;
+    return has_flag(columns_of(e), e->row, ENTITY_FLAG_MOVING);
 }
 
 const char *entity_get_id(entity e) {
-    return e->entity_id;
+    return e->archetype->entity_id;
 }
 
-static iteration_result destroy_entity_action(const hashtable_entry *entry) {
-    state_map_entry *action = (state_map_entry *) entry->value;
-    for (size_t i = 0; i < action->entry_size; i++) {
-        free(action->states[i].clip);
+static void drop_row(entity e, level l) {
+    entity_columns *c = columns_of(e);
+    if (l != NULL) release_path_request(c, e->row, l);
+    linked_list path = c->path[e->row].path;
+    if (path != NULL) {
+        linked_list_destroy(path);
     }
-    free(action->states);
-    free(action);
-    return ITERATION_CONTINUE;
+    release_row(e);
 }
 
-static iteration_result destroy_entity_animation(const hashtable_entry *entry) {
-    animation anim = (animation) entry->value;
-    animation_destroy(anim);
-    return ITERATION_CONTINUE;
+void entity_despawn(entity e, level l) {
+    if (e == NULL) return;
+    entity_set_spatial_grid(e, NULL);
+    if (e->storage != NULL) {
+        drop_row(e, l);
+    }
+    e->next_pooled = e->archetype->pool;
+    e->archetype->pool = e;
 }
 
 void entity_destroy(entity e) {
     if (e == NULL) return;
-    if (e->state_map != NULL) {
-        hashtable_foreach(e->state_map, destroy_entity_action);
-        hashtable_destroy(e->state_map);
-    }
-    if (e->animations != NULL) {
-        hashtable_foreach(e->animations, destroy_entity_animation);
-        hashtable_destroy(e->animations);
+    entity_set_spatial_grid(e, NULL);
+    fov_viewer_destroy(e->sight);
+    if (e->storage != NULL) {
+        drop_row(e, NULL);
     }
-    if (e->state.path != NULL) {
-        linked_list_destroy(e->state.path);
+    if (e->archetype != NULL) {
+        archetype_release(e->archetype);
     }
-    free(e->entity_id);
-    free(e->name);
     free(e);
 }
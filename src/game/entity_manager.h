@@ -6,17 +6,53 @@
 #include "renderer/renderer.h"
 #include "level_manager.h"
 #include "config.h"
+#include "data_structures/spatial_grid.h"
+#include "entity_storage.h"
+#include "snapshot.h"
+#include "worker_pool.h"
+
+// The entity section of a snapshot, read and checked but not put back yet
+typedef struct entity_snapshot_s *entity_snapshot;
 
 entity_manager_ctx entity_manager_init(asset_manager_ctx);
+// Instances share the entity's archetype, which is unloaded along with the last of them
 entity entity_manager_load_entity(entity_manager_ctx, const char *entity_id);
-void entity_manager_unload_entity(entity_manager_ctx, const char *entity_id);
+// Loads the archetype if needed, it stays loaded until its last instance is gone
+entity_archetype entity_manager_get_archetype(entity_manager_ctx, const char *entity_id);
+// Frees the despawned instances kept for reuse, unloading archetypes nothing else uses
+void entity_manager_trim_pools(entity_manager_ctx);
+// Threads the entity update is spread over, 0 for one per core
+worker_pool entity_manager_get_workers(entity_manager_ctx);
+int entity_manager_set_worker_count(entity_manager_ctx, int thread_count);
 void entity_manager_cleanup(entity_manager_ctx);
 
+// Takes an instance from the archetype's pool when there is one, so steady spawning doesn't allocate
+entity entity_spawn(entity_archetype, entity_storage);
+// Gives the row up and returns the instance to its archetype's pool. Path requests go back to the level, if any
+void entity_despawn(entity, level);
 entity entity_copy(entity);
 void entity_update(entity, level, double dt);
+// Updates every row of the storage but the level's player. Rows decide what to do in parallel, then
+// anything touching shared state is applied in row order, so the result doesn't depend on the thread count
+void entity_update_storage(entity_storage, level, worker_pool, double dt);
+// Appends the player's row and then everyone else's, along with the manager's spawn count. Think ticks
+// are kept relative to tick, the AI scheduler's
+int entity_storage_write_snapshot(entity_storage, entity player, entity_manager_ctx, uint32_t tick, snapshot);
+// Reads and checks what entity_storage_write_snapshot wrote without changing anything, NULL if it can't be
+// put back. Points into the snapshot
+entity_snapshot entity_storage_parse_snapshot(entity player, entity_manager_ctx, snapshot_reader *);
+// Puts back a parsed snapshot. When the storage no longer holds the same entities in the same order they are
+// respawned, which invalidates handles to all of them but the player. Failing leaves the storage as it was
+int entity_storage_apply_snapshot(entity_storage, entity player, level, entity_manager_ctx, uint32_t tick, entity_snapshot);
+void entity_snapshot_destroy(entity_snapshot);
 int entity_render(entity, renderer_ctx, double t);
+// Texture entity_render would draw with at time t, for ordering draws
+unsigned int entity_get_texture_id(entity, double t);
 void entity_set_position(entity, float x, float y);
 entity_position entity_get_position(entity);
+int entity_set_spatial_grid(entity, spatial_grid);
+// Moves the entity's row, its state comes along
+int entity_set_storage(entity, entity_storage);
 entity_hitbox entity_get_hitbox(entity);
 void entity_set_visibility(entity, int visible);
 int entity_is_visible(entity);
@@ -24,6 +60,12 @@ void entity_set_facing(entity, direction);
 direction entity_get_facing(entity);
 void entity_set_moving(entity, int moving);
 int entity_is_moving(entity);
+// Attack, hurt and death play over movement until the state goes back to idle
+void entity_set_state(entity, entity_state);
+entity_state entity_get_state(entity);
+int entity_can_see(entity, int x, int y);
+int entity_sees_player(entity);
+size_t entity_get_memory_usage(entity);
 const char *entity_get_id(entity);
 void entity_destroy(entity);
 
@@ -0,0 +1,175 @@
+#include "entity_storage.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct entity_storage_s {
+    entity_columns columns;
+    size_t capacity;
+};
+
+#define GROW_COLUMN(column, capacity) do { \
+        void *grown = realloc(s->columns.column, (capacity) * sizeof(*s->columns.column)); \
+        if (grown == NULL) return 1; \
+        s->columns.column = grown; \
+    } while (0)
+
+static int grow(entity_storage s, size_t capacity) {
+    // A failure halfway leaves some columns bigger than needed, which is harmless
+    GROW_COLUMN(owners, capacity);
+    GROW_COLUMN(position_x, capacity);
+    GROW_COLUMN(position_y, capacity);
+    GROW_COLUMN(velocity_x, capacity);
+    GROW_COLUMN(velocity_y, capacity);
+    GROW_COLUMN(facing, capacity);
+    GROW_COLUMN(flags, capacity);
+    GROW_COLUMN(state, capacity);
+    GROW_COLUMN(hitbox, capacity);
+    GROW_COLUMN(path, capacity);
+    GROW_COLUMN(random, capacity);
+    GROW_COLUMN(think_tick, capacity);
+    s->capacity = capacity;
+    return 0;
+}
+
+#undef GROW_COLUMN
+
+entity_storage entity_storage_create(size_t initial_capacity) {
+    entity_storage s = (entity_storage) calloc(1, sizeof(struct entity_storage_s));
+    if (s == NULL) {
+        return NULL;
+    }
+    if (initial_capacity > 0 && grow(s, initial_capacity) != 0) {
+        entity_storage_destroy(s);
+        return NULL;
+    }
+    return s;
+}
+
+int entity_storage_reserve(entity_storage s, size_t capacity) {
+    if (capacity <= s->capacity) return 0;
+    size_t grown = s->capacity ? s->capacity : 64;
+    while (grown < capacity) grown *= 2;
+    return grow(s, grown);
+}
+
+size_t entity_storage_add(entity_storage s, entity owner) {
+    entity_columns *c = &s->columns;
+    if (c->count == s->capacity && grow(s, s->capacity ? s->capacity * 2 : 64) != 0) {
+        return ENTITY_STORAGE_INVALID_ROW;
+    }
+
+    size_t row = c->count++;
+    c->owners[row] = owner;
+    c->position_x[row] = 0.0f;
+    c->position_y[row] = 0.0f;
+    c->velocity_x[row] = 0.0f;
+    c->velocity_y[row] = 0.0f;
+    c->facing[row] = DIRECTION_DOWN;
+    c->flags[row] = 0;
+    c->state[row] = ENTITY_STATE_IDLE;
+    c->hitbox[row] = (entity_hitbox) { 0 };
+    memset(&c->path[row], 0, sizeof(entity_path_state));
+    // xorshift32 never leaves 0
+    c->random[row] = 1;
+    c->think_tick[row] = 0;
+    return row;
+}
+
+entity entity_storage_remove(entity_storage s, size_t row) {
+    entity_columns *c = &s->columns;
+    if (row >= c->count) return NULL;
+
+    size_t last = --c->count;
+    if (row == last) return NULL;
+    c->owners[row] = c->owners[last];
+    c->position_x[row] = c->position_x[last];
+    c->position_y[row] = c->position_y[last];
+    c->velocity_x[row] = c->velocity_x[last];
+    c->velocity_y[row] = c->velocity_y[last];
+    c->facing[row] = c->facing[last];
+    c->flags[row] = c->flags[last];
+    c->state[row] = c->state[last];
+    c->hitbox[row] = c->hitbox[last];
+    c->path[row] = c->path[last];
+    c->random[row] = c->random[last];
+    c->think_tick[row] = c->think_tick[last];
+    return c->owners[row];
+}
+
+static void swap_elements(void *column, size_t element_size, size_t a, size_t b) {
+    // Path states are the widest element of any column
+    unsigned char swapped[sizeof(entity_path_state)];
+    unsigned char *element_a = (unsigned char *) column + a * element_size, *element_b = (unsigned char *) column + b * element_size;
+    memcpy(swapped, element_a, element_size);
+    memcpy(element_a, element_b, element_size);
+    memcpy(element_b, swapped, element_size);
+}
+
+#define SWAP_COLUMN(column) swap_elements(s->columns.column, sizeof(*s->columns.column), a, b)
+
+void entity_storage_swap(entity_storage s, size_t a, size_t b) {
+    if (a == b || a >= s->columns.count || b >= s->columns.count) return;
+    SWAP_COLUMN(owners);
+    SWAP_COLUMN(position_x);
+    SWAP_COLUMN(position_y);
+    SWAP_COLUMN(velocity_x);
+    SWAP_COLUMN(velocity_y);
+    SWAP_COLUMN(facing);
+    SWAP_COLUMN(flags);
+    SWAP_COLUMN(state);
+    SWAP_COLUMN(hitbox);
+    SWAP_COLUMN(path);
+    SWAP_COLUMN(random);
+    SWAP_COLUMN(think_tick);
+}
+
+#undef SWAP_COLUMN
+
+entity_columns *entity_storage_get_columns(entity_storage s) {
+    return &s->columns;
+}
+
+size_t entity_storage_size(entity_storage s) {
+    return s->columns.count;
+}
+
+void entity_storage_integrate(entity_storage s, float dt) {
+    // Plain loops over contiguous floats, the compiler vectorizes these
+    float *restrict position_x = s->columns.position_x, *restrict position_y = s->columns.position_y;
+    const float *restrict velocity_x = s->columns.velocity_x, *restrict velocity_y = s->columns.velocity_y;
+    size_t count = s->columns.count;
+    for (size_t i = 0; i < count; i++) {
+        position_x[i] += velocity_x[i] * dt;
+    }
+    for (size_t i = 0; i < count; i++) {
+        position_y[i] += velocity_y[i] * dt;
+    }
+}
+
+size_t entity_storage_get_row_size() {
+    entity_columns *c = NULL;
+    return sizeof(*c->owners) + sizeof(*c->position_x) + sizeof(*c->position_y) + sizeof(*c->velocity_x)
+        + sizeof(*c->velocity_y) + sizeof(*c->facing) + sizeof(*c->flags) + sizeof(*c->state) + sizeof(*c->hitbox) + sizeof(*c->path) + sizeof(*c->random)
+        + sizeof(*c->think_tick);
+}
+
+size_t entity_storage_get_memory_usage(entity_storage s) {
+    return sizeof(struct entity_storage_s) + s->capacity * entity_storage_get_row_size();
+}
+
+void entity_storage_destroy(entity_storage s) {
+    if (s == NULL) return;
+    free(s->columns.owners);
+    free(s->columns.position_x);
+    free(s->columns.position_y);
+    free(s->columns.velocity_x);
+    free(s->columns.velocity_y);
+    free(s->columns.facing);
+    free(s->columns.flags);
+    free(s->columns.state);
+    free(s->columns.hitbox);
+    free(s->columns.path);
+    free(s->columns.random);
+    free(s->columns.think_tick);
+    free(s);
+}
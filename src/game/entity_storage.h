@@ -0,0 +1,83 @@
+#ifndef _H_ENTITY_STORAGE_H_
+#define _H_ENTITY_STORAGE_H_
+
+#include "entity_defs.h"
+#include "config.h"
+#include "ai/pathfinding_scheduler.h"
+#include "data_structures/linked_list.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Hot entity state, one column per component and one row per entity. Rows are dense,
+// removing one moves the last row into its place
+typedef struct entity_storage_s *entity_storage;
+
+#define ENTITY_STORAGE_INVALID_ROW ((size_t) -1)
+
+typedef enum entity_flag {
+    ENTITY_FLAG_MOVING = 1 << 0,
+    ENTITY_FLAG_VISIBLE = 1 << 1,
+    ENTITY_FLAG_HAS_IMMEDIATE_GOAL = 1 << 2,
+    ENTITY_FLAG_SEES_PLAYER = 1 << 3,
+    // Intents left by the parallel update for the serial commit that follows it
+    ENTITY_FLAG_WANTS_PATH = 1 << 4,
+    ENTITY_FLAG_DROPS_PATH = 1 << 5
+} entity_flag;
+
+// Picks the animation together with facing. Idle and walk follow ENTITY_FLAG_MOVING,
+// the others are set explicitly
+typedef enum entity_state {
+    ENTITY_STATE_IDLE,
+    ENTITY_STATE_WALK,
+    ENTITY_STATE_ATTACK,
+    ENTITY_STATE_HURT,
+    ENTITY_STATE_DEATH,
+    ENTITY_STATE_COUNT
+} entity_state;
+
+// Only touched by entities that are walking somewhere
+typedef struct entity_path_state {
+    linked_list path;
+    pathfinding_request request;
+    integer_position goal, immediate_goal;
+} entity_path_state;
+
+// Valid until the next row is added, adding may move every column
+typedef struct entity_columns {
+    size_t count;
+    entity *owners;
+    float *position_x, *position_y;
+    // Pixels per second
+    float *velocity_x, *velocity_y;
+    unsigned char *facing;
+    // entity_flag bits
+    unsigned char *flags;
+    // entity_state set over movement, ENTITY_STATE_IDLE when movement decides
+    unsigned char *state;
+    // Copied from the archetype, so collisions don't chase owners
+    entity_hitbox *hitbox;
+    entity_path_state *path;
+    // Per entity random state, so decisions don't depend on the order rows are updated in
+    uint32_t *random;
+    // AI scheduler tick the row is due to think at, 0 until it first has
+    uint32_t *think_tick;
+} entity_columns;
+
+entity_storage entity_storage_create(size_t initial_capacity);
+// Makes room for at least capacity rows, so adding up to it can't fail or move the columns
+int entity_storage_reserve(entity_storage, size_t capacity);
+// Appends a zeroed row facing down, returns its index or ENTITY_STORAGE_INVALID_ROW
+size_t entity_storage_add(entity_storage, entity owner);
+// Returns the entity whose row moved into `row`, NULL if none did
+entity entity_storage_remove(entity_storage, size_t row);
+// Exchanges two rows, their owners are left for the caller to update
+void entity_storage_swap(entity_storage, size_t a, size_t b);
+entity_columns *entity_storage_get_columns(entity_storage);
+size_t entity_storage_size(entity_storage);
+// Moves every row along its velocity
+void entity_storage_integrate(entity_storage, float dt);
+size_t entity_storage_get_row_size();
+size_t entity_storage_get_memory_usage(entity_storage);
+void entity_storage_destroy(entity_storage);
+
+#endif
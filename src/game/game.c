@@ -31,7 +31,7 @@ struct game_ctx_s {
     mtx_t lock;
 };
 
-game_ctx game_context_init() {
+static game_ctx create_game(int headless) {
     game_ctx game = (game_ctx) calloc(1, sizeof(struct game_ctx_s));
     if (game == NULL) {
         log_error("Failed to initialize game");
@@ -54,6 +54,8 @@ game_ctx game_context_init() {
         game_context_cleanup(game);
         return NULL;
     }
+    // Set before anything loads, so no texture ever reaches the GPU
+    asset_manager_set_headless(game->asset_mgr, headless);
 
     game->entity_mgr = entity_manager_init(game->asset_mgr);
     if (game->entity_mgr == NULL) {
@@ -66,6 +68,14 @@ game_ctx game_context_init() {
         game_context_cleanup(game);
         return NULL;
     }
+    return game;
+}
+
+game_ctx game_context_init() {
+    game_ctx game = create_game(0);
+    if (game == NULL) {
+        return NULL;
+    }
 
     game->base_font_16 = font_create(game->asset_mgr, "font-yoster-island-12", 2, 16);
     if (game->base_font_16 == NULL) {
@@ -108,26 +118,118 @@ game_ctx game_context_init() {
     return game;
 }
 
+game_ctx game_context_init_headless(const char *level_id) {
+    game_ctx game = create_game(1);
+    if (game == NULL) {
+        return NULL;
+    }
+
+    game->current_level = level_manager_load_level(game->level_mgr, level_id);
+    if (game->current_level == NULL) {
+        game_context_cleanup(game);
+        return NULL;
+    }
+    return game;
+}
+
+level game_get_level(game_ctx game) {
+    return game->current_level;
+}
+
+entity_manager_ctx game_get_entity_manager(game_ctx game) {
+    return game->entity_mgr;
+}
+
+static float clamp_camera(float pan, int screen_size, int map_size) {
+    // Maps smaller than the screen just stay anchored at the origin
+    if (map_size <= screen_size) return 0.0f;
+    if (pan < 0.0f) return 0.0f;
+    if (pan > (float) (map_size - screen_size)) return (float) (map_size - screen_size);
+    return pan;
+}
+
+static void game_update_camera(game_ctx game, renderer_ctx ctx) {
+    entity_position player_position = entity_get_position(level_get_player_entity(game->current_level));
+    int screen_width = 0, screen_height = 0, map_width = 0, map_height = 0;
+    renderer_get_dimensions(ctx, &screen_width, &screen_height);
+    map_get_pixel_dimensions(level_get_map(game->current_level), &map_width, &map_height);
+
+    // Center on the player's tile, snapped to whole pixels to avoid shimmering
+    float pan_x = clamp_camera(player_position.x + 8.0f - screen_width / 2.0f, screen_width, map_width);
+    float pan_y = clamp_camera(player_position.y + 8.0f - screen_height / 2.0f, screen_height, map_height);
+    renderer_set_pan(ctx, roundf(pan_x), roundf(pan_y));
+}
+
 static void game_render(game_ctx game, renderer_ctx ctx, double dt, double t) {
+    game_update_camera(game, ctx);
     if (level_render(game->current_level, ctx, t) != 0) {
         log_throttle_warning(5000, "Failed to render level");
     }
+    // UI is drawn in screen space
+    renderer_set_pan(ctx, 0.0f, 0.0f);
 
     renderer_set_blend_mode(ctx, BLEND_MODE_BINARY);
     dialog_render(game->dialog, ctx, t);
 
     if (game->debug_info) {
         renderer_increment_layer(ctx);
-        char buffer[128];
+        char buffer[512];
         renderer_statistics stats = renderer_get_stats(ctx); 
+        pathfinding_scheduler_statistics path_stats = level_get_pathfinding_stats(game->current_level);
+        map current_map = level_get_map(game->current_level);
+        map_render_statistics map_stats = map_get_render_stats(current_map);
+        map_storage_statistics storage_stats = map_get_storage_stats(current_map);
         int chars_written = snprintf(
             buffer, 
             sizeof(buffer) - 1, 
-            "FPSg: %d\nDraw calls: %lu\nInstances: %lu", 
+            "FPSg: %d\nDraw calls: %lu\nInstances: %lu\nMap: %s, %lu tiles drawn, %lu culled\nTiles: %luK, %.1fx smaller than dense\nPaths: %lu pending, %d%% budget, %.1f ticks", 
             (int)(1.0 / (dt > 0.0 ? dt : 1.0)),
             stats.draw_calls, 
-            stats.drawn_instances
+            stats.drawn_instances,
+            map_get_render_mode(current_map) == MAP_RENDER_TILEMAP ? "tilemap" : "instanced",
+            map_stats.drawn_tiles,
+            map_stats.culled_tiles,
+            storage_stats.sparse_bytes / 1024,
+            storage_stats.compression_ratio,
+            path_stats.pending_requests,
+            (int) (100.0 * path_stats.average_utilization),
+            path_stats.average_latency_ticks
         );
+        level_residency_statistics residency_stats = level_manager_get_stats(game->level_mgr);
+        if (chars_written > 0) {
+            int residency_chars_written = snprintf(
+                buffer + chars_written,
+                sizeof(buffer) - 1 - chars_written,
+                "\nLevels: %lu resident, %luK/%luK, %d%% hits, %.1fms",
+                residency_stats.resident_levels,
+                residency_stats.resident_bytes / 1024,
+                residency_stats.memory_budget / 1024,
+                (int) (100.0 * residency_stats.hit_rate),
+                residency_stats.last_transition_ms
+            );
+            if (residency_chars_written > 0 && chars_written + residency_chars_written < (int) sizeof(buffer) - 1) {
+                chars_written += residency_chars_written;
+            }
+        }
+        map_streaming_statistics stream_stats = level_get_streaming_stats(game->current_level);
+        if (chars_written > 0 && stream_stats.streaming) {
+            int streaming_chars_written = snprintf(
+                buffer + chars_written,
+                sizeof(buffer) - 1 - chars_written,
+                "\nChunks: %lu (%lu loading), %luK/%luK\nLoads: %.1fms avg, %.1fms max, %lu hitches, %lu missing",
+                stream_stats.resident_chunks,
+                stream_stats.pending_chunks,
+                stream_stats.resident_bytes / 1024,
+                stream_stats.memory_budget / 1024,
+                stream_stats.average_load_latency_ms,
+                stream_stats.max_load_latency_ms,
+                stream_stats.hitches,
+                stream_stats.missing_visible_chunks
+            );
+            if (streaming_chars_written > 0 && chars_written + streaming_chars_written < (int) sizeof(buffer) - 1) {
+                chars_written += streaming_chars_written;
+            }
+        }
         if (chars_written > 0) {
             buffer[chars_written] = '\0';
             font_render(
@@ -145,7 +247,7 @@ static void game_render(game_ctx game, renderer_ctx ctx, double dt, double t) {
     }
 }
 
-static void game_step(game_ctx game, double dt, double t) {
+void game_step(game_ctx game, double dt, double t) {
     const float speed = 3 * 16.0f;
 
     level_update(game->current_level, dt);
@@ -164,30 +266,20 @@ static void game_step(game_ctx game, double dt, double t) {
     if (!player_moving && game->held_direction != DIRECTION_NONE) {
         entity_set_facing(player_entity, game->held_direction);
 
-        float next_x = player_position.x;
-        float next_y = player_position.y;
-
-        // FIXME: do proper collision detection
-        entity_hitbox player_hitbox = entity_get_hitbox(player_entity);
-        
+        float step_x = 0.0f, step_y = 0.0f;
         switch (player_direction) {
-            case DIRECTION_DOWN:
-                next_y += game->pixels_per_keypress;
-                break;
-            case DIRECTION_UP:
-                next_y -= game->pixels_per_keypress + player_hitbox.height;
-                break;
-            case DIRECTION_LEFT:
-                next_x -= game->pixels_per_keypress;
-                break;
-            case DIRECTION_RIGHT:
-                next_x += game->pixels_per_keypress + player_hitbox.width;
-                break;            
-            default:
-                break;
+            case DIRECTION_DOWN:  step_y = (float) game->pixels_per_keypress; break;
+            case DIRECTION_UP:    step_y = (float) -game->pixels_per_keypress; break;
+            case DIRECTION_LEFT:  step_x = (float) -game->pixels_per_keypress; break;
+            case DIRECTION_RIGHT: step_x = (float) game->pixels_per_keypress; break;
+            default: break;
         }
 
-        if (!map_occupied_at(level_get_map(game->current_level), next_x / 16, next_y / 16)) {
+        // Only start a step the hitbox can finish
+        float free_x = 0.0f, free_y = 0.0f;
+        collision_box player_box = collision_box_of(player_position, entity_get_hitbox(player_entity));
+        collision_tiles tiles = collision_tiles_of_map(level_get_map(game->current_level));
+        if (!collision_sweep_box(&tiles, player_box, step_x, step_y, &free_x, &free_y, NULL)) {
             entity_set_moving(player_entity, 1);
             game->start_move_pos = (int) (player_direction == DIRECTION_DOWN || player_direction == DIRECTION_UP ? player_position.y :player_position.x);
         }
@@ -195,14 +287,20 @@ static void game_step(game_ctx game, double dt, double t) {
 
     if (!player_moving) return;
 
+    float move_x = 0.0f, move_y = 0.0f;
     switch (player_direction) {
-        case DIRECTION_UP:    player_position.y -= speed * (float)dt; break;
-        case DIRECTION_DOWN:  player_position.y += speed * (float)dt; break;
-        case DIRECTION_LEFT:  player_position.x -= speed * (float)dt; break;
-        case DIRECTION_RIGHT: player_position.x += speed * (float)dt; break;
+        case DIRECTION_UP:    move_y = -speed * (float)dt; break;
+        case DIRECTION_DOWN:  move_y = speed * (float)dt; break;
+        case DIRECTION_LEFT:  move_x = -speed * (float)dt; break;
+        case DIRECTION_RIGHT: move_x = speed * (float)dt; break;
         default: break;
     }
-    entity_set_position(player_entity, player_position.x, player_position.y);
+    collision_box player_box = collision_box_of(player_position, entity_get_hitbox(player_entity));
+    collision_tiles tiles = collision_tiles_of_map(level_get_map(game->current_level));
+    if (collision_sweep_box(&tiles, player_box, move_x, move_y, &move_x, &move_y, NULL)) {
+        entity_set_moving(player_entity, 0);
+    }
+    entity_set_position(player_entity, player_position.x + move_x, player_position.y + move_y);
 }
 
 int game_update_handler(renderer_ctx ctx, double dt, double t) {
@@ -245,6 +343,13 @@ int game_key_handler(renderer_ctx ctx, int key, int, int action, int mods) {
         if (key == GLFW_KEY_F3 && action == GLFW_RELEASE && mods == 0) {
             game->debug_info = game->debug_info ? 0 : 1;
         }
+        else if (key == GLFW_KEY_F4 && action == GLFW_RELEASE && mods == 0) {
+            map current_map = level_get_map(game->current_level);
+            map_set_render_mode(current_map, map_get_render_mode(current_map) == MAP_RENDER_TILEMAP ? MAP_RENDER_INSTANCED : MAP_RENDER_TILEMAP);
+        }
+        else if (key == GLFW_KEY_F5 && action == GLFW_RELEASE && mods == 0) {
+            level_set_fog_enabled(game->current_level, !level_is_fog_enabled(game->current_level));
+        }
         else if (key == GLFW_KEY_F11 && action == GLFW_PRESS && mods == 0) {
             renderer_toggle_fullscreen(ctx);
         }
@@ -308,7 +413,6 @@ void game_context_cleanup(game_ctx ctx) {
     if (ctx == NULL) return;
     if (ctx->dialog != NULL) dialog_destroy(ctx->dialog);
     if (ctx->base_font_16 != NULL) font_destroy(ctx->base_font_16);
-    if (ctx->current_level != NULL) level_destroy(ctx->current_level);
     if (ctx->level_mgr != NULL) level_manager_cleanup(ctx->level_mgr);
     if (ctx->entity_mgr != NULL) entity_manager_cleanup(ctx->entity_mgr);
     if (ctx->asset_mgr != NULL) asset_manager_cleanup(ctx->asset_mgr);
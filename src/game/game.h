@@ -2,6 +2,8 @@
 #define _H_GAME_H_
 
 #include "config.h"
+#include "entity_manager.h"
+#include "level_manager.h"
 #include "renderer/renderer.h"
 
 typedef struct game_ctx_s* game_ctx;
@@ -10,6 +12,12 @@ typedef struct position_vec_s {
 } position_vec;
 
 game_ctx game_context_init();
+// The game without its window: no fonts or dialog, and textures never reach the GPU, so no GL is needed
+game_ctx game_context_init_headless(const char *level_id);
+level game_get_level(game_ctx);
+entity_manager_ctx game_get_entity_manager(game_ctx);
+// Advances the game logic by one fixed step, the update handler runs as many as fit in a frame
+void game_step(game_ctx, double dt, double t);
 
 int game_update_handler(renderer_ctx, double, double);
 int game_key_handler(renderer_ctx, int, int, int, int);
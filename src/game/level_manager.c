@@ -3,26 +3,71 @@
 #include "cjson/cJSON.h"
 #include "data_structures/linked_list.h"
 #include "data_structures/hashtable.h"
+#include "collision.h"
+#include "ai_scheduler.h"
 #include "entity_manager.h"
 #include "map.h"
 #include "utils/utils.h"
+#include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define LOAD_FAIL(...) do { log_error(__VA_ARGS__); return_value = 1; goto cleanup; } while (0)
 
+// One visible entity, ordered by key: its y band over its texture
+typedef struct entity_draw {
+    uint64_t key;
+    entity entity;
+} entity_draw;
+
 struct level_s {
     char *level_id;
     map map;
-    linked_list entities;
+    // Levels from the level manager borrow their map, several levels can share one
+    int owns_map;
+    // Every entity in the level, player included, one row each
+    entity_storage entities;
     entity player; // FIXME: do this some other way?
     entity_manager_ctx entity_mgr;
+    pathfinding_scheduler pathfinding;
+    // Every entity in the level, player included, by position
+    spatial_grid entity_grid;
+    collision_world collisions;
+    ai_scheduler ai;
+    level_update_statistics update_stats;
+    // What the player sees, everything outside it is covered by fog when enabled
+    fov_viewer player_view;
+    int fog_enabled;
+    // Reused every frame, the scratch half is where the radix sort scatters to
+    entity_draw *draws, *draw_scratch;
+    size_t draw_capacity;
 };
 
+typedef struct resident_level {
+    level level;
+    unsigned long last_used;
+} resident_level;
+
+typedef struct ref_counted_map {
+    map map;
+    size_t ref_count;
+} ref_counted_map;
+
 struct level_manager_ctx_s {
     entity_manager_ctx entity_mgr;
     asset_manager_ctx asset_mgr;
     hashtable level_config;
+
+    // Levels stay loaded after the player leaves them, until the budget runs out
+    hashtable resident_levels;
+    // Loaded maps by id, each resident level built on one holds a reference
+    hashtable shared_maps;
+    level active_level;
+    size_t memory_budget;
+    unsigned long use_clock;
+    level_residency_statistics stats;
+    double total_hit_ms, total_miss_ms;
 };
 
 static char *get_level_path(const char *partial_path) {
@@ -104,21 +149,72 @@ static int load_level_entities(level_manager_ctx ctx, level l, cJSON *level_conf
         if (entity_position == NULL || !cJSON_IsObject(entity_position)) LOAD_FAIL("Failed to parse config for level '{s}': entities.position must be an object", l->level_id);
 
         if (load_level_entities_position(new_entity, l, entity_position) != 0) { return_value = 1; goto cleanup; }
-        if (linked_list_pushfront(l->entities, new_entity) != 0) LOAD_FAIL("Failed to store entity in entity list for level '{s}'", l->level_id);
-        
+        if (entity_set_storage(new_entity, l->entities) != 0) LOAD_FAIL("Failed to store entity '{s}' for level '{s}'", entity_id, l->level_id);
+        entity added_entity = new_entity;
         new_entity = NULL;
+        if (entity_set_spatial_grid(added_entity, l->entity_grid) != 0) LOAD_FAIL("Failed to index entity '{s}' for level '{s}'", entity_id, l->level_id);
     }
     
 cleanup:
-    if (new_entity != NULL) entity_manager_unload_entity(ctx->entity_mgr, entity_get_id(new_entity));
+    entity_destroy(new_entity);
     return return_value;
 }
 
+static level create_level(entity_manager_ctx entity_mgr, const char *level_id, map m, int owns_map);
+
+static map acquire_map(level_manager_ctx ctx, const char *map_id) {
+    ref_counted_map *rc_map = (ref_counted_map *) hashtable_get(ctx->shared_maps, map_id);
+    if (rc_map != NULL) {
+        rc_map->ref_count++;
+        return rc_map->map;
+    }
+
+    rc_map = (ref_counted_map *) malloc(sizeof(ref_counted_map));
+    if (rc_map == NULL) {
+        log_error("Failed to allocate memory for map '{s}'", map_id);
+        return NULL;
+    }
+    rc_map->ref_count = 1;
+    rc_map->map = map_create(ctx->asset_mgr, map_id);
+    if (rc_map->map == NULL) {
+        free(rc_map);
+        return NULL;
+    }
+    if (map_load(rc_map->map) != 0) {
+        map_destroy(rc_map->map);
+        free(rc_map);
+        return NULL;
+    }
+    if (hashtable_set(ctx->shared_maps, map_id, rc_map) != 0) {
+        log_error("Failed to store map '{s}'", map_id);
+        map_destroy(rc_map->map);
+        free(rc_map);
+        return NULL;
+    }
+    return rc_map->map;
+}
+
+static void release_map(level_manager_ctx ctx, map m) {
+    const char *map_id = map_get_id(m);
+    ref_counted_map *rc_map = (ref_counted_map *) hashtable_get(ctx->shared_maps, map_id);
+    if (rc_map == NULL) {
+        return;
+    }
+    if (rc_map->ref_count > 1) {
+        rc_map->ref_count--;
+        return;
+    }
+    hashtable_pop(ctx->shared_maps, map_id);
+    map_destroy(rc_map->map);
+    free(rc_map);
+}
+
 static level load_level(level_manager_ctx ctx, const char *level_id) {
     int return_value = 0;
     char *fullpath = NULL, *config_contents = NULL;
     cJSON *level_config = NULL;
     level result = NULL;
+    map level_map_instance = NULL;
 
     char *partial_path = hashtable_get(ctx->level_config, level_id);
     if (partial_path == NULL) LOAD_FAIL("Unknown level '{s}'", level_id);
@@ -137,16 +233,27 @@ static level load_level(level_manager_ctx ctx, const char *level_id) {
     if (level_map == NULL || !cJSON_IsString(level_map)) LOAD_FAIL("Failed to parse config for level '{s}': name must be a string", level_id);
     const char* map_id = cJSON_GetStringValue(level_map);
 
-    result = level_create(ctx->asset_mgr, ctx->entity_mgr, level_id, map_id);
+    level_map_instance = acquire_map(ctx, map_id);
+    if (level_map_instance == NULL) LOAD_FAIL("Failed to load map '{s}' for level '{s}'", map_id, level_id);
+
+    result = create_level(ctx->entity_mgr, level_id, level_map_instance, 0);
     if (result == NULL) LOAD_FAIL("Failed to instantiate level '{s}'", level_id);
 
     if (load_level_entities(ctx, result, level_config) != 0) { return_value = 1; goto cleanup; }
 
+    result->player = entity_manager_load_entity(ctx->entity_mgr, "player");
+    if (result->player == NULL) LOAD_FAIL("Failed to load the player for level '{s}'", level_id);
+    if (entity_set_storage(result->player, result->entities) != 0) LOAD_FAIL("Failed to store the player for level '{s}'", level_id);
+    if (entity_set_spatial_grid(result->player, result->entity_grid) != 0) LOAD_FAIL("Failed to index the player for level '{s}'", level_id);
+
 cleanup:
     free(fullpath);
     free(config_contents);
     cJSON_Delete(level_config);
-    if (result != NULL && return_value != 0) level_destroy(result);
+    if (return_value != 0) {
+        level_destroy(result);
+        if (level_map_instance != NULL) release_map(ctx, level_map_instance);
+    }
     return return_value == 0 ? result : NULL;
 }
 
@@ -157,11 +264,22 @@ level_manager_ctx level_manager_init(asset_manager_ctx asset_mgr, entity_manager
     }
     ctx->entity_mgr = entity_mgr;
     ctx->asset_mgr = asset_mgr;
+    ctx->memory_budget = LEVEL_RESIDENCY_MEMORY_BUDGET;
     ctx->level_config = hashtable_create_copied_string_key_borrowed_pointer_value();
     if (ctx->level_config == NULL) {
         level_manager_cleanup(ctx);
         return NULL;
     }
+    ctx->resident_levels = hashtable_create_copied_string_key_borrowed_pointer_value();
+    if (ctx->resident_levels == NULL) {
+        level_manager_cleanup(ctx);
+        return NULL;
+    }
+    ctx->shared_maps = hashtable_create_copied_string_key_borrowed_pointer_value();
+    if (ctx->shared_maps == NULL) {
+        level_manager_cleanup(ctx);
+        return NULL;
+    }
     if (load_base_level_config(ctx) != 0) {
         level_manager_cleanup(ctx);
         return NULL;
@@ -169,23 +287,138 @@ level_manager_ctx level_manager_init(asset_manager_ctx asset_mgr, entity_manager
     return ctx;
 }
 
+struct residency_usage_args_s {
+    size_t bytes;
+};
+
+static iteration_result add_level_memory_usage(const hashtable_entry *entry, void *_args) {
+    struct residency_usage_args_s *args = (struct residency_usage_args_s *) _args;
+    resident_level *resident = (resident_level *) entry->value;
+    args->bytes += level_get_memory_usage(resident->level) - map_get_memory_usage(resident->level->map);
+    return ITERATION_CONTINUE;
+}
+
+static iteration_result add_map_memory_usage(const hashtable_entry *entry, void *_args) {
+    struct residency_usage_args_s *args = (struct residency_usage_args_s *) _args;
+    ref_counted_map *rc_map = (ref_counted_map *) entry->value;
+    args->bytes += map_get_memory_usage(rc_map->map);
+    return ITERATION_CONTINUE;
+}
+
+static size_t resident_memory_usage(level_manager_ctx ctx) {
+    // Shared maps only count once, however many levels use them
+    struct residency_usage_args_s residency_usage_args = { .bytes = 0 };
+    hashtable_foreach_args(ctx->resident_levels, add_level_memory_usage, &residency_usage_args);
+    hashtable_foreach_args(ctx->shared_maps, add_map_memory_usage, &residency_usage_args);
+    return residency_usage_args.bytes;
+}
+
+struct find_eviction_candidate_args_s {
+    level active_level;
+    resident_level *candidate;
+};
+
+static iteration_result find_eviction_candidate(const hashtable_entry *entry, void *_args) {
+    struct find_eviction_candidate_args_s *args = (struct find_eviction_candidate_args_s *) _args;
+    resident_level *resident = (resident_level *) entry->value;
+    if (resident->level == args->active_level) return ITERATION_CONTINUE;
+    if (args->candidate == NULL || resident->last_used < args->candidate->last_used) {
+        args->candidate = resident;
+    }
+    return ITERATION_CONTINUE;
+}
+
+static void evict_level(level_manager_ctx ctx, resident_level *resident) {
+    level l = resident->level;
+    map m = l->map;
+    log_info("Evicting level '{s}' from memory", l->level_id);
+    hashtable_pop(ctx->resident_levels, l->level_id);
+    level_destroy(l);
+    release_map(ctx, m);
+    // Memory is short, instances pooled for reuse are the next thing to go
+    entity_manager_trim_pools(ctx->entity_mgr);
+    free(resident);
+    ctx->stats.evictions++;
+}
+
+static void enforce_memory_budget(level_manager_ctx ctx) {
+    // The active level always stays, even on its own over budget
+    while (resident_memory_usage(ctx) > ctx->memory_budget) {
+        struct find_eviction_candidate_args_s find_eviction_candidate_args = {
+            .active_level = ctx->active_level,
+            .candidate = NULL
+        };
+        hashtable_foreach_args(ctx->resident_levels, find_eviction_candidate, &find_eviction_candidate_args);
+        if (find_eviction_candidate_args.candidate == NULL) break;
+        evict_level(ctx, find_eviction_candidate_args.candidate);
+    }
+}
+
 level level_manager_load_level(level_manager_ctx ctx, const char *level_id) {
-    // The level manager doesn't cache levels since there should only
-    // be one active level at a time. This may change.
-    level new_level = load_level(ctx, level_id);
-    if (new_level == NULL) {
-        return NULL;
+    // Levels are owned by the manager and stay loaded after the player leaves
+    // them, so coming back doesn't reparse configs or reload any assets
+    double start = utils_get_time();
+    resident_level *resident = (resident_level *) hashtable_get(ctx->resident_levels, level_id);
+    int hit = resident != NULL;
+    if (resident == NULL) {
+        resident = (resident_level *) malloc(sizeof(resident_level));
+        if (resident == NULL) {
+            log_error("Failed to allocate memory for level '{s}'", level_id);
+            return NULL;
+        }
+        resident->level = load_level(ctx, level_id);
+        if (resident->level == NULL) {
+            free(resident);
+            return NULL;
+        }
+        if (hashtable_set(ctx->resident_levels, level_id, resident) != 0) {
+            log_error("Failed to store level '{s}'", level_id);
+            map m = resident->level->map;
+            level_destroy(resident->level);
+            release_map(ctx, m);
+            free(resident);
+            return NULL;
+        }
     }
-    if (level_load(new_level) != 0) {
-        level_destroy(new_level);
-        return NULL;
+    resident->last_used = ++ctx->use_clock;
+    ctx->active_level = resident->level;
+    enforce_memory_budget(ctx);
+
+    double elapsed_ms = (utils_get_time() - start) * 1000.0;
+    ctx->stats.last_transition_ms = elapsed_ms;
+    if (hit) {
+        ctx->stats.hits++;
+        ctx->total_hit_ms += elapsed_ms;
     }
-    new_level->player = entity_manager_load_entity(ctx->entity_mgr, "player");
-    if (new_level->player == NULL) {
-        level_destroy(new_level);
-        return NULL;
+    else {
+        ctx->stats.misses++;
+        ctx->total_miss_ms += elapsed_ms;
     }
-    return new_level;
+    log_info("Entered level '{s}' in {f}ms ({s})", level_id, elapsed_ms, hit ? "resident" : "loaded");
+    return resident->level;
+}
+
+void level_manager_set_memory_budget(level_manager_ctx ctx, size_t memory_budget) {
+    ctx->memory_budget = memory_budget;
+    enforce_memory_budget(ctx);
+}
+
+static iteration_result count_entry(const hashtable_entry *entry) {
+    (void) entry;
+    return ITERATION_CONTINUE;
+}
+
+level_residency_statistics level_manager_get_stats(level_manager_ctx ctx) {
+    level_residency_statistics stats = ctx->stats;
+    stats.resident_levels = hashtable_foreach(ctx->resident_levels, count_entry);
+    stats.shared_maps = hashtable_foreach(ctx->shared_maps, count_entry);
+    stats.resident_bytes = resident_memory_usage(ctx);
+    stats.memory_budget = ctx->memory_budget;
+    size_t transitions = stats.hits + stats.misses;
+    stats.hit_rate = transitions > 0 ? (double) stats.hits / (double) transitions : 0.0;
+    stats.average_hit_ms = stats.hits > 0 ? ctx->total_hit_ms / (double) stats.hits : 0.0;
+    stats.average_miss_ms = stats.misses > 0 ? ctx->total_miss_ms / (double) stats.misses : 0.0;
+    return stats;
 }
 
 static iteration_result destroy_level_record(const hashtable_entry *entry) {
@@ -193,8 +426,31 @@ static iteration_result destroy_level_record(const hashtable_entry *entry) {
     return ITERATION_CONTINUE;
 }
 
+static iteration_result destroy_resident_level(const hashtable_entry *entry) {
+    resident_level *resident = (resident_level *) entry->value;
+    level_destroy(resident->level);
+    free(resident);
+    return ITERATION_CONTINUE;
+}
+
+static iteration_result destroy_shared_map(const hashtable_entry *entry) {
+    ref_counted_map *rc_map = (ref_counted_map *) entry->value;
+    map_destroy(rc_map->map);
+    free(rc_map);
+    return ITERATION_CONTINUE;
+}
+
 void level_manager_cleanup(level_manager_ctx ctx) {
     if (ctx == NULL) return;
+    // Levels first, their pathfinding may still point into the maps
+    if (ctx->resident_levels) {
+        hashtable_foreach(ctx->resident_levels, destroy_resident_level);
+        hashtable_destroy(ctx->resident_levels);
+    }
+    if (ctx->shared_maps) {
+        hashtable_foreach(ctx->shared_maps, destroy_shared_map);
+        hashtable_destroy(ctx->shared_maps);
+    }
     if (ctx->level_config) {
         hashtable_foreach(ctx->level_config, destroy_level_record);
         hashtable_destroy(ctx->level_config);
@@ -202,7 +458,7 @@ void level_manager_cleanup(level_manager_ctx ctx) {
     free(ctx);
 }
 
-level level_create(asset_manager_ctx asset_mgr, entity_manager_ctx entity_mgr, const char *level_id, const char *map_id) {
+static level create_level(entity_manager_ctx entity_mgr, const char *level_id, map m, int owns_map) {
     level l = (level) calloc(1, sizeof(struct level_s));
     if (l == NULL) {
         return NULL;
@@ -213,16 +469,53 @@ level level_create(asset_manager_ctx asset_mgr, entity_manager_ctx entity_mgr, c
         level_destroy(l);
         return NULL;
     }
-    l->map = map_create(asset_mgr, map_id);
-    if (l == NULL) {
+    l->entities = entity_storage_create(0);
+    if (l->entities == NULL) {
         level_destroy(l);
         return NULL;
     }
-    l->entities = linked_list_create_borrowed();
-    if (l == NULL) {
+    l->pathfinding = pathfinding_scheduler_create(PATHFINDING_NODE_BUDGET_PER_TICK);
+    if (l->pathfinding == NULL) {
+        level_destroy(l);
+        return NULL;
+    }
+    l->entity_grid = spatial_grid_create(ENTITY_GRID_CELL_SIZE, ENTITY_GRID_BUCKETS);
+    if (l->entity_grid == NULL) {
+        level_destroy(l);
+        return NULL;
+    }
+    l->player_view = fov_viewer_create(FOV_PLAYER_RADIUS);
+    if (l->player_view == NULL) {
+        level_destroy(l);
+        return NULL;
+    }
+    l->collisions = collision_world_create();
+    if (l->collisions == NULL) {
         level_destroy(l);
         return NULL;
     }
+    l->ai = ai_scheduler_create(AI_THINK_BUDGET_PER_TICK);
+    if (l->ai == NULL) {
+        level_destroy(l);
+        return NULL;
+    }
+    l->fog_enabled = 1;
+    // Only taken once nothing else can fail, the caller keeps the map otherwise
+    l->map = m;
+    l->owns_map = owns_map;
+    return l;
+}
+
+level level_create(asset_manager_ctx asset_mgr, entity_manager_ctx entity_mgr, const char *level_id, const char *map_id) {
+    map m = map_create(asset_mgr, map_id);
+    if (m == NULL) {
+        return NULL;
+    }
+    level l = create_level(entity_mgr, level_id, m, 1);
+    if (l == NULL) {
+        map_destroy(m);
+        return NULL;
+    }
     return l;
 }
 
@@ -234,99 +527,353 @@ entity level_get_player_entity(level l) {
     return l->player;
 }
 
-struct update_entity_args_s {
-    level level;
-    double dt;
-};
+void level_update(level l, double dt) {
+    double start = utils_get_time();
+    entity_update_storage(l->entities, l, entity_manager_get_workers(l->entity_mgr), dt);
+    double entities_done = utils_get_time();
+
+    // Keep the chunks around the player streamed in before anything paths through them
+    entity_position player_position = entity_get_position(l->player);
+    map_update(l->map, player_position.x, player_position.y);
+    double streaming_done = utils_get_time();
+
+    // Only recomputed when the player changes cell or something that blocks sight changes
+    if (map_update_fov(l->map, l->player_view, map_get_cell_at(l->map, player_position.x, player_position.y))) {
+        map_reveal(l->map, l->player_view);
+    }
+    double fov_done = utils_get_time();
+
+    // Entities queue their path requests above; spend this tick's node budget on them
+    pathfinding_scheduler_run(l->pathfinding);
+    double end = utils_get_time();
+
+    l->update_stats = (level_update_statistics) {
+        .entities_ms = (entities_done - start) * 1000.0,
+        .streaming_ms = (streaming_done - entities_done) * 1000.0,
+        .fov_ms = (fov_done - streaming_done) * 1000.0,
+        .pathfinding_ms = (end - fov_done) * 1000.0,
+        .total_ms = (end - start) * 1000.0
+    };
+}
 
-static iteration_result update_entity(void *element, void *_args) {
-    struct update_entity_args_s *args = (struct update_entity_args_s *) _args;
-    entity e = (entity) element;
+pathfinding_request level_request_path(level l, integer_position from, integer_position to) {
+    return pathfinding_scheduler_submit(l->pathfinding, map_begin_path_search(l->map, from, to));
+}
 
-    entity_update(e, args->level, args->dt);
+void level_release_path_request(level l, pathfinding_request request) {
+    pathfinding_scheduler_release(l->pathfinding, request);
+}
 
-    return ITERATION_CONTINUE;
-} 
+collision_world level_get_collisions(level l) {
+    return l->collisions;
+}
 
-void level_update(level l, double dt) {
-    struct update_entity_args_s update_entity_args = {
-        .level = l,
-        .dt = dt
-    };
-    linked_list_foreach_args(l->entities, update_entity, &update_entity_args);
+ai_scheduler level_get_ai_scheduler(level l) {
+    return l->ai;
 }
 
-struct render_entity_args_s {
-    int *result;
-    double t;
-    renderer_ctx renderer;
-    unsigned int base_layer, *max_y;
-};
+level_update_statistics level_get_update_stats(level l) {
+    return l->update_stats;
+}
 
-static iteration_result render_entity(void *_value, void *_args) {
-    struct render_entity_args_s *args = (struct render_entity_args_s *) _args;
-    entity value = (entity) _value;
-    
-    // FIXME: what if the entity is not visible? what if the first y > 0?
-    // TODO: just order entities based on y and increment layer as we go
-    unsigned int y = entity_get_position(value).y;
-    renderer_set_layer(args->renderer, args->base_layer + y);
-    if (entity_render(value, args->renderer, args->t) != 0) {
-        *args->result = 1;
+pathfinding_scheduler_statistics level_get_pathfinding_stats(level l) {
+    return pathfinding_scheduler_get_stats(l->pathfinding);
+}
+
+map_streaming_statistics level_get_streaming_stats(level l) {
+    return map_get_streaming_stats(l->map);
+}
+
+int level_player_can_see(level l, int x, int y) {
+    return fov_viewer_can_see(l->player_view, x, y);
+}
+
+void level_set_fog_enabled(level l, int enabled) {
+    l->fog_enabled = enabled;
+}
+
+int level_is_fog_enabled(level l) {
+    return l->fog_enabled;
+}
+
+size_t level_find_entities_in_radius(level l, float x, float y, float radius, spatial_grid_callback callback, void *args) {
+    return spatial_grid_query_radius(l->entity_grid, x, y, radius, callback, args);
+}
+
+size_t level_find_entities_in_rect(level l, float x, float y, float width, float height, spatial_grid_callback callback, void *args) {
+    return spatial_grid_query_rect(l->entity_grid, x, y, width, height, callback, args);
+}
+
+size_t level_find_nearest_entities(level l, float x, float y, size_t k, float max_distance, entity *out_entities) {
+    return spatial_grid_query_nearest(l->entity_grid, x, y, k, max_distance, (void **) out_entities, NULL);
+}
+
+static int reserve_draws(level l, size_t count) {
+    if (count <= l->draw_capacity) return 0;
+    size_t capacity = l->draw_capacity ? l->draw_capacity : 64;
+    while (capacity < count) capacity *= 2;
+
+    entity_draw *draws = (entity_draw *) realloc(l->draws, capacity * sizeof(entity_draw));
+    if (draws == NULL) return 1;
+    l->draws = draws;
+    entity_draw *scratch = (entity_draw *) realloc(l->draw_scratch, capacity * sizeof(entity_draw));
+    if (scratch == NULL) return 1;
+    l->draw_scratch = scratch;
+    l->draw_capacity = capacity;
+    return 0;
+}
+
+static uint64_t entity_draw_key(float y, unsigned int texture_id) {
+    // Biased so entities poking above the map still sort first
+    int64_t band = (int64_t) floorf(y / ENTITY_DRAW_Y_BAND);
+    uint32_t y_key = (uint32_t) (band - (int64_t) INT32_MIN);
+    return ((uint64_t) y_key << 32) | texture_id;
+}
+
+// Stable LSD radix sort on bytes, skipping the bytes every key shares
+static void sort_draws(level l, size_t count) {
+    entity_draw *from = l->draws, *to = l->draw_scratch;
+    uint64_t differing = 0;
+    for (size_t i = 1; i < count; i++) {
+        differing |= from[i].key ^ from[0].key;
     }
-    if (y > *args->max_y) {
-        *args->max_y = y;
+
+    for (unsigned int shift = 0; shift < 64; shift += 8) {
+        if (((differing >> shift) & 0xff) == 0) continue;
+        size_t offsets[256] = { 0 };
+        for (size_t i = 0; i < count; i++) {
+            offsets[(from[i].key >> shift) & 0xff]++;
+        }
+        size_t total = 0;
+        for (size_t digit = 0; digit < 256; digit++) {
+            size_t digit_count = offsets[digit];
+            offsets[digit] = total;
+            total += digit_count;
+        }
+        for (size_t i = 0; i < count; i++) {
+            to[offsets[(from[i].key >> shift) & 0xff]++] = from[i];
+        }
+        entity_draw *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != l->draws) {
+        memcpy(l->draws, from, count * sizeof(entity_draw));
     }
-    return ITERATION_CONTINUE;
 }
 
 int level_render(level l, renderer_ctx ctx, double t) {
     int entity_result = 0;
-    unsigned int base_layer = renderer_get_layer(ctx), max_y = entity_get_position(l->player).y;
-    struct render_entity_args_s render_entity_args = {
-        .result = &entity_result,
-        .renderer = ctx,
-        .t = t,
-        .base_layer = base_layer,
-        .max_y = &max_y
-    };
+    unsigned int base_layer = renderer_get_layer(ctx);
+
+    // Only entities near the view, padded by a cell since sprites are drawn up and out from their position
+    float view_x = 0.0f, view_y = 0.0f;
+    int view_width = 0, view_height = 0;
+    renderer_get_pan(ctx, &view_x, &view_y);
+    renderer_get_dimensions(ctx, &view_width, &view_height);
+    float min_x = view_x - ENTITY_GRID_CELL_SIZE, max_x = view_x + (float) view_width + ENTITY_GRID_CELL_SIZE;
+    float min_y = view_y - ENTITY_GRID_CELL_SIZE, max_y = view_y + (float) view_height + ENTITY_GRID_CELL_SIZE;
+
+    // A straight pass over the position columns, far cheaper per entity than chasing pointers
+    entity_columns *columns = entity_storage_get_columns(l->entities);
+    size_t draw_count = 0;
+    if (reserve_draws(l, columns->count) != 0) {
+        log_error("Failed to allocate the entity draw list of level '{s}'", l->level_id);
+        return 1;
+    }
+    for (size_t row = 0; row < columns->count; row++) {
+        float x = columns->position_x[row], y = columns->position_y[row];
+        entity value = columns->owners[row];
+        if (value != l->player) {
+            if (x < min_x || x > max_x || y < min_y || y > max_y) continue;
+            if (l->fog_enabled) {
+                integer_position cell = map_get_cell_at(l->map, x, y);
+                if (!fov_viewer_can_see(l->player_view, cell.x, cell.y)) continue;
+            }
+        }
+        l->draws[draw_count++] = (entity_draw) {
+            .key = entity_draw_key(y, entity_get_texture_id(value, t)),
+            .entity = value
+        };
+    }
+    sort_draws(l, draw_count);
+
+    // Everyone shares one layer, later draws win on it so the sorted order does the depth
     renderer_set_blend_mode(ctx, BLEND_MODE_BINARY);
-    renderer_set_layer(ctx, base_layer + max_y);
-    entity_result = entity_render(l->player, ctx, t);
-    linked_list_foreach_args(l->entities, render_entity, &render_entity_args);
+    renderer_set_layer(ctx, base_layer + map_get_entity_layer(l->map));
+    for (size_t i = 0; i < draw_count; i++) {
+        if (entity_render(l->draws[i].entity, ctx, t) != 0) {
+            entity_result = 1;
+        }
+    }
+
     renderer_set_layer(ctx, base_layer);
-    int map_result = map_render(l->map, ctx, max_y);
+    int map_result = map_render(l->map, ctx, t);
+    if (l->fog_enabled) {
+        renderer_set_layer(ctx, base_layer);
+        map_render_fog(l->map, ctx, l->player_view);
+    }
     return map_result != 0 && entity_result != 0;
 }
 
+size_t level_spawn_batch(level l, entity_archetype archetype, size_t count, const entity_position *positions, entity *out_entities) {
+    // Rows up front, so the batch can't move the columns halfway through
+    if (entity_storage_reserve(l->entities, entity_storage_size(l->entities) + count) != 0) {
+        log_error("Failed to make room for {zu} entities in level '{s}'", count, l->level_id);
+        return 0;
+    }
+
+    size_t spawned = 0;
+    for (; spawned < count; spawned++) {
+        entity e = entity_spawn(archetype, l->entities);
+        if (e == NULL) {
+            log_error("Failed to spawn entity {zu} of {zu} in level '{s}'", spawned + 1, count, l->level_id);
+            break;
+        }
+        entity_set_position(e, positions[spawned].x, positions[spawned].y);
+        if (entity_set_spatial_grid(e, l->entity_grid) != 0) {
+            log_error("Failed to index entity '{s}' for level '{s}'", entity_get_id(e), l->level_id);
+            entity_despawn(e, l);
+            break;
+        }
+        if (out_entities != NULL) out_entities[spawned] = e;
+    }
+    return spawned;
+}
+
+void level_despawn(level l, entity e) {
+    if (e == NULL) return;
+    if (e == l->player) {
+        log_warning("Refusing to despawn the player of level '{s}'", l->level_id);
+        return;
+    }
+    entity_despawn(e, l);
+}
+
+int level_write_snapshot(level l, snapshot s) {
+    uint16_t version = SNAPSHOT_VERSION, byte_order = SNAPSHOT_BYTE_ORDER;
+    uint32_t id_length = (uint32_t) strlen(l->level_id), tick = ai_scheduler_get_tick(l->ai);
+    snapshot_clear(s);
+    if (snapshot_write(s, SNAPSHOT_MAGIC, 4) != 0
+        || snapshot_write(s, &version, sizeof(version)) != 0
+        || snapshot_write(s, &byte_order, sizeof(byte_order)) != 0
+        || snapshot_write(s, &id_length, sizeof(id_length)) != 0
+        || snapshot_write(s, l->level_id, id_length) != 0
+        || snapshot_write(s, &tick, sizeof(tick)) != 0
+        || map_write_state(l->map, s) != 0
+        || entity_storage_write_snapshot(l->entities, l->player, l->entity_mgr, tick, s) != 0) {
+        log_error("Failed to snapshot level '{s}'", l->level_id);
+        return 1;
+    }
+    return 0;
+}
+
+int level_read_snapshot(level l, snapshot s) {
+    snapshot_reader reader = snapshot_begin_read(s);
+    const unsigned char *magic = snapshot_read(&reader, 4);
+    uint16_t version = 0, byte_order = 0;
+    uint32_t id_length = 0, tick = 0;
+    const unsigned char *level_id = NULL;
+    if (magic == NULL || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0
+        || snapshot_read_value(&reader, &version, sizeof(version)) != 0
+        || snapshot_read_value(&reader, &byte_order, sizeof(byte_order)) != 0) {
+        log_error("Failed to restore level '{s}': not a snapshot", l->level_id);
+        return 1;
+    }
+    if (version != SNAPSHOT_VERSION) {
+        log_error("Failed to restore level '{s}': unsupported snapshot version {d}", l->level_id, (int) version);
+        return 1;
+    }
+    if (byte_order != SNAPSHOT_BYTE_ORDER) {
+        log_error("Failed to restore level '{s}': snapshot was written with the other byte order", l->level_id);
+        return 1;
+    }
+    if (snapshot_read_value(&reader, &id_length, sizeof(id_length)) != 0
+        || (level_id = snapshot_read(&reader, id_length)) == NULL
+        || snapshot_read_value(&reader, &tick, sizeof(tick)) != 0) {
+        log_error("Failed to restore level '{s}': snapshot is truncated", l->level_id);
+        return 1;
+    }
+    if (id_length != strlen(l->level_id) || memcmp(level_id, l->level_id, id_length) != 0) {
+        log_error("Failed to restore level '{s}': snapshot is of another level", l->level_id);
+        return 1;
+    }
+
+    // Every section is checked before any is put back, so a bad snapshot leaves the level as it was
+    map_state map_section = { 0 };
+    entity_snapshot entities = NULL;
+    if (map_parse_state(l->map, &reader, &map_section) != 0
+        || (entities = entity_storage_parse_snapshot(l->player, l->entity_mgr, &reader)) == NULL) {
+        log_error("Failed to restore level '{s}'", l->level_id);
+        return 1;
+    }
+    if (reader.cursor != reader.end) {
+        log_error("Failed to restore level '{s}': {zu} bytes past the end of the snapshot", l->level_id, (size_t) (reader.end - reader.cursor));
+        entity_snapshot_destroy(entities);
+        return 1;
+    }
+    if (entity_storage_apply_snapshot(l->entities, l->player, l, l->entity_mgr, tick, entities) != 0) {
+        log_error("Failed to restore level '{s}'", l->level_id);
+        entity_snapshot_destroy(entities);
+        return 1;
+    }
+    entity_snapshot_destroy(entities);
+    map_apply_state(l->map, &map_section);
+    ai_scheduler_set_tick(l->ai, tick);
+    return 0;
+}
+
 int level_load(level l) {
+    // Shared maps are loaded by the level manager
+    if (!l->owns_map) return 0;
     return map_load(l->map);
 }
 
 void level_unload(level l) {
-    map_unload(l->map);
+    // In-flight searches point into the collision grid we're about to free
+    if (l->pathfinding != NULL) pathfinding_scheduler_cancel_all(l->pathfinding);
+    if (l->owns_map) map_unload(l->map);
 }
 
-static iteration_result destroy_entity(void *_value, void *args) {
-    entity value = _value;
-    entity_manager_ctx entity_mgr = args;
-    entity_manager_unload_entity(entity_mgr, entity_get_id(value));
-    entity_destroy(value);
-    return ITERATION_CONTINUE;   
+struct entity_memory_usage_args_s {
+    size_t bytes;
+};
+
+size_t level_get_memory_usage(level l) {
+    // Rows are counted by the entities, the storage only adds its spare capacity
+    entity_columns *columns = entity_storage_get_columns(l->entities);
+    size_t bytes = sizeof(struct level_s) + fov_viewer_get_memory_usage(l->player_view) + entity_storage_get_memory_usage(l->entities);
+    bytes += 2 * l->draw_capacity * sizeof(entity_draw);
+    bytes -= columns->count * entity_storage_get_row_size();
+    for (size_t row = 0; row < columns->count; row++) {
+        bytes += entity_get_memory_usage(columns->owners[row]);
+    }
+    return bytes + map_get_memory_usage(l->map);
 }
 
 void level_destroy(level l) {
     if (l == NULL) return;
     level_unload(l);
-    map_destroy(l->map);
-    if (l->entities) {
-        linked_list_foreach_args(l->entities, destroy_entity, l->entity_mgr);
-        linked_list_destroy(l->entities);
-    }
+    if (l->owns_map) map_destroy(l->map);
     if (l->player) {
-        entity_manager_unload_entity(l->entity_mgr, entity_get_id(l->player));
         entity_destroy(l->player);
     }
+    if (l->entities) {
+        // Destroying an entity gives up its row, so always take the last one
+        entity_columns *columns = entity_storage_get_columns(l->entities);
+        while (columns->count > 0) {
+            entity_destroy(columns->owners[columns->count - 1]);
+        }
+        entity_storage_destroy(l->entities);
+    }
+    pathfinding_scheduler_destroy(l->pathfinding);
+    spatial_grid_destroy(l->entity_grid);
+    fov_viewer_destroy(l->player_view);
+    collision_world_destroy(l->collisions);
+    ai_scheduler_destroy(l->ai);
+    free(l->draws);
+    free(l->draw_scratch);
     free(l->level_id);
     free(l);
 }
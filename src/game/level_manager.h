@@ -1,16 +1,47 @@
 #ifndef _H_LEVEL_H_
 #define _H_LEVEL_H_
 
+#include "ai/pathfinding_scheduler.h"
 #include "asset_manager.h"
+#include "collision.h"
+#include "ai_scheduler.h"
 #include "entity_defs.h"
+#include "data_structures/spatial_grid.h"
 #include "map.h"
+#include "snapshot.h"
 #include "renderer/renderer.h"
 
 typedef struct level_s *level;
 typedef struct level_manager_ctx_s *level_manager_ctx;
 
+typedef struct level_residency_statistics {
+    size_t resident_levels;
+    size_t shared_maps;
+    size_t resident_bytes;
+    size_t memory_budget;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    double hit_rate;
+    double last_transition_ms;
+    double average_hit_ms;
+    double average_miss_ms;
+} level_residency_statistics;
+
+// Where the last level_update went
+typedef struct level_update_statistics {
+    double entities_ms;
+    double streaming_ms;
+    double fov_ms;
+    double pathfinding_ms;
+    double total_ms;
+} level_update_statistics;
+
 level_manager_ctx level_manager_init(asset_manager_ctx, entity_manager_ctx);
+// The level stays owned by the manager, it is destroyed on eviction or cleanup
 level level_manager_load_level(level_manager_ctx, const char *level_id);
+void level_manager_set_memory_budget(level_manager_ctx, size_t memory_budget);
+level_residency_statistics level_manager_get_stats(level_manager_ctx);
 void level_manager_cleanup(level_manager_ctx);
 
 level level_create(asset_manager_ctx, entity_manager_ctx, const char *level_id, const char *map_id);
@@ -18,6 +49,33 @@ int level_render(level, renderer_ctx, double t);
 map level_get_map(level);
 entity level_get_player_entity(level);
 void level_update(level, double dt);
+pathfinding_request level_request_path(level, integer_position from, integer_position to);
+void level_release_path_request(level, pathfinding_request);
+// Moves the level's entities each update, its contacts are the ones from the last one
+collision_world level_get_collisions(level);
+// Picks which entities think each update, stats are for the last one
+ai_scheduler level_get_ai_scheduler(level);
+level_update_statistics level_get_update_stats(level);
+pathfinding_scheduler_statistics level_get_pathfinding_stats(level);
+map_streaming_statistics level_get_streaming_stats(level);
+size_t level_find_entities_in_radius(level, float x, float y, float radius, spatial_grid_callback, void *args);
+size_t level_find_entities_in_rect(level, float x, float y, float width, float height, spatial_grid_callback, void *args);
+size_t level_find_nearest_entities(level, float x, float y, size_t k, float max_distance, entity *out_entities);
+int level_player_can_see(level, int x, int y);
+void level_set_fog_enabled(level, int enabled);
+int level_is_fog_enabled(level);
+// Spawns count instances of the archetype at the positions, reusing pooled ones. Returns how many were
+// spawned, out_entities gets them if not NULL
+size_t level_spawn_batch(level, entity_archetype, size_t count, const entity_position *positions, entity *out_entities);
+// Removes the entity from the level and pools it for the next spawn. Invalidates rows like any removal
+void level_despawn(level, entity);
+size_t level_get_memory_usage(level);
+// Replaces the snapshot with the level's entities, the map's explored and sight blocking cells and the
+// random state. In-flight path searches aren't kept, entities waiting on one search again after a restore
+int level_write_snapshot(level, snapshot);
+// Puts the level back as it was when the snapshot was written. Handles to entities other than the player
+// are invalidated if the level no longer holds the same entities in the same order
+int level_read_snapshot(level, snapshot);
 int level_load(level);
 void level_unload(level);
 void level_destroy(level);
@@ -1,48 +1,164 @@
 #include "map.h"
 #include "config.h"
+#include "map_chunk_loader.h"
+#include "map_format.h"
 #include "cjson/cJSON.h"
 #include "data_structures/hashtable.h"
 #include "utils/utils.h"
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const int MAP_NO_OCCLUDER = INT_MIN;
+// Layer chunks store ids as uint16_t, anything larger can't be placed
+static const int MAP_MAX_TILE_ID = UINT16_MAX;
+
+#define MAP_CHUNK_CELLS (MAP_CHUNK_SIZE * MAP_CHUNK_SIZE)
+#define MAP_CHUNK_OCCUPANCY_WORDS ((MAP_CHUNK_CELLS + 63) / 64)
 
 typedef struct map_asset_info {
     int max_id;
     int min_id;
 } map_asset_info; 
 
+// Frame n of an animated tile is tile base_id + n * stride, shown for interval ms
+typedef struct map_tile_animation {
+    int base_id;
+    int frame_count;
+    int stride;
+    int interval;
+} map_tile_animation;
+
+typedef enum map_chunk_state {
+    MAP_CHUNK_UNLOADED,
+    MAP_CHUNK_LOADING,
+    MAP_CHUNK_RESIDENT
+} map_chunk_state;
+
+typedef struct map_chunk {
+    // Pixel rectangle covered by the chunk, edge chunks may be smaller than MAP_CHUNK_SIZE
+    float x, y, width, height;
+    int first_col, first_row, last_col, last_row;
+    map_chunk_state state;
+} map_chunk;
+
+typedef struct map_layer_chunk {
+    // One bit per cell (row-major, chunk-local) telling whether it holds a tile, plus the ids of
+    // just those cells in the same order. Both are NULL while the chunk is empty or not resident
+    uint64_t *occupancy;
+    uint16_t *tile_ids;
+    int tile_capacity;
+    // GPU copy of this chunk's tiles, rebuilt only when one of its cells changes
+    renderer_static_batch batch;
+    size_t batch_bytes;
+    int tile_count;
+    int dirty;
+    // Tiles hidden under an opaque tile of a higher layer, counted whenever culling changes
+    int culled_count;
+    int culling_dirty;
+} map_layer_chunk;
+
+// A tile set with map_set_tile, replayed whenever its chunk is loaded again and kept in snapshots
+typedef struct map_tile_edit {
+    uint16_t local_cell;
+    uint16_t tile_id;
+    // What the map file has there, -1 until the chunk has been loaded
+    int32_t original_tile_id;
+} map_tile_edit;
+
+typedef struct map_chunk_edits {
+    map_tile_edit *edits;
+    int count, capacity;
+} map_chunk_edits;
+
 typedef struct map_grid_info {
     int layer;
-    int *grid;
     int transparent;
+    map_layer_chunk *chunks;
+    // One entry per chunk, NULL until the layer is first edited
+    map_chunk_edits *edits;
+    // Whole-layer tile id texture for MAP_RENDER_TILEMAP, created the first time it's drawn
+    renderer_tilemap tilemap;
 } map_grid_info;
 
-typedef struct asset_and_min_id {
-    asset asset;
-    int min_id;
-} asset_and_min_id;
+typedef enum map_stream_layer_kind {
+    MAP_STREAM_LAYER_TILES,
+    MAP_STREAM_LAYER_COLLISION,
+    MAP_STREAM_LAYER_VISION,
+    MAP_STREAM_LAYER_TERRAIN
+} map_stream_layer_kind;
+
+typedef struct map_stream_layer {
+    map_stream_layer_kind kind;
+    map_grid_info *grid_info;  // Only set for tile layers
+} map_stream_layer;
 
 struct map_s {
     asset_manager_ctx asset_mgr;
     
     hashtable asset_info;
     hashtable grids;
-    hashtable texture_cache;
 
     int *collision_grid;
+    int *terrain_grid;
+    // Cells that block line of sight, a copy of the collision grid for maps without a vision layer.
+    // The version changes whenever any of them does, so viewers know to recompute
+    int *vision_grid;
+    int vision_from_collisions;
+    unsigned int vision_version;
+    // One bit per cell the player has ever seen
+    uint64_t *explored;
+    // Highest tile layer, fog goes over it
+    int top_layer;
+    // Highest layer with a fully opaque tile covering each cell, MAP_NO_OCCLUDER if none. Blending
+    // doesn't matter here, an opaque texel hides everything below it on transparent layers too
+    int *occluder_grid;
 
     int width, height;
     int tilewidth, tileheight;
     int player_layer;
 
+    map_chunk *chunks;
+    int chunk_columns, chunk_rows;
+
     char *map_id;
-    char *texture_id_buffer;
-    size_t texture_id_buffer_size;
+
+    // Indexed directly by tile id, NULL where no asset covers the id
+    texture *textures;
+    size_t texture_count;
+
+    // Animations play on the GPU, tiles only store their base id. Indexed by their row in
+    // gpu_animations, which is created the first time the map is rendered
+    map_tile_animation *animations;
+    size_t animation_count;
+    // Animation of every tile id, -1 for static tiles
+    int *tile_animations;
+    renderer_tile_animations gpu_animations;
+
+    map_render_mode render_mode;
+    // Shared by every layer's tilemap, built alongside the first one
+    renderer_tileset tileset;
+    map_render_statistics render_stats;
+
+    // Streaming maps only keep the chunks around the focus point in memory; the layers
+    // here are in the same order as the payloads the loader hands back
+    int streaming;
+    map_chunk_loader loader;
+    map_stream_layer *stream_layers;
+    size_t stream_layer_count;
+    size_t resident_bytes;
+    map_streaming_statistics stats;
+    double total_load_latency_ms;
 };
 
-static char *get_map_path(const char *partial_path) {
+static char *get_map_path(const char *partial_path, const char *extension) {
     char *fullpath = (char*) calloc(
-        strlen(partial_path) + sizeof(ASSETS_PATH_PREFIX) + sizeof(MAP_CONFIG_FILE_EXT) - 1, 
+        strlen(partial_path) + sizeof(ASSETS_PATH_PREFIX) + strlen(extension), 
         sizeof(char)
     );
     if (fullpath == NULL) {
@@ -50,7 +166,7 @@ static char *get_map_path(const char *partial_path) {
     }
     strcpy(fullpath, ASSETS_PATH_PREFIX);
     strcat(fullpath, partial_path);
-    strcat(fullpath, MAP_CONFIG_FILE_EXT);
+    strcat(fullpath, extension);
     return fullpath;
 }
 
@@ -77,462 +193,2327 @@ static int populate_grid(cJSON *layer_map, int *grid, int *largest_texture_id) {
     return 0;
 }
 
-static int load_inner_map_config(map m, const char *partial_path) {
-    char *fullpath = get_map_path(partial_path);
-    if (fullpath == NULL) {
-        log_error("Failed to allocate memory during parsing of map config");
-        return 1;
+static map_layer_chunk *layer_chunk_at(map m, map_grid_info *grid_info, int x, int y) {
+    return &grid_info->chunks[x / MAP_CHUNK_SIZE + (y / MAP_CHUNK_SIZE) * m->chunk_columns];
+}
+
+static int layer_chunk_local_cell(int x, int y) {
+    // Chunks start on multiples of MAP_CHUNK_SIZE, so the local cell is just the remainder
+    return (y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + x % MAP_CHUNK_SIZE;
+}
+
+static int popcount64(uint64_t bits) {
+#ifdef _MSC_VER
+    return (int) __popcnt64(bits);
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+// bits must not be 0
+static int ctz64(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int) index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+static int layer_chunk_rank(const map_layer_chunk *layer_chunk, int local_cell) {
+    // Position of the cell's id in tile_ids, i.e. how many occupied cells come before it
+    int rank = 0;
+    for (int word = 0; word < local_cell / 64; word++) {
+        rank += popcount64(layer_chunk->occupancy[word]);
     }
+    uint64_t preceding_bits = (UINT64_C(1) << (local_cell % 64)) - 1;
+    return rank + popcount64(layer_chunk->occupancy[local_cell / 64] & preceding_bits);
+}
 
-    char *config_contents = utils_read_whole_file(fullpath);
-    free(fullpath);
-    if (config_contents == NULL) {
-        log_error("Failed to read map config for map '{s}'", m->map_id);
-        return 1;
+static int layer_chunk_get(const map_layer_chunk *layer_chunk, int x, int y) {
+    if (layer_chunk->occupancy == NULL) return 0;
+    int local_cell = layer_chunk_local_cell(x, y);
+    if (!(layer_chunk->occupancy[local_cell / 64] & UINT64_C(1) << (local_cell % 64))) return 0;
+    return layer_chunk->tile_ids[layer_chunk_rank(layer_chunk, local_cell)];
+}
+
+static size_t layer_chunk_storage_bytes(const map_layer_chunk *layer_chunk) {
+    if (layer_chunk->occupancy == NULL) return 0;
+    return MAP_CHUNK_OCCUPANCY_WORDS * sizeof(uint64_t) + (size_t) layer_chunk->tile_capacity * sizeof(uint16_t);
+}
+
+typedef struct layer_chunk_cursor {
+    const map_layer_chunk *layer_chunk;
+    int word;
+    uint64_t bits;
+    int index;
+} layer_chunk_cursor;
+
+static layer_chunk_cursor layer_chunk_begin(const map_layer_chunk *layer_chunk) {
+    return (layer_chunk_cursor) { .layer_chunk = layer_chunk, .word = -1 };
+}
+
+// Steps to the next occupied cell in cell order, returns 0 once there are none left
+static int layer_chunk_next(layer_chunk_cursor *cursor, const map_chunk *chunk, int *out_x, int *out_y, int *out_tile_id) {
+    if (cursor->layer_chunk->occupancy == NULL) return 0;
+    while (cursor->bits == 0) {
+        if (++cursor->word == MAP_CHUNK_OCCUPANCY_WORDS) return 0;
+        cursor->bits = cursor->layer_chunk->occupancy[cursor->word];
     }
+    int local_cell = cursor->word * 64 + ctz64(cursor->bits);
+    cursor->bits &= cursor->bits - 1;
+    *out_x = chunk->first_col + local_cell % MAP_CHUNK_SIZE;
+    *out_y = chunk->first_row + local_cell / MAP_CHUNK_SIZE;
+    *out_tile_id = cursor->layer_chunk->tile_ids[cursor->index++];
+    return 1;
+}
 
-    cJSON *map_config = cJSON_Parse(config_contents);
-    free(config_contents);
-    if (map_config == NULL) {
-        log_error("Failed to parse map config for map '{s}'", m->map_id);
-        cJSON_Delete(map_config);
-        return 1;
+static texture get_texture_from_id(map m, int id) {
+    if (id < 0 || (size_t) id >= m->texture_count) return NULL;
+    return m->textures[id];
+}
+
+static int get_tile_animation(map m, int tile_id) {
+    if (m->tile_animations == NULL || tile_id < 0 || (size_t) tile_id >= m->texture_count) return -1;
+    return m->tile_animations[tile_id];
+}
+
+static int tile_occludes_cell(map m, int tile_id) {
+    // Frames of animated tiles aren't guaranteed to share their base frame's coverage
+    if (get_tile_animation(m, tile_id) >= 0) return 0;
+    texture t = get_texture_from_id(m, tile_id);
+    return t != NULL && texture_is_opaque(t) && texture_get_width(t) >= m->tilewidth && texture_get_height(t) >= m->tileheight;
+}
+
+static int is_tile_culled(map m, const map_grid_info *grid_info, int x, int y, int tile_id) {
+    if (tile_id == 0 || m->occluder_grid == NULL || m->occluder_grid[x + y * m->width] <= grid_info->layer) return 0;
+    // Tiles that spill out of their cell might still show past the one covering it
+    texture t = get_texture_from_id(m, tile_id);
+    return t != NULL && texture_get_width(t) <= m->tilewidth && texture_get_height(t) <= m->tileheight;
+}
+
+static int visible_tile_id(map m, map_grid_info *grid_info, int x, int y) {
+    int tile_id = layer_chunk_get(layer_chunk_at(m, grid_info, x, y), x, y);
+    return is_tile_culled(m, grid_info, x, y, tile_id) ? 0 : tile_id;
+}
+
+struct cell_occlusion_args_s {
+    map map;
+    int x, y;
+    int occluder_layer;
+};
+
+static iteration_result find_cell_occluder(const hashtable_entry *entry, void *_args) {
+    struct cell_occlusion_args_s *args = (struct cell_occlusion_args_s *) _args;
+    map_grid_info *grid_info = (map_grid_info *) entry->value;
+    if (grid_info->layer <= args->occluder_layer) return ITERATION_CONTINUE;
+
+    map_layer_chunk *layer_chunk = layer_chunk_at(args->map, grid_info, args->x, args->y);
+    if (tile_occludes_cell(args->map, layer_chunk_get(layer_chunk, args->x, args->y))) {
+        args->occluder_layer = grid_info->layer;
     }
-    if (!cJSON_IsObject(map_config)) {
-        log_error("Failed to parse map config for map '{s}': config must be an object", m->map_id);
-        cJSON_Delete(map_config);
-        return 1;
+    return ITERATION_CONTINUE;
+}
+
+static iteration_result refresh_cell_culling(const hashtable_entry *entry, void *_args) {
+    struct cell_occlusion_args_s *args = (struct cell_occlusion_args_s *) _args;
+    map_grid_info *grid_info = (map_grid_info *) entry->value;
+    map_layer_chunk *layer_chunk = layer_chunk_at(args->map, grid_info, args->x, args->y);
+    if (layer_chunk_get(layer_chunk, args->x, args->y) == 0) return ITERATION_CONTINUE;
+
+    layer_chunk->dirty = 1;
+    layer_chunk->culling_dirty = 1;
+    if (grid_info->tilemap != NULL) {
+        renderer_tilemap_set_tile(grid_info->tilemap, args->x, args->y, visible_tile_id(args->map, grid_info, args->x, args->y));
     }
-    
-    cJSON *map_width = cJSON_GetObjectItem(map_config, "width");
-    cJSON *map_height = cJSON_GetObjectItem(map_config, "height");
-    cJSON *map_tilewidth = cJSON_GetObjectItem(map_config, "tilewidth");
-    cJSON *map_tileheight = cJSON_GetObjectItem(map_config, "tileheight");
-    cJSON *map_layers = cJSON_GetObjectItem(map_config, "layers");
-    cJSON *map_assets = cJSON_GetObjectItem(map_config, "assets");
-    cJSON *map_player_layer = cJSON_GetObjectItem(map_config, "player_layer");
+    return ITERATION_CONTINUE;
+}
 
-    if (map_width == NULL || !cJSON_IsNumber(map_width)) {
-        log_error("Failed to parse map config for map '{s}': width must be a number", m->map_id);
-        cJSON_Delete(map_config);
+static void update_cell_occlusion(map m, int x, int y) {
+    if (m->occluder_grid == NULL) return;
+
+    struct cell_occlusion_args_s cell_occlusion_args = {
+        .map = m,
+        .x = x,
+        .y = y,
+        .occluder_layer = MAP_NO_OCCLUDER
+    };
+    hashtable_foreach_args(m->grids, find_cell_occluder, &cell_occlusion_args);
+    if (m->occluder_grid[x + y * m->width] == cell_occlusion_args.occluder_layer) return;
+
+    // Only the layers stacked on this cell can change visibility
+    m->occluder_grid[x + y * m->width] = cell_occlusion_args.occluder_layer;
+    hashtable_foreach_args(m->grids, refresh_cell_culling, &cell_occlusion_args);
+}
+
+static void free_layer_chunk_storage(map m, map_layer_chunk *layer_chunk) {
+    m->resident_bytes -= layer_chunk_storage_bytes(layer_chunk);
+    free(layer_chunk->occupancy);
+    free(layer_chunk->tile_ids);
+    layer_chunk->occupancy = NULL;
+    layer_chunk->tile_ids = NULL;
+    layer_chunk->tile_capacity = 0;
+    layer_chunk->tile_count = 0;
+}
+
+static int adopt_layer_chunk_tiles(map m, map_layer_chunk *layer_chunk, int chunk_index, const int *tiles) {
+    int tile_count = 0, out_of_range = 0;
+    for (int i = 0; i < MAP_CHUNK_CELLS; i++) {
+        tile_count += tiles[i] > 0 && tiles[i] <= MAP_MAX_TILE_ID;
+        out_of_range += tiles[i] < 0 || tiles[i] > MAP_MAX_TILE_ID;
+    }
+    // Eagerly loaded maps fail on these in store_tile. A streamed chunk is left without them, logged once
+    // rather than per tile
+    if (out_of_range > 0) {
+        log_error("Chunk ({d}, {d}) of map '{s}' has {d} tile ids out of range", chunk_index % m->chunk_columns, chunk_index / m->chunk_columns, m->map_id, out_of_range);
+    }
+    if (tile_count == 0) return 0;
+
+    // Sized exactly, loaded chunks are rarely edited afterwards
+    layer_chunk->occupancy = (uint64_t *) calloc(MAP_CHUNK_OCCUPANCY_WORDS, sizeof(uint64_t));
+    layer_chunk->tile_ids = (uint16_t *) malloc((size_t) tile_count * sizeof(uint16_t));
+    if (layer_chunk->occupancy == NULL || layer_chunk->tile_ids == NULL) {
+        free(layer_chunk->occupancy);
+        free(layer_chunk->tile_ids);
+        layer_chunk->occupancy = NULL;
+        layer_chunk->tile_ids = NULL;
         return 1;
     }
+    layer_chunk->tile_capacity = tile_count;
+    layer_chunk->tile_count = 0;
+    for (int i = 0; i < MAP_CHUNK_CELLS; i++) {
+        if (tiles[i] <= 0 || tiles[i] > MAP_MAX_TILE_ID) continue;
+        layer_chunk->occupancy[i / 64] |= UINT64_C(1) << (i % 64);
+        layer_chunk->tile_ids[layer_chunk->tile_count++] = (uint16_t) tiles[i];
+    }
+    layer_chunk->dirty = 1;
+    layer_chunk->culling_dirty = 1;
+    m->resident_bytes += layer_chunk_storage_bytes(layer_chunk);
+    return 0;
+}
 
-    if (map_height == NULL || !cJSON_IsNumber(map_height)) {
-        log_error("Failed to parse map config for map '{s}': height must be a number", m->map_id);
-        cJSON_Delete(map_config);
-        return 1;
+static void release_layer_chunk(map m, map_layer_chunk *layer_chunk) {
+    free_layer_chunk_storage(m, layer_chunk);
+    m->resident_bytes -= layer_chunk->batch_bytes;
+    renderer_static_batch_destroy(layer_chunk->batch);
+    *layer_chunk = (map_layer_chunk) { 0 };
+}
+
+// Returns 1 if it ran out of memory, leaving the chunk as it was
+static int layer_chunk_set(map m, map_layer_chunk *layer_chunk, int x, int y, int tile_id) {
+    int local_cell = layer_chunk_local_cell(x, y);
+    uint64_t bit = UINT64_C(1) << (local_cell % 64);
+    int occupied = layer_chunk->occupancy != NULL && (layer_chunk->occupancy[local_cell / 64] & bit);
+    int rank = layer_chunk->occupancy != NULL ? layer_chunk_rank(layer_chunk, local_cell) : 0;
+
+    if (!occupied && tile_id == 0) return 0;
+    if (occupied && tile_id != 0) {
+        layer_chunk->tile_ids[rank] = (uint16_t) tile_id;
+        return 0;
+    }
+    if (occupied) {
+        memmove(&layer_chunk->tile_ids[rank], &layer_chunk->tile_ids[rank + 1], (size_t) (layer_chunk->tile_count - rank - 1) * sizeof(uint16_t));
+        layer_chunk->occupancy[local_cell / 64] &= ~bit;
+        layer_chunk->tile_count--;
+        // Emptied chunks go back to having no storage at all
+        if (layer_chunk->tile_count == 0) {
+            free_layer_chunk_storage(m, layer_chunk);
+        }
+        return 0;
     }
 
-    if (map_tilewidth == NULL || !cJSON_IsNumber(map_tilewidth)) {
-        log_error("Failed to parse map config for map '{s}': tilewidth must be a number", m->map_id);
-        cJSON_Delete(map_config);
-        return 1;
+    size_t old_bytes = layer_chunk_storage_bytes(layer_chunk);
+    if (layer_chunk->occupancy == NULL) {
+        layer_chunk->occupancy = (uint64_t *) calloc(MAP_CHUNK_OCCUPANCY_WORDS, sizeof(uint64_t));
+        if (layer_chunk->occupancy == NULL) {
+            return 1;
+        }
     }
+    if (layer_chunk->tile_count == layer_chunk->tile_capacity) {
+        int new_capacity = layer_chunk->tile_capacity ? layer_chunk->tile_capacity * 2 : 16;
+        if (new_capacity > MAP_CHUNK_CELLS) new_capacity = MAP_CHUNK_CELLS;
+        uint16_t *tile_ids = (uint16_t *) realloc(layer_chunk->tile_ids, (size_t) new_capacity * sizeof(uint16_t));
+        if (tile_ids == NULL) {
+            if (layer_chunk->tile_count == 0) {
+                free(layer_chunk->occupancy);
+                layer_chunk->occupancy = NULL;
+            }
+            return 1;
+        }
+        layer_chunk->tile_ids = tile_ids;
+        layer_chunk->tile_capacity = new_capacity;
+    }
+    memmove(&layer_chunk->tile_ids[rank + 1], &layer_chunk->tile_ids[rank], (size_t) (layer_chunk->tile_count - rank) * sizeof(uint16_t));
+    layer_chunk->tile_ids[rank] = (uint16_t) tile_id;
+    layer_chunk->occupancy[local_cell / 64] |= bit;
+    layer_chunk->tile_count++;
+    m->resident_bytes += layer_chunk_storage_bytes(layer_chunk) - old_bytes;
+    return 0;
+}
 
-    if (map_tileheight == NULL || !cJSON_IsNumber(map_tileheight)) {
-        log_error("Failed to parse map config for map '{s}': tileheight must be a number", m->map_id);
-        cJSON_Delete(map_config);
+static int store_tile(map m, map_grid_info *grid_info, int x, int y, int tile_id) {
+    if (tile_id < 0 || tile_id > MAP_MAX_TILE_ID) {
+        log_error("Tile id {d} of map '{s}' is out of range", tile_id, m->map_id);
         return 1;
     }
-
-    if (map_layers == NULL || !cJSON_IsObject(map_layers)) {
-        log_error("Failed to parse map config for map '{s}': layers must be an object", m->map_id);
-        cJSON_Delete(map_config);
+    map_layer_chunk *layer_chunk = layer_chunk_at(m, grid_info, x, y);
+    if (layer_chunk_get(layer_chunk, x, y) == tile_id) return 0;
+    if (layer_chunk_set(m, layer_chunk, x, y, tile_id) != 0) {
+        log_error("Failed to allocate memory while setting a tile of map '{s}'", m->map_id);
         return 1;
     }
+    layer_chunk->dirty = 1;
+    layer_chunk->culling_dirty = 1;
+    update_cell_occlusion(m, x, y);
+    if (grid_info->tilemap != NULL) {
+        renderer_tilemap_set_tile(grid_info->tilemap, x, y, visible_tile_id(m, grid_info, x, y));
+    }
+    return 0;
+}
 
-    if (map_assets == NULL || !cJSON_IsObject(map_assets)) {
-        log_error("Failed to parse map config for map '{s}': assets must be an object", m->map_id);
-        cJSON_Delete(map_config);
-        return 1;
+static const char *DUPLICATE_GRID_WARNINGS[] = {
+    [MAP_STREAM_LAYER_COLLISION] = "More than on collision grid defined",
+    [MAP_STREAM_LAYER_VISION] = "More than one vision grid defined",
+    [MAP_STREAM_LAYER_TERRAIN] = "More than one terrain grid defined"
+};
+
+static int **cell_grid_of_kind(map m, map_stream_layer_kind kind) {
+    switch (kind) {
+        case MAP_STREAM_LAYER_COLLISION: return &m->collision_grid;
+        case MAP_STREAM_LAYER_VISION: return &m->vision_grid;
+        case MAP_STREAM_LAYER_TERRAIN: return &m->terrain_grid;
+        default: return NULL;
     }
+}
 
-    m->width = (int) cJSON_GetNumberValue(map_width);
-    m->height = (int) cJSON_GetNumberValue(map_height);
-    m->tilewidth = (int) cJSON_GetNumberValue(map_tilewidth);
-    m->tileheight = (int) cJSON_GetNumberValue(map_tileheight);
+static int populate_layer(map m, map_grid_info *grid_info, cJSON *layer_map, int *largest_texture_id) {
+    int y = 0;
+    cJSON *row = NULL, *col = NULL;
+    cJSON_ArrayForEach(row, layer_map) {
+        if (row == NULL || !cJSON_IsArray(row)) {
+            log_error("Failed to parse map config for map '{s}': each map row must be an array", m->map_id);
+            return 1;
+        }
+        int x = 0;
+        cJSON_ArrayForEach(col, row) {
+            if (col == NULL || !cJSON_IsNumber(col)) {
+                log_error("Failed to parse map config for map '{s}': each map cell must be a number", m->map_id);
+                return 1;
+            }
+            if (x >= m->width || y >= m->height) {
+                log_error("Failed to parse map config for map '{s}': layer is larger than the map", m->map_id);
+                return 1;
+            }
+            int id = (int) cJSON_GetNumberValue(col);
+            if (store_tile(m, grid_info, x++, y, id) != 0) {
+                return 1;
+            }
+            if (id > *largest_texture_id) {
+                *largest_texture_id = id;
+            }
+        }
+        y++;
+    }
+    return 0;
+}
 
-    if (map_player_layer != NULL && cJSON_IsNumber(map_player_layer)) {
-        m->player_layer = (int) cJSON_GetNumberValue(map_player_layer);
+static void compute_texture_offsets(map m, asset a, int id, int *offset_x, int *offset_y) {
+    int asset_width_in_tiles = asset_get_width(a) / m->tilewidth;
+
+    int row = id / asset_width_in_tiles;
+    int col = id % asset_width_in_tiles;
+
+    *offset_x = col * m->tilewidth;
+    *offset_y = row * m->tileheight;
+}
+
+struct fill_texture_range_args_s {
+    map map;
+    int result;
+};
+
+static iteration_result fill_texture_range(const hashtable_entry *entry, void *_args) {
+    struct fill_texture_range_args_s *args = (struct fill_texture_range_args_s *) _args;
+    map m = args->map;
+    map_asset_info *m_asset_info = (map_asset_info *) entry->value;
+
+    asset a = asset_manager_get_asset(m->asset_mgr, entry->key);
+    if (a == NULL) {
+        log_error("Parent asset '{s}' for map '{s}' was not found", entry->key, m->map_id);
+        args->result = 1;
+        return ITERATION_BREAK;
     }
 
-    m->asset_info = hashtable_create_copied_string_key_borrowed_pointer_value();
-    if (m->asset_info == NULL) {
+    // Ids past the largest one used by the map would never be looked up
+    int max_id = m_asset_info->max_id < (int) m->texture_count ? m_asset_info->max_id : (int) m->texture_count;
+    for (int id = m_asset_info->min_id > 0 ? m_asset_info->min_id : 0; id < max_id; id++) {
+        int offset_x = 0, offset_y = 0;
+        compute_texture_offsets(m, a, id - m_asset_info->min_id, &offset_x, &offset_y);
+        texture t = texture_from_asset(a, m->tilewidth, m->tileheight, offset_x, offset_y);
+        if (t == NULL) {
+            log_error("Failed to create texture for map '{s}' with ID {d} from base asset", m->map_id, id);
+            continue;
+        }
+        texture_destroy(m->textures[id]);
+        m->textures[id] = t;
+    }
+    return ITERATION_CONTINUE;
+}
+
+static int build_texture_lut(map m, int largest_texture_id) {
+    m->texture_count = (size_t) largest_texture_id + 1;
+    m->textures = (texture *) calloc(m->texture_count, sizeof(texture));
+    if (m->textures == NULL) {
         log_error("Failed to allocate memory during parsing of map config");
-        cJSON_Delete(map_config);
+        m->texture_count = 0;
         return 1;
     }
 
-    cJSON *asset_info = NULL;
-    cJSON_ArrayForEach(asset_info, map_assets) {
-        cJSON *asset_max_id = cJSON_GetObjectItem(asset_info, "max_id");
-        cJSON *asset_min_id = cJSON_GetObjectItem(asset_info, "min_id");
+    struct fill_texture_range_args_s fill_texture_range_args = {
+        .map = m,
+        .result = 0
+    };
+    hashtable_foreach_args(m->asset_info, fill_texture_range, &fill_texture_range_args);
+    return fill_texture_range_args.result;
+}
 
-        if (asset_max_id == NULL || !cJSON_IsNumber(asset_max_id)) {
-            log_error("Failed to parse map config for map '{s}': max_id must be a number", m->map_id);
-            cJSON_Delete(map_config);
+static int add_tile_animation(map m, int base_id, int frame_count, int stride, int interval, int *largest_texture_id) {
+    if (base_id <= 0 || frame_count <= 0 || stride <= 0 || interval <= 0) {
+        log_error("Invalid animation for tile {d} of map '{s}'", base_id, m->map_id);
+        return 1;
+    }
+    map_tile_animation *animations = (map_tile_animation *) realloc(m->animations, (m->animation_count + 1) * sizeof(map_tile_animation));
+    if (animations == NULL) {
+        log_error("Failed to allocate memory during parsing of map config");
+        return 1;
+    }
+    m->animations = animations;
+    m->animations[m->animation_count++] = (map_tile_animation) {
+        .base_id = base_id,
+        .frame_count = frame_count,
+        .stride = stride,
+        .interval = interval
+    };
+
+    // Frames need textures even when no layer places them directly
+    int last_frame_id = base_id + (frame_count - 1) * stride;
+    if (last_frame_id > *largest_texture_id) {
+        *largest_texture_id = last_frame_id;
+    }
+    return 0;
+}
+
+static int parse_tile_animations(map m, cJSON *animated_tiles, int *largest_texture_id) {
+    cJSON *animation = NULL;
+    cJSON_ArrayForEach(animation, animated_tiles) {
+        cJSON *animation_base_id = cJSON_GetObjectItem(animation, "base_id");
+        cJSON *animation_frames = cJSON_GetObjectItem(animation, "frames");
+        cJSON *animation_interval = cJSON_GetObjectItem(animation, "interval");
+        cJSON *animation_stride = cJSON_GetObjectItem(animation, "stride");
+
+        if (animation_base_id == NULL || !cJSON_IsNumber(animation_base_id)) {
+            log_error("Failed to parse map config for map '{s}': base_id must be a number", m->map_id);
             return 1;
         }
-
-        if (asset_min_id == NULL || !cJSON_IsNumber(asset_min_id)) {
-            log_error("Failed to parse map config for map '{s}': min_id must be a number", m->map_id);
-            cJSON_Delete(map_config);
+        if (animation_frames == NULL || !cJSON_IsNumber(animation_frames)) {
+            log_error("Failed to parse map config for map '{s}': frames must be a number", m->map_id);
             return 1;
         }
-
-        if (asset_manager_asset_gpu_preload(m->asset_mgr, asset_info->string) == NULL) {
-            log_error("Failed to load map '{s}'", m->map_id);
-            cJSON_Delete(map_config);
+        if (animation_interval == NULL || !cJSON_IsNumber(animation_interval)) {
+            log_error("Failed to parse map config for map '{s}': interval must be a number", m->map_id);
             return 1;
         }
-
-        map_asset_info *m_asset_info = (map_asset_info *) malloc(sizeof(map_asset_info));
-        if (m_asset_info == NULL) {
-            log_error("Failed to allocate memory during parsing of map config");
-            cJSON_Delete(map_config);
+        // Optional, frames are usually next to each other
+        if (animation_stride != NULL && !cJSON_IsNumber(animation_stride)) {
+            log_error("Failed to parse map config for map '{s}': stride must be a number", m->map_id);
             return 1;
         }
 
-        m_asset_info->max_id = (int) cJSON_GetNumberValue(asset_max_id);
-        m_asset_info->min_id = (int) cJSON_GetNumberValue(asset_min_id);
-
-        if (hashtable_set(m->asset_info, asset_info->string, m_asset_info) != 0) {
-            log_error("Failed to allocate memory during parsing of map config");
-            free(m_asset_info);
-            cJSON_Delete(map_config);
+        if (add_tile_animation(
+            m,
+            (int) cJSON_GetNumberValue(animation_base_id),
+            (int) cJSON_GetNumberValue(animation_frames),
+            animation_stride != NULL ? (int) cJSON_GetNumberValue(animation_stride) : 1,
+            (int) cJSON_GetNumberValue(animation_interval),
+            largest_texture_id
+        ) != 0) {
+            return 1;
         }
     }
+    return 0;
+}
 
-    m->grids = hashtable_create_copied_string_key_borrowed_pointer_value();
-    if (m->grids == NULL) {
-        log_error("Failed to allocate memory during parsing of map config");
-        cJSON_Delete(map_config);
+static int build_tile_animation_lut(map m) {
+    free(m->tile_animations);
+    m->tile_animations = NULL;
+    if (m->animation_count == 0 || m->texture_count == 0) return 0;
+
+    m->tile_animations = (int *) malloc(m->texture_count * sizeof(int));
+    if (m->tile_animations == NULL) {
+        log_error("Failed to allocate memory for the tile animations of map '{s}'", m->map_id);
         return 1;
     }
+    for (size_t i = 0; i < m->texture_count; i++) {
+        m->tile_animations[i] = -1;
+    }
 
-    int largest_texture_id = 0;
-    cJSON *layer = NULL;
-    cJSON_ArrayForEach(layer, map_layers) {
-        cJSON *layer_map = cJSON_GetObjectItem(layer, "map");
-        cJSON *layer_layer = cJSON_GetObjectItem(layer, "layer");
-        cJSON *layer_transparent = cJSON_GetObjectItem(layer, "transparent");
-        cJSON *layer_collisions = cJSON_GetObjectItem(layer, "collisions");
-        cJSON *layer_vision = cJSON_GetObjectItem(layer, "vision");
-        cJSON *layer_entities = cJSON_GetObjectItem(layer, "entities");
-
-        if (layer_map == NULL || !cJSON_IsArray(layer_map)) {
-            log_error("Failed to parse map config for map '{s}': map must be an array", m->map_id);
-            cJSON_Delete(map_config);
-            return 1;
+    for (size_t i = 0; i < m->animation_count; i++) {
+        const map_tile_animation *animation = &m->animations[i];
+        texture base = get_texture_from_id(m, animation->base_id);
+        int valid = base != NULL;
+        for (int frame = 1; valid && frame < animation->frame_count; frame++) {
+            // The shaders sample every frame from the base tile's texture
+            texture t = get_texture_from_id(m, animation->base_id + frame * animation->stride);
+            valid = t != NULL && texture_get_id(t) == texture_get_id(base);
         }
-
-        if (layer_collisions == NULL || !cJSON_IsBool(layer_collisions)) {
-            log_error("Failed to parse map config for map '{s}': collisions must be a boolean", m->map_id);
-            cJSON_Delete(map_config);
-            return 1;
+        if (!valid) {
+            log_warning("Animation of tile {d} in map '{s}' has frames outside its tileset, it won't play", animation->base_id, m->map_id);
+            continue;
         }
+        m->tile_animations[animation->base_id] = (int) i;
+    }
+    return 0;
+}
 
-        if (layer_vision == NULL || !cJSON_IsBool(layer_vision)) {
-            log_error("Failed to parse map config for map '{s}': vision must be a boolean", m->map_id);
-            cJSON_Delete(map_config);
-            return 1;
+static int create_gpu_animations(map m, renderer_ctx ctx) {
+    int max_frames = 0;
+    for (size_t i = 0; i < m->animation_count; i++) {
+        if (m->animations[i].frame_count > max_frames) {
+            max_frames = m->animations[i].frame_count;
         }
+    }
+    texture *frames = (texture *) malloc((size_t) max_frames * sizeof(texture));
+    m->gpu_animations = renderer_tile_animations_create(ctx, m->animation_count, (size_t) max_frames);
+    if (frames == NULL || m->gpu_animations == NULL) {
+        free(frames);
+        return 1;
+    }
 
-        if (layer_entities == NULL || !cJSON_IsBool(layer_entities)) {
-            log_error("Failed to parse map config for map '{s}': entities must be a boolean", m->map_id);
-            cJSON_Delete(map_config);
-            return 1;
+    for (size_t i = 0; i < m->animation_count; i++) {
+        const map_tile_animation *animation = &m->animations[i];
+        if (get_tile_animation(m, animation->base_id) != (int) i) continue;
+        for (int frame = 0; frame < animation->frame_count; frame++) {
+            frames[frame] = get_texture_from_id(m, animation->base_id + frame * animation->stride);
+        }
+        renderer_tile_animations_set(m->gpu_animations, i, frames, (size_t) animation->frame_count, (float) animation->interval);
+    }
+    free(frames);
+    return 0;
+}
+
+static int create_chunks(map m) {
+    m->chunk_columns = (m->width + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+    m->chunk_rows = (m->height + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+    m->chunks = (map_chunk *) calloc((size_t) m->chunk_columns * (size_t) m->chunk_rows, sizeof(map_chunk));
+    if (m->chunks == NULL) {
+        return 1;
+    }
+
+    for (int chunk_row = 0; chunk_row < m->chunk_rows; chunk_row++) {
+        for (int chunk_col = 0; chunk_col < m->chunk_columns; chunk_col++) {
+            map_chunk *chunk = &m->chunks[chunk_col + chunk_row * m->chunk_columns];
+            chunk->first_col = chunk_col * MAP_CHUNK_SIZE;
+            chunk->first_row = chunk_row * MAP_CHUNK_SIZE;
+            chunk->last_col = chunk->first_col + MAP_CHUNK_SIZE < m->width ? chunk->first_col + MAP_CHUNK_SIZE : m->width;
+            chunk->last_row = chunk->first_row + MAP_CHUNK_SIZE < m->height ? chunk->first_row + MAP_CHUNK_SIZE : m->height;
+            chunk->x = (float) (chunk->first_col * m->tilewidth);
+            chunk->y = (float) (chunk->first_row * m->tileheight);
+            chunk->width = (float) ((chunk->last_col - chunk->first_col) * m->tilewidth);
+            chunk->height = (float) ((chunk->last_row - chunk->first_row) * m->tileheight);
+            chunk->state = m->streaming ? MAP_CHUNK_UNLOADED : MAP_CHUNK_RESIDENT;
+        }
+    }
+    return 0;
+}
+
+static int create_map_tables(map m) {
+    m->asset_info = hashtable_create_copied_string_key_borrowed_pointer_value();
+    m->grids = hashtable_create_copied_string_key_borrowed_pointer_value();
+    if (m->asset_info == NULL || m->grids == NULL) {
+        log_error("Failed to allocate memory during parsing of map config");
+        return 1;
+    }
+    return 0;
+}
+
+static int register_map_asset(map m, const char *asset_id, int min_id, int max_id) {
+    if (asset_manager_asset_gpu_preload(m->asset_mgr, asset_id) == NULL) {
+        log_error("Failed to load map '{s}'", m->map_id);
+        return 1;
+    }
+
+    map_asset_info *m_asset_info = (map_asset_info *) malloc(sizeof(map_asset_info));
+    if (m_asset_info == NULL) {
+        log_error("Failed to allocate memory during parsing of map config");
+        return 1;
+    }
+    m_asset_info->max_id = max_id;
+    m_asset_info->min_id = min_id;
+
+    if (hashtable_set(m->asset_info, asset_id, m_asset_info) != 0) {
+        log_error("Failed to allocate memory during parsing of map config");
+        free(m_asset_info);
+        return 1;
+    }
+    return 0;
+}
+
+static map_grid_info *create_tile_layer(map m, const char *layer_name, int layer, int transparent) {
+    map_grid_info *grid_info = (map_grid_info *) calloc(1, sizeof(map_grid_info));
+    if (grid_info == NULL) {
+        log_error("Failed to allocate memory during parsing of map config");
+        return NULL;
+    }
+    grid_info->layer = layer;
+    grid_info->transparent = transparent;
+    if (layer > m->top_layer) m->top_layer = layer;
+
+    size_t chunk_count = (size_t) m->chunk_columns * (size_t) m->chunk_rows;
+    grid_info->chunks = (map_layer_chunk *) calloc(chunk_count, sizeof(map_layer_chunk));
+    if (grid_info->chunks == NULL || hashtable_set(m->grids, layer_name, grid_info) != 0) {
+        log_error("Failed to allocate memory during parsing of map config");
+        free(grid_info->chunks);
+        free(grid_info);
+        return NULL;
+    }
+    return grid_info;
+}
+
+struct largest_asset_texture_id_args_s {
+    int largest_texture_id;
+};
+
+static iteration_result largest_asset_texture_id_step(const hashtable_entry *entry, void *_args) {
+    struct largest_asset_texture_id_args_s *args = (struct largest_asset_texture_id_args_s *) _args;
+    map_asset_info *m_asset_info = (map_asset_info *) entry->value;
+    if (m_asset_info->max_id - 1 > args->largest_texture_id) {
+        args->largest_texture_id = m_asset_info->max_id - 1;
+    }
+    return ITERATION_CONTINUE;
+}
+
+static int largest_asset_texture_id(map m) {
+    // Streamed maps can't scan their tiles up front, so size the lookup table for every id the assets cover
+    struct largest_asset_texture_id_args_s largest_asset_texture_id_args = {
+        .largest_texture_id = 0
+    };
+    hashtable_foreach_args(m->asset_info, largest_asset_texture_id_step, &largest_asset_texture_id_args);
+    return largest_asset_texture_id_args.largest_texture_id;
+}
+
+static int create_chunk_loader(map m, const char *partial_path, const char **layer_names) {
+    char *directory = get_map_path(partial_path, MAP_CHUNKS_DIR_EXT);
+    if (directory == NULL) {
+        log_error("Failed to allocate memory during parsing of map config");
+        return 1;
+    }
+
+    // Every chunk can be in flight at once, so the loader's queues never fill up
+    size_t chunk_count = (size_t) m->chunk_columns * (size_t) m->chunk_rows;
+    m->loader = map_chunk_loader_create(directory, layer_names, m->stream_layer_count, chunk_count);
+    free(directory);
+    if (m->loader == NULL) {
+        log_error("Failed to start chunk loader for map '{s}'", m->map_id);
+        return 1;
+    }
+    return 0;
+}
+
+static int load_inner_map_config(map m, const char *partial_path) {
+    char *fullpath = get_map_path(partial_path, MAP_CONFIG_FILE_EXT);
+    if (fullpath == NULL) {
+        log_error("Failed to allocate memory during parsing of map config");
+        return 1;
+    }
+
+    char *config_contents = utils_read_whole_file(fullpath);
+    free(fullpath);
+    if (config_contents == NULL) {
+        log_error("Failed to read map config for map '{s}'", m->map_id);
+        return 1;
+    }
+
+    cJSON *map_config = cJSON_Parse(config_contents);
+    free(config_contents);
+    if (map_config == NULL) {
+        log_error("Failed to parse map config for map '{s}'", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+    if (!cJSON_IsObject(map_config)) {
+        log_error("Failed to parse map config for map '{s}': config must be an object", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+    
+    cJSON *map_width = cJSON_GetObjectItem(map_config, "width");
+    cJSON *map_height = cJSON_GetObjectItem(map_config, "height");
+    cJSON *map_tilewidth = cJSON_GetObjectItem(map_config, "tilewidth");
+    cJSON *map_tileheight = cJSON_GetObjectItem(map_config, "tileheight");
+    cJSON *map_layers = cJSON_GetObjectItem(map_config, "layers");
+    cJSON *map_assets = cJSON_GetObjectItem(map_config, "assets");
+    cJSON *map_player_layer = cJSON_GetObjectItem(map_config, "player_layer");
+    cJSON *map_streaming = cJSON_GetObjectItem(map_config, "streaming");
+    cJSON *map_animated_tiles = cJSON_GetObjectItem(map_config, "animated_tiles");
+
+    if (map_width == NULL || !cJSON_IsNumber(map_width)) {
+        log_error("Failed to parse map config for map '{s}': width must be a number", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    if (map_height == NULL || !cJSON_IsNumber(map_height)) {
+        log_error("Failed to parse map config for map '{s}': height must be a number", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    if (map_tilewidth == NULL || !cJSON_IsNumber(map_tilewidth)) {
+        log_error("Failed to parse map config for map '{s}': tilewidth must be a number", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    if (map_tileheight == NULL || !cJSON_IsNumber(map_tileheight)) {
+        log_error("Failed to parse map config for map '{s}': tileheight must be a number", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    if (map_layers == NULL || !cJSON_IsObject(map_layers)) {
+        log_error("Failed to parse map config for map '{s}': layers must be an object", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    if (map_assets == NULL || !cJSON_IsObject(map_assets)) {
+        log_error("Failed to parse map config for map '{s}': assets must be an object", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    // Optional, most maps have no animated tiles
+    if (map_animated_tiles != NULL && !cJSON_IsArray(map_animated_tiles)) {
+        log_error("Failed to parse map config for map '{s}': animated_tiles must be an array", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    m->width = (int) cJSON_GetNumberValue(map_width);
+    m->height = (int) cJSON_GetNumberValue(map_height);
+    m->tilewidth = (int) cJSON_GetNumberValue(map_tilewidth);
+    m->tileheight = (int) cJSON_GetNumberValue(map_tileheight);
+
+    if (map_player_layer != NULL && cJSON_IsNumber(map_player_layer)) {
+        m->player_layer = (int) cJSON_GetNumberValue(map_player_layer);
+    }
+
+    // Optional, streamed maps keep their layers in per-chunk files instead of the config
+    if (map_streaming != NULL && !cJSON_IsBool(map_streaming)) {
+        log_error("Failed to parse map config for map '{s}': streaming must be a boolean", m->map_id);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+    m->streaming = cJSON_IsTrue(map_streaming);
+
+    cJSON *map_chunk_size = cJSON_GetObjectItem(map_config, "chunk_size");
+    if (m->streaming && (map_chunk_size == NULL || !cJSON_IsNumber(map_chunk_size) || (int) cJSON_GetNumberValue(map_chunk_size) != MAP_CHUNK_SIZE)) {
+        log_error("Failed to parse map config for map '{s}': chunk_size must be {d} for streamed maps", m->map_id, MAP_CHUNK_SIZE);
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    if (create_chunks(m) != 0) {
+        log_error("Failed to allocate memory during parsing of map config");
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    if (create_map_tables(m) != 0) {
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    cJSON *asset_info = NULL;
+    cJSON_ArrayForEach(asset_info, map_assets) {
+        cJSON *asset_max_id = cJSON_GetObjectItem(asset_info, "max_id");
+        cJSON *asset_min_id = cJSON_GetObjectItem(asset_info, "min_id");
+
+        if (asset_max_id == NULL || !cJSON_IsNumber(asset_max_id)) {
+            log_error("Failed to parse map config for map '{s}': max_id must be a number", m->map_id);
+            cJSON_Delete(map_config);
+            return 1;
+        }
+
+        if (asset_min_id == NULL || !cJSON_IsNumber(asset_min_id)) {
+            log_error("Failed to parse map config for map '{s}': min_id must be a number", m->map_id);
+            cJSON_Delete(map_config);
+            return 1;
+        }
+
+        if (register_map_asset(m, asset_info->string, (int) cJSON_GetNumberValue(asset_min_id), (int) cJSON_GetNumberValue(asset_max_id)) != 0) {
+            cJSON_Delete(map_config);
+            return 1;
+        }
+    }
+
+    // Names of the layers the chunk loader should pull out of each chunk file,
+    // they point into map_config so the loader has to be created before it's freed
+    size_t max_stream_layers = (size_t) cJSON_GetArraySize(map_layers);
+    const char **stream_layer_names = NULL;
+    if (m->streaming) {
+        stream_layer_names = (const char **) calloc(max_stream_layers, sizeof(const char *));
+        m->stream_layers = (map_stream_layer *) calloc(max_stream_layers, sizeof(map_stream_layer));
+        if (stream_layer_names == NULL || m->stream_layers == NULL) {
+            log_error("Failed to allocate memory during parsing of map config");
+            free(stream_layer_names);
+            cJSON_Delete(map_config);
+            return 1;
+        }
+    }
+
+    int largest_texture_id = 0;
+    cJSON *layer = NULL;
+    cJSON_ArrayForEach(layer, map_layers) {
+        cJSON *layer_map = cJSON_GetObjectItem(layer, "map");
+        cJSON *layer_layer = cJSON_GetObjectItem(layer, "layer");
+        cJSON *layer_transparent = cJSON_GetObjectItem(layer, "transparent");
+        cJSON *layer_collisions = cJSON_GetObjectItem(layer, "collisions");
+        cJSON *layer_vision = cJSON_GetObjectItem(layer, "vision");
+        cJSON *layer_entities = cJSON_GetObjectItem(layer, "entities");
+        cJSON *layer_terrain = cJSON_GetObjectItem(layer, "terrain");
+
+        if (!m->streaming && (layer_map == NULL || !cJSON_IsArray(layer_map))) {
+            log_error("Failed to parse map config for map '{s}': map must be an array", m->map_id);
+            free(stream_layer_names);
+            cJSON_Delete(map_config);
+            return 1;
+        }
+
+        if (layer_collisions == NULL || !cJSON_IsBool(layer_collisions)) {
+            log_error("Failed to parse map config for map '{s}': collisions must be a boolean", m->map_id);
+            free(stream_layer_names);
+            cJSON_Delete(map_config);
+            return 1;
+        }
+
+        if (layer_vision == NULL || !cJSON_IsBool(layer_vision)) {
+            log_error("Failed to parse map config for map '{s}': vision must be a boolean", m->map_id);
+            free(stream_layer_names);
+            cJSON_Delete(map_config);
+            return 1;
+        }
+
+        if (layer_entities == NULL || !cJSON_IsBool(layer_entities)) {
+            log_error("Failed to parse map config for map '{s}': entities must be a boolean", m->map_id);
+            free(stream_layer_names);
+            cJSON_Delete(map_config);
+            return 1;
+        }
+
+        // Optional, older maps don't have terrain costs
+        if (layer_terrain != NULL && !cJSON_IsBool(layer_terrain)) {
+            log_error("Failed to parse map config for map '{s}': terrain must be a boolean", m->map_id);
+            free(stream_layer_names);
+            cJSON_Delete(map_config);
+            return 1;
         }
 
         if (layer_layer == NULL || !cJSON_IsNumber(layer_layer)) {
             log_error("Failed to parse map config for map '{s}': layer must be a number", m->map_id);
+            free(stream_layer_names);
+            cJSON_Delete(map_config);
+            return 1;
+        }
+
+        if (layer_transparent == NULL || !cJSON_IsBool(layer_transparent)) {
+            log_error("Failed to parse map config for map '{s}': transparent must be a boolean", m->map_id);
+            free(stream_layer_names);
             cJSON_Delete(map_config);
             return 1;
         }
 
-        if (layer_transparent == NULL || !cJSON_IsBool(layer_transparent)) {
-            log_error("Failed to parse map config for map '{s}': transparent must be a boolean", m->map_id);
-            cJSON_Delete(map_config);
+        // TODO: handle these separately
+        if (cJSON_IsTrue(layer_entities)) {
+            continue;
+        }
+
+        map_stream_layer_kind kind = MAP_STREAM_LAYER_TILES;
+        map_grid_info *grid_info = NULL;
+        if (cJSON_IsTrue(layer_collisions) || cJSON_IsTrue(layer_vision) || cJSON_IsTrue(layer_terrain)) {
+            kind = cJSON_IsTrue(layer_collisions) ? MAP_STREAM_LAYER_COLLISION : cJSON_IsTrue(layer_vision) ? MAP_STREAM_LAYER_VISION : MAP_STREAM_LAYER_TERRAIN;
+            int **target = cell_grid_of_kind(m, kind);
+            if (*target != NULL) {
+                log_warning(DUPLICATE_GRID_WARNINGS[kind]);
+                continue;
+            }
+
+            int *grid = (int*) calloc(m->width * m->height, sizeof(int));
+            if (grid == NULL) {
+                log_error("Failed to allocate memory during parsing of map config");
+                free(stream_layer_names);
+                cJSON_Delete(map_config);
+                return 1;
+            }
+            *target = grid;
+
+            if (m->streaming) {
+                // Cells of chunks we haven't loaded count as walls, so nothing walks, paths or sees into them
+                if (kind != MAP_STREAM_LAYER_TERRAIN) {
+                    for (int i = 0; i < m->width * m->height; i++) grid[i] = 1;
+                }
+            }
+            else {
+                // Terrain cells hold movement costs and vision cells flags, not texture ids
+                int largest_value = 0;
+                if (populate_grid(layer_map, grid, kind == MAP_STREAM_LAYER_COLLISION ? &largest_texture_id : &largest_value) != 0) {
+                    free(stream_layer_names);
+                    cJSON_Delete(map_config);
+                    return 1;
+                }
+                continue;
+            }
+        }
+        else {
+            grid_info = create_tile_layer(m, layer->string, (int) cJSON_GetNumberValue(layer_layer), cJSON_IsTrue(layer_transparent));
+            if (grid_info == NULL) {
+                free(stream_layer_names);
+                cJSON_Delete(map_config);
+                return 1;
+            }
+
+            if (!m->streaming) {
+                if (populate_layer(m, grid_info, layer_map, &largest_texture_id) != 0) {
+                    free(stream_layer_names);
+                    cJSON_Delete(map_config);
+                    return 1;
+                }
+                continue;
+            }
+        }
+
+        stream_layer_names[m->stream_layer_count] = layer->string;
+        m->stream_layers[m->stream_layer_count++] = (map_stream_layer) {
+            .kind = kind,
+            .grid_info = grid_info
+        };
+    }
+
+    if (m->streaming) {
+        int result = create_chunk_loader(m, partial_path, stream_layer_names);
+        free(stream_layer_names);
+        if (result != 0) {
+            cJSON_Delete(map_config);
+            return 1;
+        }
+        largest_texture_id = largest_asset_texture_id(m);
+    }
+
+    if (map_animated_tiles != NULL && parse_tile_animations(m, map_animated_tiles, &largest_texture_id) != 0) {
+        cJSON_Delete(map_config);
+        return 1;
+    }
+
+    cJSON_Delete(map_config);
+    
+    return build_texture_lut(m, largest_texture_id);
+}
+
+static uint16_t read_u16(const unsigned char *bytes) {
+    return (uint16_t) (bytes[0] | bytes[1] << 8);
+}
+
+static uint32_t read_u32(const unsigned char *bytes) {
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static int32_t read_i32(const unsigned char *bytes) {
+    return (int32_t) read_u32(bytes);
+}
+
+typedef struct map_binary {
+    const unsigned char *data;
+    size_t size;
+    const char *strings;
+    size_t strings_size;
+} map_binary;
+
+static const char *get_binary_string(const map_binary *binary, uint32_t offset) {
+    if (offset >= binary->strings_size) return NULL;
+    // Names must end inside the string block
+    if (memchr(binary->strings + offset, '\0', binary->strings_size - offset) == NULL) return NULL;
+    return binary->strings + offset;
+}
+
+typedef struct tile_decoder {
+    const unsigned char *cursor, *end;
+    map_binary_encoding encoding;
+    uint32_t run_left;
+    int run_value;
+} tile_decoder;
+
+static int tile_decoder_next(tile_decoder *decoder, int *out_value) {
+    if (decoder->encoding == MAP_BINARY_ENCODING_RAW) {
+        if (decoder->end - decoder->cursor < 2) return 1;
+        *out_value = read_u16(decoder->cursor);
+        decoder->cursor += 2;
+        return 0;
+    }
+    while (decoder->run_left == 0) {
+        if (decoder->end - decoder->cursor < 4) return 1;
+        decoder->run_left = read_u16(decoder->cursor);
+        decoder->run_value = read_u16(decoder->cursor + 2);
+        decoder->cursor += 4;
+    }
+    decoder->run_left--;
+    *out_value = decoder->run_value;
+    return 0;
+}
+
+static int load_binary_layer(map m, const map_binary *binary, const unsigned char *entry, int *largest_texture_id) {
+    const char *name = get_binary_string(binary, read_u32(entry));
+    int layer = read_i32(entry + 4);
+    unsigned char flags = entry[8];
+    unsigned char encoding = entry[9];
+    uint32_t data_offset = read_u32(entry + 12), data_size = read_u32(entry + 16);
+
+    if (name == NULL || encoding > MAP_BINARY_ENCODING_RLE || data_offset > binary->size || data_size > binary->size - data_offset) {
+        log_error("Failed to parse compiled map '{s}': invalid layer entry", m->map_id);
+        return 1;
+    }
+
+    // Skipped like in the JSON config
+    if (flags & MAP_BINARY_LAYER_ENTITIES) return 0;
+
+    tile_decoder decoder = {
+        .cursor = binary->data + data_offset,
+        .end = binary->data + data_offset + data_size,
+        .encoding = (map_binary_encoding) encoding
+    };
+
+    if (flags & (MAP_BINARY_LAYER_COLLISIONS | MAP_BINARY_LAYER_VISION | MAP_BINARY_LAYER_TERRAIN)) {
+        map_stream_layer_kind kind = (flags & MAP_BINARY_LAYER_COLLISIONS) ? MAP_STREAM_LAYER_COLLISION : (flags & MAP_BINARY_LAYER_VISION) ? MAP_STREAM_LAYER_VISION : MAP_STREAM_LAYER_TERRAIN;
+        int **target = cell_grid_of_kind(m, kind);
+        if (*target != NULL) {
+            log_warning(DUPLICATE_GRID_WARNINGS[kind]);
+            return 0;
+        }
+        *target = (int *) malloc((size_t) m->width * (size_t) m->height * sizeof(int));
+        if (*target == NULL) {
+            log_error("Failed to allocate memory during parsing of map config");
+            return 1;
+        }
+        for (int i = 0; i < m->width * m->height; i++) {
+            if (tile_decoder_next(&decoder, &(*target)[i]) != 0) {
+                log_error("Failed to parse compiled map '{s}': layer '{s}' is truncated", m->map_id, name);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    map_grid_info *grid_info = create_tile_layer(m, name, layer, (flags & MAP_BINARY_LAYER_TRANSPARENT) != 0);
+    if (grid_info == NULL) {
+        return 1;
+    }
+    for (int y = 0; y < m->height; y++) {
+        for (int x = 0; x < m->width; x++) {
+            int id = 0;
+            if (tile_decoder_next(&decoder, &id) != 0) {
+                log_error("Failed to parse compiled map '{s}': layer '{s}' is truncated", m->map_id, name);
+                return 1;
+            }
+            if (store_tile(m, grid_info, x, y, id) != 0) {
+                return 1;
+            }
+            if (id > *largest_texture_id) {
+                *largest_texture_id = id;
+            }
+        }
+    }
+    return 0;
+}
+
+// Cell indices, chunk counts and pixel positions are all ints. Takes positive dimensions
+static int map_dimensions_fit(map m) {
+    return (size_t) m->width * (size_t) m->height <= INT_MAX
+        && ((size_t) m->width + MAP_CHUNK_SIZE) * (size_t) m->tilewidth <= INT_MAX
+        && ((size_t) m->height + MAP_CHUNK_SIZE) * (size_t) m->tileheight <= INT_MAX;
+}
+
+static int load_binary_map(map m, const unsigned char *data, size_t size) {
+    if (size < MAP_BINARY_HEADER_SIZE || memcmp(data, MAP_BINARY_MAGIC, 4) != 0) {
+        log_error("Failed to parse compiled map '{s}': not a map file", m->map_id);
+        return 1;
+    }
+    if (read_u16(data + 4) != MAP_BINARY_VERSION) {
+        log_error("Failed to parse compiled map '{s}': unsupported version {d}", m->map_id, (int) read_u16(data + 4));
+        return 1;
+    }
+
+    m->width = read_i32(data + 8);
+    m->height = read_i32(data + 12);
+    m->tilewidth = read_i32(data + 16);
+    m->tileheight = read_i32(data + 20);
+    m->player_layer = read_i32(data + 24);
+    uint32_t asset_count = read_u32(data + 28), layer_count = read_u32(data + 32);
+    uint32_t strings_offset = read_u32(data + 36), strings_size = read_u32(data + 40);
+    uint32_t animation_count = read_u32(data + 44);
+
+    size_t tables_size = (size_t) asset_count * MAP_BINARY_ASSET_SIZE + (size_t) layer_count * MAP_BINARY_LAYER_SIZE
+        + (size_t) animation_count * MAP_BINARY_ANIMATION_SIZE;
+    if (m->width <= 0 || m->height <= 0 || m->tilewidth <= 0 || m->tileheight <= 0 || !map_dimensions_fit(m)
+        || tables_size > size - MAP_BINARY_HEADER_SIZE || strings_offset > size || strings_size > size - strings_offset) {
+        log_error("Failed to parse compiled map '{s}': invalid header", m->map_id);
+        return 1;
+    }
+    map_binary binary = {
+        .data = data,
+        .size = size,
+        .strings = (const char *) data + strings_offset,
+        .strings_size = strings_size
+    };
+
+    if (create_chunks(m) != 0) {
+        log_error("Failed to allocate memory during parsing of map config");
+        return 1;
+    }
+    if (create_map_tables(m) != 0) {
+        return 1;
+    }
+
+    const unsigned char *asset_entry = data + MAP_BINARY_HEADER_SIZE;
+    for (uint32_t i = 0; i < asset_count; i++, asset_entry += MAP_BINARY_ASSET_SIZE) {
+        const char *asset_id = get_binary_string(&binary, read_u32(asset_entry));
+        if (asset_id == NULL) {
+            log_error("Failed to parse compiled map '{s}': invalid asset entry", m->map_id);
+            return 1;
+        }
+        if (register_map_asset(m, asset_id, read_i32(asset_entry + 4), read_i32(asset_entry + 8)) != 0) {
+            return 1;
+        }
+    }
+
+    int largest_texture_id = 0;
+    const unsigned char *layer_entry = asset_entry;
+    for (uint32_t i = 0; i < layer_count; i++, layer_entry += MAP_BINARY_LAYER_SIZE) {
+        if (load_binary_layer(m, &binary, layer_entry, &largest_texture_id) != 0) {
+            return 1;
+        }
+    }
+
+    const unsigned char *animation_entry = layer_entry;
+    for (uint32_t i = 0; i < animation_count; i++, animation_entry += MAP_BINARY_ANIMATION_SIZE) {
+        if (add_tile_animation(
+            m,
+            read_i32(animation_entry),
+            read_i32(animation_entry + 4),
+            read_i32(animation_entry + 8),
+            read_i32(animation_entry + 12),
+            &largest_texture_id
+        ) != 0) {
+            return 1;
+        }
+    }
+    return build_texture_lut(m, largest_texture_id);
+}
+
+static int load_compiled_map_config(map m, const char *partial_path, int *out_loaded) {
+    *out_loaded = 0;
+    char *binary_path = get_map_path(partial_path, MAP_BINARY_FILE_EXT);
+    char *config_path = get_map_path(partial_path, MAP_CONFIG_FILE_EXT);
+    if (binary_path == NULL || config_path == NULL) {
+        log_error("Failed to allocate memory during parsing of map config");
+        free(binary_path);
+        free(config_path);
+        return 1;
+    }
+
+    double binary_mtime = utils_get_modification_time(binary_path);
+    double config_mtime = utils_get_modification_time(config_path);
+    free(config_path);
+    if (binary_mtime < 0.0) {
+        free(binary_path);
+        return 0;
+    }
+    // The JSON config is what gets edited, so a binary older than it is out of date
+    if (config_mtime > binary_mtime) {
+        log_warning("Compiled map '{s}' is older than its config, loading the config instead", binary_path);
+        free(binary_path);
+        return 0;
+    }
+
+    size_t size = 0;
+    const unsigned char *data = utils_map_file(binary_path, &size);
+    if (data == NULL) {
+        log_warning("Failed to map compiled map '{s}', loading the config instead", binary_path);
+        free(binary_path);
+        return 0;
+    }
+    free(binary_path);
+
+    int result = load_binary_map(m, data, size);
+    utils_unmap_file(data, size);
+    *out_loaded = result == 0;
+    return result;
+}
+
+static int load_map_config(map m) {
+    if (m->grids != NULL || m->asset_info != NULL || m->collision_grid != NULL) return 0;
+
+    // Read maps list
+    char *config_contents = utils_read_whole_file("assets/maps.json");
+    if (config_contents == NULL) {
+        log_error("Failed to read main map config file");
+        return 1;
+    }
+    cJSON *config_json = cJSON_Parse(config_contents);
+    free(config_contents);
+    if (config_json == NULL) {
+        log_error("Failed to parse main map config file");
+        return 1;
+    }
+
+    if (!cJSON_IsObject(config_json)) {
+        log_error("Failed to parse main map config file: config must be an object");
+        cJSON_Delete(config_json);
+        return 1;
+    }
+
+    cJSON *map_config_partial_path_json = cJSON_GetObjectItem(config_json, m->map_id);
+    if (map_config_partial_path_json == NULL || !cJSON_IsString(map_config_partial_path_json)) {
+        log_error("Failed to parse main map config file: map path must be a string");
+        cJSON_Delete(config_json);
+        return 1;
+    }
+
+    // Prefer the compiled map, it's mapped straight into memory without any parsing
+    const char *partial_path = cJSON_GetStringValue(map_config_partial_path_json);
+    int loaded = 0;
+    if (load_compiled_map_config(m, partial_path, &loaded) != 0) {
+        log_warning("Failed to load compiled map '{s}', loading the config instead", m->map_id);
+        map_unload(m);
+        m->player_layer = -1;
+    }
+
+    int result = loaded ? 0 : load_inner_map_config(m, partial_path);
+    cJSON_Delete(config_json);
+    return result;
+}
+
+map map_create(asset_manager_ctx ctx, const char *map_id) {
+    map m = (map) calloc(1, sizeof(struct map_s));
+    if (m == NULL) {
+        return NULL;
+    }
+    m->asset_mgr = ctx;
+    m->player_layer = -1;
+    m->map_id = utils_copy_string(map_id);
+    if (m->map_id == NULL) {
+        map_destroy(m);
+        return NULL;
+    }
+    return m;
+}
+
+static int bake_map_chunk(map m, map_grid_info *grid_info, int chunk_index, renderer_ctx ctx) {
+    map_layer_chunk *layer_chunk = &grid_info->chunks[chunk_index];
+    const map_chunk *chunk = &m->chunks[chunk_index];
+    if (layer_chunk->batch == NULL) {
+        layer_chunk->batch = renderer_static_batch_create(ctx);
+        if (layer_chunk->batch == NULL) {
+            return 1;
+        }
+    }
+
+    renderer_static_batch_clear(layer_chunk->batch);
+    layer_chunk->culled_count = 0;
+    int col = 0, row = 0, grid_value = 0;
+    layer_chunk_cursor cursor = layer_chunk_begin(layer_chunk);
+    while (layer_chunk_next(&cursor, chunk, &col, &row, &grid_value)) {
+        if (is_tile_culled(m, grid_info, col, row, grid_value)) {
+            layer_chunk->culled_count++;
+            continue;
+        }
+
+        texture t = get_texture_from_id(m, grid_value);
+        if (t == NULL) {
+            log_error("Failed to get for map '{s}' with ID {d}", m->map_id, grid_value);
+            continue;
+        }
+        float x = (float) col * m->tilewidth;
+        float y = (float) row * m->tileheight;
+        if (renderer_static_batch_add_animated_texture(layer_chunk->batch, t, x, y, get_tile_animation(m, grid_value)) != 0) {
+            return 1;
+        }
+    }
+    renderer_static_batch_upload(layer_chunk->batch);
+    layer_chunk->dirty = 0;
+    layer_chunk->culling_dirty = 0;
+
+    size_t batch_bytes = renderer_static_batch_get_memory_usage(layer_chunk->batch);
+    m->resident_bytes += batch_bytes - layer_chunk->batch_bytes;
+    layer_chunk->batch_bytes = batch_bytes;
+    return 0;
+}
+
+static void count_culled_tiles(map m, map_grid_info *grid_info, int chunk_index) {
+    map_layer_chunk *layer_chunk = &grid_info->chunks[chunk_index];
+    const map_chunk *chunk = &m->chunks[chunk_index];
+    layer_chunk->culled_count = 0;
+    int col = 0, row = 0, tile_id = 0;
+    layer_chunk_cursor cursor = layer_chunk_begin(layer_chunk);
+    while (layer_chunk_next(&cursor, chunk, &col, &row, &tile_id)) {
+        layer_chunk->culled_count += is_tile_culled(m, grid_info, col, row, tile_id);
+    }
+    layer_chunk->culling_dirty = 0;
+}
+
+static void upload_chunk_to_tilemap(map m, map_grid_info *grid_info, int chunk_index) {
+    const map_chunk *chunk = &m->chunks[chunk_index];
+    const map_layer_chunk *layer_chunk = &grid_info->chunks[chunk_index];
+    int visible_tiles[MAP_CHUNK_CELLS] = { 0 };
+    const int *tiles = NULL;
+    if (layer_chunk->occupancy != NULL) {
+        // Culled tiles go up as empty cells, which the shader discards before sampling anything
+        int col = 0, row = 0, tile_id = 0;
+        layer_chunk_cursor cursor = layer_chunk_begin(layer_chunk);
+        while (layer_chunk_next(&cursor, chunk, &col, &row, &tile_id)) {
+            int local = (row - chunk->first_row) * MAP_CHUNK_SIZE + (col - chunk->first_col);
+            visible_tiles[local] = is_tile_culled(m, grid_info, col, row, tile_id) ? 0 : tile_id;
+        }
+        tiles = visible_tiles;
+    }
+    // Chunks that aren't resident (or are empty) have no tiles, which clears their region
+    renderer_tilemap_set_region(
+        grid_info->tilemap,
+        chunk->first_col,
+        chunk->first_row,
+        chunk->last_col - chunk->first_col,
+        chunk->last_row - chunk->first_row,
+        tiles,
+        MAP_CHUNK_SIZE
+    );
+}
+
+static int create_grid_tilemap(map m, map_grid_info *grid_info, renderer_ctx ctx) {
+    if (m->tileset == NULL) {
+        m->tileset = renderer_tileset_create(ctx, m->textures, m->texture_count, m->tile_animations);
+        if (m->tileset == NULL) {
+            return 1;
+        }
+    }
+    grid_info->tilemap = renderer_tilemap_create(ctx, m->tileset, m->width, m->height, m->tilewidth, m->tileheight);
+    if (grid_info->tilemap == NULL) {
+        return 1;
+    }
+    int chunk_count = m->chunk_columns * m->chunk_rows;
+    for (int chunk_index = 0; chunk_index < chunk_count; chunk_index++) {
+        if (grid_info->chunks[chunk_index].occupancy != NULL) {
+            upload_chunk_to_tilemap(m, grid_info, chunk_index);
+        }
+    }
+    return 0;
+}
+
+struct draw_map_grid_args_s {
+    unsigned int base_layer, *max_nonplayer_layer;
+    int transparent;
+    map map;
+    renderer_ctx renderer;
+    // Range of chunks touching the camera, last ones exclusive
+    int first_chunk_col, first_chunk_row, last_chunk_col, last_chunk_row;
+    float view_x, view_y, view_width, view_height;
+};
+
+static int chunk_in_view(const map_chunk *chunk, const struct draw_map_grid_args_s *args) {
+    if (chunk->x >= args->view_x + args->view_width || chunk->x + chunk->width <= args->view_x) return 0;
+    if (chunk->y >= args->view_y + args->view_height || chunk->y + chunk->height <= args->view_y) return 0;
+    return 1;
+}
+
+static iteration_result draw_map_grid(const hashtable_entry* entry, void *_args) {
+    struct draw_map_grid_args_s *args = (struct draw_map_grid_args_s *) _args;
+    map_grid_info *grid_info = (map_grid_info *) entry->value;
+
+    // Only draw layers with specified transparency
+    if (args->transparent != grid_info->transparent) return ITERATION_CONTINUE;
+
+    // Layers from the player's up move one over to make room for the entities
+    unsigned int real_layer = grid_info->layer;
+    if (args->map->player_layer == -1 || grid_info->layer < args->map->player_layer) {
+        if (real_layer > *args->max_nonplayer_layer) {
+            *args->max_nonplayer_layer = real_layer;
+        }
+    }
+    else {
+        real_layer += 1;
+    }
+
+    renderer_set_layer(args->renderer, args->base_layer + real_layer);
+    map m = args->map;
+
+    int use_tilemap = m->render_mode == MAP_RENDER_TILEMAP;
+    if (use_tilemap) {
+        if (grid_info->tilemap == NULL && create_grid_tilemap(m, grid_info, args->renderer) != 0) {
+            log_error("Failed to create tilemap for layer '{s}' of map '{s}'", entry->key, m->map_id);
+            return ITERATION_CONTINUE;
+        }
+        renderer_draw_tilemap(args->renderer, grid_info->tilemap);
+    }
+
+    for (int chunk_row = args->first_chunk_row; chunk_row < args->last_chunk_row; chunk_row++) {
+        for (int chunk_col = args->first_chunk_col; chunk_col < args->last_chunk_col; chunk_col++) {
+            int chunk_index = chunk_col + chunk_row * m->chunk_columns;
+            map_layer_chunk *layer_chunk = &grid_info->chunks[chunk_index];
+            if (layer_chunk->tile_count == 0) continue;
+
+            const map_chunk *chunk = &m->chunks[chunk_index];
+            if (chunk->state != MAP_CHUNK_RESIDENT || !chunk_in_view(chunk, args)) continue;
+
+            if (use_tilemap) {
+                // Only needed for the statistics, the tilemap already has culled cells cleared
+                if (layer_chunk->culling_dirty) {
+                    count_culled_tiles(m, grid_info, chunk_index);
+                }
+            }
+            else {
+                if (layer_chunk->dirty && bake_map_chunk(m, grid_info, chunk_index, args->renderer) != 0) {
+                    log_error("Failed to bake layer '{s}' of map '{s}'", entry->key, m->map_id);
+                    continue;
+                }
+                renderer_draw_static_batch(args->renderer, layer_chunk->batch);
+            }
+            m->render_stats.drawn_tiles += (size_t) (layer_chunk->tile_count - layer_chunk->culled_count);
+            m->render_stats.culled_tiles += (size_t) layer_chunk->culled_count;
+        }
+    }
+
+    return ITERATION_CONTINUE;
+}
+
+static int clamp_int(int value, int min, int max) {
+    return value < min ? min : (value > max ? max : value);
+}
+
+int map_render(map m, renderer_ctx ctx, double time) {
+    if (m->chunks == NULL) return 1;
+
+    if (m->animation_count > 0 && m->gpu_animations == NULL && create_gpu_animations(m, ctx) != 0) {
+        // Fall back to static tiles, nothing has been baked with the animations yet
+        log_error("Failed to create tile animations for map '{s}'", m->map_id);
+        renderer_tile_animations_destroy(m->gpu_animations);
+        m->gpu_animations = NULL;
+        m->animation_count = 0;
+        free(m->tile_animations);
+        m->tile_animations = NULL;
+    }
+    renderer_set_tile_animations(ctx, m->gpu_animations, time);
+
+    unsigned int base_layer = renderer_get_layer(ctx);
+    unsigned int max_nonplayer_layer = 0;
+
+    float view_x = 0.0f, view_y = 0.0f;
+    int view_width = 0, view_height = 0;
+    renderer_get_pan(ctx, &view_x, &view_y);
+    renderer_get_dimensions(ctx, &view_width, &view_height);
+
+    int chunk_pixel_width = MAP_CHUNK_SIZE * m->tilewidth, chunk_pixel_height = MAP_CHUNK_SIZE * m->tileheight;
+    struct draw_map_grid_args_s draw_map_grid_args = {
+        .base_layer = base_layer,
+        .max_nonplayer_layer = &max_nonplayer_layer,
+        .transparent = 0,
+        .map = m,
+        .renderer = ctx,
+        .first_chunk_col = clamp_int((int) floorf(view_x / chunk_pixel_width), 0, m->chunk_columns),
+        .first_chunk_row = clamp_int((int) floorf(view_y / chunk_pixel_height), 0, m->chunk_rows),
+        .last_chunk_col = clamp_int((int) floorf((view_x + view_width) / chunk_pixel_width) + 1, 0, m->chunk_columns),
+        .last_chunk_row = clamp_int((int) floorf((view_y + view_height) / chunk_pixel_height) + 1, 0, m->chunk_rows),
+        .view_x = view_x,
+        .view_y = view_y,
+        .view_width = (float) view_width,
+        .view_height = (float) view_height
+    };
+
+    m->stats.missing_visible_chunks = 0;
+    for (int chunk_row = draw_map_grid_args.first_chunk_row; chunk_row < draw_map_grid_args.last_chunk_row; chunk_row++) {
+        for (int chunk_col = draw_map_grid_args.first_chunk_col; chunk_col < draw_map_grid_args.last_chunk_col; chunk_col++) {
+            const map_chunk *chunk = &m->chunks[chunk_col + chunk_row * m->chunk_columns];
+            if (chunk->state != MAP_CHUNK_RESIDENT && chunk_in_view(chunk, &draw_map_grid_args)) {
+                m->stats.missing_visible_chunks++;
+            }
+        }
+    }
+
+    m->render_stats = (map_render_statistics) { 0 };
+    renderer_set_blend_mode(ctx, BLEND_MODE_BINARY);
+    hashtable_foreach_args(m->grids, draw_map_grid, &draw_map_grid_args);
+    draw_map_grid_args.transparent = 1;
+    renderer_set_blend_mode(ctx, BLEND_MODE_TRANSPARENCY);
+    hashtable_foreach_args(m->grids, draw_map_grid, &draw_map_grid_args);
+
+    // The table goes away with the map, nothing else should draw with it
+    renderer_set_tile_animations(ctx, NULL, time);
+    renderer_set_layer(ctx, base_layer + max_nonplayer_layer);
+    return 0;
+}
+
+static map_chunk_edits *chunk_edits_at(map m, map_grid_info *grid_info, int x, int y) {
+    if (grid_info->edits == NULL) {
+        grid_info->edits = (map_chunk_edits *) calloc((size_t) m->chunk_columns * (size_t) m->chunk_rows, sizeof(map_chunk_edits));
+        if (grid_info->edits == NULL) return NULL;
+    }
+    return &grid_info->edits[x / MAP_CHUNK_SIZE + (y / MAP_CHUNK_SIZE) * m->chunk_columns];
+}
+
+static int reserve_chunk_edits(map_chunk_edits *chunk_edits, int count) {
+    if (count <= chunk_edits->capacity) return 0;
+    int capacity = chunk_edits->capacity ? chunk_edits->capacity : 8;
+    while (capacity < count) capacity *= 2;
+    map_tile_edit *edits = (map_tile_edit *) realloc(chunk_edits->edits, (size_t) capacity * sizeof(map_tile_edit));
+    if (edits == NULL) return 1;
+    chunk_edits->edits = edits;
+    chunk_edits->capacity = capacity;
+    return 0;
+}
+
+static int record_tile_edit(map m, map_grid_info *grid_info, int x, int y, int tile_id) {
+    map_chunk_edits *chunk_edits = chunk_edits_at(m, grid_info, x, y);
+    if (chunk_edits == NULL) return 1;
+    uint16_t local_cell = (uint16_t) layer_chunk_local_cell(x, y);
+    // A cell keeps only its latest edit
+    for (int i = 0; i < chunk_edits->count; i++) {
+        if (chunk_edits->edits[i].local_cell == local_cell) {
+            chunk_edits->edits[i].tile_id = (uint16_t) tile_id;
+            return 0;
+        }
+    }
+    if (reserve_chunk_edits(chunk_edits, chunk_edits->count + 1) != 0) return 1;
+    int resident = m->chunks[x / MAP_CHUNK_SIZE + (y / MAP_CHUNK_SIZE) * m->chunk_columns].state == MAP_CHUNK_RESIDENT;
+    chunk_edits->edits[chunk_edits->count++] = (map_tile_edit) {
+        .local_cell = local_cell,
+        .tile_id = (uint16_t) tile_id,
+        .original_tile_id = resident ? layer_chunk_get(layer_chunk_at(m, grid_info, x, y), x, y) : -1
+    };
+    return 0;
+}
+
+// Called with the chunk's tiles freshly adopted, its occlusion is computed afterwards
+static void apply_chunk_edits(map m, map_grid_info *grid_info, int chunk_index) {
+    if (grid_info->edits == NULL) return;
+    const map_chunk *chunk = &m->chunks[chunk_index];
+    map_chunk_edits *chunk_edits = &grid_info->edits[chunk_index];
+    for (int i = 0; i < chunk_edits->count; i++) {
+        int x = chunk->first_col + chunk_edits->edits[i].local_cell % MAP_CHUNK_SIZE;
+        int y = chunk->first_row + chunk_edits->edits[i].local_cell / MAP_CHUNK_SIZE;
+        if (chunk_edits->edits[i].original_tile_id < 0) {
+            chunk_edits->edits[i].original_tile_id = layer_chunk_get(&grid_info->chunks[chunk_index], x, y);
+        }
+        if (layer_chunk_set(m, &grid_info->chunks[chunk_index], x, y, chunk_edits->edits[i].tile_id) != 0) {
+            log_error("Failed to allocate memory while replaying edits of chunk ({d}, {d}) of map '{s}'", chunk_index % m->chunk_columns, chunk_index / m->chunk_columns, m->map_id);
+            return;
+        }
+    }
+    grid_info->chunks[chunk_index].dirty = 1;
+}
+
+static void free_chunk_edits(map m, map_grid_info *grid_info) {
+    if (grid_info->edits == NULL) return;
+    for (int i = 0; i < m->chunk_columns * m->chunk_rows; i++) {
+        free(grid_info->edits[i].edits);
+    }
+    free(grid_info->edits);
+    grid_info->edits = NULL;
+}
+
+int map_set_tile(map m, const char *layer_name, int x, int y, int tile_id) {
+    if (m->grids == NULL) return 1;
+    if (x < 0 || y < 0 || x >= m->width || y >= m->height) return 1;
+
+    map_grid_info *grid_info = (map_grid_info *) hashtable_get(m->grids, layer_name);
+    if (grid_info == NULL) {
+        log_error("Map '{s}' has no layer named '{s}'", m->map_id, layer_name);
+        return 1;
+    }
+    if (tile_id < 0 || tile_id > MAP_MAX_TILE_ID) {
+        log_error("Tile id {d} of map '{s}' is out of range", tile_id, m->map_id);
+        return 1;
+    }
+    // Edits are kept on the side for snapshots, and because streamed chunks are reloaded from disk after
+    // an eviction. Chunks that aren't loaded yet pick the edit up when they are
+    if (record_tile_edit(m, grid_info, x, y, tile_id) != 0) {
+        log_error("Failed to allocate memory while setting a tile of map '{s}'", m->map_id);
+        return 1;
+    }
+    if (m->chunks[x / MAP_CHUNK_SIZE + (y / MAP_CHUNK_SIZE) * m->chunk_columns].state != MAP_CHUNK_RESIDENT) {
+        return 0;
+    }
+    return store_tile(m, grid_info, x, y, tile_id);
+}
+
+static void fill_chunk_cells(map m, const map_chunk *chunk, int *grid, const int *tiles, int fill) {
+    for (int row = chunk->first_row; row < chunk->last_row; row++) {
+        for (int col = chunk->first_col; col < chunk->last_col; col++) {
+            int local = (row - chunk->first_row) * MAP_CHUNK_SIZE + (col - chunk->first_col);
+            grid[col + row * m->width] = tiles != NULL ? tiles[local] : fill;
+        }
+    }
+}
+
+struct chunk_occlusion_args_s {
+    map map;
+    int chunk_index;
+};
+
+static iteration_result find_chunk_occluders(const hashtable_entry *entry, void *_args) {
+    struct chunk_occlusion_args_s *args = (struct chunk_occlusion_args_s *) _args;
+    map_grid_info *grid_info = (map_grid_info *) entry->value;
+    map_layer_chunk *layer_chunk = &grid_info->chunks[args->chunk_index];
+    map m = args->map;
+    const map_chunk *chunk = &m->chunks[args->chunk_index];
+    int col = 0, row = 0, tile_id = 0;
+    layer_chunk_cursor cursor = layer_chunk_begin(layer_chunk);
+    while (layer_chunk_next(&cursor, chunk, &col, &row, &tile_id)) {
+        int *occluder_layer = &m->occluder_grid[col + row * m->width];
+        if (grid_info->layer > *occluder_layer && tile_occludes_cell(m, tile_id)) {
+            *occluder_layer = grid_info->layer;
+        }
+    }
+    return ITERATION_CONTINUE;
+}
+
+static iteration_result invalidate_chunk_culling(const hashtable_entry *entry, void *_args) {
+    struct chunk_occlusion_args_s *args = (struct chunk_occlusion_args_s *) _args;
+    map_grid_info *grid_info = (map_grid_info *) entry->value;
+    map_layer_chunk *layer_chunk = &grid_info->chunks[args->chunk_index];
+    if (layer_chunk->occupancy == NULL) return ITERATION_CONTINUE;
+
+    layer_chunk->dirty = 1;
+    layer_chunk->culling_dirty = 1;
+    if (grid_info->tilemap != NULL) {
+        upload_chunk_to_tilemap(args->map, grid_info, args->chunk_index);
+    }
+    return ITERATION_CONTINUE;
+}
+
+static void compute_chunk_occlusion(map m, int chunk_index) {
+    if (m->occluder_grid == NULL) return;
+
+    fill_chunk_cells(m, &m->chunks[chunk_index], m->occluder_grid, NULL, MAP_NO_OCCLUDER);
+    struct chunk_occlusion_args_s chunk_occlusion_args = {
+        .map = m,
+        .chunk_index = chunk_index
+    };
+    hashtable_foreach_args(m->grids, find_chunk_occluders, &chunk_occlusion_args);
+    hashtable_foreach_args(m->grids, invalidate_chunk_culling, &chunk_occlusion_args);
+}
+
+static int compute_map_occlusion(map m) {
+    if (m->occluder_grid == NULL) {
+        m->occluder_grid = (int *) malloc((size_t) m->width * (size_t) m->height * sizeof(int));
+        if (m->occluder_grid == NULL) {
+            log_error("Failed to allocate memory for the occlusion grid of map '{s}'", m->map_id);
             return 1;
         }
-
-        // TODO: handle these separately
-        if (cJSON_IsTrue(layer_vision) || cJSON_IsTrue(layer_entities)) {
-            continue;
+        for (int i = 0; i < m->width * m->height; i++) {
+            m->occluder_grid[i] = MAP_NO_OCCLUDER;
         }
+    }
+    for (int chunk_index = 0; chunk_index < m->chunk_columns * m->chunk_rows; chunk_index++) {
+        if (m->chunks[chunk_index].state == MAP_CHUNK_RESIDENT) {
+            compute_chunk_occlusion(m, chunk_index);
+        }
+    }
+    return 0;
+}
 
-        int *grid = (int*) calloc(m->width * m->height, sizeof(int));
-        if (grid == NULL) {
-            log_error("Failed to allocate memory during parsing of map config");
-            cJSON_Delete(map_config);
-            return 1;
+static int chunk_distance(map m, int chunk_index, int focus_col, int focus_row) {
+    int col_distance = abs(chunk_index % m->chunk_columns - focus_col);
+    int row_distance = abs(chunk_index / m->chunk_columns - focus_row);
+    return col_distance > row_distance ? col_distance : row_distance;
+}
+
+static void evict_chunk(map m, int chunk_index) {
+    map_chunk *chunk = &m->chunks[chunk_index];
+    for (size_t i = 0; i < m->stream_layer_count; i++) {
+        map_stream_layer *stream_layer = &m->stream_layers[i];
+        switch (stream_layer->kind) {
+            case MAP_STREAM_LAYER_TILES:
+                release_layer_chunk(m, &stream_layer->grid_info->chunks[chunk_index]);
+                if (stream_layer->grid_info->tilemap != NULL) {
+                    upload_chunk_to_tilemap(m, stream_layer->grid_info, chunk_index);
+                }
+                break;
+            case MAP_STREAM_LAYER_COLLISION:
+                fill_chunk_cells(m, chunk, m->collision_grid, NULL, 1);
+                if (m->vision_from_collisions) fill_chunk_cells(m, chunk, m->vision_grid, NULL, 1);
+                break;
+            case MAP_STREAM_LAYER_VISION:
+                fill_chunk_cells(m, chunk, m->vision_grid, NULL, 1);
+                break;
+            case MAP_STREAM_LAYER_TERRAIN:
+                fill_chunk_cells(m, chunk, m->terrain_grid, NULL, 0);
+                break;
         }
+    }
+    if (m->occluder_grid != NULL) {
+        fill_chunk_cells(m, chunk, m->occluder_grid, NULL, MAP_NO_OCCLUDER);
+    }
+    m->vision_version++;
+    chunk->state = MAP_CHUNK_UNLOADED;
+    m->stats.evicted_chunks++;
+}
 
-        if (cJSON_IsTrue(layer_collisions)) {
-            if (m->collision_grid) {
-                log_warning("More than on collision grid defined");
-                free(grid);
-                continue;
-            }
+static void integrate_chunk(map m, map_chunk_payload *payload) {
+    int chunk_index = payload->chunk_col + payload->chunk_row * m->chunk_columns;
+    map_chunk *chunk = &m->chunks[chunk_index];
 
-            if (populate_grid(layer_map, grid, &largest_texture_id) != 0) {
-                cJSON_Delete(map_config);
-                free(grid);
-                return 1;
-            }
+    double latency_ms = (payload->completed_at - payload->requested_at) * 1000.0;
+    m->total_load_latency_ms += latency_ms;
+    if (latency_ms > m->stats.max_load_latency_ms) {
+        m->stats.max_load_latency_ms = latency_ms;
+    }
+    m->stats.loaded_chunks++;
+
+    if (payload->failed) {
+        // Leave it resident but empty and solid, retrying every update would only flood the log
+        log_error("Failed to load chunk ({d}, {d}) of map '{s}'", payload->chunk_col, payload->chunk_row, m->map_id);
+        m->stats.failed_chunks++;
+        chunk->state = MAP_CHUNK_RESIDENT;
+        return;
+    }
 
-            m->collision_grid = grid;
-            continue;
+    for (size_t i = 0; i < m->stream_layer_count; i++) {
+        map_stream_layer *stream_layer = &m->stream_layers[i];
+        switch (stream_layer->kind) {
+            case MAP_STREAM_LAYER_TILES:
+                // The payload keeps its dense copy and frees it with the rest of the payload
+                if (payload->layers[i] != NULL && adopt_layer_chunk_tiles(m, &stream_layer->grid_info->chunks[chunk_index], chunk_index, payload->layers[i]) != 0) {
+                    log_error("Failed to allocate memory for chunk ({d}, {d}) of map '{s}'", payload->chunk_col, payload->chunk_row, m->map_id);
+                    break;
+                }
+                apply_chunk_edits(m, stream_layer->grid_info, chunk_index);
+                break;
+            case MAP_STREAM_LAYER_COLLISION:
+                fill_chunk_cells(m, chunk, m->collision_grid, payload->layers[i], 0);
+                if (m->vision_from_collisions) fill_chunk_cells(m, chunk, m->vision_grid, payload->layers[i], 0);
+                break;
+            case MAP_STREAM_LAYER_VISION:
+                fill_chunk_cells(m, chunk, m->vision_grid, payload->layers[i], 0);
+                break;
+            case MAP_STREAM_LAYER_TERRAIN:
+                fill_chunk_cells(m, chunk, m->terrain_grid, payload->layers[i], 0);
+                break;
         }
+    }
+    chunk->state = MAP_CHUNK_RESIDENT;
+    m->vision_version++;
+    // Also uploads the chunk to any tilemaps, now that its culling is known
+    compute_chunk_occlusion(m, chunk_index);
+}
 
-        map_grid_info *grid_info = (map_grid_info *) malloc(sizeof(map_grid_info));
-        if (grid_info == NULL) {
-            log_error("Failed to allocate memory during parsing of map config");
-            free(grid);
-            cJSON_Delete(map_config);
-            return 1;
+static void request_chunks_around(map m, int focus_col, int focus_row) {
+    // Ring by ring, so the loader (which works in request order) brings in the nearest chunks first
+    for (int radius = 0; radius <= MAP_STREAMING_LOAD_RADIUS; radius++) {
+        for (int chunk_row = focus_row - radius; chunk_row <= focus_row + radius; chunk_row++) {
+            for (int chunk_col = focus_col - radius; chunk_col <= focus_col + radius; chunk_col++) {
+                if (chunk_col < 0 || chunk_row < 0 || chunk_col >= m->chunk_columns || chunk_row >= m->chunk_rows) continue;
+                int chunk_index = chunk_col + chunk_row * m->chunk_columns;
+                if (chunk_distance(m, chunk_index, focus_col, focus_row) != radius) continue;
+
+                map_chunk *chunk = &m->chunks[chunk_index];
+                if (chunk->state != MAP_CHUNK_UNLOADED) continue;
+                if (map_chunk_loader_request(m->loader, chunk_col, chunk_row) == 0) {
+                    chunk->state = MAP_CHUNK_LOADING;
+                }
+            }
+        }
+    }
+}
+
+static int farthest_evictable_chunk(map m, int focus_col, int focus_row) {
+    int farthest = -1, farthest_distance = MAP_STREAMING_LOAD_RADIUS;
+    for (int i = 0; i < m->chunk_columns * m->chunk_rows; i++) {
+        if (m->chunks[i].state != MAP_CHUNK_RESIDENT) continue;
+        int distance = chunk_distance(m, i, focus_col, focus_row);
+        if (distance > farthest_distance) {
+            farthest = i;
+            farthest_distance = distance;
         }
+    }
+    return farthest;
+}
 
-        grid_info->layer = (int) cJSON_GetNumberValue(layer_layer);
-        grid_info->transparent = (int) cJSON_IsTrue(layer_transparent);
-        grid_info->grid = grid;
+void map_update(map m, float focus_x, float focus_y) {
+    if (!m->streaming || m->loader == NULL) return;
+    double start = utils_get_time();
 
-        if (hashtable_set(m->grids, layer->string, grid_info) != 0) {
-            log_error("Failed to allocate memory during parsing of map config");
-            cJSON_Delete(map_config);
-            free(grid_info->grid);
-            free(grid_info);
-            return 1;
+    int focus_col = clamp_int((int) floorf(focus_x / (float) (MAP_CHUNK_SIZE * m->tilewidth)), 0, m->chunk_columns - 1);
+    int focus_row = clamp_int((int) floorf(focus_y / (float) (MAP_CHUNK_SIZE * m->tileheight)), 0, m->chunk_rows - 1);
+
+    // Decoding already happened on the loader thread, all that's left here is swapping pointers
+    // and patching the collision grid, capped so a burst of arrivals can't stall a frame
+    for (size_t i = 0; i < MAP_STREAMING_INTEGRATIONS_PER_UPDATE; i++) {
+        map_chunk_payload *payload = map_chunk_loader_poll(m->loader);
+        if (payload == NULL) break;
+
+        int chunk_index = payload->chunk_col + payload->chunk_row * m->chunk_columns;
+        if (chunk_distance(m, chunk_index, focus_col, focus_row) > MAP_STREAMING_EVICT_RADIUS) {
+            // The player moved on while this was loading
+            m->chunks[chunk_index].state = MAP_CHUNK_UNLOADED;
         }
+        else {
+            integrate_chunk(m, payload);
+        }
+        map_chunk_payload_destroy(payload);
+    }
 
-        if (populate_grid(layer_map, grid, &largest_texture_id) != 0) {
-            cJSON_Delete(map_config);
-            return 1;
+    for (int i = 0; i < m->chunk_columns * m->chunk_rows; i++) {
+        if (m->chunks[i].state == MAP_CHUNK_RESIDENT && chunk_distance(m, i, focus_col, focus_row) > MAP_STREAMING_EVICT_RADIUS) {
+            evict_chunk(m, i);
         }
     }
+    // Over budget, drop the farthest chunks first but never the ones around the player
+    while (m->resident_bytes > MAP_STREAMING_MEMORY_BUDGET) {
+        int chunk_index = farthest_evictable_chunk(m, focus_col, focus_row);
+        if (chunk_index < 0) break;
+        evict_chunk(m, chunk_index);
+    }
+    if (m->resident_bytes < MAP_STREAMING_MEMORY_BUDGET) {
+        request_chunks_around(m, focus_col, focus_row);
+    }
 
-    cJSON_Delete(map_config);
-    
-    m->texture_id_buffer_size = utils_digit_length((size_t) largest_texture_id) + 1;
-    m->texture_id_buffer = (char*) calloc(m->texture_id_buffer_size, sizeof(char));
-    if (m->texture_id_buffer == NULL) {
-        return 1;
+    m->stats.last_update_ms = (utils_get_time() - start) * 1000.0;
+    if (m->stats.last_update_ms > MAP_STREAMING_HITCH_MS) {
+        m->stats.hitches++;
     }
+}
 
-    return 0;
+void map_set_render_mode(map m, map_render_mode render_mode) {
+    m->render_mode = render_mode;
 }
 
-static int load_map_config(map m) {
-    if (m->grids != NULL || m->asset_info != NULL || m->collision_grid != NULL) return 0;
+const char *map_get_id(map m) {
+    return m->map_id;
+}
 
-    // Read maps list
-    char *config_contents = utils_read_whole_file("assets/maps.json");
-    if (config_contents == NULL) {
-        log_error("Failed to read main map config file");
-        return 1;
-    }
-    cJSON *config_json = cJSON_Parse(config_contents);
-    free(config_contents);
-    if (config_json == NULL) {
-        log_error("Failed to parse main map config file");
-        return 1;
-    }
+unsigned int map_get_entity_layer(map m) {
+    return m->player_layer >= 0 ? (unsigned int) m->player_layer : (unsigned int) m->top_layer + 1;
+}
 
-    if (!cJSON_IsObject(config_json)) {
-        log_error("Failed to parse main map config file: config must be an object");
-        cJSON_Delete(config_json);
-        return 1;
+size_t map_get_memory_usage(map m) {
+    size_t cell_count = (size_t) m->width * (size_t) m->height;
+    // Tile storage and vertex batches, GPU resources belong to the asset manager
+    size_t bytes = sizeof(struct map_s) + m->resident_bytes;
+    int *cell_grids[] = { m->collision_grid, m->terrain_grid, m->vision_grid, m->occluder_grid };
+    for (size_t i = 0; i < sizeof(cell_grids) / sizeof(cell_grids[0]); i++) {
+        if (cell_grids[i] != NULL) bytes += cell_count * sizeof(int);
     }
+    if (m->explored != NULL) bytes += (cell_count + 63) / 64 * sizeof(uint64_t);
+    if (m->textures != NULL) bytes += m->texture_count * sizeof(texture);
+    if (m->tile_animations != NULL) bytes += m->texture_count * sizeof(int);
+    bytes += (size_t) m->chunk_columns * (size_t) m->chunk_rows * sizeof(map_chunk);
+    return bytes;
+}
 
-    cJSON *map_config_partial_path_json = cJSON_GetObjectItem(config_json, m->map_id);
-    if (map_config_partial_path_json == NULL || !cJSON_IsString(map_config_partial_path_json)) {
-        log_error("Failed to parse main map config file: map path must be a string");
-        cJSON_Delete(config_json);
-        return 1;
-    }
+map_render_mode map_get_render_mode(map m) {
+    return m->render_mode;
+}
 
-    int result = load_inner_map_config(m, cJSON_GetStringValue(map_config_partial_path_json));
-    cJSON_Delete(config_json);
-    return result;
+map_render_statistics map_get_render_stats(map m) {
+    return m->render_stats;
 }
 
-map map_create(asset_manager_ctx ctx, const char *map_id) {
-    map m = (map) calloc(1, sizeof(struct map_s));
-    if (m == NULL) {
-        return NULL;
-    }
-    m->asset_mgr = ctx;
-    m->player_layer = -1;
-    m->map_id = utils_copy_string(map_id);
-    if (m->map_id == NULL) {
-        map_destroy(m);
-        return NULL;
-    }
-    m->texture_cache = hashtable_create_copied_string_key_borrowed_pointer_value();
-    if (m->texture_cache == NULL) {
-        map_destroy(m);
-        return NULL;
+map_streaming_statistics map_get_streaming_stats(map m) {
+    map_streaming_statistics stats = m->stats;
+    stats.streaming = m->streaming;
+    stats.resident_bytes = m->resident_bytes;
+    stats.memory_budget = MAP_STREAMING_MEMORY_BUDGET;
+    stats.pending_chunks = m->loader != NULL ? map_chunk_loader_pending(m->loader) : 0;
+    stats.resident_chunks = 0;
+    for (int i = 0; i < m->chunk_columns * m->chunk_rows; i++) {
+        stats.resident_chunks += m->chunks[i].state == MAP_CHUNK_RESIDENT;
     }
-
-    return m;
+    stats.average_load_latency_ms = stats.loaded_chunks > 0 ? m->total_load_latency_ms / (double) stats.loaded_chunks : 0.0;
+    return stats;
 }
 
-struct find_parent_asset_id_args_s {
+struct storage_stats_args_s {
     map map;
-    int id;
-    const char *result;
-    int *min_id;
+    map_storage_statistics *stats;
 };
 
-static iteration_result find_parent_asset_id(const hashtable_entry *entry, void *_args) {
-    struct find_parent_asset_id_args_s *args = (struct find_parent_asset_id_args_s *) _args;
-    map_asset_info *m_asset_info = (map_asset_info *) entry->value;
-
-    if (args->id >= m_asset_info->min_id && args->id < m_asset_info->max_id) {
-        args->result = entry->key;
-        *args->min_id = m_asset_info->min_id; 
-        return ITERATION_BREAK;
+static iteration_result add_layer_storage_stats(const hashtable_entry *entry, void *_args) {
+    struct storage_stats_args_s *args = (struct storage_stats_args_s *) _args;
+    map_grid_info *grid_info = (map_grid_info *) entry->value;
+    map m = args->map;
+    args->stats->tile_layers++;
+    for (int i = 0; i < m->chunk_columns * m->chunk_rows; i++) {
+        const map_chunk *chunk = &m->chunks[i];
+        if (chunk->state != MAP_CHUNK_RESIDENT) continue;
+        size_t cells = (size_t) (chunk->last_col - chunk->first_col) * (size_t) (chunk->last_row - chunk->first_row);
+        args->stats->dense_bytes += cells * sizeof(int);
+        args->stats->sparse_bytes += layer_chunk_storage_bytes(&grid_info->chunks[i]);
+        args->stats->occupied_tiles += (size_t) grid_info->chunks[i].tile_count;
     }
-
     return ITERATION_CONTINUE;
 }
 
-static asset_and_min_id get_texture_parent_asset_and_min_id(map m, int id) {
-    int min_id = 0;
-    struct find_parent_asset_id_args_s find_parent_asset_id_args = {
+map_storage_statistics map_get_storage_stats(map m) {
+    map_storage_statistics stats = { 0 };
+    struct storage_stats_args_s storage_stats_args = {
         .map = m,
-        .id = id,
-        .min_id = &min_id,
-        .result = NULL
+        .stats = &stats
     };
-    hashtable_foreach_args(m->asset_info, find_parent_asset_id, &find_parent_asset_id_args);
+    hashtable_foreach_args(m->grids, add_layer_storage_stats, &storage_stats_args);
+    stats.compression_ratio = stats.sparse_bytes > 0 ? (double) stats.dense_bytes / (double) stats.sparse_bytes : 0.0;
+    return stats;
+}
 
-    const char *asset_id = find_parent_asset_id_args.result;
-    if (asset_id == NULL) {
-        return (asset_and_min_id) { .asset = NULL, .min_id = 0 };
-    }
+void map_get_pixel_dimensions(map m, int *out_width, int *out_height) {
+    if (out_width != NULL) *out_width = m->width * m->tilewidth;
+    if (out_height != NULL) *out_height = m->height * m->tileheight;
+}
+
+const int *map_get_collision_grid(map m, int *out_width, int *out_height) {
+    if (out_width != NULL) *out_width = m->width;
+    if (out_height != NULL) *out_height = m->height;
+    return m->collision_grid;
+}
+
+void map_get_tile_dimensions(map m, int *out_width, int *out_height) {
+    if (out_width != NULL) *out_width = m->tilewidth;
+    if (out_height != NULL) *out_height = m->tileheight;
+}
+
+int map_occupied_at(map m, int x, int y) {
+    if (m->collision_grid == NULL) return 0;
+    if (x < 0 || y < 0 || x >= m->width || y >= m->height) return 1;
+    return m->collision_grid[x + y * m->width];
+}
 
-    return (asset_and_min_id) {
-        .asset = asset_manager_get_asset(m->asset_mgr, asset_id),
-        .min_id = min_id
+integer_position map_get_cell_at(map m, float x, float y) {
+    return (integer_position) {
+        .x = (int) floorf(x / (float) m->tilewidth),
+        .y = (int) floorf(y / (float) m->tileheight)
     };
 }
 
-static void compute_texture_offsets(map m, asset a, int id, int *offset_x, int *offset_y) {
-    int asset_width_in_tiles = asset_get_width(a) / m->tilewidth;
+int map_blocks_sight(map m, int x, int y) {
+    if (x < 0 || y < 0 || x >= m->width || y >= m->height) return 1;
+    return m->vision_grid != NULL && m->vision_grid[x + y * m->width] != 0;
+}
 
-    int row = id / asset_width_in_tiles;
-    int col = id % asset_width_in_tiles;
+int map_set_blocks_sight(map m, int x, int y, int blocks) {
+    if (m->vision_grid == NULL || x < 0 || y < 0 || x >= m->width || y >= m->height) return 1;
+    if ((m->vision_grid[x + y * m->width] != 0) == (blocks != 0)) return 0;
+    m->vision_grid[x + y * m->width] = blocks != 0;
+    m->vision_version++;
+    return 0;
+}
 
-    *offset_x = col * m->tilewidth;
-    *offset_y = row * m->tileheight;
+int map_update_fov(map m, fov_viewer viewer, integer_position origin) {
+    return fov_viewer_update(viewer, m->vision_grid, m->width, m->height, m->vision_version, origin);
 }
 
-static texture get_texture_from_id(map m, int id) {
-    snprintf(m->texture_id_buffer, m->texture_id_buffer_size, "%d", id);
-    texture cached = hashtable_get(m->texture_cache, m->texture_id_buffer);
-    if (cached != NULL) {
-        // If this texture has already been cached, return it
-        return cached;
-    }
-    // Texture hasn't been cached yet, so we must create it
-    asset_and_min_id parent_asset_and_min_id = get_texture_parent_asset_and_min_id(m, id);
-    if (parent_asset_and_min_id.asset == NULL) {
-        log_error("Parent asset for map '{s}' texture with ID {d} was not found", m->map_id, id);
-        return NULL;
+void map_reveal(map m, fov_viewer viewer) {
+    if (m->explored == NULL) return;
+    integer_position origin = fov_viewer_get_origin(viewer);
+    int radius = fov_viewer_get_radius(viewer);
+    for (int y = origin.y - radius; y <= origin.y + radius; y++) {
+        for (int x = origin.x - radius; x <= origin.x + radius; x++) {
+            if (!fov_viewer_can_see(viewer, x, y)) continue;
+            size_t cell = (size_t) x + (size_t) y * (size_t) m->width;
+            m->explored[cell / 64] |= UINT64_C(1) << (cell % 64);
+        }
     }
-    int offset_x = 0, offset_y = 0;
-    compute_texture_offsets(m, parent_asset_and_min_id.asset, id - parent_asset_and_min_id.min_id, &offset_x, &offset_y);
-    texture t = texture_from_asset(parent_asset_and_min_id.asset, m->tilewidth, m->tileheight, offset_x, offset_y);
-    if (t == NULL) {
-        log_error("Failed to create texture for map '{s}' with ID {d} from base asset", m->map_id, id);
-        return NULL;
+}
+
+int map_is_explored(map m, int x, int y) {
+    if (m->explored == NULL || x < 0 || y < 0 || x >= m->width || y >= m->height) return 0;
+    size_t cell = (size_t) x + (size_t) y * (size_t) m->width;
+    return (m->explored[cell / 64] >> (cell % 64)) & 1;
+}
+
+static size_t cell_word_count(map m) {
+    return ((size_t) m->width * (size_t) m->height + 63) / 64;
+}
+
+static size_t chunk_word_count(map m) {
+    return ((size_t) m->chunk_columns * (size_t) m->chunk_rows + 63) / 64;
+}
+
+static int cell_is_resident(map m, size_t cell) {
+    int x = (int) (cell % (size_t) m->width), y = (int) (cell / (size_t) m->width);
+    return m->chunks[x / MAP_CHUNK_SIZE + (y / MAP_CHUNK_SIZE) * m->chunk_columns].state == MAP_CHUNK_RESIDENT;
+}
+
+static int bit_is_set(const unsigned char *words, size_t bit) {
+    uint64_t word = 0;
+    memcpy(&word, words + bit / 64 * sizeof(uint64_t), sizeof(word));
+    return (int) ((word >> (bit % 64)) & 1);
+}
+
+static int layer_has_edits(map m, const map_grid_info *grid_info) {
+    if (grid_info->edits == NULL) return 0;
+    for (int chunk_index = 0; chunk_index < m->chunk_columns * m->chunk_rows; chunk_index++) {
+        if (grid_info->edits[chunk_index].count > 0) return 1;
     }
-    hashtable_set(m->texture_cache, m->texture_id_buffer, t);
-    return t;
+    return 0;
 }
 
-struct draw_map_grid_args_s {
-    unsigned int base_layer, *max_nonplayer_layer;
-    unsigned int entity_layer_offset;
-    int transparent;
+struct write_layer_edits_args_s {
     map map;
-    renderer_ctx renderer;
+    snapshot snapshot;
+    uint32_t layer_count;
+    int failed;
 };
 
-static iteration_result draw_map_grid(const hashtable_entry* entry, void *_args) {
-    struct draw_map_grid_args_s *args = (struct draw_map_grid_args_s *) _args;
+static iteration_result write_layer_edits(const hashtable_entry *entry, void *_args) {
+    struct write_layer_edits_args_s *args = (struct write_layer_edits_args_s *) _args;
+    map m = args->map;
     map_grid_info *grid_info = (map_grid_info *) entry->value;
+    if (!layer_has_edits(m, grid_info)) return ITERATION_CONTINUE;
 
-    // Only draw layers with specified transparency
-    if (args->transparent != grid_info->transparent) return ITERATION_CONTINUE;
+    int chunk_count = m->chunk_columns * m->chunk_rows;
+    uint32_t edit_count = 0;
+    for (int chunk_index = 0; chunk_index < chunk_count; chunk_index++) {
+        edit_count += (uint32_t) grid_info->edits[chunk_index].count;
+    }
 
-    // FIXME: Instead of arbitrarily adding 100 to the layer, do something smarter
-    unsigned int real_layer = grid_info->layer;
-    if (args->map->player_layer == -1 || grid_info->layer < args->map->player_layer) {
-        if (real_layer > *args->max_nonplayer_layer) {
-            *args->max_nonplayer_layer = real_layer;
+    // Written with its terminator so readers can look it up in place
+    const char *name = (const char *) entry->key;
+    uint32_t name_length = (uint32_t) strlen(name) + 1;
+    unsigned char *out = NULL;
+    if (snapshot_write(args->snapshot, &name_length, sizeof(name_length)) != 0
+        || snapshot_write(args->snapshot, name, name_length) != 0
+        || snapshot_write(args->snapshot, &edit_count, sizeof(edit_count)) != 0
+        || (out = snapshot_extend(args->snapshot, edit_count * (sizeof(uint32_t) + sizeof(uint16_t)))) == NULL) {
+        args->failed = 1;
+        return ITERATION_BREAK;
+    }
+    // Cells then tile ids
+    uint32_t i = 0;
+    for (int chunk_index = 0; chunk_index < chunk_count; chunk_index++) {
+        const map_chunk *chunk = &m->chunks[chunk_index];
+        const map_chunk_edits *chunk_edits = &grid_info->edits[chunk_index];
+        for (int j = 0; j < chunk_edits->count; j++, i++) {
+            int x = chunk->first_col + chunk_edits->edits[j].local_cell % MAP_CHUNK_SIZE;
+            int y = chunk->first_row + chunk_edits->edits[j].local_cell / MAP_CHUNK_SIZE;
+            uint32_t cell = (uint32_t) x + (uint32_t) y * (uint32_t) m->width;
+            memcpy(out + i * sizeof(uint32_t), &cell, sizeof(cell));
+            memcpy(out + edit_count * sizeof(uint32_t) + i * sizeof(uint16_t), &chunk_edits->edits[j].tile_id, sizeof(uint16_t));
         }
     }
-    else {
-        real_layer += args->entity_layer_offset;
+    return ITERATION_CONTINUE;
+}
+
+static iteration_result count_edited_layers(const hashtable_entry *entry, void *_args) {
+    struct write_layer_edits_args_s *args = (struct write_layer_edits_args_s *) _args;
+    if (layer_has_edits(args->map, (const map_grid_info *) entry->value)) args->layer_count++;
+    return ITERATION_CONTINUE;
+}
+
+static int write_tile_edits(map m, snapshot s) {
+    struct write_layer_edits_args_s write_layer_edits_args = { .map = m, .snapshot = s, .layer_count = 0, .failed = 0 };
+    if (m->grids != NULL) hashtable_foreach_args(m->grids, count_edited_layers, &write_layer_edits_args);
+    if (snapshot_write(s, &write_layer_edits_args.layer_count, sizeof(uint32_t)) != 0) return 1;
+    if (m->grids != NULL) hashtable_foreach_args(m->grids, write_layer_edits, &write_layer_edits_args);
+    return write_layer_edits_args.failed;
+}
+
+int map_write_state(map m, snapshot s) {
+    int32_t dimensions[2] = { m->width, m->height };
+    uint32_t explored_words = m->explored != NULL ? (uint32_t) cell_word_count(m) : 0;
+    uint32_t vision_words = m->vision_grid != NULL ? (uint32_t) cell_word_count(m) : 0;
+    uint32_t chunk_words = m->vision_grid != NULL ? (uint32_t) chunk_word_count(m) : 0;
+    if (snapshot_write(s, dimensions, sizeof(dimensions)) != 0
+        || snapshot_write(s, &explored_words, sizeof(explored_words)) != 0
+        || snapshot_write(s, m->explored, explored_words * sizeof(uint64_t)) != 0
+        || snapshot_write(s, &chunk_words, sizeof(chunk_words)) != 0) {
+        return 1;
     }
 
-    renderer_set_layer(args->renderer, args->base_layer + real_layer);
-    for (int row = 0; row < args->map->height; row++) {
-        for (int col = 0; col < args->map->width; col++) {
-            int grid_value = grid_info->grid[row * args->map->width + col];
-            if (grid_value == 0) continue;
-
-            texture t = get_texture_from_id(args->map, grid_value);
-            if (t == NULL) {
-                log_error("Failed to get for map '{s}' with ID {d}", args->map->map_id, grid_value);
-                return ITERATION_CONTINUE;
+    // Unloaded chunks only hold a blocking filler, their cells are left out
+    unsigned char *out = snapshot_extend(s, chunk_words * sizeof(uint64_t));
+    if (out == NULL) return 1;
+    for (size_t word_index = 0; word_index < chunk_words; word_index++) {
+        uint64_t word = 0;
+        size_t first = word_index * 64, chunk_count = (size_t) m->chunk_columns * (size_t) m->chunk_rows;
+        for (size_t chunk_index = first; chunk_index < first + 64 && chunk_index < chunk_count; chunk_index++) {
+            if (m->chunks[chunk_index].state == MAP_CHUNK_RESIDENT) word |= UINT64_C(1) << (chunk_index - first);
+        }
+        memcpy(out + word_index * sizeof(uint64_t), &word, sizeof(word));
+    }
+
+    // Packed a bit per cell like explored, the grid itself keeps an int each
+    if (snapshot_write(s, &vision_words, sizeof(vision_words)) != 0) return 1;
+    out = snapshot_extend(s, vision_words * sizeof(uint64_t));
+    if (out == NULL) return 1;
+    size_t cell_count = (size_t) m->width * (size_t) m->height;
+    for (size_t word_index = 0; word_index < vision_words; word_index++) {
+        uint64_t word = 0;
+        size_t first = word_index * 64, last = first + 64 < cell_count ? first + 64 : cell_count;
+        for (size_t cell = first; cell < last; cell++) {
+            if (m->vision_grid[cell] != 0 && cell_is_resident(m, cell)) word |= UINT64_C(1) << (cell - first);
+        }
+        memcpy(out + word_index * sizeof(uint64_t), &word, sizeof(word));
+    }
+    return write_tile_edits(m, s);
+}
+
+// Checks the edits and makes room for them in the layers' edit lists, so applying them can't run out of memory
+static int parse_tile_edits(map m, snapshot_reader *reader, map_state *out) {
+    const unsigned char *start = reader->cursor;
+    if (snapshot_read_value(reader, &out->edited_layers, sizeof(out->edited_layers)) != 0) return 1;
+
+    int chunk_count = m->chunk_columns * m->chunk_rows;
+    int *chunk_counts = (int *) calloc((size_t) chunk_count + 1, sizeof(int));
+    if (chunk_counts == NULL) return 1;
+    int return_value = 1;
+    for (uint32_t layer = 0; layer < out->edited_layers; layer++) {
+        uint32_t name_length = 0, edit_count = 0;
+        const unsigned char *name = NULL, *cells = NULL, *tile_ids = NULL;
+        if (snapshot_read_value(reader, &name_length, sizeof(name_length)) != 0
+            || (name = snapshot_read(reader, name_length)) == NULL
+            || snapshot_read_value(reader, &edit_count, sizeof(edit_count)) != 0
+            || (cells = snapshot_read(reader, (size_t) edit_count * sizeof(uint32_t))) == NULL
+            || (tile_ids = snapshot_read(reader, (size_t) edit_count * sizeof(uint16_t))) == NULL) {
+            goto cleanup;
+        }
+        if (name_length == 0 || memchr(name, '\0', name_length) != name + name_length - 1) goto cleanup;
+        map_grid_info *grid_info = m->grids != NULL ? (map_grid_info *) hashtable_get(m->grids, (const char *) name) : NULL;
+        if (grid_info == NULL) goto cleanup;
+
+        memset(chunk_counts, 0, (size_t) chunk_count * sizeof(int));
+        for (uint32_t i = 0; i < edit_count; i++) {
+            uint32_t cell = 0;
+            memcpy(&cell, cells + i * sizeof(uint32_t), sizeof(cell));
+            if (cell >= (uint32_t) m->width * (uint32_t) m->height) goto cleanup;
+            int x = (int) (cell % (uint32_t) m->width), y = (int) (cell / (uint32_t) m->width);
+            chunk_counts[x / MAP_CHUNK_SIZE + (y / MAP_CHUNK_SIZE) * m->chunk_columns]++;
+        }
+        for (int chunk_index = 0; chunk_index < chunk_count; chunk_index++) {
+            if (chunk_counts[chunk_index] == 0) continue;
+            const map_chunk *chunk = &m->chunks[chunk_index];
+            map_chunk_edits *chunk_edits = chunk_edits_at(m, grid_info, chunk->first_col, chunk->first_row);
+            if (chunk_edits == NULL || reserve_chunk_edits(chunk_edits, chunk_counts[chunk_index]) != 0) {
+                log_error("Failed to allocate memory while reading the tile edits of map '{s}'", m->map_id);
+                goto cleanup;
             }
-            float x = (float) col * args->map->tilewidth;
-            float y = (float) row * args->map->tileheight;
-            renderer_draw_texture(args->renderer, t, x, y);
         }
     }
+    out->edits = start;
+    out->edits_size = (size_t) (reader->cursor - start);
+    return_value = 0;
+
+cleanup:
+    free(chunk_counts);
+    return return_value;
+}
+
+int map_parse_state(map m, snapshot_reader *reader, map_state *out) {
+    int32_t dimensions[2] = { 0, 0 };
+    *out = (map_state) { 0 };
+    if (snapshot_read_value(reader, dimensions, sizeof(dimensions)) != 0
+        || snapshot_read_value(reader, &out->explored_words, sizeof(out->explored_words)) != 0
+        || (out->explored = snapshot_read(reader, out->explored_words * sizeof(uint64_t))) == NULL
+        || snapshot_read_value(reader, &out->chunk_words, sizeof(out->chunk_words)) != 0
+        || (out->resident_chunks = snapshot_read(reader, out->chunk_words * sizeof(uint64_t))) == NULL
+        || snapshot_read_value(reader, &out->vision_words, sizeof(out->vision_words)) != 0
+        || (out->vision = snapshot_read(reader, out->vision_words * sizeof(uint64_t))) == NULL) {
+        log_error("Failed to read the state of map '{s}': snapshot is truncated", m->map_id);
+        return 1;
+    }
+    if (dimensions[0] != m->width || dimensions[1] != m->height) {
+        log_error("Failed to read the state of map '{s}': snapshot is of a {d}x{d} map", m->map_id, dimensions[0], dimensions[1]);
+        return 1;
+    }
+    // Only written when the map had them loaded, a bit for each of its cells or chunks
+    size_t word_count = cell_word_count(m);
+    if ((out->explored_words != 0 && (m->explored == NULL || out->explored_words != word_count))
+        || (out->vision_words != 0 && (m->vision_grid == NULL || out->vision_words != word_count))
+        || out->chunk_words != (out->vision_words != 0 ? chunk_word_count(m) : 0)) {
+        log_error("Failed to read the state of map '{s}': map is not loaded or cells don't match", m->map_id);
+        return 1;
+    }
+    if (parse_tile_edits(m, reader, out) != 0) {
+        log_error("Failed to read the state of map '{s}': truncated or unknown tile edits", m->map_id);
+        return 1;
+    }
+    return 0;
+}
 
+struct revert_layer_edits_args_s {
+    map map;
+};
+
+// Puts back the map file's tiles wherever the layer was edited and forgets the edits
+static iteration_result revert_layer_edits(const hashtable_entry *entry, void *_args) {
+    map m = ((struct revert_layer_edits_args_s *) _args)->map;
+    map_grid_info *grid_info = (map_grid_info *) entry->value;
+    if (grid_info->edits == NULL) return ITERATION_CONTINUE;
+
+    for (int chunk_index = 0; chunk_index < m->chunk_columns * m->chunk_rows; chunk_index++) {
+        const map_chunk *chunk = &m->chunks[chunk_index];
+        map_chunk_edits *chunk_edits = &grid_info->edits[chunk_index];
+        for (int i = 0; i < chunk_edits->count && chunk->state == MAP_CHUNK_RESIDENT; i++) {
+            if (chunk_edits->edits[i].original_tile_id < 0) continue;
+            int x = chunk->first_col + chunk_edits->edits[i].local_cell % MAP_CHUNK_SIZE;
+            int y = chunk->first_row + chunk_edits->edits[i].local_cell / MAP_CHUNK_SIZE;
+            store_tile(m, grid_info, x, y, chunk_edits->edits[i].original_tile_id);
+        }
+        chunk_edits->count = 0;
+    }
     return ITERATION_CONTINUE;
 }
 
-int map_render(map m, renderer_ctx ctx, unsigned int entity_layer_offset) {
-    unsigned int base_layer = renderer_get_layer(ctx);
-    unsigned int max_nonplayer_layer = 0;
-    struct draw_map_grid_args_s draw_map_grid_args = {
-        .base_layer = base_layer,
-        .max_nonplayer_layer = &max_nonplayer_layer,
-        .entity_layer_offset = entity_layer_offset,
-        .transparent = 0,
-        .map = m,
-        .renderer = ctx
-    };
+static void apply_tile_edits(map m, const map_state *state) {
+    struct revert_layer_edits_args_s revert_layer_edits_args = { .map = m };
+    if (m->grids != NULL) hashtable_foreach_args(m->grids, revert_layer_edits, &revert_layer_edits_args);
+
+    // Already checked, and the edit lists have room for every edit
+    snapshot_reader reader = { .cursor = state->edits, .end = state->edits + state->edits_size };
+    uint32_t layer_count = 0;
+    snapshot_read_value(&reader, &layer_count, sizeof(layer_count));
+    for (uint32_t layer = 0; layer < layer_count; layer++) {
+        uint32_t name_length = 0, edit_count = 0;
+        snapshot_read_value(&reader, &name_length, sizeof(name_length));
+        const unsigned char *name = snapshot_read(&reader, name_length);
+        snapshot_read_value(&reader, &edit_count, sizeof(edit_count));
+        const unsigned char *cells = snapshot_read(&reader, (size_t) edit_count * sizeof(uint32_t));
+        const unsigned char *tile_ids = snapshot_read(&reader, (size_t) edit_count * sizeof(uint16_t));
+
+        map_grid_info *grid_info = (map_grid_info *) hashtable_get(m->grids, (const char *) name);
+        for (uint32_t i = 0; i < edit_count; i++) {
+            uint32_t cell = 0;
+            uint16_t tile_id = 0;
+            memcpy(&cell, cells + i * sizeof(uint32_t), sizeof(cell));
+            memcpy(&tile_id, tile_ids + i * sizeof(uint16_t), sizeof(tile_id));
+            int x = (int) (cell % (uint32_t) m->width), y = (int) (cell / (uint32_t) m->width);
+            record_tile_edit(m, grid_info, x, y, tile_id);
+            if (cell_is_resident(m, cell)) store_tile(m, grid_info, x, y, tile_id);
+        }
+    }
+}
 
-    renderer_set_blend_mode(ctx, BLEND_MODE_BINARY);
-    hashtable_foreach_args(m->grids, draw_map_grid, &draw_map_grid_args);
-    draw_map_grid_args.transparent = 1;
-    renderer_set_blend_mode(ctx, BLEND_MODE_TRANSPARENCY);
-    hashtable_foreach_args(m->grids, draw_map_grid, &draw_map_grid_args);
+void map_apply_state(map m, const map_state *state) {
+    if (state->explored_words != 0) memcpy(m->explored, state->explored, state->explored_words * sizeof(uint64_t));
+    int vision_changed = 0;
+    size_t cell_count = (size_t) m->width * (size_t) m->height;
+    for (size_t word_index = 0; word_index < state->vision_words; word_index++) {
+        uint64_t word = 0;
+        memcpy(&word, state->vision + word_index * sizeof(uint64_t), sizeof(word));
+        size_t first = word_index * 64, last = first + 64 < cell_count ? first + 64 : cell_count;
+        for (size_t cell = first; cell < last; cell++) {
+            int blocks = (int) ((word >> (cell - first)) & 1);
+            if ((m->vision_grid[cell] != 0) == blocks) continue;
+            // Cells of chunks unloaded on either side are whatever the map file has
+            if (!cell_is_resident(m, cell)) continue;
+            int x = (int) (cell % (size_t) m->width), y = (int) (cell / (size_t) m->width);
+            if (!bit_is_set(state->resident_chunks, (size_t) (x / MAP_CHUNK_SIZE + (y / MAP_CHUNK_SIZE) * m->chunk_columns))) continue;
+            m->vision_grid[cell] = blocks;
+            vision_changed = 1;
+        }
+    }
+    if (vision_changed) m->vision_version++;
+    apply_tile_edits(m, state);
+}
 
-    renderer_set_layer(ctx, base_layer + max_nonplayer_layer);
+static int fog_level(map m, fov_viewer viewer, int x, int y) {
+    if (fov_viewer_can_see(viewer, x, y)) return 0;
+    return map_is_explored(m, x, y) ? 1 : 2;
+}
+
+int map_render_fog(map m, renderer_ctx ctx, fov_viewer viewer) {
+    if (m->explored == NULL) return 1;
+
+    float view_x = 0.0f, view_y = 0.0f;
+    int view_width = 0, view_height = 0;
+    renderer_get_pan(ctx, &view_x, &view_y);
+    renderer_get_dimensions(ctx, &view_width, &view_height);
+    int first_col = clamp_int((int) floorf(view_x / m->tilewidth), 0, m->width);
+    int first_row = clamp_int((int) floorf(view_y / m->tileheight), 0, m->height);
+    int last_col = clamp_int((int) floorf((view_x + view_width) / m->tilewidth) + 1, 0, m->width);
+    int last_row = clamp_int((int) floorf((view_y + view_height) / m->tileheight) + 1, 0, m->height);
+
+    // Above every map layer and the entity layer between them
+    renderer_set_layer(ctx, renderer_get_layer(ctx) + (unsigned int) m->top_layer + 2);
+    renderer_set_blend_mode(ctx, BLEND_MODE_TRANSPARENCY);
+    static const float FOG_ALPHAS[] = { 0.0f, FOG_EXPLORED_ALPHA, FOG_UNEXPLORED_ALPHA };
+    for (int row = first_row; row < last_row; row++) {
+        // One rectangle per run of cells sharing a fog level
+        int run_start = first_col, run_level = fog_level(m, viewer, first_col, row);
+        for (int col = first_col + 1; col <= last_col; col++) {
+            int level = col < last_col ? fog_level(m, viewer, col, row) : -1;
+            if (level == run_level) continue;
+            if (run_level > 0) {
+                renderer_draw_rect(
+                    ctx,
+                    (float) (run_start * m->tilewidth),
+                    (float) (row * m->tileheight),
+                    (float) ((col - run_start) * m->tilewidth),
+                    (float) m->tileheight,
+                    (color_rgb) { .r = 0.0f, .g = 0.0f, .b = 0.0f },
+                    FOG_ALPHAS[run_level]
+                );
+            }
+            run_start = col;
+            run_level = level;
+        }
+    }
     return 0;
 }
 
-int map_occupied_at(map m, int x, int y) {
-    if (m->collision_grid == NULL) return 0;
-    if (x < 0 || y < 0 || x >= m->width || y >= m->height) return 1;
-    return m->collision_grid[x + y * m->width];
+static pathfinding_options map_path_options(map m) {
+    // Entities walk one axis at a time, so stick to 4-connected paths
+    pathfinding_options options = pathfinding_default_options();
+    options.terrain_costs = m->terrain_grid;
+    return options;
 }
 
 linked_list map_find_path(map m, integer_position from, integer_position to) {
-    return pathfinding_find_path(m->collision_grid, m->width, m->height, from, to);
+    pathfinding_options options = map_path_options(m);
+    return pathfinding_find_path(m->collision_grid, m->width, m->height, from, to, &options);
+}
+
+pathfinding_search map_begin_path_search(map m, integer_position from, integer_position to) {
+    pathfinding_options options = map_path_options(m);
+    return pathfinding_begin(m->collision_grid, m->width, m->height, from, to, &options);
+}
+
+static int prepare_vision(map m) {
+    size_t cell_count = (size_t) m->width * (size_t) m->height;
+    m->explored = (uint64_t *) calloc((cell_count + 63) / 64, sizeof(uint64_t));
+    if (m->explored == NULL) {
+        log_error("Failed to allocate memory for the explored cells of map '{s}'", m->map_id);
+        return 1;
+    }
+    // Viewers computed against a previous load of this map are stale
+    m->vision_version++;
+    if (m->vision_grid != NULL || m->collision_grid == NULL) return 0;
+
+    // Walls block sight unless the map says otherwise, kept in sync as collision chunks stream in
+    m->vision_grid = (int *) malloc(cell_count * sizeof(int));
+    if (m->vision_grid == NULL) {
+        log_error("Failed to allocate memory for the vision grid of map '{s}'", m->map_id);
+        return 1;
+    }
+    memcpy(m->vision_grid, m->collision_grid, cell_count * sizeof(int));
+    m->vision_from_collisions = 1;
+    return 0;
 }
 
 int map_load(map m) {
-    return load_map_config(m);
+    if (load_map_config(m) != 0) return 1;
+    if (build_tile_animation_lut(m) != 0) return 1;
+    if (compute_map_occlusion(m) != 0) return 1;
+    if (prepare_vision(m) != 0) return 1;
+
+    map_storage_statistics storage_stats = map_get_storage_stats(m);
+    log_info("Map '{s}' stores {zu} tiles in {zu} bytes ({f}x smaller than dense layers)", m->map_id, storage_stats.occupied_tiles, storage_stats.sparse_bytes, storage_stats.compression_ratio);
+    return 0;
 }
 
 struct destroy_asset_info_args_s {
@@ -546,16 +2527,62 @@ iteration_result destroy_asset_info(const hashtable_entry *entry, void *_args) {
     return ITERATION_CONTINUE;
 }
 
-iteration_result destroy_grid(const hashtable_entry *entry) {
+struct destroy_grid_args_s {
+    map map;
+    size_t chunk_count;
+};
+
+iteration_result destroy_grid(const hashtable_entry *entry, void *_args) {
+    struct destroy_grid_args_s *args = (struct destroy_grid_args_s *) _args;
     map_grid_info *grid_info = (map_grid_info*) entry->value;
-    free(grid_info->grid);
+    if (grid_info->chunks != NULL) {
+        for (size_t i = 0; i < args->chunk_count; i++) {
+            release_layer_chunk(args->map, &grid_info->chunks[i]);
+        }
+        free(grid_info->chunks);
+    }
+    free_chunk_edits(args->map, grid_info);
+    renderer_tilemap_destroy(grid_info->tilemap);
     free(grid_info);
     return ITERATION_CONTINUE;
 }
 
 int map_unload(map m) {
+    // Stop the loader first, its thread knows nothing about the grids freed below
+    map_chunk_loader_destroy(m->loader);
+    m->loader = NULL;
+    free(m->stream_layers);
+    m->stream_layers = NULL;
+    m->stream_layer_count = 0;
+    m->streaming = 0;
+
     free(m->collision_grid);
     m->collision_grid = NULL;
+    free(m->terrain_grid);
+    m->terrain_grid = NULL;
+    free(m->occluder_grid);
+    m->occluder_grid = NULL;
+    free(m->vision_grid);
+    m->vision_grid = NULL;
+    m->vision_from_collisions = 0;
+    free(m->explored);
+    m->explored = NULL;
+    m->top_layer = 0;
+    for (size_t i = 0; i < m->texture_count; i++) {
+        texture_destroy(m->textures[i]);
+    }
+    free(m->textures);
+    m->textures = NULL;
+    m->texture_count = 0;
+    renderer_tileset_destroy(m->tileset);
+    m->tileset = NULL;
+    free(m->animations);
+    m->animations = NULL;
+    m->animation_count = 0;
+    free(m->tile_animations);
+    m->tile_animations = NULL;
+    renderer_tile_animations_destroy(m->gpu_animations);
+    m->gpu_animations = NULL;
     if (m->asset_info != NULL) {
         struct destroy_asset_info_args_s destroy_asset_info_args = {
             .ctx = m->asset_mgr
@@ -565,28 +2592,28 @@ int map_unload(map m) {
         m->asset_info = NULL;
     }
     if (m->grids != NULL) {
-        hashtable_foreach(m->grids, destroy_grid);
+        struct destroy_grid_args_s destroy_grid_args = {
+            .map = m,
+            .chunk_count = (size_t) m->chunk_columns * (size_t) m->chunk_rows
+        };
+        hashtable_foreach_args(m->grids, destroy_grid, &destroy_grid_args);
         hashtable_destroy(m->grids);
         m->grids = NULL;
     }
+    free(m->chunks);
+    m->chunks = NULL;
+    m->chunk_columns = 0;
+    m->chunk_rows = 0;
+    m->resident_bytes = 0;
+    m->stats = (map_streaming_statistics) { 0 };
+    m->total_load_latency_ms = 0.0;
     return 0;
 }
 
-static iteration_result destroy_cached_texture(const hashtable_entry *entry) {
-    texture t = (texture) entry->value;
-    texture_destroy(t);
-    return ITERATION_CONTINUE;
-}
-
 void map_destroy(map m) {
     if (m == NULL) return;
     map_unload(m);
-    if (m->texture_cache != NULL) {
-        hashtable_foreach(m->texture_cache, destroy_cached_texture);
-        hashtable_destroy(m->texture_cache);
-    } 
     free(m->map_id);
-    free(m->texture_id_buffer);
     free(m);
 }
 
@@ -1,16 +1,99 @@
 #ifndef _H_MAP_H_
 #define _H_MAP_H_
 
+#include "ai/fov.h"
 #include "ai/pathfinding.h"
 #include "asset_manager.h"
 #include "renderer/renderer.h"
+#include "snapshot.h"
 
 typedef struct map_s *map;
 
+typedef enum map_render_mode {
+    // Per-chunk static batches with one instance per tile
+    MAP_RENDER_INSTANCED,
+    // One quad per layer, tiles are looked up from a tile id texture in the fragment shader
+    MAP_RENDER_TILEMAP
+} map_render_mode;
+
+// A snapshot's map section, checked against the map and pointing into the snapshot
+typedef struct map_state {
+    uint32_t explored_words, chunk_words, vision_words, edited_layers;
+    const unsigned char *explored, *resident_chunks, *vision;
+    // Tile edits section, from its layer count on
+    const unsigned char *edits;
+    size_t edits_size;
+} map_state;
+
+typedef struct map_render_statistics {
+    // Tiles in the chunks touching the camera during the last map_render
+    size_t drawn_tiles;
+    size_t culled_tiles;
+} map_render_statistics;
+
+typedef struct map_storage_statistics {
+    // Tile layers of the resident chunks, against what dense int cells would have taken
+    size_t tile_layers;
+    size_t occupied_tiles;
+    size_t dense_bytes;
+    size_t sparse_bytes;
+    double compression_ratio;
+} map_storage_statistics;
+
+typedef struct map_streaming_statistics {
+    int streaming;
+    size_t resident_chunks;
+    size_t pending_chunks;
+    size_t resident_bytes;
+    size_t memory_budget;
+    size_t loaded_chunks;
+    size_t evicted_chunks;
+    size_t failed_chunks;
+    double average_load_latency_ms;
+    double max_load_latency_ms;
+    double last_update_ms;
+    size_t hitches;
+    // Chunks inside the camera that weren't resident when last rendered
+    size_t missing_visible_chunks;
+} map_streaming_statistics;
+
 map map_create(asset_manager_ctx, const char *map_id);
-int map_render(map, renderer_ctx, unsigned int entity_layer_offset);
+// Layers from the player layer up are drawn one over, leaving map_get_entity_layer free for entities
+int map_render(map, renderer_ctx, double time);
+void map_update(map, float focus_x, float focus_y);
+void map_set_render_mode(map, map_render_mode);
+map_render_mode map_get_render_mode(map);
+const char *map_get_id(map);
+// Layer above the map's base layer that entities share, between the ground and what covers them
+unsigned int map_get_entity_layer(map);
+// Bytes of CPU memory held by the map's loaded state
+size_t map_get_memory_usage(map);
+map_render_statistics map_get_render_stats(map);
+map_streaming_statistics map_get_streaming_stats(map);
+map_storage_statistics map_get_storage_stats(map);
+void map_get_pixel_dimensions(map, int *out_width, int *out_height);
+void map_get_tile_dimensions(map, int *out_width, int *out_height);
+// Edits outlive evictions of streamed chunks, chunks not loaded yet get theirs once they are, and
+// snapshots keep them
+int map_set_tile(map, const char *layer_name, int x, int y, int tile_id);
 int map_occupied_at(map, int x, int y);
+// One cell per tile, non zero where it blocks. NULL until the map is loaded
+const int *map_get_collision_grid(map, int *out_width, int *out_height);
+integer_position map_get_cell_at(map, float x, float y);
+int map_blocks_sight(map, int x, int y);
+int map_set_blocks_sight(map, int x, int y, int blocks);
+int map_update_fov(map, fov_viewer, integer_position origin);
+void map_reveal(map, fov_viewer);
+int map_is_explored(map, int x, int y);
+// The state a level snapshot keeps of its map: which cells block sight, which have been explored and
+// the tiles set with map_set_tile
+int map_write_state(map, snapshot);
+// Reads and checks what map_write_state wrote, changing nothing but making room for its tile edits
+int map_parse_state(map, snapshot_reader *, map_state *out);
+void map_apply_state(map, const map_state *);
+int map_render_fog(map, renderer_ctx, fov_viewer);
 linked_list map_find_path(map, integer_position from, integer_position to);
+pathfinding_search map_begin_path_search(map, integer_position from, integer_position to);
 int map_load(map);
 int map_unload(map);
 void map_destroy(map);
@@ -0,0 +1,253 @@
+#include "map_chunk_loader.h"
+#include "config.h"
+#include "cjson/cJSON.h"
+#include "utils/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+struct map_chunk_loader_s {
+    char *chunk_directory;
+    // Immutable after creation, so the worker reads them without locking
+    char **layer_names;
+    size_t layer_count;
+
+    // FIFO rings of requested and finished payloads, nearest chunks are requested first.
+    // A payload sits in at most one of them, so neither can overflow while in_flight <= capacity
+    map_chunk_payload **requests, **completed;
+    size_t capacity, request_head, request_count, completed_head, completed_count;
+    size_t in_flight;
+
+    mtx_t lock;
+    cnd_t wake;
+    thrd_t thread;
+    int thread_started;
+    int stop;
+};
+
+void map_chunk_payload_destroy(map_chunk_payload *payload) {
+    if (payload == NULL) return;
+    if (payload->layers != NULL) {
+        for (size_t i = 0; i < payload->layer_count; i++) {
+            free(payload->layers[i]);
+        }
+        free(payload->layers);
+    }
+    free(payload);
+}
+
+static int *decode_chunk_layer(cJSON *layer_map) {
+    int *tiles = (int *) calloc(MAP_CHUNK_SIZE * MAP_CHUNK_SIZE, sizeof(int));
+    if (tiles == NULL) {
+        return NULL;
+    }
+
+    int row_index = 0;
+    cJSON *row = NULL, *col = NULL;
+    cJSON_ArrayForEach(row, layer_map) {
+        if (!cJSON_IsArray(row) || row_index >= MAP_CHUNK_SIZE) {
+            free(tiles);
+            return NULL;
+        }
+        int col_index = 0;
+        cJSON_ArrayForEach(col, row) {
+            if (!cJSON_IsNumber(col) || col_index >= MAP_CHUNK_SIZE) {
+                free(tiles);
+                return NULL;
+            }
+            tiles[row_index * MAP_CHUNK_SIZE + col_index++] = (int) cJSON_GetNumberValue(col);
+        }
+        row_index++;
+    }
+    return tiles;
+}
+
+static char *get_chunk_path(map_chunk_loader loader, int chunk_col, int chunk_row) {
+    int length = snprintf(NULL, 0, "%s/%d_%d.json", loader->chunk_directory, chunk_col, chunk_row);
+    char *path = (char *) malloc((size_t) length + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+    snprintf(path, (size_t) length + 1, "%s/%d_%d.json", loader->chunk_directory, chunk_col, chunk_row);
+    return path;
+}
+
+static void load_chunk(map_chunk_loader loader, map_chunk_payload *payload) {
+    char *path = get_chunk_path(loader, payload->chunk_col, payload->chunk_row);
+    if (path == NULL) {
+        payload->failed = 1;
+        return;
+    }
+    char *contents = utils_read_whole_file(path);
+    free(path);
+    if (contents == NULL) {
+        payload->failed = 1;
+        return;
+    }
+    cJSON *chunk_json = cJSON_Parse(contents);
+    free(contents);
+    cJSON *layers = cJSON_GetObjectItem(chunk_json, "layers");
+    if (layers == NULL || !cJSON_IsObject(layers)) {
+        payload->failed = 1;
+        cJSON_Delete(chunk_json);
+        return;
+    }
+
+    for (size_t i = 0; i < loader->layer_count; i++) {
+        cJSON *layer_map = cJSON_GetObjectItem(layers, loader->layer_names[i]);
+        if (layer_map == NULL) continue;
+        if (!cJSON_IsArray(layer_map) || (payload->layers[i] = decode_chunk_layer(layer_map)) == NULL) {
+            payload->failed = 1;
+            break;
+        }
+    }
+    cJSON_Delete(chunk_json);
+}
+
+static int loader_worker(void *_loader) {
+    map_chunk_loader loader = (map_chunk_loader) _loader;
+    mtx_lock(&loader->lock);
+    while (1) {
+        while (!loader->stop && loader->request_count == 0) {
+            cnd_wait(&loader->wake, &loader->lock);
+        }
+        if (loader->stop) break;
+
+        map_chunk_payload *payload = loader->requests[loader->request_head];
+        loader->request_head = (loader->request_head + 1) % loader->capacity;
+        loader->request_count--;
+        mtx_unlock(&loader->lock);
+
+        // Parsing happens outside the lock so the main thread never waits on disk
+        load_chunk(loader, payload);
+        payload->completed_at = utils_get_time();
+
+        mtx_lock(&loader->lock);
+        loader->completed[(loader->completed_head + loader->completed_count) % loader->capacity] = payload;
+        loader->completed_count++;
+    }
+    mtx_unlock(&loader->lock);
+    return 0;
+}
+
+map_chunk_loader map_chunk_loader_create(const char *chunk_directory, const char *const *layer_names, size_t layer_count, size_t max_requests) {
+    map_chunk_loader loader = (map_chunk_loader) calloc(1, sizeof(struct map_chunk_loader_s));
+    if (loader == NULL) {
+        return NULL;
+    }
+    if (mtx_init(&loader->lock, mtx_plain) != thrd_success) {
+        free(loader);
+        return NULL;
+    }
+    if (cnd_init(&loader->wake) != thrd_success) {
+        mtx_destroy(&loader->lock);
+        free(loader);
+        return NULL;
+    }
+
+    loader->chunk_directory = utils_copy_string(chunk_directory);
+    loader->layer_names = (char **) calloc(layer_count, sizeof(char *));
+    loader->capacity = max_requests > 0 ? max_requests : 1;
+    loader->requests = (map_chunk_payload **) malloc(loader->capacity * sizeof(map_chunk_payload *));
+    loader->completed = (map_chunk_payload **) malloc(loader->capacity * sizeof(map_chunk_payload *));
+    if (loader->chunk_directory == NULL || loader->layer_names == NULL || loader->requests == NULL || loader->completed == NULL) {
+        map_chunk_loader_destroy(loader);
+        return NULL;
+    }
+    loader->layer_count = layer_count;
+    for (size_t i = 0; i < layer_count; i++) {
+        loader->layer_names[i] = utils_copy_string(layer_names[i]);
+        if (loader->layer_names[i] == NULL) {
+            map_chunk_loader_destroy(loader);
+            return NULL;
+        }
+    }
+
+    if (thrd_create(&loader->thread, loader_worker, loader) != thrd_success) {
+        map_chunk_loader_destroy(loader);
+        return NULL;
+    }
+    loader->thread_started = 1;
+    return loader;
+}
+
+int map_chunk_loader_request(map_chunk_loader loader, int chunk_col, int chunk_row) {
+    // Allocated here so the worker never has to report an allocation failure
+    map_chunk_payload *payload = (map_chunk_payload *) calloc(1, sizeof(map_chunk_payload));
+    if (payload == NULL) {
+        return 1;
+    }
+    payload->layers = (int **) calloc(loader->layer_count, sizeof(int *));
+    if (payload->layers == NULL) {
+        free(payload);
+        return 1;
+    }
+    payload->layer_count = loader->layer_count;
+    payload->chunk_col = chunk_col;
+    payload->chunk_row = chunk_row;
+    payload->requested_at = utils_get_time();
+
+    mtx_lock(&loader->lock);
+    if (loader->in_flight == loader->capacity) {
+        mtx_unlock(&loader->lock);
+        map_chunk_payload_destroy(payload);
+        return 1;
+    }
+    loader->requests[(loader->request_head + loader->request_count) % loader->capacity] = payload;
+    loader->request_count++;
+    loader->in_flight++;
+    cnd_signal(&loader->wake);
+    mtx_unlock(&loader->lock);
+    return 0;
+}
+
+map_chunk_payload *map_chunk_loader_poll(map_chunk_loader loader) {
+    // Never blocks on the worker, it only holds the lock to move a pointer around
+    mtx_lock(&loader->lock);
+    map_chunk_payload *payload = NULL;
+    if (loader->completed_count > 0) {
+        payload = loader->completed[loader->completed_head];
+        loader->completed_head = (loader->completed_head + 1) % loader->capacity;
+        loader->completed_count--;
+        loader->in_flight--;
+    }
+    mtx_unlock(&loader->lock);
+    return payload;
+}
+
+size_t map_chunk_loader_pending(map_chunk_loader loader) {
+    mtx_lock(&loader->lock);
+    size_t pending = loader->in_flight;
+    mtx_unlock(&loader->lock);
+    return pending;
+}
+
+void map_chunk_loader_destroy(map_chunk_loader loader) {
+    if (loader == NULL) return;
+    if (loader->thread_started) {
+        mtx_lock(&loader->lock);
+        loader->stop = 1;
+        cnd_signal(&loader->wake);
+        mtx_unlock(&loader->lock);
+        thrd_join(loader->thread, NULL);
+    }
+    for (size_t i = 0; i < loader->request_count; i++) {
+        map_chunk_payload_destroy(loader->requests[(loader->request_head + i) % loader->capacity]);
+    }
+    for (size_t i = 0; i < loader->completed_count; i++) {
+        map_chunk_payload_destroy(loader->completed[(loader->completed_head + i) % loader->capacity]);
+    }
+    if (loader->layer_names != NULL) {
+        for (size_t i = 0; i < loader->layer_count; i++) {
+            free(loader->layer_names[i]);
+        }
+        free(loader->layer_names);
+    }
+    free(loader->requests);
+    free(loader->completed);
+    free(loader->chunk_directory);
+    cnd_destroy(&loader->wake);
+    mtx_destroy(&loader->lock);
+    free(loader);
+}
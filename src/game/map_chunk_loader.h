@@ -0,0 +1,26 @@
+#ifndef _H_MAP_CHUNK_LOADER_H_
+#define _H_MAP_CHUNK_LOADER_H_
+
+#include <stddef.h>
+
+typedef struct map_chunk_loader_s *map_chunk_loader;
+
+typedef struct map_chunk_payload {
+    int chunk_col, chunk_row;
+    // One MAP_CHUNK_SIZE * MAP_CHUNK_SIZE array per layer name given to the loader,
+    // NULL where the chunk file doesn't have that layer
+    int **layers;
+    size_t layer_count;
+    double requested_at, completed_at;
+    int failed;
+} map_chunk_payload;
+
+map_chunk_loader map_chunk_loader_create(const char *chunk_directory, const char *const *layer_names, size_t layer_count, size_t max_requests);
+int map_chunk_loader_request(map_chunk_loader, int chunk_col, int chunk_row);
+map_chunk_payload *map_chunk_loader_poll(map_chunk_loader);
+size_t map_chunk_loader_pending(map_chunk_loader);
+void map_chunk_loader_destroy(map_chunk_loader);
+
+void map_chunk_payload_destroy(map_chunk_payload *);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _H_MAP_FORMAT_H_
+#define _H_MAP_FORMAT_H_
+
+// Layout of compiled .map.bin files, written by scripts/compile_map.py. Every integer is
+// little-endian and every offset is relative to the start of the file.
+//
+// header:      char magic[4], u16 version, u16 reserved,
+//              i32 width, height, tilewidth, tileheight, player_layer (-1 for none),
+//              u32 asset_count, layer_count, strings_offset, strings_size, animation_count
+// assets:      asset_count entries of u32 name, i32 min_id, i32 max_id
+// layers:      layer_count entries of u32 name, i32 layer, u8 flags, u8 encoding, u16 reserved,
+//              u32 data_offset, u32 data_size
+// animations:  animation_count entries of i32 base_id, i32 frame_count, i32 stride, i32 interval (ms)
+// strings:     NUL-terminated names, referenced by their offset into this block
+// layer data:  width * height u16 cells in row-major order, either raw or as (u16 count, u16 value) runs
+
+#define MAP_BINARY_MAGIC "TMAP"
+#define MAP_BINARY_VERSION 2
+
+#define MAP_BINARY_HEADER_SIZE 48
+#define MAP_BINARY_ASSET_SIZE 12
+#define MAP_BINARY_LAYER_SIZE 20
+#define MAP_BINARY_ANIMATION_SIZE 16
+
+typedef enum map_binary_layer_flag {
+    MAP_BINARY_LAYER_COLLISIONS = 1 << 0,
+    MAP_BINARY_LAYER_VISION = 1 << 1,
+    MAP_BINARY_LAYER_ENTITIES = 1 << 2,
+    MAP_BINARY_LAYER_TRANSPARENT = 1 << 3,
+    MAP_BINARY_LAYER_TERRAIN = 1 << 4
+} map_binary_layer_flag;
+
+typedef enum map_binary_encoding {
+    MAP_BINARY_ENCODING_RAW,
+    MAP_BINARY_ENCODING_RLE
+} map_binary_encoding;
+
+#endif
@@ -0,0 +1,210 @@
+#include "snapshot.h"
+#include "logger/logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+// An op header takes 12 bytes, so matches have to be longer than that to be worth switching to
+#define SNAPSHOT_DELTA_MIN_MATCH 16
+// How far a stretch may have moved in the base and still be found, enough for a few path steps
+#define SNAPSHOT_DELTA_MAX_SHIFT 64
+#define SNAPSHOT_DELTA_MIN_SHIFTED_MATCH 64
+
+struct snapshot_s {
+    unsigned char *data;
+    size_t size, capacity;
+};
+
+snapshot snapshot_create() {
+    return (snapshot) calloc(1, sizeof(struct snapshot_s));
+}
+
+void snapshot_clear(snapshot s) {
+    s->size = 0;
+}
+
+unsigned char *snapshot_extend(snapshot s, size_t size) {
+    if (s->data == NULL || size > s->capacity - s->size) {
+        size_t capacity = s->capacity ? s->capacity : 4096;
+        while (capacity - s->size < size) capacity *= 2;
+        unsigned char *data = (unsigned char *) realloc(s->data, capacity);
+        if (data == NULL) {
+            log_error("Failed to grow snapshot to {zu} bytes", capacity);
+            return NULL;
+        }
+        s->data = data;
+        s->capacity = capacity;
+    }
+    unsigned char *start = s->data + s->size;
+    s->size += size;
+    return start;
+}
+
+int snapshot_write(snapshot s, const void *data, size_t size) {
+    if (size == 0) return 0;
+    unsigned char *out = snapshot_extend(s, size);
+    if (out == NULL) return 1;
+    memcpy(out, data, size);
+    return 0;
+}
+
+const unsigned char *snapshot_get_data(snapshot s, size_t *out_size) {
+    *out_size = s->size;
+    return s->data;
+}
+
+int snapshot_set_data(snapshot s, const unsigned char *data, size_t size) {
+    snapshot_clear(s);
+    return snapshot_write(s, data, size);
+}
+
+snapshot_reader snapshot_begin_read(snapshot s) {
+    if (s->data == NULL) return (snapshot_reader) { .cursor = NULL, .end = NULL };
+    return (snapshot_reader) { .cursor = s->data, .end = s->data + s->size };
+}
+
+const unsigned char *snapshot_read(snapshot_reader *reader, size_t size) {
+    if (size > (size_t) (reader->end - reader->cursor)) return NULL;
+    const unsigned char *start = reader->cursor;
+    reader->cursor += size;
+    return start;
+}
+
+int snapshot_read_value(snapshot_reader *reader, void *out, size_t size) {
+    const unsigned char *bytes = snapshot_read(reader, size);
+    if (bytes == NULL) return 1;
+    memcpy(out, bytes, size);
+    return 0;
+}
+
+static size_t match_length(snapshot base, size_t base_position, snapshot target, size_t position) {
+    if (base_position >= base->size) return 0;
+    size_t length = 0, limit = base->size - base_position < target->size - position ? base->size - base_position : target->size - position;
+    const unsigned char *a = base->data + base_position, *b = target->data + position;
+    // A word at a time through the long stretches nothing touched
+    while (length + 8 <= limit && memcmp(a + length, b + length, 8) == 0) length += 8;
+    while (length < limit && a[length] == b[length]) length++;
+    return length;
+}
+
+// Whether the target picks up again at position, with the base shift bytes further along
+static int matches_at(snapshot base, snapshot target, size_t position, ptrdiff_t shift, size_t length) {
+    if (shift < 0 && (size_t) -shift > position) return 0;
+    size_t base_position = position + (size_t) shift;
+    if (length > target->size - position) length = target->size - position;
+    if (base_position > base->size || length > base->size - base_position) return 0;
+    return memcmp(base->data + base_position, target->data + position, length) == 0;
+}
+
+static int write_u32(snapshot s, uint32_t value) {
+    return snapshot_write(s, &value, sizeof(value));
+}
+
+int snapshot_encode_delta(snapshot base, snapshot target, snapshot delta) {
+    if (base->size > UINT32_MAX || target->size > UINT32_MAX) {
+        log_error("Failed to encode snapshot delta: snapshots over 4GB");
+        return 1;
+    }
+    snapshot_clear(delta);
+    uint16_t version = SNAPSHOT_VERSION, reserved = 0;
+    if (snapshot_write(delta, SNAPSHOT_DELTA_MAGIC, 4) != 0
+        || snapshot_write(delta, &version, sizeof(version)) != 0
+        || snapshot_write(delta, &reserved, sizeof(reserved)) != 0
+        || write_u32(delta, (uint32_t) base->size) != 0
+        || write_u32(delta, (uint32_t) target->size) != 0) {
+        return 1;
+    }
+
+    // Where the base lines up with the target. Paths that lost a step move everything after them
+    ptrdiff_t shift = 0;
+    size_t position = 0;
+    while (position < target->size) {
+        size_t copy_from = position + (size_t) shift;
+        size_t copy_length = match_length(base, copy_from, target, position);
+        position += copy_length;
+
+        size_t literal_start = position;
+        for (; position < target->size; position++) {
+            if (matches_at(base, target, position, shift, SNAPSHOT_DELTA_MIN_MATCH)) break;
+            // Moving takes a longer match, runs of zeroes line up anywhere. Looking every few bytes keeps
+            // scattered changes cheap to encode, at worst a couple more literals
+            if ((position - literal_start) % 4 != 0) continue;
+            int found = 0;
+            for (ptrdiff_t offset = 8; offset <= SNAPSHOT_DELTA_MAX_SHIFT && !found; offset += 8) {
+                if (matches_at(base, target, position, shift - offset, SNAPSHOT_DELTA_MIN_SHIFTED_MATCH)) shift -= offset, found = 1;
+                else if (matches_at(base, target, position, shift + offset, SNAPSHOT_DELTA_MIN_SHIFTED_MATCH)) shift += offset, found = 1;
+            }
+            if (found) break;
+        }
+
+        if (copy_length == 0 && position == literal_start) continue;
+        if (write_u32(delta, (uint32_t) (copy_length > 0 ? copy_from : 0)) != 0
+            || write_u32(delta, (uint32_t) copy_length) != 0
+            || write_u32(delta, (uint32_t) (position - literal_start)) != 0
+            || snapshot_write(delta, target->data + literal_start, position - literal_start) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int snapshot_apply_delta(snapshot base, snapshot delta, snapshot target) {
+    if (target == base || target == delta) {
+        log_error("Failed to apply snapshot delta: the target can't be one of its inputs");
+        return 1;
+    }
+    snapshot_reader reader = snapshot_begin_read(delta);
+    const unsigned char *magic = snapshot_read(&reader, 4);
+    uint16_t version = 0, reserved = 0;
+    uint32_t base_size = 0, target_size = 0;
+    if (magic == NULL || memcmp(magic, SNAPSHOT_DELTA_MAGIC, 4) != 0
+        || snapshot_read_value(&reader, &version, sizeof(version)) != 0
+        || snapshot_read_value(&reader, &reserved, sizeof(reserved)) != 0
+        || snapshot_read_value(&reader, &base_size, sizeof(base_size)) != 0
+        || snapshot_read_value(&reader, &target_size, sizeof(target_size)) != 0) {
+        log_error("Failed to apply snapshot delta: not a delta");
+        return 1;
+    }
+    if (version != SNAPSHOT_VERSION) {
+        log_error("Failed to apply snapshot delta: unsupported version {d}", (int) version);
+        return 1;
+    }
+    if (base_size != base->size) {
+        log_error("Failed to apply snapshot delta: encoded against {zu} bytes, base has {zu}", (size_t) base_size, base->size);
+        return 1;
+    }
+
+    snapshot_clear(target);
+    unsigned char *out = snapshot_extend(target, target_size);
+    if (out == NULL) return 1;
+    size_t position = 0;
+    while (reader.cursor < reader.end) {
+        uint32_t copy_from = 0, copy_length = 0, literal_length = 0;
+        if (snapshot_read_value(&reader, &copy_from, sizeof(copy_from)) != 0
+            || snapshot_read_value(&reader, &copy_length, sizeof(copy_length)) != 0
+            || snapshot_read_value(&reader, &literal_length, sizeof(literal_length)) != 0) {
+            log_error("Failed to apply snapshot delta: truncated op");
+            return 1;
+        }
+        const unsigned char *literals = snapshot_read(&reader, literal_length);
+        if (literals == NULL || copy_from > base_size || copy_length > base_size - copy_from
+            || (size_t) copy_length + literal_length > target_size - position) {
+            log_error("Failed to apply snapshot delta: op out of bounds");
+            return 1;
+        }
+        if (copy_length > 0) memcpy(out + position, base->data + copy_from, copy_length);
+        position += copy_length;
+        if (literal_length > 0) memcpy(out + position, literals, literal_length);
+        position += literal_length;
+    }
+    if (position != target_size) {
+        log_error("Failed to apply snapshot delta: rebuilt {zu} of {zu} bytes", position, (size_t) target_size);
+        return 1;
+    }
+    return 0;
+}
+
+void snapshot_destroy(snapshot s) {
+    if (s == NULL) return;
+    free(s->data);
+    free(s);
+}
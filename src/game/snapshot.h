@@ -0,0 +1,58 @@
+#ifndef _H_SNAPSHOT_H_
+#define _H_SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Level state written by level_write_snapshot. Values are in the byte order of the machine that wrote
+// them, which the header records, and entity state is stored a column at a time like the storage.
+//
+// header:    char magic[4], u16 version, u16 byte_order (SNAPSHOT_BYTE_ORDER as written)
+// level:     u32 length, char id[length], u32 AI scheduler tick
+// map:       i32 width, height, u32 word_count, u64 explored[word_count], u32 chunk_word_count,
+//            u64 resident_chunks[chunk_word_count], u32 word_count, u64 blocks_sight[word_count] (0 outside resident
+//            chunks), u32 edited_layers, edited_layers entries of u32 length, char name[length] (with its terminator),
+//            u32 n, u32 cell[n] (x + y * width), u16 tile_id[n]
+// entities:  u32 spawned (seeds the next instance's random state), the player's rows (none without a player),
+//            everyone else's rows, u32 archetype_count, archetype_count entries of u32 length, char id[length]
+// rows:      u32 n, u16 archetype[n], f32 position_x[n], position_y[n], velocity_x[n], velocity_y[n],
+//            u8 facing[n], flags[n], state[n], i32 goal[n][2], immediate_goal[n][2],
+//            u32 random[n], think_tick[n] (less the AI tick with the top bit flipped, 0 if never), i32 hitpoints[n],
+//            u32 path_length[n], i32 path[sum of path_length][2]
+//
+// A delta rebuilds a snapshot from an earlier one, appending what each op copies and then its literals:
+//
+// header:    char magic[4], u16 version, u16 reserved, u32 base_size, u32 target_size
+// ops:       until the end, u32 copy_from, u32 copy_length (bytes of the base), u32 literal_length, u8 literals[literal_length]
+
+#define SNAPSHOT_MAGIC "TSNP"
+#define SNAPSHOT_DELTA_MAGIC "TSND"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_BYTE_ORDER 0x0102
+
+typedef struct snapshot_s *snapshot;
+
+typedef struct snapshot_reader {
+    const unsigned char *cursor, *end;
+} snapshot_reader;
+
+snapshot snapshot_create();
+void snapshot_clear(snapshot);
+// Grows the snapshot by size bytes and returns where they go, NULL when out of memory
+unsigned char *snapshot_extend(snapshot, size_t size);
+int snapshot_write(snapshot, const void *data, size_t size);
+const unsigned char *snapshot_get_data(snapshot, size_t *out_size);
+// Replaces the contents, e.g. with a save read back from disk
+int snapshot_set_data(snapshot, const unsigned char *data, size_t size);
+// The reader borrows the snapshot's bytes, valid until it is next written
+snapshot_reader snapshot_begin_read(snapshot);
+// Returns the next size bytes and moves past them, NULL when fewer are left
+const unsigned char *snapshot_read(snapshot_reader *, size_t size);
+int snapshot_read_value(snapshot_reader *, void *out, size_t size);
+// Replaces delta with what changed from base to target, mostly op headers when little did
+int snapshot_encode_delta(snapshot base, snapshot target, snapshot delta);
+// Replaces target with the snapshot the delta was encoded from, given the same base
+int snapshot_apply_delta(snapshot base, snapshot delta, snapshot target);
+void snapshot_destroy(snapshot);
+
+#endif
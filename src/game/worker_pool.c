@@ -0,0 +1,163 @@
+#include "worker_pool.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Batches handed out per thread, more than one so a slow batch doesn't hold everyone back
+#define BATCHES_PER_THREAD 4
+
+struct worker_pool_s {
+    thrd_t *threads;
+    int thread_count, started;
+
+    mtx_t lock;
+    cnd_t wake, done;
+    // Bumped for every job so sleeping workers can tell a new one from a spurious wakeup
+    unsigned long generation;
+    int busy, stop;
+
+    // Current job, only written while no worker is busy
+    worker_pool_job job;
+    void *args;
+    size_t count, batch;
+    atomic_size_t next;
+};
+
+static void run_batches(worker_pool pool) {
+    size_t begin;
+    while ((begin = atomic_fetch_add(&pool->next, pool->batch)) < pool->count) {
+        size_t end = begin + pool->batch < pool->count ? begin + pool->batch : pool->count;
+        pool->job(pool->args, begin, end);
+    }
+}
+
+static int pool_worker(void *_pool) {
+    worker_pool pool = (worker_pool) _pool;
+    unsigned long seen = 0;
+    mtx_lock(&pool->lock);
+    while (1) {
+        while (!pool->stop && pool->generation == seen) {
+            cnd_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop) break;
+        seen = pool->generation;
+        mtx_unlock(&pool->lock);
+
+        run_batches(pool);
+
+        mtx_lock(&pool->lock);
+        if (--pool->busy == 0) cnd_signal(&pool->done);
+    }
+    mtx_unlock(&pool->lock);
+    return 0;
+}
+
+int worker_pool_get_core_count(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    long cores = (long) system_info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    long cores = 1;
+#endif
+    return cores > 0 ? (int) cores : 1;
+}
+
+worker_pool worker_pool_create(int thread_count) {
+    if (thread_count <= 0) {
+        thread_count = worker_pool_get_core_count();
+    }
+    worker_pool pool = (worker_pool) calloc(1, sizeof(struct worker_pool_s));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->thread_count = thread_count;
+    if (mtx_init(&pool->lock, mtx_plain) != thrd_success) {
+        free(pool);
+        return NULL;
+    }
+    if (cnd_init(&pool->wake) != thrd_success) {
+        mtx_destroy(&pool->lock);
+        free(pool);
+        return NULL;
+    }
+    if (cnd_init(&pool->done) != thrd_success) {
+        cnd_destroy(&pool->wake);
+        mtx_destroy(&pool->lock);
+        free(pool);
+        return NULL;
+    }
+
+    // The calling thread is the first worker
+    if (thread_count > 1) {
+        pool->threads = (thrd_t *) malloc((size_t) (thread_count - 1) * sizeof(thrd_t));
+        if (pool->threads == NULL) {
+            worker_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < thread_count - 1; i++) {
+        if (thrd_create(&pool->threads[i], pool_worker, pool) != thrd_success) {
+            worker_pool_destroy(pool);
+            return NULL;
+        }
+        pool->started++;
+    }
+    return pool;
+}
+
+int worker_pool_get_thread_count(worker_pool pool) {
+    return pool->thread_count;
+}
+
+void worker_pool_run(worker_pool pool, size_t count, size_t min_batch, worker_pool_job job, void *args) {
+    if (count == 0) return;
+    if (pool->started == 0 || count <= min_batch) {
+        job(args, 0, count);
+        return;
+    }
+
+    size_t batch = count / ((size_t) pool->thread_count * BATCHES_PER_THREAD);
+    mtx_lock(&pool->lock);
+    pool->job = job;
+    pool->args = args;
+    pool->count = count;
+    pool->batch = batch > min_batch ? batch : (min_batch > 0 ? min_batch : 1);
+    atomic_store(&pool->next, 0);
+    pool->busy = pool->started;
+    pool->generation++;
+    cnd_broadcast(&pool->wake);
+    mtx_unlock(&pool->lock);
+
+    run_batches(pool);
+
+    mtx_lock(&pool->lock);
+    while (pool->busy > 0) {
+        cnd_wait(&pool->done, &pool->lock);
+    }
+    mtx_unlock(&pool->lock);
+}
+
+void worker_pool_destroy(worker_pool pool) {
+    if (pool == NULL) return;
+    mtx_lock(&pool->lock);
+    pool->stop = 1;
+    cnd_broadcast(&pool->wake);
+    mtx_unlock(&pool->lock);
+    for (int i = 0; i < pool->started; i++) {
+        thrd_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    cnd_destroy(&pool->done);
+    cnd_destroy(&pool->wake);
+    mtx_destroy(&pool->lock);
+    free(pool);
+}
@@ -0,0 +1,22 @@
+#ifndef _H_WORKER_POOL_H_
+#define _H_WORKER_POOL_H_
+
+#include <stddef.h>
+
+// Fixed set of threads splitting a range of indices between them. The calling thread takes
+// its share too, so a pool of one thread runs every job inline
+typedef struct worker_pool_s *worker_pool;
+
+// Processes [begin, end). Called concurrently on disjoint ranges
+typedef void (*worker_pool_job)(void *args, size_t begin, size_t end);
+
+// Online cores, at least 1
+int worker_pool_get_core_count(void);
+// 0 threads means one per online core
+worker_pool worker_pool_create(int thread_count);
+int worker_pool_get_thread_count(worker_pool);
+// Returns once the whole range has been processed. Ranges smaller than min_batch stay on the calling thread
+void worker_pool_run(worker_pool, size_t count, size_t min_batch, worker_pool_job, void *args);
+void worker_pool_destroy(worker_pool);
+
+#endif
@@ -22,6 +22,8 @@ struct texture_s {
     GLuint asset_id;
     int width, height, offset_x, offset_y;
     float vertices[16];
+    // Every pixel is fully opaque, so the texture hides whatever is drawn behind it
+    int opaque;
 };
 
 static int asset_printer_fn(FILE *stream, const char *, va_list args) {
@@ -155,6 +157,15 @@ int asset_to_gpu(asset a) {
     return 0;
 }
 
+int asset_to_gpu_headless(asset a) {
+    // Far above anything glGenTextures hands out, textures find their asset by this id
+    static GLuint next_headless_id = 0x80000000u;
+    if (!a || !a->pixels) return 1;
+    a->id = next_headless_id++;
+    a->flags |= ASSET_GPU_LOADED | ASSET_HEADLESS;
+    return 0;
+}
+
 int asset_get_height(asset a) {
     return a->height;
 }
@@ -165,9 +176,20 @@ int asset_get_width(asset a) {
 
 void asset_gpu_cleanup(asset a) {
     if (!asset_is_gpu_loaded(a)) return;
-    glDeleteTextures(1, &a->id);
+    if (!(a->flags & ASSET_HEADLESS)) glDeleteTextures(1, &a->id);
     a->id = 0;
-    a->flags &= ~ASSET_GPU_LOADED;
+    a->flags &= ~(ASSET_GPU_LOADED | ASSET_HEADLESS);
+}
+
+static int is_region_opaque(asset a, int width, int height, int offset_x, int offset_y) {
+    // Pixels are always loaded as RGBA
+    for (int y = offset_y; y < offset_y + height; y++) {
+        const unsigned char *row = a->pixels + ((size_t) y * (size_t) a->width + (size_t) offset_x) * 4;
+        for (int x = 0; x < width; x++) {
+            if (row[x * 4 + 3] != 255) return 0;
+        }
+    }
+    return 1;
 }
 
 texture texture_from_asset(asset a, int width, int height, int offset_x, int offset_y) {
@@ -208,6 +230,7 @@ texture texture_from_asset(asset a, int width, int height, int offset_x, int off
         0.0f, 0.0f, u0, v1
     };
     memcpy(t->vertices, vertices, sizeof(vertices));
+    t->opaque = a->pixels != NULL && width > 0 && height > 0 && offset_x >= 0 && offset_y >= 0 && is_region_opaque(a, width, height, offset_x, offset_y);
 
     return t;
 }
@@ -232,6 +255,10 @@ int texture_get_offset_y(texture t) {
     return t->offset_y;
 }
 
+int texture_is_opaque(texture t) {
+    return t->opaque;
+}
+
 void texture_get_vertices(texture t, float vertices[16]) {
     memcpy(vertices, t->vertices, sizeof(t->vertices));
 }
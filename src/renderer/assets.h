@@ -4,7 +4,8 @@
 enum asset_flags_e {
     ASSET_PERMANENT     = 0b00000001,
     ASSET_TILED         = 0b00000010,
-    ASSET_GPU_LOADED    = 0b00000100
+    ASSET_GPU_LOADED    = 0b00000100,
+    ASSET_HEADLESS      = 0b00001000
 };
 
 typedef struct asset_s* asset;
@@ -15,6 +16,8 @@ int asset_is_gpu_loaded(asset);
 int asset_is_permanent(asset);
 int asset_is_tiled(asset);
 int asset_to_gpu(asset);
+// Stands in for asset_to_gpu without a GL context: the asset gets a unique id but nothing is uploaded
+int asset_to_gpu_headless(asset);
 int asset_get_height(asset);
 int asset_get_width(asset);
 unsigned int asset_get_id(asset);
@@ -28,6 +31,7 @@ int texture_get_height(texture);
 int texture_get_width(texture);
 int texture_get_offset_x(texture);
 int texture_get_offset_y(texture);
+int texture_is_opaque(texture);
 void texture_get_vertices(texture, float vertices[16]);
 void texture_destroy(texture);
 void texture_register_log_printer();
@@ -49,6 +49,10 @@ static const float LINE_QUAD_VERTS[] = {
     -0.5f,  0.5f
 };
 static const unsigned LINE_IDX[] = { 0, 1, 2, 0, 2, 3 };
+// Tile ids are laid out in rows of this many texels in a tileset's lookup textures
+static const int TILESET_LUT_WIDTH = 256;
+// Marks tile ids with no texture in the atlas index lookup
+static const unsigned char TILESET_NO_ATLAS = 0xFF;
 
 typedef struct batch_renderer_data {
     GLuint shader_program;
@@ -63,6 +67,8 @@ typedef struct gl_texture_instance {
     float w, h;
     float u0, v0, u1, v1;
     float z;
+    // Row of the bound tile animation table, negative for static textures
+    float animation;
 } gl_texture_instance;
 
 typedef struct texture_renderer_data {
@@ -75,14 +81,76 @@ typedef struct texture_renderer_data {
     GLint uPanLoc; 
     GLint uColorLoc;
     GLint uAlphaClipLoc;
+    GLint uDepthOffsetLoc;
+    GLint uAnimationsLoc;
+    GLint uTimeLoc;
 } texture_renderer_data;
 
+// Instances that share a texture inside a static batch, with their own GPU buffer
+typedef struct static_batch_group {
+    GLuint texture;
+    GLuint vertex_array_buffer, instance_vertex_buffer_object;
+    gl_texture_instance *instances;
+    size_t instance_count, capacity;
+    size_t uploaded_count;
+    int dirty;
+} static_batch_group;
+
+struct renderer_static_batch_s {
+    renderer_ctx ctx;
+    static_batch_group *groups;
+    size_t group_count, group_capacity;
+};
+
+// One row per animation: (frame count, interval in ms) followed by the UV rectangle of each frame
+struct renderer_tile_animations_s {
+    GLuint texture;
+    float *rows;
+    size_t animation_count, max_frames;
+    int dirty;
+};
+
+// Id -> UV rectangle lookup shared by every tilemap drawn with the same tiles
+struct renderer_tileset_s {
+    GLuint uv_texture, atlas_index_texture, animation_index_texture;
+    GLuint *atlases;
+    size_t atlas_count;
+};
+
+struct renderer_tilemap_s {
+    renderer_tileset tileset;
+    GLuint tile_id_texture;
+    int columns, rows;
+    int tile_width, tile_height;
+};
+
+typedef struct tilemap_renderer_data {
+    batch_renderer_data base_data;
+
+    // Uniforms
+    GLint uScreenLoc;
+    GLint uPanLoc;
+    GLint uMapSizeLoc;
+    GLint uDepthLoc;
+    GLint uAtlasLoc;
+    GLint uTileIdsLoc;
+    GLint uTileUVsLoc;
+    GLint uTileAtlasesLoc;
+    GLint uTileSizeLoc;
+    GLint uLutWidthLoc;
+    GLint uAtlasIndexLoc;
+    GLint uAlphaClipLoc;
+    GLint uTileAnimationsLoc;
+    GLint uAnimationsLoc;
+    GLint uTimeLoc;
+} tilemap_renderer_data;
+
 typedef struct gl_line_instance {
     float start_x, start_y;
     float dir_x, dir_y;
     float length;
     float width;
-    float r, g, b;
+    float r, g, b, a;
     float z;
 } gl_line_instance;
 
@@ -100,6 +168,7 @@ struct renderer_ctx_s {
 
     texture_renderer_data texture_renderer_data; 
     line_renderer_data line_renderer_data; 
+    tilemap_renderer_data tilemap_renderer_data;
 
     unsigned int layer;
     float layer_step;
@@ -130,6 +199,10 @@ struct renderer_ctx_s {
     size_t drawn_instances, last_drawn_instances;
 
     blending_mode blending_mode;
+
+    // Used by static batches and tilemaps drawn until it's replaced
+    renderer_tile_animations tile_animations;
+    float animation_time;
 };
 
 typedef struct input_callbacks {
@@ -348,6 +421,25 @@ static GLint get_uniform_location(GLuint shader_program, const char* name) {
     return result;
 }
 
+// Points the per-instance attributes at the currently bound GL_ARRAY_BUFFER
+static void bind_texture_instance_attributes() {
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(gl_texture_instance), (void*) offsetof(gl_texture_instance, x));
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(gl_texture_instance), (void*) offsetof(gl_texture_instance, u0));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(gl_texture_instance), (void*) offsetof(gl_texture_instance, z));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(gl_texture_instance), (void*) offsetof(gl_texture_instance, animation));
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+}
+
 static int create_texture_buffers(renderer_ctx ctx) {
     ctx->texture_renderer_data.instances = (gl_texture_instance*) malloc(sizeof(gl_texture_instance) * ctx->texture_renderer_data.base_data.max_instances);
     if (ctx->texture_renderer_data.instances == NULL) {
@@ -372,17 +464,7 @@ static int create_texture_buffers(renderer_ctx ctx) {
     glBindBuffer(GL_ARRAY_BUFFER, ctx->texture_renderer_data.base_data.instance_vertex_buffer_object);
     glBufferData(GL_ARRAY_BUFFER, ctx->texture_renderer_data.base_data.max_instances * sizeof(gl_texture_instance), NULL, GL_STREAM_DRAW);
 
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(gl_texture_instance), (void*) offsetof(gl_texture_instance, x));
-    glEnableVertexAttribArray(1);
-    glVertexAttribDivisor(1, 1);
-
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(gl_texture_instance), (void*) offsetof(gl_texture_instance, u0));
-    glEnableVertexAttribArray(2);
-    glVertexAttribDivisor(2, 1);
-
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(gl_texture_instance), (void*) offsetof(gl_texture_instance, z));
-    glEnableVertexAttribArray(3);
-    glVertexAttribDivisor(3, 1);
+    bind_texture_instance_attributes();
 
     glBindVertexArray(0);
 
@@ -392,6 +474,14 @@ static int create_texture_buffers(renderer_ctx ctx) {
     DECLARE_UNIFORM(ctx->texture_renderer_data, uPan);
     DECLARE_UNIFORM(ctx->texture_renderer_data, uColor);
     DECLARE_UNIFORM(ctx->texture_renderer_data, uAlphaClip);
+    DECLARE_UNIFORM(ctx->texture_renderer_data, uDepthOffset);
+    DECLARE_UNIFORM(ctx->texture_renderer_data, uAnimations);
+    DECLARE_UNIFORM(ctx->texture_renderer_data, uTime);
+
+    // The animation table is read in the vertex shader, away from the unit the sprites use
+    glUseProgram(ctx->texture_renderer_data.base_data.shader_program);
+    glUniform1i(ctx->texture_renderer_data.uAnimationsLoc, 4);
+    glUseProgram(0);
 
     return 0;
 }
@@ -437,7 +527,7 @@ static int create_line_buffers(renderer_ctx ctx) {
     glVertexAttribDivisor(4, 1);
 
     glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(gl_line_instance), (void*) offsetof(gl_line_instance, r));
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(gl_line_instance), (void*) offsetof(gl_line_instance, r));
     glVertexAttribDivisor(5, 1);
 
     glEnableVertexAttribArray(6);
@@ -454,6 +544,50 @@ static int create_line_buffers(renderer_ctx ctx) {
     return 0;
 }
 
+static int create_tilemap_buffers(renderer_ctx ctx) {
+    // Shares the texture renderer's quad, but without any per-instance attributes
+    glGenVertexArrays(1, &ctx->tilemap_renderer_data.base_data.vertex_array_buffer);
+    glBindVertexArray(ctx->tilemap_renderer_data.base_data.vertex_array_buffer);
+
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->texture_renderer_data.base_data.vertex_buffer_object);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ctx->texture_renderer_data.base_data.element_buffer_object);
+
+    glBindVertexArray(0);
+
+    DECLARE_SHADERS(ctx->tilemap_renderer_data, "tilemap/vertex.vs", "tilemap/fragment.fs");
+
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uScreen);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uPan);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uMapSize);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uDepth);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uAtlas);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uTileIds);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uTileUVs);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uTileAtlases);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uTileSize);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uLutWidth);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uAtlasIndex);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uAlphaClip);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uTileAnimations);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uAnimations);
+    DECLARE_UNIFORM(ctx->tilemap_renderer_data, uTime);
+
+    // Samplers never move between texture units
+    glUseProgram(ctx->tilemap_renderer_data.base_data.shader_program);
+    glUniform1i(ctx->tilemap_renderer_data.uAtlasLoc, 0);
+    glUniform1i(ctx->tilemap_renderer_data.uTileIdsLoc, 1);
+    glUniform1i(ctx->tilemap_renderer_data.uTileUVsLoc, 2);
+    glUniform1i(ctx->tilemap_renderer_data.uTileAtlasesLoc, 3);
+    glUniform1i(ctx->tilemap_renderer_data.uAnimationsLoc, 4);
+    glUniform1i(ctx->tilemap_renderer_data.uTileAnimationsLoc, 5);
+    glUniform1i(ctx->tilemap_renderer_data.uLutWidthLoc, TILESET_LUT_WIDTH);
+    glUseProgram(0);
+
+    return 0;
+}
+
 renderer_ctx renderer_init(int width, int height, const char *title) {
     renderer_ctx ctx = (renderer_ctx) calloc(1, sizeof(struct renderer_ctx_s));
     if (ctx == NULL) {
@@ -520,9 +654,16 @@ renderer_ctx renderer_init(int width, int height, const char *title) {
         return NULL;
     }
 
+    if (create_tilemap_buffers(ctx) != 0) {
+        log_error("Failed to initialize tilemap buffers");
+        renderer_cleanup(ctx);
+        return NULL;
+    }
+
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_BLEND);
-    glDepthFunc(GL_LESS);
+    // Later draws on the same layer win, so sorted draws can share one
+    glDepthFunc(GL_LEQUAL);
     glDepthMask(GL_FALSE);
     glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -587,6 +728,8 @@ static void renderer_flush_texture_batch(renderer_ctx ctx) {
     if (ctx->texture_renderer_data.uPanLoc >= 0) {
         glUniform2f(ctx->texture_renderer_data.uPanLoc, ctx->pan_x, ctx->pan_y);
     }
+    // Dynamic instances carry their absolute depth
+    glUniform1f(ctx->texture_renderer_data.uDepthOffsetLoc, 0.0f);
 
     glBufferData(
         GL_ARRAY_BUFFER, 
@@ -639,6 +782,10 @@ void renderer_flush_batch(renderer_ctx ctx) {
 void renderer_set_blend_mode(renderer_ctx ctx, blending_mode mode) {
     if (ctx->blending_mode == mode) return;
     renderer_flush_texture_batch(ctx);
+    // Lines and rectangles can be translucent too, so they have to go out under the mode they were drawn in
+    if (ctx->line_renderer_data.base_data.instance_count > 0) {
+        renderer_flush_line_batch(ctx);
+    }
 
     ctx->blending_mode = mode;
     if (mode == BLEND_MODE_BINARY) {
@@ -672,11 +819,31 @@ void renderer_draw_line(renderer_ctx ctx, float start_x, float start_y, float en
     inst->dir_y = dir_y;
     inst->length = len;
     inst->width = thickness;
-    inst->r = color.r; inst->g = color.g; inst->b = color.b;
+    inst->r = color.r; inst->g = color.g; inst->b = color.b; inst->a = 1.0f;
 
     inst->z = ctx->layer_step;
 }
 
+void renderer_draw_rect(renderer_ctx ctx, float x, float y, float w, float h, color_rgb color, float alpha) {
+    if (w <= 0.0f || h <= 0.0f) return;
+
+    if (ctx->line_renderer_data.base_data.instance_count >= ctx->line_renderer_data.base_data.max_instances) {
+        renderer_flush_line_batch(ctx);
+    }
+
+    // A horizontal line as thick as the rectangle is tall, but on the current layer instead of on top of everything
+    gl_line_instance *inst = &ctx->line_renderer_data.instances[ctx->line_renderer_data.base_data.instance_count++];
+    inst->start_x = x;
+    inst->start_y = y + 0.5f * h;
+    inst->dir_x = 1.0f;
+    inst->dir_y = 0.0f;
+    inst->length = w;
+    inst->width = h;
+    inst->r = color.r; inst->g = color.g; inst->b = color.b; inst->a = alpha;
+
+    inst->z = 1.0 - ctx->layer * ctx->layer_step;
+}
+
 void renderer_draw_texture_with_dimensions(renderer_ctx ctx, texture t, float x, float y, float w, float h) {
     const unsigned int tex_id = texture_get_id(t);
 
@@ -693,6 +860,7 @@ void renderer_draw_texture_with_dimensions(renderer_ctx ctx, texture t, float x,
     gl_texture_instance *inst = &ctx->texture_renderer_data.instances[ctx->texture_renderer_data.base_data.instance_count++];
     inst->x = x; inst->y = y; inst->w = w; inst->h = h;
     inst->z = 1.0 - ctx->layer * ctx->layer_step;
+    inst->animation = -1.0f;
     
     float vertices[16];
     texture_get_vertices(t, vertices);
@@ -712,6 +880,430 @@ void renderer_draw_texture(renderer_ctx ctx, texture t, float x, float y) {
     );
 }
 
+renderer_static_batch renderer_static_batch_create(renderer_ctx ctx) {
+    renderer_static_batch batch = (renderer_static_batch) calloc(1, sizeof(struct renderer_static_batch_s));
+    if (batch == NULL) {
+        return NULL;
+    }
+    batch->ctx = ctx;
+    return batch;
+}
+
+static static_batch_group *static_batch_get_group(renderer_static_batch batch, GLuint texture) {
+    for (size_t i = 0; i < batch->group_count; i++) {
+        if (batch->groups[i].texture == texture) return &batch->groups[i];
+    }
+
+    if (batch->group_count == batch->group_capacity) {
+        size_t new_capacity = batch->group_capacity ? batch->group_capacity * 2 : 4;
+        static_batch_group *groups = (static_batch_group *) realloc(batch->groups, new_capacity * sizeof(static_batch_group));
+        if (groups == NULL) {
+            return NULL;
+        }
+        batch->groups = groups;
+        batch->group_capacity = new_capacity;
+    }
+
+    static_batch_group *group = &batch->groups[batch->group_count];
+    *group = (static_batch_group) { .texture = texture, .dirty = 1 };
+
+    // Same quad as the dynamic batch, but instances come from this group's own buffer
+    glGenVertexArrays(1, &group->vertex_array_buffer);
+    glBindVertexArray(group->vertex_array_buffer);
+
+    glBindBuffer(GL_ARRAY_BUFFER, batch->ctx->texture_renderer_data.base_data.vertex_buffer_object);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->ctx->texture_renderer_data.base_data.element_buffer_object);
+
+    glGenBuffers(1, &group->instance_vertex_buffer_object);
+    glBindBuffer(GL_ARRAY_BUFFER, group->instance_vertex_buffer_object);
+    bind_texture_instance_attributes();
+
+    glBindVertexArray(0);
+
+    batch->group_count++;
+    return group;
+}
+
+void renderer_static_batch_clear(renderer_static_batch batch) {
+    for (size_t i = 0; i < batch->group_count; i++) {
+        batch->groups[i].instance_count = 0;
+        batch->groups[i].dirty = 1;
+    }
+}
+
+int renderer_static_batch_add_animated_texture(renderer_static_batch batch, texture t, float x, float y, int animation) {
+    static_batch_group *group = static_batch_get_group(batch, texture_get_id(t));
+    if (group == NULL) {
+        return 1;
+    }
+
+    if (group->instance_count == group->capacity) {
+        size_t new_capacity = group->capacity ? group->capacity * 2 : 64;
+        gl_texture_instance *instances = (gl_texture_instance *) realloc(group->instances, new_capacity * sizeof(gl_texture_instance));
+        if (instances == NULL) {
+            return 1;
+        }
+        group->instances = instances;
+        group->capacity = new_capacity;
+    }
+
+    gl_texture_instance *inst = &group->instances[group->instance_count++];
+    inst->x = x; inst->y = y;
+    inst->w = (float) texture_get_width(t);
+    inst->h = (float) texture_get_height(t);
+    // Depth comes from the layer the batch is drawn at
+    inst->z = 0.0f;
+    inst->animation = (float) animation;
+
+    float vertices[16];
+    texture_get_vertices(t, vertices);
+    inst->u0 = vertices[2]; inst->v0 = vertices[3];
+    inst->u1 = vertices[10]; inst->v1 = vertices[11];
+    group->dirty = 1;
+    return 0;
+}
+
+int renderer_static_batch_add_texture(renderer_static_batch batch, texture t, float x, float y) {
+    return renderer_static_batch_add_animated_texture(batch, t, x, y, -1);
+}
+
+void renderer_static_batch_upload(renderer_static_batch batch) {
+    for (size_t i = 0; i < batch->group_count; i++) {
+        static_batch_group *group = &batch->groups[i];
+        if (!group->dirty) continue;
+
+        glBindBuffer(GL_ARRAY_BUFFER, group->instance_vertex_buffer_object);
+        glBufferData(
+            GL_ARRAY_BUFFER,
+            (GLsizeiptr) (group->instance_count * sizeof(gl_texture_instance)),
+            group->instances,
+            GL_STATIC_DRAW
+        );
+        group->uploaded_count = group->instance_count;
+        group->dirty = 0;
+    }
+}
+
+size_t renderer_static_batch_get_memory_usage(renderer_static_batch batch) {
+    // CPU staging copy plus the GPU buffer it was uploaded to
+    size_t bytes = sizeof(struct renderer_static_batch_s) + batch->group_capacity * sizeof(static_batch_group);
+    for (size_t i = 0; i < batch->group_count; i++) {
+        bytes += (batch->groups[i].capacity + batch->groups[i].uploaded_count) * sizeof(gl_texture_instance);
+    }
+    return bytes;
+}
+
+static void bind_tile_animations(renderer_ctx ctx, GLint uTimeLoc) {
+    renderer_tile_animations animations = ctx->tile_animations;
+    if (animations == NULL) return;
+
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, animations->texture);
+    if (animations->dirty) {
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            GL_RGBA32F,
+            (GLsizei) (animations->max_frames + 1),
+            (GLsizei) animations->animation_count,
+            0,
+            GL_RGBA,
+            GL_FLOAT,
+            animations->rows
+        );
+        animations->dirty = 0;
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1f(uTimeLoc, ctx->animation_time);
+}
+
+void renderer_draw_static_batch(renderer_ctx ctx, renderer_static_batch batch) {
+    // Keep whatever was queued before this batch in front of it in submission order
+    renderer_flush_batch(ctx);
+    renderer_static_batch_upload(batch);
+
+    glUseProgram(ctx->texture_renderer_data.base_data.shader_program);
+    glUniform1f(ctx->texture_renderer_data.uAlphaClipLoc, ctx->blending_mode == BLEND_MODE_BINARY ? 0.5 : 0);
+    glUniform2f(ctx->texture_renderer_data.uScreenLoc, (float)ctx->logical_w, (float)ctx->logical_h);
+    if (ctx->texture_renderer_data.uPanLoc >= 0) {
+        glUniform2f(ctx->texture_renderer_data.uPanLoc, ctx->pan_x, ctx->pan_y);
+    }
+    glUniform1f(ctx->texture_renderer_data.uDepthOffsetLoc, 1.0 - ctx->layer * ctx->layer_step);
+    bind_tile_animations(ctx, ctx->texture_renderer_data.uTimeLoc);
+    glActiveTexture(GL_TEXTURE0);
+
+    for (size_t i = 0; i < batch->group_count; i++) {
+        static_batch_group *group = &batch->groups[i];
+        if (group->uploaded_count == 0) continue;
+
+        glBindVertexArray(group->vertex_array_buffer);
+        glBindTexture(GL_TEXTURE_2D, group->texture);
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, group->uploaded_count);
+
+        ctx->draw_calls++;
+        ctx->drawn_instances += group->uploaded_count;
+    }
+    glBindVertexArray(0);
+}
+
+void renderer_static_batch_destroy(renderer_static_batch batch) {
+    if (batch == NULL) return;
+    for (size_t i = 0; i < batch->group_count; i++) {
+        static_batch_group *group = &batch->groups[i];
+        if (group->instance_vertex_buffer_object != 0) glDeleteBuffers(1, &group->instance_vertex_buffer_object);
+        if (group->vertex_array_buffer != 0) glDeleteVertexArrays(1, &group->vertex_array_buffer);
+        free(group->instances);
+    }
+    free(batch->groups);
+    free(batch);
+}
+
+static GLuint create_lookup_texture(GLint internal_format, int width, int height, GLenum format, GLenum type, const void *data) {
+    GLuint lookup_texture = 0;
+    glGenTextures(1, &lookup_texture);
+    glBindTexture(GL_TEXTURE_2D, lookup_texture);
+    // Integer textures can't be filtered, and lookups must never blend neighbouring entries anyway
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return lookup_texture;
+}
+
+renderer_tile_animations renderer_tile_animations_create(renderer_ctx, size_t animation_count, size_t max_frames) {
+    if (animation_count == 0 || max_frames == 0) return NULL;
+    renderer_tile_animations animations = (renderer_tile_animations) calloc(1, sizeof(struct renderer_tile_animations_s));
+    if (animations == NULL) {
+        return NULL;
+    }
+    animations->rows = (float *) calloc(animation_count * (max_frames + 1) * 4, sizeof(float));
+    if (animations->rows == NULL) {
+        free(animations);
+        return NULL;
+    }
+    animations->animation_count = animation_count;
+    animations->max_frames = max_frames;
+    animations->dirty = 1;
+
+    glGenTextures(1, &animations->texture);
+    glBindTexture(GL_TEXTURE_2D, animations->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return animations;
+}
+
+int renderer_tile_animations_set(renderer_tile_animations animations, size_t animation, const texture *frames, size_t frame_count, float interval_ms) {
+    if (animation >= animations->animation_count || frame_count == 0 || frame_count > animations->max_frames || interval_ms <= 0.0f) return 1;
+
+    float *row = &animations->rows[animation * (animations->max_frames + 1) * 4];
+    row[0] = (float) frame_count;
+    row[1] = interval_ms;
+    for (size_t i = 0; i < frame_count; i++) {
+        float vertices[16];
+        texture_get_vertices(frames[i], vertices);
+        row[(i + 1) * 4 + 0] = vertices[2];
+        row[(i + 1) * 4 + 1] = vertices[3];
+        row[(i + 1) * 4 + 2] = vertices[10];
+        row[(i + 1) * 4 + 3] = vertices[11];
+    }
+    animations->dirty = 1;
+    return 0;
+}
+
+void renderer_tile_animations_destroy(renderer_tile_animations animations) {
+    if (animations == NULL) return;
+    if (animations->texture != 0) glDeleteTextures(1, &animations->texture);
+    free(animations->rows);
+    free(animations);
+}
+
+void renderer_set_tile_animations(renderer_ctx ctx, renderer_tile_animations animations, double time) {
+    ctx->tile_animations = animations;
+    // Floats run out of millisecond precision past 2^24, so the clock wraps every ~4.6 hours
+    ctx->animation_time = (float) fmod(time * 1000.0, 16777216.0);
+}
+
+renderer_tileset renderer_tileset_create(renderer_ctx, const texture *tiles, size_t tile_count, const int *tile_animations) {
+    renderer_tileset tileset = (renderer_tileset) calloc(1, sizeof(struct renderer_tileset_s));
+    if (tileset == NULL) {
+        return NULL;
+    }
+
+    size_t lut_rows = tile_count > 0 ? (tile_count + TILESET_LUT_WIDTH - 1) / TILESET_LUT_WIDTH : 1;
+    size_t lut_size = lut_rows * TILESET_LUT_WIDTH;
+    float *uvs = (float *) calloc(lut_size * 4, sizeof(float));
+    unsigned char *atlas_indices = (unsigned char *) malloc(lut_size);
+    int *animation_indices = (int *) malloc(lut_size * sizeof(int));
+    if (uvs == NULL || atlas_indices == NULL || animation_indices == NULL) {
+        free(uvs);
+        free(atlas_indices);
+        free(animation_indices);
+        renderer_tileset_destroy(tileset);
+        return NULL;
+    }
+    memset(atlas_indices, TILESET_NO_ATLAS, lut_size);
+    for (size_t id = 0; id < lut_size; id++) {
+        animation_indices[id] = tile_animations != NULL && id < tile_count ? tile_animations[id] : -1;
+    }
+
+    for (size_t id = 0; id < tile_count; id++) {
+        if (tiles[id] == NULL) continue;
+
+        GLuint atlas = texture_get_id(tiles[id]);
+        size_t atlas_index = 0;
+        while (atlas_index < tileset->atlas_count && tileset->atlases[atlas_index] != atlas) atlas_index++;
+        if (atlas_index == tileset->atlas_count) {
+            GLuint *atlases = atlas_index < TILESET_NO_ATLAS ? (GLuint *) realloc(tileset->atlases, (atlas_index + 1) * sizeof(GLuint)) : NULL;
+            if (atlases == NULL) {
+                free(uvs);
+                free(atlas_indices);
+                free(animation_indices);
+                renderer_tileset_destroy(tileset);
+                return NULL;
+            }
+            tileset->atlases = atlases;
+            tileset->atlases[tileset->atlas_count++] = atlas;
+        }
+
+        float vertices[16];
+        texture_get_vertices(tiles[id], vertices);
+        uvs[id * 4 + 0] = vertices[2];
+        uvs[id * 4 + 1] = vertices[3];
+        uvs[id * 4 + 2] = vertices[10];
+        uvs[id * 4 + 3] = vertices[11];
+        atlas_indices[id] = (unsigned char) atlas_index;
+    }
+
+    tileset->uv_texture = create_lookup_texture(GL_RGBA32F, TILESET_LUT_WIDTH, (int) lut_rows, GL_RGBA, GL_FLOAT, uvs);
+    tileset->atlas_index_texture = create_lookup_texture(GL_R8UI, TILESET_LUT_WIDTH, (int) lut_rows, GL_RED_INTEGER, GL_UNSIGNED_BYTE, atlas_indices);
+    tileset->animation_index_texture = create_lookup_texture(GL_R32I, TILESET_LUT_WIDTH, (int) lut_rows, GL_RED_INTEGER, GL_INT, animation_indices);
+    free(uvs);
+    free(atlas_indices);
+    free(animation_indices);
+    return tileset;
+}
+
+void renderer_tileset_destroy(renderer_tileset tileset) {
+    if (tileset == NULL) return;
+    if (tileset->uv_texture != 0) glDeleteTextures(1, &tileset->uv_texture);
+    if (tileset->atlas_index_texture != 0) glDeleteTextures(1, &tileset->atlas_index_texture);
+    if (tileset->animation_index_texture != 0) glDeleteTextures(1, &tileset->animation_index_texture);
+    free(tileset->atlases);
+    free(tileset);
+}
+
+renderer_tilemap renderer_tilemap_create(renderer_ctx, renderer_tileset tileset, int columns, int rows, int tile_width, int tile_height) {
+    if (columns <= 0 || rows <= 0) return NULL;
+    renderer_tilemap tilemap = (renderer_tilemap) calloc(1, sizeof(struct renderer_tilemap_s));
+    if (tilemap == NULL) {
+        return NULL;
+    }
+    tilemap->tileset = tileset;
+    tilemap->columns = columns;
+    tilemap->rows = rows;
+    tilemap->tile_width = tile_width;
+    tilemap->tile_height = tile_height;
+
+    // Integer textures start out undefined, so clear them explicitly
+    unsigned int *empty = (unsigned int *) calloc((size_t) columns * (size_t) rows, sizeof(unsigned int));
+    if (empty == NULL) {
+        free(tilemap);
+        return NULL;
+    }
+    tilemap->tile_id_texture = create_lookup_texture(GL_R32UI, columns, rows, GL_RED_INTEGER, GL_UNSIGNED_INT, empty);
+    free(empty);
+    return tilemap;
+}
+
+void renderer_tilemap_set_region(renderer_tilemap tilemap, int column, int row, int width, int height, const int *tile_ids, int stride) {
+    if (column < 0 || row < 0 || width <= 0 || height <= 0) return;
+    if (column + width > tilemap->columns || row + height > tilemap->rows) return;
+
+    int *zeros = NULL;
+    if (tile_ids == NULL) {
+        zeros = (int *) calloc((size_t) width * (size_t) height, sizeof(int));
+        if (zeros == NULL) return;
+        tile_ids = zeros;
+        stride = width;
+    }
+
+    // Tile ids are never negative, so they can go up as they are
+    glBindTexture(GL_TEXTURE_2D, tilemap->tile_id_texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, column, row, width, height, GL_RED_INTEGER, GL_UNSIGNED_INT, tile_ids);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    free(zeros);
+}
+
+void renderer_tilemap_set_tile(renderer_tilemap tilemap, int column, int row, int tile_id) {
+    renderer_tilemap_set_region(tilemap, column, row, 1, 1, &tile_id, 1);
+}
+
+void renderer_draw_tilemap(renderer_ctx ctx, renderer_tilemap tilemap) {
+    // Keep whatever was queued before this tilemap in front of it in submission order
+    renderer_flush_batch(ctx);
+
+    tilemap_renderer_data *data = &ctx->tilemap_renderer_data;
+    glUseProgram(data->base_data.shader_program);
+    glUniform2f(data->uScreenLoc, (float)ctx->logical_w, (float)ctx->logical_h);
+    glUniform2f(data->uPanLoc, ctx->pan_x, ctx->pan_y);
+    glUniform2f(data->uMapSizeLoc, (float) (tilemap->columns * tilemap->tile_width), (float) (tilemap->rows * tilemap->tile_height));
+    glUniform2f(data->uTileSizeLoc, (float) tilemap->tile_width, (float) tilemap->tile_height);
+    glUniform1f(data->uDepthLoc, 1.0 - ctx->layer * ctx->layer_step);
+    glUniform1f(data->uAlphaClipLoc, ctx->blending_mode == BLEND_MODE_BINARY ? 0.5 : 0);
+
+    glBindVertexArray(data->base_data.vertex_array_buffer);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, tilemap->tile_id_texture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, tilemap->tileset->uv_texture);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, tilemap->tileset->atlas_index_texture);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, tilemap->tileset->animation_index_texture);
+    bind_tile_animations(ctx, data->uTimeLoc);
+
+    // One pass per atlas, each one only keeps the tiles that come from it
+    glActiveTexture(GL_TEXTURE0);
+    for (size_t i = 0; i < tilemap->tileset->atlas_count; i++) {
+        glBindTexture(GL_TEXTURE_2D, tilemap->tileset->atlases[i]);
+        glUniform1ui(data->uAtlasIndexLoc, (GLuint) i);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        ctx->draw_calls++;
+    }
+    glBindVertexArray(0);
+}
+
+void renderer_tilemap_destroy(renderer_tilemap tilemap) {
+    if (tilemap == NULL) return;
+    if (tilemap->tile_id_texture != 0) glDeleteTextures(1, &tilemap->tile_id_texture);
+    free(tilemap);
+}
+
+void renderer_set_pan(renderer_ctx ctx, float x, float y) {
+    if (ctx->pan_x == x && ctx->pan_y == y) return;
+    // Pan is applied at flush time, so queued instances must go out with the old one
+    renderer_flush_batch(ctx);
+    ctx->pan_x = x;
+    ctx->pan_y = y;
+}
+
+void renderer_get_pan(renderer_ctx ctx, float *out_x, float *out_y) {
+    if (out_x != NULL) *out_x = ctx->pan_x;
+    if (out_y != NULL) *out_y = ctx->pan_y;
+}
+
 void renderer_set_tint(renderer_ctx ctx, color_rgb color) {
     renderer_flush_texture_batch(ctx);
     glUniform4f(ctx->texture_renderer_data.uColorLoc, color.r, color.g, color.b, 1.0f);
@@ -892,6 +1484,7 @@ void renderer_cleanup(renderer_ctx ctx) {
     // Destroy *_renderer_data GL objects
     destroy_batch_renderer_objects(&ctx->texture_renderer_data.base_data);
     destroy_batch_renderer_objects(&ctx->line_renderer_data.base_data);
+    destroy_batch_renderer_objects(&ctx->tilemap_renderer_data.base_data);
 
     // Free *_renderer_data instances
     free(ctx->texture_renderer_data.instances);
@@ -27,6 +27,10 @@ typedef enum blending_mode {
 } blending_mode;
 
 typedef struct renderer_ctx_s *renderer_ctx;
+typedef struct renderer_static_batch_s *renderer_static_batch;
+typedef struct renderer_tile_animations_s *renderer_tile_animations;
+typedef struct renderer_tileset_s *renderer_tileset;
+typedef struct renderer_tilemap_s *renderer_tilemap;
 typedef int (*key_callback) (renderer_ctx, int key, int scancode, int action, int mods);
 typedef int (*mouse_button_callback) (renderer_ctx, int button, int action, int mods);
 typedef int (*mouse_move_callback) (renderer_ctx, double x, double y);
@@ -52,6 +56,28 @@ void renderer_run(
 void renderer_draw_texture_with_dimensions(renderer_ctx, texture, float x, float y, float w, float h);
 void renderer_draw_texture(renderer_ctx, texture, float x, float y);
 void renderer_draw_line(renderer_ctx, float start_x, float start_y, float end_x, float end_y, color_rgb, float thickness);
+void renderer_draw_rect(renderer_ctx, float x, float y, float w, float h, color_rgb, float alpha);
+renderer_static_batch renderer_static_batch_create(renderer_ctx);
+void renderer_static_batch_clear(renderer_static_batch);
+int renderer_static_batch_add_texture(renderer_static_batch, texture, float x, float y);
+int renderer_static_batch_add_animated_texture(renderer_static_batch, texture, float x, float y, int animation);
+void renderer_static_batch_upload(renderer_static_batch);
+size_t renderer_static_batch_get_memory_usage(renderer_static_batch);
+void renderer_draw_static_batch(renderer_ctx, renderer_static_batch);
+void renderer_static_batch_destroy(renderer_static_batch);
+renderer_tile_animations renderer_tile_animations_create(renderer_ctx, size_t animation_count, size_t max_frames);
+int renderer_tile_animations_set(renderer_tile_animations, size_t animation, const texture *frames, size_t frame_count, float interval_ms);
+void renderer_tile_animations_destroy(renderer_tile_animations);
+void renderer_set_tile_animations(renderer_ctx, renderer_tile_animations, double time);
+renderer_tileset renderer_tileset_create(renderer_ctx, const texture *tiles, size_t tile_count, const int *tile_animations);
+void renderer_tileset_destroy(renderer_tileset);
+renderer_tilemap renderer_tilemap_create(renderer_ctx, renderer_tileset, int columns, int rows, int tile_width, int tile_height);
+void renderer_tilemap_set_region(renderer_tilemap, int column, int row, int width, int height, const int *tile_ids, int stride);
+void renderer_tilemap_set_tile(renderer_tilemap, int column, int row, int tile_id);
+void renderer_draw_tilemap(renderer_ctx, renderer_tilemap);
+void renderer_tilemap_destroy(renderer_tilemap);
+void renderer_set_pan(renderer_ctx, float x, float y);
+void renderer_get_pan(renderer_ctx, float *out_x, float *out_y);
 void renderer_set_tint(renderer_ctx, color_rgb);
 void renderer_clear_tint(renderer_ctx);
 void renderer_toggle_fullscreen(renderer_ctx);
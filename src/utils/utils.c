@@ -1,8 +1,23 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "utils.h"
 #include "logger/logger.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 char *utils_read_whole_file(const char* filename) {
     FILE *fp = fopen(filename, "r");
@@ -65,3 +80,77 @@ cJSON *utils_read_base_config(const char *config_file_name) {
 
     return config_json;
 }
+
+double utils_get_time() {
+    // Wall clock in seconds, safe to call from any thread (unlike glfwGetTime)
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+const unsigned char *utils_map_file(const char *filename, size_t *out_size) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    // The view keeps the mapping and the file open on its own, so both handles can go right away
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return NULL;
+    }
+    void *contents = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (contents == NULL) {
+        return NULL;
+    }
+    *out_size = (size_t) file_size.QuadPart;
+    return (const unsigned char *) contents;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // The mapping keeps its own reference to the file, so the descriptor can go right away
+    void *contents = mmap(NULL, (size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (contents == MAP_FAILED) {
+        return NULL;
+    }
+    *out_size = (size_t) file_stat.st_size;
+    return (const unsigned char *) contents;
+#endif
+}
+
+void utils_unmap_file(const unsigned char *contents, size_t size) {
+    if (contents == NULL) return;
+#if defined(_WIN32)
+    (void) size;
+    UnmapViewOfFile((const void *) contents);
+#else
+    munmap((void *) contents, size);
+#endif
+}
+
+double utils_get_modification_time(const char *filename) {
+    struct stat file_stat;
+    if (stat(filename, &file_stat) != 0) {
+        return -1.0;
+    }
+    return (double) file_stat.st_mtime;
+}
@@ -8,5 +8,9 @@ char *utils_read_whole_file(const char *filename);
 char *utils_copy_string(const char *string);
 int utils_digit_length(size_t n);
 cJSON *utils_read_base_config(const char *config_file_name);
+double utils_get_time();
+const unsigned char *utils_map_file(const char *filename, size_t *out_size);
+void utils_unmap_file(const unsigned char *contents, size_t size);
+double utils_get_modification_time(const char *filename);
 
 #endif